@@ -0,0 +1,89 @@
+/*****************************************************************************
+ * cgi.h: CGI connector with a fork server
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#ifndef __CGI_H__
+#define __CGI_H__
+
+/**
+ * default values of the configuration
+ */
+#define CGI_TIMEOUT 5000
+
+typedef struct cgi_config_s cgi_config_t;
+struct cgi_config_s
+{
+	const char *docroot; /* directory of the scripts, SCRIPT_FILENAME is the URI into it */
+	const char *prefix; /* beginning of the URIs of the scripts, NULL for all */
+	const char **env; /* NULL terminated list of "NAME=value" added to the environment */
+	int timeout; /* milliseconds to wait the output of the script */
+};
+
+typedef struct cgi_s cgi_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief add the CGI connector to the server
+ *
+ * The function starts a small process, the fork server, while the
+ * server is still small. The scripts are started by the fork server,
+ * the server sends the environment and the pipes of the script, and
+ * its memory is never copied by a fork.
+ * The body of the request is written on the input of the script, its
+ * output is parsed as CGI headers. With a Content-Length, the rest of
+ * the output is spliced from the pipe to the socket, otherwise it is
+ * streamed as the content of the response.
+ * The client waits the output of the script between the calls of the
+ * connector, but the input is written inside the client: the library
+ * must be built with VTHREAD (fork or pthread) and the connector is not
+ * built without it.
+ *
+ * @param server	the server to change
+ * @param config	the configuration with the directory of the scripts
+ *
+ * @return the connector handle or NULL on error
+ */
+cgi_t *cgi_create(http_server_t *server, const cgi_config_t *config);
+
+/**
+ * @brief stop the fork server and free the connector
+ *
+ * The server keeps its connectors, it must be destroyed before.
+ *
+ * @param cgi	the handle returned by cgi_create
+ */
+void cgi_destroy(cgi_t *cgi);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
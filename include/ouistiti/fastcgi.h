@@ -0,0 +1,98 @@
+/*****************************************************************************
+ * fastcgi.h: FastCGI client connector
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#ifndef __FASTCGI_H__
+#define __FASTCGI_H__
+
+/**
+ * default values of the configuration
+ */
+#define FASTCGI_POOLSIZE 4
+#define FASTCGI_TIMEOUT 5000
+#define FASTCGI_IDLETIME 30
+#define FASTCGI_MAXREQUESTS 16
+
+typedef struct fastcgi_config_s fastcgi_config_t;
+struct fastcgi_config_s
+{
+	const char **backends; /* NULL terminated list of "host:port" or "unix:/path/of/socket" */
+	const char *prefix; /* beginning of the URIs sent to the backends, NULL for all */
+	const char *docroot; /* DOCUMENT_ROOT, SCRIPT_FILENAME is the URI into this directory */
+	const char *script; /* SCRIPT_FILENAME of all the requests, NULL to use the URI */
+	int poolsize; /* maximum idle connections kept by backend, 0 without pool */
+	int timeout; /* milliseconds to connect and to wait the backend */
+	int idletime; /* seconds before to close an idle connection */
+	int maxrequests; /* requests multiplexed on one connection, 1 without multiplexing */
+};
+
+typedef struct fastcgi_s fastcgi_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief add the FastCGI connector to the server
+ *
+ * The requests under the prefix are sent to the backend with the least
+ * requests in progress. The body of the request is sent into STDIN
+ * records while it is received, and the STDOUT records are parsed as
+ * the CGI headers of the response and relayed as its content. The
+ * connections stay open after the requests and they are kept into a
+ * pool, the pool belongs to each process of the server.
+ * With maxrequests greater than 1, the connector asks the backend if
+ * it multiplexes the requests (FCGI_MPXS_CONNS) and sends up to
+ * FCGI_MAX_REQS requests on the same connection. The multiplexing
+ * needs the threads of the server (VTHREAD_TYPE=pthread), otherwise
+ * each connection carries one request at a time.
+ * The connector waits its backends inside the client, the library must
+ * be built with VTHREAD (fork or pthread) and the connector is not
+ * built without it.
+ *
+ * @param server	the server to change
+ * @param config	the configuration with at least one backend
+ *
+ * @return the connector handle or NULL on error
+ */
+fastcgi_t *fastcgi_create(http_server_t *server, const fastcgi_config_t *config);
+
+/**
+ * @brief close the connections of the pool and free the connector
+ *
+ * The server keeps its connectors, it must be destroyed before.
+ *
+ * @param fastcgi	the handle returned by fastcgi_create
+ */
+void fastcgi_destroy(fastcgi_t *fastcgi);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,281 @@
+/*****************************************************************************
+ * fetch.h: asynchronous HTTP client
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#ifndef __FETCH_H__
+#define __FETCH_H__
+
+/**
+ * default values of the configuration
+ */
+#define FETCH_MAXCONNECTIONS 4
+#define FETCH_PIPELINE 1
+#define FETCH_TIMEOUT 5000
+#define FETCH_IDLETIME 30
+
+typedef struct fetch_config_s fetch_config_t;
+struct fetch_config_s
+{
+	int maxconnections; /* connections opened at the same time to one origin */
+	int pipeline; /* requests sent on a connection before the responses, 1 without pipelining */
+	int timeout; /* default deadline of a request in milliseconds */
+	int idletime; /* seconds before to close an idle connection of the pool */
+};
+
+typedef enum
+{
+	FETCH_OK = 0,
+	FETCH_ECONNECT, /* the origin is not reachable */
+	FETCH_ETIMEOUT, /* the deadline of the request expired */
+	FETCH_EPROTOCOL, /* the response is malformed or the connection closed */
+	FETCH_ECANCEL, /* a callback or fetch_cancel stopped the request */
+} fetch_error_e;
+
+typedef struct fetch_s fetch_t;
+typedef struct fetch_request_s fetch_request_t;
+
+typedef struct fetch_ops_s fetch_ops_t;
+struct fetch_ops_s
+{
+	/**
+	 * @brief the status line and the headers of the response are received
+	 *
+	 * The headers are available with fetch_header.
+	 *
+	 * @return EREJECT to cancel the request, any other value to continue
+	 */
+	int (*response)(void *arg, fetch_request_t *request, int status);
+	/**
+	 * @brief a slice of the content of the response is received
+	 *
+	 * The data is available only during the call, the chunks are
+	 * already decoded.
+	 *
+	 * @return EREJECT to cancel the request, ESPACE to stop the reading
+	 * of the connection until fetch_resume, any other value to continue
+	 */
+	int (*content)(void *arg, fetch_request_t *request, const char *data, int length);
+	/**
+	 * @brief the request is finished
+	 *
+	 * The request is freed after the call.
+	 */
+	void (*complete)(void *arg, fetch_request_t *request, fetch_error_e error);
+};
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief create a client
+ *
+ * The client sends the requests of the application without blocking:
+ * the requests are queued by origin, sent on the connections of a pool
+ * and the responses are given to the callbacks while they are received.
+ * All the work is done by fetch_run, that a connector may call each
+ * time that it runs, and returns ECONTINUE until the end of its
+ * requests. Several requests to several origins run at the same time.
+ *
+ * The client is used by one thread, the server creates it for each
+ * connection or each process.
+ *
+ * @param config	the configuration or NULL for the default values
+ *
+ * @return the client or NULL on error
+ */
+fetch_t *fetch_create(const fetch_config_t *config);
+
+/**
+ * @brief prepare a new request
+ *
+ * Only the "http" scheme is supported. The request is not sent before
+ * the call to fetch_send.
+ *
+ * @param fetch		the client
+ * @param method	the method of the request ("GET", "POST"...)
+ * @param url		the absolute URL "http://host[:port]/path?query"
+ * @param ops		the callbacks, the members may be NULL
+ * @param arg		the first argument of the callbacks
+ *
+ * @return the request or NULL on error
+ */
+fetch_request_t *fetch_request(fetch_t *fetch, const char *method, const char *url, const fetch_ops_t *ops, void *arg);
+
+/**
+ * @brief add a header to the request before its sending
+ *
+ * A Host header replaces the authority of the URL. With an Upgrade
+ * header, the 101 response is given to the response callback as
+ * the final one (see fetch_detach).
+ *
+ * @param request	the request
+ * @param key		the name of the header
+ * @param value		the value of the header
+ *
+ * @return ESUCCESS or EREJECT
+ */
+int fetch_addheader(fetch_request_t *request, const char *key, const char *value);
+
+/**
+ * @brief set the content of the request before its sending
+ *
+ * The data is copied, the Content-Length is set with the length.
+ *
+ * @param request	the request
+ * @param type		the Content-Type of the content or NULL
+ * @param content	the data
+ * @param length	the length of the data, -1 for a string
+ *
+ * @return ESUCCESS or EREJECT
+ */
+int fetch_setcontent(fetch_request_t *request, const char *type, const char *content, int length);
+
+/**
+ * @brief change the deadline of the request
+ *
+ * The deadline includes the connection, the sending and the whole
+ * response. It starts with fetch_send.
+ *
+ * @param request	the request
+ * @param timeout	the delay in milliseconds
+ */
+void fetch_deadline(fetch_request_t *request, int timeout);
+
+/**
+ * @brief queue the request to its origin
+ *
+ * @param request	the request
+ *
+ * @return ESUCCESS or EREJECT, the complete callback is called in both cases
+ */
+int fetch_send(fetch_request_t *request);
+
+/**
+ * @brief stop a request before its end
+ *
+ * The complete callback is called with FETCH_ECANCEL.
+ *
+ * @param request	the request
+ */
+void fetch_cancel(fetch_request_t *request);
+
+/**
+ * @brief send and receive the data of the requests
+ *
+ * The function waits the events of the connections at most timeout
+ * milliseconds, handles them and returns.
+ *
+ * @param fetch		the client
+ * @param timeout	the maximum delay in milliseconds, 0 to not wait
+ *
+ * @return the number of requests not yet complete
+ */
+int fetch_run(fetch_t *fetch, int timeout);
+
+/**
+ * @brief returns the status of the response
+ *
+ * @param request	the request
+ *
+ * @return the status or 0 before the response
+ */
+int fetch_status(fetch_request_t *request);
+
+/**
+ * @brief returns a header of the response
+ *
+ * @param request	the request
+ * @param key		the name of the header
+ *
+ * @return the value or NULL, available until the end of the request
+ */
+const char *fetch_header(fetch_request_t *request, const char *key);
+
+/**
+ * @brief iterate on the headers of the response
+ *
+ * @param request	the request
+ * @param iterator	the position, set to 0 for the first header
+ * @param key		set to the name of the header
+ *
+ * @return the value or NULL after the last header
+ */
+const char *fetch_headers(fetch_request_t *request, int *iterator, const char **key);
+
+/**
+ * @brief returns the socket that carries the request
+ *
+ * The application may wait the socket with its own loop and call
+ * fetch_run when it is ready, instead of waiting inside fetch_run.
+ *
+ * @param request	the request
+ * @param events	set with the events of poll that the connection waits
+ *
+ * @return the socket or -1 while the request waits its connection
+ */
+int fetch_socket(fetch_request_t *request, short *events);
+
+/**
+ * @brief restart the reading of the connection after ESPACE
+ *
+ * The data already received is given by the next fetch_run.
+ *
+ * @param request	the request
+ */
+void fetch_resume(fetch_request_t *request);
+
+/**
+ * @brief take the connection after a change of protocol
+ *
+ * The function is called by the response callback of the 101 response.
+ * The socket belongs to the application, the request is complete
+ * after the callback.
+ *
+ * @param request	the request
+ * @param data		set with the data already received after the response
+ * @param length	set with the length of the data
+ *
+ * @return the socket or -1 if the response is not a change of protocol
+ */
+int fetch_detach(fetch_request_t *request, const char **data, int *length);
+
+/**
+ * @brief close the connections and free the client
+ *
+ * The requests not yet complete are canceled.
+ *
+ * @param fetch		the handle returned by fetch_create
+ */
+void fetch_destroy(fetch_t *fetch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+/*****************************************************************************
+ * gzip.h: gzip and deflate content encoders
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#ifndef __GZIP_H__
+#define __GZIP_H__
+
+/**
+ * default values of the configuration
+ */
+#define GZIP_LEVEL 6
+#define GZIP_MINLENGTH 256
+
+typedef struct gzip_config_s gzip_config_t;
+struct gzip_config_s
+{
+	int level; /* the level without load, it decreases to 1 at full load */
+	int minlength; /* shorter contents are sent unchanged */
+	const char **types; /* NULL terminated list of prefixes of the content types */
+};
+
+typedef struct gzip_s gzip_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief add the gzip and deflate encoders to the server
+ *
+ * The contents of the compressible types are compressed while they
+ * are sent. The level of compression follows the load of the server.
+ *
+ * @param server	the server to change
+ * @param config	the configuration or NULL for the default values
+ *
+ * @return the encoders handle or NULL on error
+ */
+gzip_t *gzip_create(http_server_t *server, const gzip_config_t *config);
+
+/**
+ * @brief free the encoders
+ *
+ * The server keeps its encoders, it must be destroyed before.
+ *
+ * @param gzip	the handle returned by gzip_create
+ */
+void gzip_destroy(gzip_t *gzip);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,150 @@
+/*****************************************************************************
+ * hpack.h: HPACK header compression (RFC 7541)
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#ifndef __HPACK_H__
+#define __HPACK_H__
+
+#include <stdint.h>
+
+/**
+ * default size of the dynamic table (SETTINGS_HEADER_TABLE_SIZE)
+ */
+#define HPACK_TABLESIZE 4096
+/**
+ * maximum length of a decoded name or value and of the dynamic table
+ */
+#define HPACK_MAXSTRING 8192
+
+typedef struct hpack_s hpack_t;
+
+/**
+ * @brief callback called for each field of a header block
+ *
+ * The strings are not null terminated and are valid only during the call.
+ *
+ * @return ESUCCESS or EREJECT to stop the decoding
+ */
+typedef int (*hpack_field_t)(void *arg, const char *name, int namelen, const char *value, int valuelen);
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief build the static tables of the coders
+ *
+ * hpack_create calls it, the server may call it before the start of
+ * its clients to share the tables with all of them.
+ */
+void hpack_init(void);
+
+/**
+ * @brief create the context of one direction of a connection
+ *
+ * A decoder and an encoder need each one context.
+ *
+ * @param tablesize	the maximum size of the dynamic table
+ *
+ * @return the context or NULL on error
+ */
+hpack_t *hpack_create(int tablesize);
+void hpack_destroy(hpack_t *hpack);
+
+/**
+ * @brief change the size of the dynamic table of the encoder
+ *
+ * The size is limited by the value of hpack_create.
+ * The update is sent at the beginning of the next header block.
+ *
+ * @param hpack		the encoder
+ * @param tablesize	the SETTINGS_HEADER_TABLE_SIZE of the peer
+ *
+ * @return the new size
+ */
+int hpack_tablesize(hpack_t *hpack, int tablesize);
+
+/**
+ * @brief decode a complete header block
+ *
+ * @param hpack		the decoder
+ * @param block		the header block
+ * @param length	the length of the block
+ * @param cb		the callback called for each field
+ * @param arg		the first argument of the callback
+ *
+ * @return ESUCCESS or EREJECT on compression error
+ */
+int hpack_decode(hpack_t *hpack, const uint8_t *block, int length, hpack_field_t cb, void *arg);
+
+/**
+ * @brief encode a field
+ *
+ * The fields repeated by the server (Server, Content-Type, Date) are
+ * added to the dynamic table, the other ones are sent as literal.
+ * The name is set in lower case.
+ *
+ * @param hpack		the encoder
+ * @param out		the buffer of the header block
+ * @param size		the free space of the buffer
+ *
+ * @return the length of the encoded field or EREJECT if the buffer is too small
+ */
+int hpack_encode(hpack_t *hpack, uint8_t *out, int size, const char *name, int namelen, const char *value, int valuelen);
+
+/**
+ * @brief encode a known header
+ *
+ * @param hpack		the encoder
+ * @param out		the buffer of the header block
+ * @param size		the free space of the buffer
+ * @param id		the identifier of the header (HDR_CONTENT_TYPE...)
+ *
+ * @return the length of the encoded field, or EREJECT if the buffer is too
+ * small or if the header is forbidden with HTTP/2 (Connection...)
+ */
+int hpack_encodeheader(hpack_t *hpack, uint8_t *out, int size, http_header_e id, const char *value, int valuelen);
+
+/**
+ * @brief encode the ":status" pseudo header, first field of a response
+ */
+int hpack_encodestatus(hpack_t *hpack, uint8_t *out, int size, int status);
+
+/**
+ * @brief Huffman coding of a string
+ *
+ * @return the length of the coded string or EREJECT if the buffer is too small
+ */
+int hpack_huffmanencode(const char *in, int length, uint8_t *out, int size);
+int hpack_huffmandecode(const uint8_t *in, int length, char *out, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+/*****************************************************************************
+ * http2.h: HTTP/2 protocol layer
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#ifndef __HTTP2_H__
+#define __HTTP2_H__
+
+/**
+ * default values of the settings sent to the client
+ */
+#define HTTP2_MAXSTREAMS 100
+#define HTTP2_WINDOW 65535
+#define HTTP2_MAXFRAME 16384
+
+typedef struct http2_config_s http2_config_t;
+struct http2_config_s
+{
+	int maxstreams; /* SETTINGS_MAX_CONCURRENT_STREAMS */
+	int window; /* SETTINGS_INITIAL_WINDOW_SIZE */
+	int maxframe; /* SETTINGS_MAX_FRAME_SIZE */
+};
+
+typedef struct http2_s http2_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief add HTTP/2 to the connections of the server
+ *
+ * The new connections are checked for the HTTP/2 preface
+ * (prior knowledge) or for an "Upgrade: h2c" request.
+ * The other connections continue with HTTP/1.
+ * Each stream runs its own request beside the other ones (see
+ * httpclient_openstream), the responses are sent back into HEADERS
+ * and DATA frames.
+ *
+ * It must be called after the creation of the server and before any
+ * other change of protocol.
+ *
+ * @param server	the server to change
+ * @param config	the settings of the connections or NULL for the default values
+ *
+ * @return the http2 handle or NULL on error
+ */
+http2_t *http2_create(http_server_t *server, const http2_config_t *config);
+
+/**
+ * @brief remove HTTP/2 from the new connections of the server
+ *
+ * @param http2		the handle returned by http2_create
+ */
+void http2_destroy(http2_t *http2);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
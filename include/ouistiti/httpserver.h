@@ -32,6 +32,7 @@
 #ifndef WIN32
 # include <sys/types.h>
 # include <sys/socket.h>
+# include <sys/uio.h>
 # include <netinet/in.h>
 # include <netdb.h>
 #else
@@ -76,6 +77,15 @@ extern "C"
 #ifndef MAXCHUNKS_URI
 #define MAXCHUNKS_URI 2
 #endif
+/**
+ * the reception buffer of the client may contain several requests,
+ * they are parsed in one pass and their responses are sent together.
+ * The content buffer of a request receives the data of a full packet
+ * of this buffer.
+ */
+#ifndef MAXCHUNKS_SOCKDATA
+#define MAXCHUNKS_SOCKDATA 8
+#endif
 
 #define ESUCCESS 0
 #define EINCOMPLETE -1
@@ -83,6 +93,7 @@ extern "C"
 #define ESPACE -3
 #define EREJECT -4
 #define ETIMEOUT -5
+#define ESOURCE -6
 
 #define EXPORT_SYMBOL __attribute__((visibility("default")))
 
@@ -108,6 +119,30 @@ typedef enum
 } http_message_version_e;
 
 EXPORT_SYMBOL extern const char *httpversion[];
+
+/**
+ * identifiers of the headers known by the parser.
+ * The values of these headers are available without lookup.
+ */
+typedef enum
+{
+	HDR_UNKNOWN = -1,
+	HDR_CONTENT_LENGTH,
+	HDR_CONTENT_TYPE,
+	HDR_CONNECTION,
+	HDR_COOKIE,
+	HDR_HOST,
+	HDR_UPGRADE,
+	HDR_TRANSFER_ENCODING,
+	HDR_ACCEPT_ENCODING,
+	HDR_IF_NONE_MATCH,
+	HDR_RANGE,
+	HDR_STATUS,
+	HDR_IF_RANGE,
+	HDR_IF_MODIFIED_SINCE,
+	HDR_EXPECT,
+	HDR_MAX,
+} http_header_e;
 /**
 {
 	"HTTP/0.9",
@@ -124,6 +159,7 @@ typedef int http_message_result_e;
 #define RESULT_404 404
 #define RESULT_405 405
 #ifndef HTTP_STATUS_PARTIAL
+#define RESULT_100 100
 #define RESULT_101 101
 #define RESULT_201 201
 #define RESULT_204 204
@@ -134,9 +170,14 @@ typedef int http_message_result_e;
 #define RESULT_307 307
 #define RESULT_401 401
 #define RESULT_403 403
+#define RESULT_413 413
 #define RESULT_414 414
 #define RESULT_416 416
+#define RESULT_431 431
 #define RESULT_500 500
+#define RESULT_502 502
+#define RESULT_503 503
+#define RESULT_504 504
 #define RESULT_505 505
 #define RESULT_511 511
 #endif
@@ -166,11 +207,98 @@ typedef int (*http_recv_t)(void *ctx, char *data, int length);
  * @return the length of the response
  */
 typedef int (*http_send_t)(void *ctx, const char *data, int length);
+/**
+ * @brief callback to check the sending done without copy
+ *
+ * @param ctx          the context pointer of the module
+ *
+ * @return the number of sendings released by the kernel
+ */
+typedef unsigned int (*http_released_t)(void *ctx);
+/**
+ * @brief callback to send several buffers to the client with one call
+ *
+ * @param ctx          the context pointer of the module
+ * @param iov          the buffers to send
+ * @param iovcnt       the number of buffers
+ *
+ * @return the length sent from all the buffers
+ */
+typedef int (*http_sendv_t)(void *ctx, const struct iovec *iov, int iovcnt);
+/**
+ * @brief callback to send a part of a file to the client inside the kernel
+ *
+ * @param ctx          the context pointer of the module
+ * @param fd           the file descriptor, a file or a pipe
+ * @param offset       the position into the file, (unsigned long long)-1 for a pipe
+ * @param length       the maximum length to send
+ *
+ * @return the length sent, EINCOMPLETE when the socket is full,
+ * ESOURCE when the pipe is empty, or EREJECT
+ */
+typedef int (*http_sendfile_t)(void *ctx, int fd, unsigned long long offset, int length);
+/**
+ * @brief callback to receive data of the client into a pipe inside the kernel
+ *
+ * @param ctx          the context pointer of the module
+ * @param fd           the writing end of a pipe
+ * @param length       the maximum length to receive
+ *
+ * @return the length received, 0 when the client closed its side,
+ * EINCOMPLETE or EREJECT
+ */
+typedef int (*http_recvfile_t)(void *ctx, int fd, int length);
+/**
+ * @brief callback to receive the content of a request of a multiplexed
+ * connection
+ *
+ * @param ctx          the context pointer of the module
+ * @param stream       the stream given to httpclient_openstream
+ * @param data         the buffer to fill
+ * @param length       the size of the buffer
+ *
+ * @return the length received, 0 at the end of the content,
+ * EINCOMPLETE or EREJECT
+ */
+typedef int (*http_recvstream_t)(void *ctx, void *stream, char *data, int length);
+/**
+ * the parts of a response sent with http_sendstream_t
+ */
+typedef enum
+{
+	HTTPSTREAM_READY, /* the stream accepts the next part */
+	HTTPSTREAM_HEAD, /* the status and the headers of the response are set */
+	HTTPSTREAM_DATA, /* a part of the content */
+	HTTPSTREAM_END, /* the content is complete */
+} http_stream_part_e;
+/**
+ * @brief callback to send a part of the response of a multiplexed
+ * connection
+ *
+ * The response is given with its status and its headers, the
+ * protocol builds its own framing.
+ *
+ * @param ctx          the context pointer of the module
+ * @param stream       the stream given to httpclient_openstream
+ * @param response     the response of the stream
+ * @param part         the part to send
+ * @param data         the data of HTTPSTREAM_DATA
+ * @param length       the length of the data
+ *
+ * @return ESUCCESS, EINCOMPLETE when HTTPSTREAM_READY has to wait,
+ * EREJECT when the stream is closed (the request is dropped)
+ */
+typedef int (*http_sendstream_t)(void *ctx, void *stream, http_message_t *response, http_stream_part_e part, const char *data, int length);
 
 typedef void (*http_disconnect_t)(void *ctx);
 typedef void (*http_destroy_t)(void *ctx);
 
 #define HTTPCLIENT_TYPE_SECURE 0x0001
+/**
+ * the connection carries several requests at the same time (HTTP/2),
+ * an error response closes only its stream.
+ */
+#define HTTPCLIENT_TYPE_MULTIPLEX 0x0002
 
 typedef struct httpclient_ops_s httpclient_ops_t;
 struct httpclient_ops_s
@@ -187,6 +315,13 @@ struct httpclient_ops_s
 	http_flush_t flush; /* callback to flush the socket */
 	http_disconnect_t disconnect; /* callback to close the socket */
 	http_destroy_t destroy; /* callback to close the socket */
+	http_send_t sendzerocopy; /* callback to send data without copy, the data must stay available until the release */
+	http_released_t released; /* callback to get the number of sendzerocopy released */
+	http_sendv_t sendv; /* callback to send several buffers at once */
+	http_sendfile_t sendfile; /* callback to send a file descriptor without copy into the user space */
+	http_recvfile_t recvfile; /* callback to receive into a pipe without copy into the user space */
+	http_recvstream_t recvstream; /* callback to receive the content of a stream (HTTPCLIENT_TYPE_MULTIPLEX) */
+	http_sendstream_t sendstream; /* callback to send the response of a stream (HTTPCLIENT_TYPE_MULTIPLEX) */
 
 	const httpclient_ops_t *next;
 };
@@ -210,6 +345,8 @@ EXPORT_SYMBOL void httpclient_appendops(const httpclient_ops_t *ops);
  *  ECONTINUE for content available and more in future (exception if the
  *   content is empty, the connector needs to be called again).
  *  EINCOMPLETE for content not ready and need to be called again.
+ *  ESOURCE for content not ready, the connector is called again when
+ *   the descriptor set with httpmessage_source is ready.
  */
 typedef int (*http_connector_t)(void *arg, http_message_t *request, http_message_t *response);
 #define CONNECTOR_FILTER		0
@@ -255,8 +392,18 @@ typedef struct http_server_config_s
 	const char *versionstr;
 	/** the keepalive timeout **/
 	int keepalive;
+	/** the minimum size of content to send without copy (MSG_ZEROCOPY), 0 to disable **/
+	int zerocopy;
+	/** the headers added to all the responses (HTTPSERVER_HEADER_*), 0 to disable **/
+	int headers;
 } http_server_config_t;
 
+/**
+ * headers of http_server_config_t, they are not added if the response has already them
+ */
+#define HTTPSERVER_HEADER_SERVER 0x01
+#define HTTPSERVER_HEADER_DATE 0x02
+
 /**
  * @brief software name
  *
@@ -312,6 +459,10 @@ EXPORT_SYMBOL const char * httpserver_INFO(http_server_t *server, const char *ke
  */
 #define MESSAGE_PROTECTED 0x01
 #define MESSAGE_ALLOW_CONTENT 0x02
+/**
+ * the URI of the request is an authority "host:port" (CONNECT)
+ */
+#define MESSAGE_AUTHORITY 0x04
 EXPORT_SYMBOL void httpserver_addmethod(http_server_t *server, const char *method, short properties);
 
 /**
@@ -343,6 +494,73 @@ EXPORT_SYMBOL void httpserver_addconnector(http_server_t *server, http_connector
  */
 EXPORT_SYMBOL void httpserver_addmod(http_server_t *server, http_getctx_t mod, http_freectx_t unmod, void *arg, const char *name);
 
+/**
+ * @brief callback to send the content encoded by an encoder
+ *
+ * @param arg          the writearg of the encoder creation
+ * @param data         the encoded data
+ * @param length       the length of the data
+ *
+ * @return ESUCCESS or EREJECT
+ */
+typedef int (*http_encoder_write_t)(void *arg, const char *data, int length);
+
+#define ENCODER_MORE 0 /* more data follows */
+#define ENCODER_FLUSH 1 /* the data must be sent now, the connector streams */
+#define ENCODER_END 2 /* the content is complete */
+
+/**
+ * @brief content encoder of the responses
+ *
+ * The encoder is selected with the Accept-Encoding of the request. The
+ * content of the connector and the file of the response go through
+ * the encoder and the encoded data are sent with chunked framing.
+ */
+typedef struct http_encoder_s http_encoder_t;
+struct http_encoder_s
+{
+	const char *name; /* the token of Accept-Encoding and Content-Encoding */
+	/**
+	 * @param arg the argument of httpserver_addencoder
+	 * @param contenttype the type of the content, may be NULL
+	 * @param length the length of the content or (unsigned long long)-1
+	 *
+	 * @return the context of the encoding or NULL to send the content unchanged
+	 */
+	void *(*create)(void *arg, const char *contenttype, unsigned long long length,
+					http_encoder_write_t write, void *writearg);
+	/**
+	 * @param flush ENCODER_MORE, ENCODER_FLUSH or ENCODER_END
+	 *
+	 * @return ESUCCESS or EREJECT
+	 */
+	int (*encode)(void *ctx, const char *data, int length, int flush);
+	void (*destroy)(void *ctx);
+};
+
+/**
+ * @brief add a content encoder for the responses
+ *
+ * The first encoder added is preferred when the request accepts several
+ * of them with the same quality.
+ *
+ * @param server the server object generated by httpserver_create
+ * @param encoder the encoder description
+ * @param arg the first parameter of the create callback
+ */
+EXPORT_SYMBOL void httpserver_addencoder(http_server_t *server, const http_encoder_t *encoder, void *arg);
+
+/**
+ * @brief return the load of the server
+ *
+ * With the fork model, the load is the one at the creation of the client.
+ *
+ * @param server the server object generated by httpserver_create
+ *
+ * @return the percent of the maximum of clients running
+ */
+EXPORT_SYMBOL int httpserver_load(http_server_t *server);
+
 /**
  * @brief start the server to a new thread
  *
@@ -472,6 +690,23 @@ EXPORT_SYMBOL int httpmessage_appendheader(http_message_t *message, const char *
  */
 EXPORT_SYMBOL int httpmessage_addcontent(http_message_t *message, const char *type, const char *content, int length);
 
+/**
+ * @brief reserve a buffer for a large content of the response message
+ *
+ * The connector writes the content into the buffer, there is no copy.
+ * The buffer is sent with MSG_ZEROCOPY when its length reaches the
+ * zerocopy value of the server configuration, and it is freed by
+ * the library after the release of the kernel. The buffers released
+ * are used again by the next reservations of the connection.
+ *
+ * @param message the response message to update
+ * @param type the mime type of the content, NULL will set to "text/plain"
+ * @param length the length of the content
+ *
+ * @return the buffer to fill or NULL if the response has already a content
+ */
+EXPORT_SYMBOL char *httpmessage_reservecontent(http_message_t *message, const char *type, int length);
+
 /**
  * @brief append data to content of the response message before sending
  *
@@ -479,16 +714,35 @@ EXPORT_SYMBOL int httpmessage_addcontent(http_message_t *message, const char *ty
  * @param content the data of the content
  * @param length the length of the bitstream of the content
  *
- * @return the space available into the chunk of content
+ * @return the space available into the chunk of content,
+ * with a NULL content the length accepted before the next sending
  */
 EXPORT_SYMBOL int httpmessage_appendcontent(http_message_t *message, const char *content, int length);
 
+/**
+ * @brief set a range of a file as content of the response message
+ *
+ * The response keeps the file descriptor and closes it when it is
+ * destroyed. The Content-Length is set to the length of the range.
+ * The range is sent by the kernel (sendfile or splice) when the
+ * connection allows it, otherwise it is read by chunks.
+ *
+ * @param message the response message to update
+ * @param fd the file descriptor, a regular file or a pipe
+ * @param offset the position of the first byte to send, unused for a pipe
+ * @param length the number of bytes to send
+ *
+ * @return ESUCCESS or EREJECT if the response has already a file
+ */
+EXPORT_SYMBOL int httpmessage_addfile(http_message_t *message, int fd, unsigned long long offset, unsigned long long length);
+
 /**
  * @brief returns the content of the request message
  *
  * @param message the request message
  * @param contentpart the data of the content
- * @param contentlenght the rest size of the content to read
+ * @param contentlenght the rest size of the content to read,
+ *  (unsigned long long)-1 while the chunks of a chunked content are received.
  *
  * @return the length of data pop into contentpart
  */
@@ -506,6 +760,20 @@ EXPORT_SYMBOL int httpmessage_content(http_message_t *message, char **contentpar
  */
 EXPORT_SYMBOL int httpmessage_keepalive(http_message_t *message);
 
+/**
+ * @brief set the descriptor that the connector waits
+ *
+ * The connector returns ESOURCE after the call, the client waits the
+ * events of the descriptor (or a timer) instead of the connector,
+ * and calls it again.
+ * The descriptor is forgotten after the waiting.
+ *
+ * @param message the response message to update
+ * @param fd the descriptor, a socket or a pipe
+ * @param events the events of poll to wait (POLLIN, POLLOUT)
+ */
+EXPORT_SYMBOL void httpmessage_source(http_message_t *message, int fd, short events);
+
 /**
  * @brief lock the connection
  *
@@ -579,6 +847,93 @@ EXPORT_SYMBOL const char * httpmessage_SERVER(http_message_t *message, const cha
  */
 EXPORT_SYMBOL const char * httpmessage_REQUEST(http_message_t *message, const char *key);
 
+/**
+ * @brief get value of a known header of the message
+ *
+ * the value is stored during the parsing of the headers.
+ *
+ * @param message the message received
+ * @param id the identifier of the header (HDR_CONTENT_LENGTH...)
+ *
+ * @return the value of the header or NULL
+ */
+EXPORT_SYMBOL const char * httpmessage_header_id(http_message_t *message, http_header_e id);
+
+/**
+ * @brief iterate over the headers of the request
+ *
+ * the headers are returned in the order of the request.
+ *
+ * @param message the request message received
+ * @param iterator the position into the headers, must be 0 for the first call
+ * @param name set to the name of the header
+ *
+ * @return the value of the header or NULL at the end
+ */
+EXPORT_SYMBOL const char * httpmessage_headers(http_message_t *message, int *iterator, const char **name);
+
+/**
+ * @brief get the quality of a token into a list like Accept-Encoding
+ *
+ * @param list the value of the header
+ * @param token the token to search ("gzip", "*"...)
+ *
+ * @return the quality in thousandth, 0 if refused or -1 if the token is missing
+ */
+EXPORT_SYMBOL int httpmessage_quality(const char *list, const char *token);
+
+/**
+ * @brief get value of a trailer of a chunked message
+ *
+ * the trailers follow the last chunk of the content, they are
+ * available after the end of the content.
+ *
+ * @param message the message received
+ * @param key the name of the trailer field
+ *
+ * @return the value of the trailer or NULL
+ */
+EXPORT_SYMBOL const char * httpmessage_trailer(http_message_t *message, const char *key);
+
+/**
+ * the parts returned by httpmessage_dechunk
+ */
+typedef enum
+{
+	HTTPCHUNK_MORE, /* the data is used, the decoder needs the next data */
+	HTTPCHUNK_DATA, /* a part of the data of a chunk */
+	HTTPCHUNK_TRAILER, /* a part of a trailer line, without its end */
+	HTTPCHUNK_LINE, /* the end of a trailer line */
+	HTTPCHUNK_END, /* the end of the content */
+	HTTPCHUNK_ERROR, /* the framing is malformed */
+} http_chunk_part_e;
+
+typedef struct http_chunk_s http_chunk_t;
+struct http_chunk_s
+{
+	int state;
+	unsigned long long length;
+};
+
+/**
+ * @brief decode the "Transfer-Encoding: chunked" framing
+ *
+ * The framing is dropped and the parts of the content are returned
+ * one after the other without copy. The decoder keeps its state and
+ * continues with the next data received.
+ * The server decodes the requests with it, the HTTP clients
+ * the responses.
+ *
+ * @param chunk the state of the decoder, set with zeros for a new content
+ * @param data the data to decode, moved after the returned part
+ * @param end the end of the data
+ * @param part set with the beginning of the part
+ * @param length set with the length of the part
+ *
+ * @return the type of the part
+ */
+EXPORT_SYMBOL http_chunk_part_e httpmessage_dechunk(http_chunk_t *chunk, const char **data, const char *end, const char **part, int *length);
+
 /**
  * @brief get value for the session used by the request
  *
@@ -597,6 +952,8 @@ EXPORT_SYMBOL const void *httpmessage_SESSION(http_message_t *message, const cha
  * @brief get value from query parameters and/or POST form data
  *
  * the value are stored by mod with the same function.
+ * The value is decoded on the first access. For a repeated
+ * parameter the last value is returned, see httpmessage_parameters.
  *
  * @param message the request message received
  * @param key the name of the attribute
@@ -605,6 +962,21 @@ EXPORT_SYMBOL const void *httpmessage_SESSION(http_message_t *message, const cha
  */
 EXPORT_SYMBOL const char * httpmessage_parameter(http_message_t *message, const char *key);
 
+/**
+ * @brief iterate over the values of query parameters and POST form data
+ *
+ * the values are returned in the order of the request, a parameter
+ * may be repeated ("a=1&a=2").
+ *
+ * @param message the request message received
+ * @param key the name of the attribute or NULL for all parameters
+ * @param iterator the position into the parameters, must be 0 for the first call
+ * @param name if not NULL, set to the name of the parameter
+ *
+ * @return the decoded value of the parameter or NULL at the end
+ */
+EXPORT_SYMBOL const char * httpmessage_parameters(http_message_t *message, const char *key, int *iterator, const char **name);
+
 /**
  * @brief get value from Cookie header
  *
@@ -724,6 +1096,55 @@ EXPORT_SYMBOL http_send_t httpclient_addsender(http_client_t *client, http_send_
  */
 EXPORT_SYMBOL void httpclient_shutdown(http_client_t *client);
 
+/**
+ * @brief relay the connection with another socket after the response
+ *
+ * The connector sets the response of an upgrade (101) or of a
+ * CONNECT request (2xx) and gives the socket of the other side.
+ * After the response, the data received on each side is sent to the
+ * other one through pipes without copy into the user space, and the
+ * end of one direction is forwarded with a shutdown, until both
+ * directions are closed. The library closes the socket.
+ * The relay needs the ops of the client to receive and to send with
+ * pipes (TCP without TLS and without HTTP/2).
+ *
+ * @param client the connection that received the request
+ * @param sock the socket to relay
+ * @param data the data already received from the socket for the client
+ * @param length the length of data
+ *
+ * @return ESUCCESS or EREJECT if the connection cannot be relayed,
+ * the socket stays to the caller on error
+ */
+EXPORT_SYMBOL int httpclient_relay(http_client_t *client, int sock, const char *data, int length);
+
+/**
+ * @brief open a request received on a stream of a multiplexed connection
+ *
+ * The protocol (HTTP/2) decodes the request line and the headers by
+ * itself. The request runs beside the other streams of the connection,
+ * its content is read with the recvstream callback of the ops and its
+ * response is sent with the sendstream callback.
+ *
+ * @param client the connection that received the request
+ * @param stream the pointer given back to the callbacks
+ * @param method the method of the request
+ * @param uri the target of the request
+ * @param content 1 if a content follows the headers
+ *
+ * @return the request or NULL on error
+ */
+EXPORT_SYMBOL http_message_t *httpclient_openstream(http_client_t *client, void *stream, const char *method, const char *uri, int content);
+
+/**
+ * @brief add a header to a request opened by httpclient_openstream
+ *
+ * The headers are added before the first run of the client loop.
+ *
+ * @return ESUCCESS or EREJECT if the headers are too large
+ */
+EXPORT_SYMBOL int httpclient_streamheader(http_message_t *request, const char *key, int keylength, const char *value, int valuelength);
+
 /**
  * @brief wait on the socket while no dat available
  *
@@ -0,0 +1,141 @@
+/*****************************************************************************
+ * multipart.h: streaming multipart/form-data parser
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#ifndef __MULTIPART_H__
+#define __MULTIPART_H__
+
+/**
+ * the boundary is limited to 70 characters by RFC 2046
+ */
+#define MULTIPART_BOUNDARYMAX 70
+/**
+ * the maximum size of the headers of one part
+ */
+#ifndef MULTIPART_HEADERMAX
+#define MULTIPART_HEADERMAX 1024
+#endif
+
+typedef struct multipart_part_s multipart_part_t;
+struct multipart_part_s
+{
+	const char *name; /* name of the field from Content-Disposition */
+	const char *filename; /* name of the file or NULL */
+	const char *contenttype; /* Content-Type of the part or NULL */
+	int index; /* position of the part into the content */
+};
+
+typedef struct multipart_ops_s multipart_ops_t;
+struct multipart_ops_s
+{
+	/**
+	 * @brief the headers of a new part are received
+	 *
+	 * @return EREJECT to stop the parsing, any other value to continue
+	 */
+	int (*begin)(void *arg, const multipart_part_t *part);
+	/**
+	 * @brief a slice of the body of the part is received
+	 *
+	 * The data is available only during the call.
+	 */
+	int (*data)(void *arg, const multipart_part_t *part, const char *data, int length);
+	/**
+	 * @brief the body of the part is complete
+	 */
+	int (*end)(void *arg, const multipart_part_t *part);
+};
+
+typedef struct multipart_s multipart_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief create a parser for the content of the request
+ *
+ * The parser uses a fixed size memory, whatever the size of the parts.
+ * The boundaries are found with a Boyer-Moore-Horspool search and
+ * the body of the parts is given to the callbacks without copy.
+ *
+ * @param request	the request with the multipart/form-data content
+ * @param ops		the callbacks, the members may be NULL
+ * @param arg		the first argument of the callbacks
+ *
+ * @return the parser or NULL if the request is not a multipart/form-data
+ */
+multipart_t *multipart_create(http_message_t *request, const multipart_ops_t *ops, void *arg);
+
+/**
+ * @brief parse a slice of the content
+ *
+ * @param multipart	the parser
+ * @param data		the slice of the content
+ * @param length	the length of the slice
+ *
+ * @return ESUCCESS after the closing boundary, EINCOMPLETE while more
+ * data is needed or EREJECT on syntax error or callback rejection
+ */
+int multipart_parse(multipart_t *multipart, const char *data, int length);
+
+/**
+ * @brief parse the content received with the request
+ *
+ * This function is called by the connector each time that it runs,
+ * until it returns ESUCCESS or EREJECT.
+ *
+ * @param multipart	the parser
+ * @param request	the request given to the connector
+ *
+ * @return the same values as multipart_parse
+ */
+int multipart_content(multipart_t *multipart, http_message_t *request);
+
+/**
+ * @brief returns a header of the current part
+ *
+ * @param multipart	the parser
+ * @param key		the name of the header
+ *
+ * @return the value or NULL, available until the end of the part
+ */
+const char *multipart_header(multipart_t *multipart, const char *key);
+
+/**
+ * @brief free the parser
+ *
+ * @param multipart	the handle returned by multipart_create
+ */
+void multipart_destroy(multipart_t *multipart);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
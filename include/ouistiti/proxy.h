@@ -0,0 +1,119 @@
+/*****************************************************************************
+ * proxy.h: reverse proxy connector
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#ifndef __PROXY_H__
+#define __PROXY_H__
+
+/**
+ * default values of the configuration
+ */
+#define PROXY_POOLSIZE 8
+#define PROXY_TIMEOUT 5000
+#define PROXY_IDLETIME 30
+#define PROXY_MAXFAILS 3
+#define PROXY_EJECTTIME 30
+#define PROXY_CACHEENTRIES 1024
+#define PROXY_CACHEMAXLENGTH (8 * 1024 * 1024)
+
+typedef struct proxy_config_s proxy_config_t;
+struct proxy_config_s
+{
+	const char **upstreams; /* NULL terminated list of "host:port" */
+	const char *prefix; /* beginning of the proxied URIs, NULL for all */
+	int poolsize; /* maximum connections of a client to one upstream, 0 without keep-alive */
+	int timeout; /* milliseconds to connect and to wait the upstream */
+	int idletime; /* seconds before to close an idle connection */
+	int maxfails; /* consecutive errors before the ejection of an upstream */
+	int ejecttime; /* seconds of the ejection */
+	const char *cachedir; /* directory of the cached responses, NULL without cache */
+	int cacheentries; /* maximum number of cached responses */
+	int cachemaxlength; /* bytes of the largest cached content */
+	const char **tunnels; /* NULL terminated list of "host:port" of the CONNECT requests, "*:port" for all hosts, NULL without tunnel */
+};
+
+typedef struct proxy_s proxy_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief add the reverse proxy connector to the server
+ *
+ * The requests under the prefix are sent to the upstream with the least
+ * requests in progress, by the fetch client of the connection (see
+ * fetch.h). The content of the request is received before the sending,
+ * the content of the response is relayed while it is received.
+ * The connector never blocks on the upstream, the client waits its
+ * socket between the calls.
+ * The connections to the upstreams belong to the client connection
+ * which opened them: the next requests and the streams of the same
+ * client reuse them, the other clients and the other processes open
+ * their own connections. poolsize limits the connections of a client
+ * to one upstream, 0 closes them after each response.
+ * An upstream which fails maxfails times in a row is not used during
+ * ejecttime seconds.
+ * The counters of the upstreams are shared by the processes of the
+ * server.
+ * With a cache directory, the responses of GET requests with an
+ * explicit freshness (Cache-Control max-age or s-maxage, Expires) are
+ * stored into files and sent again while they are fresh, following
+ * the Vary header of the upstream. The index of the files is mapped
+ * into the memory of all the processes of the server. One request gets
+ * the response of the upstream, the other requests of the same URI
+ * wait it or receive the stale response during the
+ * stale-while-revalidate time.
+ * The upgraded connections (101 response of the upstream) and the
+ * tunnels of the CONNECT requests are relayed by the library between
+ * the sockets without copy into the process.
+ * The cache waits the response of another client inside the client,
+ * the library must be built with VTHREAD (fork or pthread) and the
+ * proxy is not built without it.
+ *
+ * @param server	the server to change
+ * @param config	the configuration with at least one upstream
+ *
+ * @return the connector handle or NULL on error
+ */
+proxy_t *proxy_create(http_server_t *server, const proxy_config_t *config);
+
+/**
+ * @brief free the connector
+ *
+ * The server keeps its connectors, it must be destroyed before.
+ *
+ * @param proxy	the handle returned by proxy_create
+ */
+void proxy_destroy(proxy_t *proxy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
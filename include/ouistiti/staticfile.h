@@ -0,0 +1,89 @@
+/*****************************************************************************
+ * staticfile.h: static documents connector
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#ifndef __STATICFILE_H__
+#define __STATICFILE_H__
+
+/**
+ * default values of the configuration
+ */
+#define STATICFILE_INDEX "index.html"
+#define STATICFILE_CACHESIZE 128
+#define STATICFILE_NEGATIVESIZE 1024
+
+typedef struct staticfile_config_s staticfile_config_t;
+struct staticfile_config_s
+{
+	const char *docroot; /* directory of the documents */
+	const char *index; /* document of the directories */
+	int cachesize; /* maximum number of open documents */
+	int negativesize; /* maximum number of missing paths */
+};
+
+typedef struct staticfile_s staticfile_t;
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief add the static documents connector to the server
+ *
+ * The connector answers to GET and HEAD with the file of the URI under
+ * the document root. The descriptors, the stat results, the ETag and the
+ * Last-Modified values of the last documents are kept into a LRU cache,
+ * and the missing paths into a negative cache. On Linux the caches are
+ * invalidated by inotify, otherwise the documents are not cached.
+ * With the fork model (VTHREAD_TYPE=fork) each client process opens
+ * the documents without cache.
+ * The conditional requests are answered with 304 from the cache.
+ * The "file.br" and "file.gz" sidecars, not older than "file", are sent
+ * as is to the clients accepting the encoding.
+ *
+ * @param server	the server to change
+ * @param config	the configuration or NULL for the current directory
+ *
+ * @return the connector handle or NULL on error
+ */
+staticfile_t *staticfile_create(http_server_t *server, const staticfile_config_t *config);
+
+/**
+ * @brief free the connector
+ *
+ * The server keeps its connectors, it must be destroyed before.
+ *
+ * @param staticfile	the handle returned by staticfile_create
+ */
+void staticfile_destroy(staticfile_t *staticfile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
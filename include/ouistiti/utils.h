@@ -56,6 +56,33 @@ struct utils_parsestring_s
 typedef struct utils_parsestring_s utils_parsestring_t;
 int utils_parsestring(const char *string, int listlength, utils_parsestring_t list[]);
 
+/**
+ * @brief callback to store a meta-variable of a CGI script
+ *
+ * @param arg		the argument of utils_cgienv
+ * @param name		the name of the variable
+ * @param namelength	the length of the name or -1
+ * @param value		the value, NULL if the request does not set it
+ *
+ * @return ESUCCESS or EREJECT
+ */
+typedef int (*utils_cgienv_t)(void *arg, const char *name, int namelength, const char *value);
+
+/**
+ * @brief build the meta-variables of a CGI script from the request (RFC 3875)
+ *
+ * The variables of the request, of the server and the HTTP_ variables of
+ * the headers are given to the callback. The variables of the script
+ * (SCRIPT_NAME, PATH_INFO...) and DOCUMENT_ROOT belong to the connector.
+ *
+ * @param request	the request to the script
+ * @param cb		the callback called for each variable
+ * @param arg		the first argument of the callback
+ *
+ * @return ESUCCESS or EREJECT if a callback failed
+ */
+int utils_cgienv(http_message_t *request, utils_cgienv_t cb, void *arg);
+
 /**
  * @brief get value of each cookie of the request
  *
@@ -0,0 +1,75 @@
+/*****************************************************************************
+ * _proxycache.h: disk cache of the reverse proxy, private API
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#ifndef ___PROXYCACHE_H__
+#define ___PROXYCACHE_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#define PROXYCACHE_VARYMAX 96
+
+typedef enum
+{
+	PROXYCACHE_MISS,
+	PROXYCACHE_HIT,
+	PROXYCACHE_FILL,
+} _proxycache_e;
+
+typedef struct proxy_cache_s proxy_cache_t;
+
+/**
+ * the state of one request into the cache, the request which fills
+ * an entry owns it until _proxycache_end
+ */
+typedef struct proxy_cachectx_s proxy_cachectx_t;
+struct proxy_cachectx_s
+{
+	int slot; /* the entry filled by the request, -1 without */
+	uint64_t key;
+	uint64_t token; /* the owner of the entry */
+	uint32_t generation; /* the version of the new file */
+	int fd; /* the temporary file of the response */
+	uint32_t headerlength;
+	uint64_t length;
+	time_t expires;
+	time_t stale; /* end of the stale-while-revalidate window */
+	uint64_t vary;
+	char varynames[PROXYCACHE_VARYMAX];
+};
+
+proxy_cache_t *_proxycache_create(const char *directory, int entries, unsigned long long maxlength, int timeout);
+void _proxycache_init(proxy_cachectx_t *ctx);
+int _proxycache_lookup(proxy_cache_t *cache, proxy_cachectx_t *ctx, http_message_t *request, http_message_t *response);
+void _proxycache_store(proxy_cache_t *cache, proxy_cachectx_t *ctx, int status, const char *type,
+			const char **names, const char **values, int nheaders, http_message_t *request);
+void _proxycache_write(proxy_cache_t *cache, proxy_cachectx_t *ctx, const char *data, int length);
+void _proxycache_end(proxy_cache_t *cache, proxy_cachectx_t *ctx, int complete);
+void _proxycache_destroy(proxy_cache_t *cache);
+
+#endif
@@ -0,0 +1,913 @@
+/*****************************************************************************
+ * cgi.c: CGI connector with a fork server
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "log.h"
+#include "httpserver.h"
+#include "utils.h"
+#include "cgi.h"
+
+#ifndef VTHREAD
+# error "the connector writes the input of the scripts inside the client, it needs VTHREAD"
+#endif
+
+#define cgi_dbg(...)
+
+/**
+ * the buffer receives the environment of the script, then its output.
+ * It is the limit of the CGI headers.
+ */
+#ifndef CGI_BUFFERSIZE
+#define CGI_BUFFERSIZE 16384
+#endif
+#define CGI_MAXENV 256
+
+typedef struct cgi_client_s cgi_client_t;
+typedef struct cgi_request_s cgi_request_t;
+
+struct cgi_s
+{
+	cgi_config_t config;
+	int prefixlength;
+	int channel; /* the socket to the fork server */
+	pid_t forkserver;
+};
+
+typedef enum
+{
+	CGI_STDIN,
+	CGI_HEADER,
+	CGI_CONTENT,
+	CGI_ABORTED,
+} _cgi_state_e;
+
+struct cgi_request_s
+{
+	cgi_client_t *client;
+	_cgi_state_e state;
+	pid_t pid;
+	int input; /* the standard input of the script */
+	int output; /* the standard output of the script */
+	int form; /* the content is stored with the query */
+	int eof; /* the script closed its output */
+	int timeout;
+	long long deadline; /* milliseconds of the end of the wait of the output */
+	int offset; /* the beginning of the output not yet used */
+	int length;
+	char buffer[CGI_BUFFERSIZE];
+	cgi_request_t *next;
+};
+
+struct cgi_client_s
+{
+	cgi_t *cgi;
+	cgi_request_t *requests;
+};
+
+static long long _cgi_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief start one script from the fork server
+ *
+ * The data of the message is the path of the script followed by the
+ * environment, the message carries the standard input, the standard
+ * output and the pipe for the pid.
+ */
+static void _cgi_start(char *data, int length, int fds[3])
+{
+	char *envp[CGI_MAXENV + 1];
+	int nenv = 0;
+	char *path = data;
+	char *it = path + strlen(path) + 1;
+	while (it < data + length && nenv < CGI_MAXENV)
+	{
+		envp[nenv++] = it;
+		it += strlen(it) + 1;
+	}
+	envp[nenv] = NULL;
+
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		/**
+		 * the script receives the default signals
+		 */
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+		signal(SIGCHLD, SIG_DFL);
+		signal(SIGPIPE, SIG_DFL);
+		setpgid(0, 0);
+		dup2(fds[0], STDIN_FILENO);
+		dup2(fds[1], STDOUT_FILENO);
+		char *argv[2] = {path, NULL};
+		char *slash = strrchr(path, '/');
+		if (slash != NULL && slash != path)
+		{
+			*slash = '\0';
+			int ret = chdir(path);
+			*slash = '/';
+			if (ret != 0)
+				_exit(127);
+		}
+		execve(path, argv, envp);
+		_exit(127);
+	}
+	if (write(fds[2], &pid, sizeof(pid)) != sizeof(pid))
+		err("cgi: fork server reply error %s", strerror(errno));
+}
+
+/**
+ * @brief the loop of the fork server
+ *
+ * The process is forked before the server starts, its memory stays
+ * small and the fork of the scripts is cheap. It exits when the
+ * server closes the channel.
+ */
+static void _cgi_forkserver(int channel)
+{
+	static char data[CGI_BUFFERSIZE + 1];
+	int fd;
+	for (fd = getdtablesize() - 1; fd > STDERR_FILENO; fd--)
+	{
+		if (fd != channel)
+			close(fd);
+	}
+	/**
+	 * the scripts are not waited
+	 */
+	signal(SIGCHLD, SIG_IGN);
+	while (1)
+	{
+		struct iovec iov = {.iov_base = data, .iov_len = CGI_BUFFERSIZE};
+		union
+		{
+			struct cmsghdr header;
+			char space[CMSG_SPACE(3 * sizeof(int))];
+		} control;
+		struct msghdr msg =
+		{
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = control.space,
+			.msg_controllen = sizeof(control.space),
+		};
+		ssize_t length = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+		if (length < 0 && errno == EINTR)
+			continue;
+		if (length <= 0)
+			break;
+		int fds[3] = {-1, -1, -1};
+		int nfds = 0;
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+		{
+			nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			memcpy(fds, CMSG_DATA(cmsg), ((nfds > 3)? 3 : nfds) * sizeof(int));
+		}
+		data[length] = '\0';
+		if (nfds == 3 && !(msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)))
+			_cgi_start(data, length, fds);
+		for (fd = 0; fd < 3 && fd < nfds; fd++)
+			close(fds[fd]);
+	}
+	_exit(0);
+}
+
+/**
+ * @brief send the script and its environment to the fork server
+ *
+ * The environment is into the buffer of the request.
+ *
+ * @return the pid of the script or EREJECT
+ */
+static pid_t _cgi_spawn(cgi_t *cgi, cgi_request_t *creq)
+{
+	int input[2];
+	int output[2];
+	int reply[2];
+	if (pipe2(input, O_CLOEXEC) < 0)
+		return EREJECT;
+	if (pipe2(output, O_CLOEXEC) < 0)
+	{
+		close(input[0]);
+		close(input[1]);
+		return EREJECT;
+	}
+	if (pipe2(reply, O_CLOEXEC) < 0)
+	{
+		close(input[0]);
+		close(input[1]);
+		close(output[0]);
+		close(output[1]);
+		return EREJECT;
+	}
+	struct iovec iov = {.iov_base = creq->buffer, .iov_len = creq->length};
+	union
+	{
+		struct cmsghdr header;
+		char space[CMSG_SPACE(3 * sizeof(int))];
+	} control = {0};
+	struct msghdr msg =
+	{
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.space,
+		.msg_controllen = sizeof(control.space),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+	int fds[3] = {input[0], output[1], reply[1]};
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	ssize_t ret;
+	do
+	{
+		ret = sendmsg(cgi->channel, &msg, MSG_NOSIGNAL);
+	} while (ret < 0 && errno == EINTR);
+	close(input[0]);
+	close(output[1]);
+	close(reply[1]);
+
+	pid_t pid = EREJECT;
+	struct pollfd pfd = {.fd = reply[0], .events = POLLIN};
+	if (ret < 0)
+		err("cgi: fork server error %s", strerror(errno));
+	else if (poll(&pfd, 1, cgi->config.timeout) > 0 &&
+		read(reply[0], &pid, sizeof(pid)) != sizeof(pid))
+		pid = EREJECT;
+	close(reply[0]);
+	if (pid <= 0)
+	{
+		err("cgi: script not started");
+		close(input[1]);
+		close(output[0]);
+		return EREJECT;
+	}
+	creq->input = input[1];
+	creq->output = output[0];
+	fcntl(creq->input, F_SETFL, fcntl(creq->input, F_GETFL) | O_NONBLOCK);
+	creq->length = 0;
+	return pid;
+}
+
+/**
+ * @brief find the script into the path, the rest is the PATH_INFO
+ *
+ * @return the offset of the PATH_INFO into the path or EREJECT
+ */
+static int _cgi_script(cgi_t *cgi, char *path)
+{
+	int length = strlen(cgi->config.docroot);
+	char *it = path + length;
+	while (*it == '/')
+	{
+		char *next = strchr(it + 1, '/');
+		if (next != NULL)
+			*next = '\0';
+		struct stat filestat;
+		int ret = stat(path, &filestat);
+		if (ret == 0 && S_ISREG(filestat.st_mode) && access(path, X_OK) != 0)
+			ret = EREJECT;
+		if (next != NULL)
+			*next = '/';
+		if (ret != 0)
+			return EREJECT;
+		if (S_ISREG(filestat.st_mode))
+			return (next != NULL)? next - path : (int)strlen(path);
+		if (!S_ISDIR(filestat.st_mode) || next == NULL)
+			return EREJECT;
+		it = next;
+	}
+	return EREJECT;
+}
+
+static int _cgi_env(void *arg, const char *name, int namelength, const char *value)
+{
+	cgi_request_t *creq = (cgi_request_t *)arg;
+	if (value == NULL)
+		return ESUCCESS;
+	if (namelength < 0)
+		namelength = strlen(name);
+	int valuelength = strlen(value);
+	if (creq->length + namelength + valuelength + 2 > (int)sizeof(creq->buffer))
+	{
+		warn("cgi: variable %.*s dropped", namelength, name);
+		return ESUCCESS;
+	}
+	char *it = creq->buffer + creq->length;
+	memcpy(it, name, namelength);
+	it += namelength;
+	*it++ = '=';
+	memcpy(it, value, valuelength);
+	it += valuelength;
+	*it++ = '\0';
+	creq->length = it - creq->buffer;
+	return ESUCCESS;
+}
+
+/**
+ * @brief build the environment of the script after its path
+ */
+static void _cgi_environment(cgi_request_t *creq, http_message_t *request, const char *path, int script)
+{
+	cgi_t *cgi = creq->client->cgi;
+	int docrootlength = strlen(cgi->config.docroot);
+	char value[PATH_MAX];
+
+	creq->length = 0;
+	snprintf(value, sizeof(value), "%.*s", script, path);
+	creq->length = script + 1;
+	memcpy(creq->buffer, value, creq->length);
+	_cgi_env(creq, "SCRIPT_FILENAME", -1, value);
+	snprintf(value, sizeof(value), "%.*s", script - docrootlength, path + docrootlength);
+	_cgi_env(creq, "SCRIPT_NAME", -1, value);
+	if (path[script] != '\0')
+	{
+		_cgi_env(creq, "PATH_INFO", -1, path + script);
+		snprintf(value, sizeof(value), "%s%s", cgi->config.docroot, path + script);
+		_cgi_env(creq, "PATH_TRANSLATED", -1, value);
+	}
+	_cgi_env(creq, "DOCUMENT_ROOT", -1, cgi->config.docroot);
+	utils_cgienv(request, _cgi_env, creq);
+	const char **env;
+	for (env = cgi->config.env; env != NULL && *env != NULL; env++)
+	{
+		int length = strlen(*env);
+		if (creq->length + length + 1 > (int)sizeof(creq->buffer))
+			break;
+		memcpy(creq->buffer + creq->length, *env, length + 1);
+		creq->length += length + 1;
+	}
+}
+
+/**
+ * @brief read the next part of the output of the script
+ *
+ * The output is read only when it is ready, the client waits it
+ * between the calls of the connector.
+ *
+ * @return the length of the new data, 0 at the end of the output,
+ * EINCOMPLETE if the output is empty, ECONTINUE if the buffer is full
+ * or EREJECT on error
+ */
+static int _cgi_read(cgi_request_t *creq)
+{
+	if (creq->eof)
+		return 0;
+	if (creq->offset > 0)
+	{
+		memmove(creq->buffer, creq->buffer + creq->offset, creq->length - creq->offset);
+		creq->length -= creq->offset;
+		creq->offset = 0;
+	}
+	if (creq->length == sizeof(creq->buffer))
+		return ECONTINUE;
+	struct pollfd pfd = {.fd = creq->output, .events = POLLIN};
+	if (poll(&pfd, 1, 0) == 0)
+		return EINCOMPLETE;
+	ssize_t ret;
+	do
+	{
+		ret = read(creq->output, creq->buffer + creq->length, sizeof(creq->buffer) - creq->length);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0)
+	{
+		err("cgi: script output error %s", strerror(errno));
+		return EREJECT;
+	}
+	if (ret == 0)
+		creq->eof = 1;
+	creq->length += ret;
+	creq->deadline = _cgi_now() + creq->client->cgi->config.timeout;
+	return ret;
+}
+
+/**
+ * @brief give the output of the script to the client to wait it
+ *
+ * @return ESOURCE or EREJECT after the timeout
+ */
+static int _cgi_wait(cgi_request_t *creq, http_message_t *response)
+{
+	if (_cgi_now() >= creq->deadline)
+	{
+		err("cgi: script timeout");
+		creq->timeout = 1;
+		return EREJECT;
+	}
+	httpmessage_source(response, creq->output, POLLIN);
+	return ESOURCE;
+}
+
+/**
+ * @brief write a part of the request content on the input of the script
+ *
+ * The output of the script is read at the same time, the script may
+ * wait its output is read before to read its input. The content is
+ * already consumed from the request, the client waits the script
+ * until its end.
+ */
+static int _cgi_write(cgi_request_t *creq, const char *data, int length)
+{
+	while (length > 0 && creq->input != -1)
+	{
+		ssize_t ret = write(creq->input, data, length);
+		if (ret > 0)
+		{
+			data += ret;
+			length -= ret;
+			continue;
+		}
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0 && errno == EPIPE)
+		{
+			/**
+			 * the script does not read its input, the rest is dropped
+			 */
+			close(creq->input);
+			creq->input = -1;
+			break;
+		}
+		if (ret < 0 && errno != EAGAIN)
+			return EREJECT;
+		struct pollfd pfd[2] =
+		{
+			{.fd = creq->input, .events = POLLOUT},
+			{.fd = creq->output, .events = POLLIN},
+		};
+		int nfds = (!creq->eof && creq->length < (int)sizeof(creq->buffer))? 2 : 1;
+		if (poll(pfd, nfds, creq->client->cgi->config.timeout) <= 0)
+		{
+			err("cgi: script input timeout");
+			creq->timeout = 1;
+			return EREJECT;
+		}
+		if (nfds > 1 && pfd[1].revents && _cgi_read(creq) == EREJECT)
+			return EREJECT;
+	}
+	return ESUCCESS;
+}
+
+/**
+ * @brief write the next part of the request content into the input
+ *
+ * @return EINCOMPLETE while the content is received, ESUCCESS or EREJECT
+ */
+static int _cgi_body(cgi_request_t *creq, http_message_t *request)
+{
+	char *data = NULL;
+	unsigned long long rest = 0;
+	int size = httpmessage_content(request, &data, &rest);
+	if (creq->form && size > 0)
+	{
+		/**
+		 * the parser stores the form after the query
+		 */
+		const char *query = httpmessage_REQUEST(request, "query");
+		int skip = (query != NULL && query[0] != '\0')? strlen(query) + 1: 0;
+		data += skip;
+		size -= (size > skip)? skip : size;
+		rest = 0;
+	}
+	if (size > 0 && _cgi_write(creq, data, size) != ESUCCESS)
+		return EREJECT;
+	if (size == EINCOMPLETE || rest > 0)
+		return EINCOMPLETE;
+	/**
+	 * the end of the input is the end of the content
+	 */
+	if (creq->input != -1)
+		close(creq->input);
+	creq->input = -1;
+	return ESUCCESS;
+}
+
+/**
+ * @brief find the empty line at the end of the CGI headers
+ */
+static char *_cgi_headerend(cgi_request_t *creq, char **body)
+{
+	char *it = creq->buffer + creq->offset;
+	char *end = creq->buffer + creq->length;
+	while ((it = memchr(it, '\n', end - it)) != NULL)
+	{
+		it++;
+		if (it < end && *it == '\n')
+		{
+			*body = it + 1;
+			return it;
+		}
+		if (it + 1 < end && it[0] == '\r' && it[1] == '\n')
+		{
+			*body = it + 2;
+			return it;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief read the CGI headers of the output and set the response
+ *
+ * The headers may arrive in several parts, the parsing starts when
+ * the empty line is received.
+ *
+ * @return ECONTINUE if the content is streamed, ESUCCESS if the response
+ * is complete or its content is spliced from the output, ESOURCE while
+ * the output is empty, EREJECT on error
+ */
+static int _cgi_header(cgi_request_t *creq, http_message_t *request, http_message_t *response)
+{
+	char *end;
+	char *body = NULL;
+	while ((end = _cgi_headerend(creq, &body)) == NULL)
+	{
+		int ret = _cgi_read(creq);
+		if (ret == 0 || ret == ECONTINUE)
+		{
+			err("cgi: bad response from the script");
+			return EREJECT;
+		}
+		if (ret == EREJECT)
+			return EREJECT;
+		if (ret == EINCOMPLETE)
+			return _cgi_wait(creq, response);
+	}
+	*end = '\0';
+
+	int status = 0;
+	const char *type = NULL;
+	const char *location = NULL;
+	long long length = -1;
+	char *line = creq->buffer + creq->offset;
+	while (line != NULL && *line != '\0')
+	{
+		char *next = strchr(line, '\n');
+		if (next != NULL)
+		{
+			*next = '\0';
+			if (next > line && next[-1] == '\r')
+				next[-1] = '\0';
+			next++;
+		}
+		char *value = strchr(line, ':');
+		if (value != NULL)
+		{
+			*value++ = '\0';
+			while (*value == ' ' || *value == '\t')
+				value++;
+			if (!strcasecmp(line, "Status"))
+				status = atoi(value);
+			else if (!strcasecmp(line, "Content-Type"))
+				type = value;
+			else if (!strcasecmp(line, "Content-Length"))
+				length = strtoll(value, NULL, 10);
+			else if (!strcasecmp(line, "Connection") || !strcasecmp(line, "Keep-Alive") ||
+					!strcasecmp(line, "Transfer-Encoding"))
+				continue;
+			else
+			{
+				if (!strcasecmp(line, "Location"))
+					location = value;
+				httpmessage_addheader(response, line, value);
+			}
+		}
+		line = next;
+	}
+	creq->offset = body - creq->buffer;
+	if (status == 0)
+		status = (location != NULL)? RESULT_302 : RESULT_200;
+	httpmessage_result(response, status);
+
+	const char *method = httpmessage_REQUEST(request, "method");
+	if (!strcmp(method, str_head) || status == 204 || status == 304)
+	{
+		if (length >= 0 && status != 204 && status != 304)
+			httpmessage_addcontent(response, (type != NULL)? type : "none", NULL,
+					(length <= INT_MAX)? (int)length : -1);
+		return ESUCCESS;
+	}
+	if (length >= 0)
+	{
+		/**
+		 * the output already read is the beginning of the content,
+		 * the rest is spliced by the kernel from the pipe.
+		 */
+		int rest = creq->length - creq->offset;
+		if (rest > length)
+			rest = length;
+		/**
+		 * the output already read may be larger than the content
+		 * buffer of the response
+		 */
+		char *data = NULL;
+		if (rest > 0)
+			data = httpmessage_reservecontent(response, (type != NULL)? type : "none", rest);
+		if (data != NULL)
+			memcpy(data, creq->buffer + creq->offset, rest);
+		else if (rest > 0)
+			return EREJECT;
+		else
+			httpmessage_addcontent(response, (type != NULL)? type : "none", creq->buffer + creq->offset, 0);
+		if (length > rest)
+		{
+			if (httpmessage_addfile(response, creq->output, (unsigned long long)-1, length - rest) != ESUCCESS)
+				return EREJECT;
+			creq->output = -1;
+		}
+		return ESUCCESS;
+	}
+	httpmessage_addcontent(response, (type != NULL)? type : "none", NULL, -1);
+	/**
+	 * the content of an error must not be replaced by the status
+	 */
+	if (status >= 300)
+		httpmessage_appendcontent(response, "", 0);
+	return ECONTINUE;
+}
+
+/**
+ * @brief append the next part of the output to the response
+ *
+ * @return ECONTINUE, ESUCCESS at the end of the output, ESOURCE while
+ * the output is empty or EREJECT
+ */
+static int _cgi_content(cgi_request_t *creq, http_message_t *response)
+{
+	int space = httpmessage_appendcontent(response, NULL, 0);
+	if (space <= 0)
+		return ECONTINUE;
+	if (creq->offset == creq->length && !creq->eof)
+	{
+		int ret = _cgi_read(creq);
+		if (ret == EREJECT)
+			return EREJECT;
+		if (ret == EINCOMPLETE)
+			return _cgi_wait(creq, response);
+	}
+	int length = creq->length - creq->offset;
+	if (length > space)
+		length = space;
+	if (length > 0)
+	{
+		if (httpmessage_appendcontent(response, creq->buffer + creq->offset, length) == EREJECT)
+			return EREJECT;
+		creq->offset += length;
+	}
+	if (creq->offset == creq->length && creq->eof)
+		return ESUCCESS;
+	return ECONTINUE;
+}
+
+static cgi_request_t *_cgi_open(cgi_client_t *client, http_message_t *request)
+{
+	cgi_t *cgi = client->cgi;
+	const char *uri = httpmessage_REQUEST(request, "uri");
+	char path[PATH_MAX];
+	/**
+	 * the URI must stay into the directory of the scripts
+	 */
+	if (strstr(uri, "..") != NULL ||
+		snprintf(path, sizeof(path), "%s%s%s", cgi->config.docroot, (uri[0] != '/')? "/" : "", uri) >= (int)sizeof(path))
+		return NULL;
+	int script = _cgi_script(cgi, path);
+	if (script == EREJECT)
+		return NULL;
+
+	cgi_request_t *creq = calloc(1, sizeof(*creq));
+	if (creq == NULL)
+		return NULL;
+	creq->client = client;
+	creq->input = -1;
+	creq->output = -1;
+	const char *type = httpmessage_header_id(request, HDR_CONTENT_TYPE);
+	creq->form = (type != NULL && !strncasecmp(type, str_form_urlencoded, strlen(str_form_urlencoded)));
+	creq->next = client->requests;
+	client->requests = creq;
+	_cgi_environment(creq, request, path, script);
+	return creq;
+}
+
+/**
+ * @brief free the request and close the pipes of the script
+ *
+ * A script that stops to answer is killed with its own children, the
+ * others receive the end of their pipes.
+ */
+static void _cgi_release(cgi_request_t *creq)
+{
+	cgi_client_t *client = creq->client;
+	cgi_request_t **it = &client->requests;
+	while (*it != NULL && *it != creq)
+		it = &(*it)->next;
+	if (*it != NULL)
+		*it = creq->next;
+	if (creq->input != -1)
+		close(creq->input);
+	if (creq->output != -1)
+		close(creq->output);
+	if (creq->timeout && creq->pid > 0)
+		kill(-creq->pid, SIGKILL);
+	free(creq);
+}
+
+static int _cgi_connector(void *arg, http_message_t *request, http_message_t *response)
+{
+	cgi_client_t *client = (cgi_client_t *)arg;
+	cgi_t *cgi = client->cgi;
+	cgi_request_t *creq = httpmessage_private(response, NULL);
+	if (creq == NULL)
+	{
+		const char *uri = httpmessage_REQUEST(request, "uri");
+		if (uri == NULL || (cgi->config.prefix != NULL &&
+			strncmp(uri, cgi->config.prefix, cgi->prefixlength)))
+			return EREJECT;
+		creq = _cgi_open(client, request);
+		if (creq == NULL)
+			return EREJECT;
+		creq->pid = _cgi_spawn(cgi, creq);
+		if (creq->pid == EREJECT)
+		{
+			_cgi_release(creq);
+			httpmessage_result(response, RESULT_502);
+			return ESUCCESS;
+		}
+		cgi_dbg("cgi: script %s started %d", creq->buffer, creq->pid);
+		httpmessage_private(response, creq);
+	}
+
+	int ret = EREJECT;
+	switch (creq->state)
+	{
+	case CGI_STDIN:
+		ret = _cgi_body(creq, request);
+		if (ret != ESUCCESS)
+			break;
+		creq->state = CGI_HEADER;
+		creq->deadline = _cgi_now() + cgi->config.timeout;
+	/* fallthrough */
+	case CGI_HEADER:
+		ret = _cgi_header(creq, request, response);
+		if (ret == ECONTINUE)
+			creq->state = CGI_CONTENT;
+		else if (ret == ESUCCESS)
+			_cgi_release(creq);
+	break;
+	case CGI_CONTENT:
+		ret = _cgi_content(creq, response);
+		if (ret == ESUCCESS)
+			_cgi_release(creq);
+		else if (ret == EREJECT)
+		{
+			/**
+			 * the header is already sent, the client must detect the error
+			 * with the end of the connection.
+			 */
+			close(creq->output);
+			creq->output = -1;
+			creq->state = CGI_ABORTED;
+			httpclient_shutdown(httpmessage_client(request));
+		}
+	break;
+	case CGI_ABORTED:
+	break;
+	}
+	if (ret == EREJECT && creq->state != CGI_CONTENT && creq->state != CGI_ABORTED)
+	{
+		/**
+		 * the script failed before the response
+		 */
+		httpmessage_result(response, creq->timeout? RESULT_504 : RESULT_502);
+		_cgi_release(creq);
+		ret = ESUCCESS;
+	}
+	else if (ret == EREJECT)
+		ret = ECONTINUE;
+	return ret;
+}
+
+static void *_cgi_getctx(void *arg, http_client_t *clt, struct sockaddr *addr, int addrsize)
+{
+	cgi_client_t *client = calloc(1, sizeof(*client));
+	if (client == NULL)
+		return NULL;
+	client->cgi = (cgi_t *)arg;
+	httpclient_addconnector(clt, _cgi_connector, client, CONNECTOR_DOCUMENT, "cgi");
+	return client;
+}
+
+static void _cgi_freectx(void *arg)
+{
+	cgi_client_t *client = (cgi_client_t *)arg;
+	/**
+	 * the requests still there are not complete
+	 */
+	while (client->requests != NULL)
+		_cgi_release(client->requests);
+	free(client);
+}
+
+cgi_t *cgi_create(http_server_t *server, const cgi_config_t *config)
+{
+	if (config == NULL || config->docroot == NULL)
+		return NULL;
+	cgi_t *cgi = calloc(1, sizeof(*cgi));
+	if (cgi == NULL)
+		return NULL;
+	cgi->config = *config;
+	if (cgi->config.timeout <= 0)
+		cgi->config.timeout = CGI_TIMEOUT;
+	if (cgi->config.prefix != NULL)
+		cgi->prefixlength = strlen(cgi->config.prefix);
+
+	int channel[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, channel) < 0)
+	{
+		err("cgi: channel error %s", strerror(errno));
+		free(cgi);
+		return NULL;
+	}
+	cgi->forkserver = fork();
+	if (cgi->forkserver == 0)
+	{
+		close(channel[0]);
+		_cgi_forkserver(channel[1]);
+	}
+	close(channel[1]);
+	if (cgi->forkserver < 0)
+	{
+		err("cgi: fork server error %s", strerror(errno));
+		close(channel[0]);
+		free(cgi);
+		return NULL;
+	}
+	cgi->channel = channel[0];
+	/**
+	 * the write on the input of a script which exited must not stop
+	 * the server.
+	 */
+	signal(SIGPIPE, SIG_IGN);
+	httpserver_addmod(server, _cgi_getctx, _cgi_freectx, cgi, "cgi");
+	return cgi;
+}
+
+void cgi_destroy(cgi_t *cgi)
+{
+	/**
+	 * the fork server exits at the end of its channel
+	 */
+	close(cgi->channel);
+	waitpid(cgi->forkserver, NULL, 0);
+	free(cgi);
+}
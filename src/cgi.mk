@@ -0,0 +1,8 @@
+lib-$(SHARED)+=ouicgi
+slib-$(STATIC)+=ouicgi
+ouicgi_SOURCES=cgi.c
+ouicgi_CFLAGS+=-I../include/ouistiti
+ouicgi_LIBS+=ouiutils
+ouicgi_PKGCONFIG:=ouistiti
+
+ouicgi_CFLAGS-$(DEBUG)+=-g -DDEBUG
@@ -0,0 +1,1430 @@
+/*****************************************************************************
+ * fastcgi.c: FastCGI client connector
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#ifdef USE_PTHREAD
+# include <pthread.h>
+#endif
+
+#include "log.h"
+#include "httpserver.h"
+#include "utils.h"
+#include "fastcgi.h"
+
+#ifndef VTHREAD
+# error "the connector waits its backends inside the client, it needs VTHREAD"
+#endif
+
+#define fastcgi_dbg(...)
+
+/**
+ * the buffers receive the records of a connection and the STDOUT of
+ * a request, they are also the limit of the CGI headers.
+ */
+#ifndef FASTCGI_BUFFERSIZE
+#define FASTCGI_BUFFERSIZE 16384
+#endif
+/**
+ * the backends already tried by a request are stored into a bit field
+ */
+#define FASTCGI_MAXBACKENDS 32
+
+/**
+ * the records of the protocol, see the FastCGI specification
+ */
+#define FCGI_VERSION_1 1
+#define FCGI_HEADERLENGTH 8
+#define FCGI_MAXCONTENT 65535
+#define FCGI_BEGIN_REQUEST 1
+#define FCGI_ABORT_REQUEST 2
+#define FCGI_END_REQUEST 3
+#define FCGI_PARAMS 4
+#define FCGI_STDIN 5
+#define FCGI_STDOUT 6
+#define FCGI_STDERR 7
+#define FCGI_GET_VALUES 9
+#define FCGI_GET_VALUES_RESULT 10
+#define FCGI_RESPONDER 1
+#define FCGI_KEEP_CONN 1
+#define FCGI_REQUEST_COMPLETE 0
+#define FCGI_OVERLOADED 2
+
+typedef struct fastcgi_client_s fastcgi_client_t;
+typedef struct fastcgi_request_s fastcgi_request_t;
+typedef struct fastcgi_conn_s fastcgi_conn_t;
+typedef struct fastcgi_backend_s fastcgi_backend_t;
+
+struct fastcgi_conn_s
+{
+	fastcgi_backend_t *backend;
+	int sock;
+	int broken; /* the connection is closed or out of the protocol */
+	int maxrequests; /* requests multiplexed on the connection */
+	int nrequests; /* requests in progress, the aborted requests too */
+	int reading; /* a request waits the socket for all the others */
+	fastcgi_request_t *requests[FASTCGI_MAXREQUESTS + 1]; /* by request id */
+	char aborted[FASTCGI_MAXREQUESTS + 1]; /* the id waits the end of an aborted request */
+	time_t since; /* end of the last request */
+	/**
+	 * the record in progress
+	 */
+	int inrecord;
+	int type;
+	int id;
+	int rest; /* the content not yet received */
+	int padding;
+	unsigned char body[256]; /* the content of the management records */
+	int bodylength;
+	int mpxs; /* FCGI_GET_VALUES_RESULT */
+	int maxreqs;
+	int values;
+	int inoffset;
+	int inlength;
+	char in[FASTCGI_BUFFERSIZE];
+	fastcgi_conn_t *next;
+};
+
+struct fastcgi_backend_s
+{
+	const char *name;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	fastcgi_conn_t *conns; /* connections of the process */
+};
+
+struct fastcgi_s
+{
+	fastcgi_config_t config;
+	int prefixlength;
+	fastcgi_backend_t *backends;
+	int nbackends;
+	unsigned int next; /* first backend checked by the balancing */
+#ifdef USE_PTHREAD
+	pthread_mutex_t mutex;
+	pthread_cond_t cond; /* the connections changed for the waiting requests */
+#endif
+};
+
+typedef enum
+{
+	FASTCGI_STDIN,
+	FASTCGI_HEADER,
+	FASTCGI_CONTENT,
+	FASTCGI_ABORTED,
+} _fastcgi_state_e;
+
+struct fastcgi_request_s
+{
+	fastcgi_client_t *client;
+	fastcgi_backend_t *backend;
+	fastcgi_conn_t *conn; /* NULL after the end of the request */
+	unsigned int tried;
+	int id;
+	_fastcgi_state_e state;
+	int reused; /* the connection comes from the pool */
+	int form; /* the content is stored with the query */
+	int ended; /* FCGI_END_REQUEST is received */
+	int protocolstatus;
+	int timeout; /* the backend did not answer */
+	int outoffset; /* the beginning of the STDOUT data not yet used */
+	int outlength;
+	char out[FASTCGI_BUFFERSIZE];
+	fastcgi_request_t *next;
+};
+
+struct fastcgi_client_s
+{
+	fastcgi_t *fastcgi;
+	fastcgi_request_t *requests;
+};
+
+static const fastcgi_config_t _fastcgi_defaultconfig =
+{
+	.poolsize = FASTCGI_POOLSIZE,
+	.timeout = FASTCGI_TIMEOUT,
+	.idletime = FASTCGI_IDLETIME,
+	.maxrequests = 1,
+};
+
+static void _fastcgi_lock(fastcgi_t *fastcgi)
+{
+#ifdef USE_PTHREAD
+	pthread_mutex_lock(&fastcgi->mutex);
+#endif
+}
+
+static void _fastcgi_unlock(fastcgi_t *fastcgi)
+{
+#ifdef USE_PTHREAD
+	pthread_mutex_unlock(&fastcgi->mutex);
+#endif
+}
+
+/**
+ * @brief wake the requests waiting the other requests of their connection
+ */
+static void _fastcgi_signal(fastcgi_t *fastcgi)
+{
+#ifdef USE_PTHREAD
+	pthread_cond_broadcast(&fastcgi->cond);
+#endif
+}
+
+/**
+ * @brief wait a change of the connections with the lock
+ *
+ * @return ESUCCESS or EREJECT after the deadline
+ */
+static int _fastcgi_condwait(fastcgi_t *fastcgi, const struct timespec *deadline)
+{
+#ifdef USE_PTHREAD
+	if (pthread_cond_timedwait(&fastcgi->cond, &fastcgi->mutex, deadline) == ETIMEDOUT)
+		return EREJECT;
+	return ESUCCESS;
+#else
+	/**
+	 * without thread, the other requests cannot run during the wait
+	 */
+	return EREJECT;
+#endif
+}
+
+/**
+ * @return the milliseconds until the deadline
+ */
+static int _fastcgi_remaining(const struct timespec *deadline)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long long remaining = (deadline->tv_sec - now.tv_sec) * 1000LL +
+				(deadline->tv_nsec - now.tv_nsec) / 1000000;
+	return (remaining > 0)? (int)remaining : 0;
+}
+
+/**
+ * @brief send a record on the connection
+ *
+ * The record is sent completely, the other requests of the connection
+ * must wait with the lock.
+ */
+static int _fastcgi_record(fastcgi_t *fastcgi, fastcgi_conn_t *conn, int type, int id, const char *data, int length)
+{
+	static const char padding[8] = {0};
+	unsigned char header[FCGI_HEADERLENGTH] =
+	{
+		FCGI_VERSION_1, type, (id >> 8) & 0xFF, id & 0xFF,
+		(length >> 8) & 0xFF, length & 0xFF, (8 - (length & 7)) & 7, 0
+	};
+	struct iovec iov[3] =
+	{
+		{.iov_base = header, .iov_len = sizeof(header)},
+		{.iov_base = (void *)data, .iov_len = length},
+		{.iov_base = (void *)padding, .iov_len = header[6]},
+	};
+	struct iovec *it = iov;
+	int iovcnt = 3;
+	if (conn->broken)
+		return EREJECT;
+	while (iovcnt > 0)
+	{
+		struct msghdr msg = {.msg_iov = it, .msg_iovlen = iovcnt};
+		ssize_t ret = sendmsg(conn->sock, &msg, MSG_NOSIGNAL);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			struct pollfd pfd = {.fd = conn->sock, .events = POLLOUT};
+			if (poll(&pfd, 1, fastcgi->config.timeout) <= 0)
+				break;
+			continue;
+		}
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+			break;
+		while (iovcnt > 0 && (size_t)ret >= it->iov_len)
+		{
+			ret -= it->iov_len;
+			it++;
+			iovcnt--;
+		}
+		if (iovcnt > 0)
+		{
+			it->iov_base = (char *)it->iov_base + ret;
+			it->iov_len -= ret;
+		}
+	}
+	if (iovcnt > 0)
+	{
+		err("fastcgi: %s send error %s", conn->backend->name, strerror(errno));
+		conn->broken = 1;
+		return EREJECT;
+	}
+	return ESUCCESS;
+}
+
+/**
+ * @brief encode the length of a name or a value of the parameters
+ */
+static int _fastcgi_pairlength(unsigned char *it, int length)
+{
+	if (length < 128)
+	{
+		it[0] = length;
+		return 1;
+	}
+	it[0] = ((length >> 24) & 0x7F) | 0x80;
+	it[1] = (length >> 16) & 0xFF;
+	it[2] = (length >> 8) & 0xFF;
+	it[3] = length & 0xFF;
+	return 4;
+}
+
+/**
+ * @brief decode the length of a name or a value of the parameters
+ *
+ * @return the number of bytes of the length or 0 at the end of the data
+ */
+static int _fastcgi_pairdecode(const unsigned char *it, int size, int *length)
+{
+	if (size < 1)
+		return 0;
+	if (!(it[0] & 0x80))
+	{
+		*length = it[0];
+		return 1;
+	}
+	if (size < 4)
+		return 0;
+	*length = ((it[0] & 0x7F) << 24) | (it[1] << 16) | (it[2] << 8) | it[3];
+	return 4;
+}
+
+/**
+ * @brief read the FCGI_GET_VALUES_RESULT of the connection
+ */
+static void _fastcgi_values(fastcgi_conn_t *conn)
+{
+	const unsigned char *it = conn->body;
+	int size = conn->bodylength;
+	while (size > 0)
+	{
+		int namelength = 0;
+		int valuelength = 0;
+		int first = _fastcgi_pairdecode(it, size, &namelength);
+		int second = (first > 0)? _fastcgi_pairdecode(it + first, size - first, &valuelength) : 0;
+		if (second == 0 || first + second + namelength + valuelength > size)
+			break;
+		const char *name = (const char *)it + first + second;
+		char value[12] = {0};
+		if (valuelength < (int)sizeof(value))
+			memcpy(value, name + namelength, valuelength);
+		if (namelength == 15 && !strncmp(name, "FCGI_MPXS_CONNS", namelength))
+			conn->mpxs = atoi(value);
+		else if (namelength == 13 && !strncmp(name, "FCGI_MAX_REQS", namelength))
+			conn->maxreqs = atoi(value);
+		it += first + second + namelength + valuelength;
+		size -= first + second + namelength + valuelength;
+	}
+	conn->values = 1;
+}
+
+/**
+ * @brief the record is complete, the management records are used now
+ */
+static void _fastcgi_endrecord(fastcgi_conn_t *conn)
+{
+	if (conn->type == FCGI_GET_VALUES_RESULT)
+		_fastcgi_values(conn);
+	else if (conn->type == FCGI_END_REQUEST && conn->id > 0 && conn->id <= conn->maxrequests)
+	{
+		fastcgi_request_t *freq = conn->requests[conn->id];
+		if (freq != NULL)
+		{
+			freq->ended = 1;
+			freq->protocolstatus = (conn->bodylength > 4)? conn->body[4] : FCGI_REQUEST_COMPLETE;
+			freq->conn = NULL;
+			conn->requests[conn->id] = NULL;
+			conn->nrequests--;
+		}
+		else if (conn->aborted[conn->id])
+		{
+			conn->aborted[conn->id] = 0;
+			conn->nrequests--;
+		}
+		conn->since = time(NULL);
+	}
+	conn->inrecord = 0;
+}
+
+/**
+ * @brief give the data of the records to their requests
+ *
+ * The dispatching stops when the STDOUT buffer of a request is full,
+ * this request must use its data before.
+ */
+static void _fastcgi_dispatch(fastcgi_conn_t *conn)
+{
+	while (1)
+	{
+		if (conn->inrecord && conn->rest == 0 && conn->padding == 0)
+			_fastcgi_endrecord(conn);
+		unsigned char *data = (unsigned char *)conn->in + conn->inoffset;
+		int length = conn->inlength - conn->inoffset;
+		if (length == 0)
+			break;
+		if (!conn->inrecord)
+		{
+			if (length < FCGI_HEADERLENGTH)
+				break;
+			if (data[0] != FCGI_VERSION_1)
+			{
+				err("fastcgi: %s bad record", conn->backend->name);
+				conn->broken = 1;
+				break;
+			}
+			conn->type = data[1];
+			conn->id = (data[2] << 8) | data[3];
+			conn->rest = (data[4] << 8) | data[5];
+			conn->padding = data[6];
+			conn->bodylength = 0;
+			conn->inrecord = 1;
+			conn->inoffset += FCGI_HEADERLENGTH;
+		}
+		else if (conn->rest > 0)
+		{
+			int size = (length < conn->rest)? length : conn->rest;
+			fastcgi_request_t *freq = NULL;
+			if (conn->id > 0 && conn->id <= conn->maxrequests)
+				freq = conn->requests[conn->id];
+			if (conn->type == FCGI_STDOUT && freq != NULL)
+			{
+				if (freq->outoffset > 0 && freq->outlength + size > (int)sizeof(freq->out))
+				{
+					memmove(freq->out, freq->out + freq->outoffset, freq->outlength - freq->outoffset);
+					freq->outlength -= freq->outoffset;
+					freq->outoffset = 0;
+				}
+				if (size > (int)sizeof(freq->out) - freq->outlength)
+					size = sizeof(freq->out) - freq->outlength;
+				if (size == 0)
+					break;
+				memcpy(freq->out + freq->outlength, data, size);
+				freq->outlength += size;
+			}
+			else if (conn->type == FCGI_STDERR)
+				warn("fastcgi: %s %.*s", conn->backend->name, size, data);
+			else if (conn->bodylength < (int)sizeof(conn->body))
+			{
+				int copy = sizeof(conn->body) - conn->bodylength;
+				if (copy > size)
+					copy = size;
+				memcpy(conn->body + conn->bodylength, data, copy);
+				conn->bodylength += copy;
+			}
+			conn->inoffset += size;
+			conn->rest -= size;
+		}
+		else
+		{
+			int size = (length < conn->padding)? length : conn->padding;
+			conn->inoffset += size;
+			conn->padding -= size;
+		}
+	}
+}
+
+/**
+ * @brief read the connection and dispatch its records
+ *
+ * @return the length of the new data, 0 if the backend closed the
+ * connection, EINCOMPLETE without data, ECONTINUE if a request must
+ * use its data before or EREJECT on error
+ */
+static int _fastcgi_receive(fastcgi_conn_t *conn)
+{
+	_fastcgi_dispatch(conn);
+	if (conn->broken)
+		return 0;
+	if (conn->inoffset > 0)
+	{
+		memmove(conn->in, conn->in + conn->inoffset, conn->inlength - conn->inoffset);
+		conn->inlength -= conn->inoffset;
+		conn->inoffset = 0;
+	}
+	if (conn->inlength == sizeof(conn->in))
+		return ECONTINUE;
+	ssize_t ret;
+	do
+	{
+		ret = recv(conn->sock, conn->in + conn->inlength, sizeof(conn->in) - conn->inlength, MSG_DONTWAIT);
+	} while (ret < 0 && errno == EINTR);
+	if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return EINCOMPLETE;
+	if (ret <= 0)
+	{
+		if (ret < 0)
+			err("fastcgi: %s receive error %s", conn->backend->name, strerror(errno));
+		conn->broken = 1;
+		return (ret < 0)? EREJECT : 0;
+	}
+	conn->inlength += ret;
+	_fastcgi_dispatch(conn);
+	return ret;
+}
+
+/**
+ * @brief wait the next data of the backend for the request
+ *
+ * One request at a time waits the socket of a connection and
+ * dispatches the records of all its requests, the other requests wait
+ * on the condition. When the STDOUT buffer of another request is full,
+ * the request waits that this request uses its data.
+ *
+ * @return ESUCCESS with new data or at the end of the request,
+ * EREJECT on error or timeout
+ */
+static int _fastcgi_wait(fastcgi_request_t *freq)
+{
+	fastcgi_t *fastcgi = freq->client->fastcgi;
+	struct timespec deadline;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec += fastcgi->config.timeout / 1000;
+	deadline.tv_nsec += (fastcgi->config.timeout % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	int ret = ESUCCESS;
+	_fastcgi_lock(fastcgi);
+	int outlength = freq->outlength - freq->outoffset;
+	while (!freq->ended && (freq->outlength - freq->outoffset) == outlength)
+	{
+		fastcgi_conn_t *conn = freq->conn;
+		int received = 0;
+		if (conn != NULL)
+			received = (conn->reading)? EINCOMPLETE : _fastcgi_receive(conn);
+		if (received > 0)
+		{
+			/**
+			 * the records may be for the other requests
+			 */
+			_fastcgi_signal(fastcgi);
+			continue;
+		}
+		if (received == 0 || received == EREJECT)
+		{
+			err("fastcgi: %s closed the connection", freq->backend->name);
+			ret = EREJECT;
+			break;
+		}
+		int remaining = _fastcgi_remaining(&deadline);
+		if (remaining > 0 && received == EINCOMPLETE && !conn->reading)
+		{
+			/**
+			 * the connection stays with the request until its end
+			 */
+			int sock = conn->sock;
+			conn->reading = 1;
+			_fastcgi_unlock(fastcgi);
+			struct pollfd pfd = {.fd = sock, .events = POLLIN};
+			poll(&pfd, 1, remaining);
+			_fastcgi_lock(fastcgi);
+			conn->reading = 0;
+			_fastcgi_signal(fastcgi);
+			continue;
+		}
+		if (remaining == 0 || _fastcgi_condwait(fastcgi, &deadline) != ESUCCESS)
+		{
+			err("fastcgi: %s timeout", freq->backend->name);
+			freq->timeout = 1;
+			ret = EREJECT;
+			break;
+		}
+	}
+	_fastcgi_unlock(fastcgi);
+	return ret;
+}
+
+/**
+ * @brief close a connection without request
+ */
+static void _fastcgi_close(fastcgi_conn_t *conn)
+{
+	fastcgi_dbg("fastcgi: close connection to %s", conn->backend->name);
+	close(conn->sock);
+	free(conn);
+}
+
+/**
+ * @brief remove the broken and the expired connections of the backend
+ *
+ * The pool keeps poolsize connections without request, the most recent
+ * ones.
+ */
+static void _fastcgi_collect(fastcgi_t *fastcgi, fastcgi_backend_t *backend)
+{
+	time_t now = time(NULL);
+	int idle = 0;
+	fastcgi_conn_t **it = &backend->conns;
+	while (*it != NULL)
+	{
+		fastcgi_conn_t *conn = *it;
+		if (conn->nrequests == 0 && !conn->broken)
+		{
+			/**
+			 * the backend may close the connection during the idle time,
+			 * an alive connection has nothing to read.
+			 */
+			char c;
+			if (now - conn->since >= fastcgi->config.idletime || idle >= fastcgi->config.poolsize ||
+				recv(conn->sock, &c, 1, MSG_PEEK | MSG_DONTWAIT) >= 0 ||
+				(errno != EAGAIN && errno != EWOULDBLOCK))
+				conn->broken = 1;
+			else
+				idle++;
+		}
+		if (conn->nrequests == 0 && conn->broken)
+		{
+			*it = conn->next;
+			_fastcgi_close(conn);
+		}
+		else
+			it = &conn->next;
+	}
+}
+
+/**
+ * @brief open a new connection to the backend
+ *
+ * The socket is not blocking, the connection waits the timeout at most.
+ * With multiplexing, the backend gives its limits before the first
+ * request.
+ */
+static fastcgi_conn_t *_fastcgi_connect(fastcgi_t *fastcgi, fastcgi_backend_t *backend)
+{
+	int sock = socket(backend->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return NULL;
+	int ret = connect(sock, (struct sockaddr *)&backend->addr, backend->addrlen);
+	if (ret < 0 && errno == EINPROGRESS)
+	{
+		struct pollfd pfd = {.fd = sock, .events = POLLOUT};
+		int error = ETIMEDOUT;
+		socklen_t length = sizeof(error);
+		if (poll(&pfd, 1, fastcgi->config.timeout) > 0)
+			getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length);
+		ret = (error == 0)? 0 : -1;
+		errno = error;
+	}
+	if (ret < 0)
+	{
+		err("fastcgi: connection to %s %s", backend->name, strerror(errno));
+		close(sock);
+		return NULL;
+	}
+	if (backend->addr.ss_family != AF_UNIX)
+	{
+		int nodelay = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	}
+	fastcgi_conn_t *conn = calloc(1, sizeof(*conn));
+	if (conn == NULL)
+	{
+		close(sock);
+		return NULL;
+	}
+	conn->backend = backend;
+	conn->sock = sock;
+	conn->maxrequests = 1;
+	conn->since = time(NULL);
+	if (fastcgi->config.maxrequests > 1)
+	{
+		static const char values[] =
+			"\x0f\x00" "FCGI_MPXS_CONNS"
+			"\x0d\x00" "FCGI_MAX_REQS";
+		ret = _fastcgi_record(fastcgi, conn, FCGI_GET_VALUES, 0, values, sizeof(values) - 1);
+		while (ret == ESUCCESS && !conn->values)
+		{
+			ret = _fastcgi_receive(conn);
+			struct pollfd pfd = {.fd = sock, .events = POLLIN};
+			if (ret == EINCOMPLETE && poll(&pfd, 1, fastcgi->config.timeout) > 0)
+				ret = ESUCCESS;
+			else if (ret > 0)
+				ret = ESUCCESS;
+		}
+		if (!conn->values)
+		{
+			warn("fastcgi: %s does not give its values", backend->name);
+			_fastcgi_close(conn);
+			return NULL;
+		}
+		if (conn->mpxs)
+		{
+			conn->maxrequests = fastcgi->config.maxrequests;
+			if (conn->maxreqs > 0 && conn->maxreqs < conn->maxrequests)
+				conn->maxrequests = conn->maxreqs;
+		}
+	}
+	fastcgi_dbg("fastcgi: new connection to %s for %d requests", backend->name, conn->maxrequests);
+	return conn;
+}
+
+/**
+ * @brief select the backend with the least requests in progress
+ */
+static fastcgi_backend_t *_fastcgi_balance(fastcgi_t *fastcgi, unsigned int tried)
+{
+	fastcgi_backend_t *best = NULL;
+	int bestload = 0;
+	unsigned int start = fastcgi->next++;
+	int i;
+	for (i = 0; i < fastcgi->nbackends; i++)
+	{
+		int index = (start + i) % fastcgi->nbackends;
+		fastcgi_backend_t *backend = &fastcgi->backends[index];
+		if (tried & (1U << index))
+			continue;
+		int load = 0;
+		const fastcgi_conn_t *conn;
+		for (conn = backend->conns; conn != NULL; conn = conn->next)
+			load += conn->nrequests;
+		if (best == NULL || load < bestload)
+		{
+			best = backend;
+			bestload = load;
+		}
+	}
+	return best;
+}
+
+/**
+ * @brief check if a connection is free for the request
+ *
+ * The thread of a client serves its requests one after the other, two
+ * requests of the client on the same connection may wait each other.
+ */
+static int _fastcgi_available(const fastcgi_conn_t *conn, const fastcgi_request_t *freq)
+{
+	if (conn->broken || conn->nrequests >= conn->maxrequests)
+		return 0;
+	int id;
+	for (id = 1; id <= conn->maxrequests; id++)
+	{
+		if (conn->requests[id] != NULL && conn->requests[id]->client == freq->client)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief give an id of a connection to the request
+ *
+ * A connection of the pool is used first, otherwise a new connection
+ * is opened.
+ */
+static int _fastcgi_attach(fastcgi_request_t *freq, int reuse)
+{
+	fastcgi_t *fastcgi = freq->client->fastcgi;
+	fastcgi_backend_t *backend = freq->backend;
+	fastcgi_conn_t *conn = NULL;
+	_fastcgi_lock(fastcgi);
+	_fastcgi_collect(fastcgi, backend);
+	if (reuse)
+	{
+		for (conn = backend->conns; conn != NULL; conn = conn->next)
+		{
+			if (_fastcgi_available(conn, freq))
+				break;
+		}
+	}
+	_fastcgi_unlock(fastcgi);
+	freq->reused = (conn != NULL);
+	if (conn == NULL)
+	{
+		conn = _fastcgi_connect(fastcgi, backend);
+		if (conn == NULL)
+			return EREJECT;
+		_fastcgi_lock(fastcgi);
+		conn->next = backend->conns;
+		backend->conns = conn;
+	}
+	else
+		_fastcgi_lock(fastcgi);
+	int id;
+	for (id = 1; id <= conn->maxrequests; id++)
+	{
+		if (conn->requests[id] == NULL && !conn->aborted[id])
+			break;
+	}
+	conn->requests[id] = freq;
+	conn->nrequests++;
+	freq->conn = conn;
+	freq->id = id;
+	_fastcgi_unlock(fastcgi);
+	return ESUCCESS;
+}
+
+/**
+ * @brief stop the request on its connection
+ *
+ * A multiplexed connection continues with the other requests, the id
+ * is free after the end of the aborted request. Otherwise the
+ * connection is closed.
+ */
+static void _fastcgi_detach(fastcgi_request_t *freq)
+{
+	fastcgi_t *fastcgi = freq->client->fastcgi;
+	_fastcgi_lock(fastcgi);
+	fastcgi_conn_t *conn = freq->conn;
+	if (conn != NULL)
+	{
+		conn->requests[freq->id] = NULL;
+		if (conn->maxrequests > 1 &&
+			_fastcgi_record(fastcgi, conn, FCGI_ABORT_REQUEST, freq->id, NULL, 0) == ESUCCESS)
+			conn->aborted[freq->id] = 1;
+		else
+		{
+			conn->nrequests--;
+			conn->broken = 1;
+		}
+		freq->conn = NULL;
+	}
+	if (freq->backend != NULL)
+		_fastcgi_collect(fastcgi, freq->backend);
+	_fastcgi_unlock(fastcgi);
+	_fastcgi_signal(fastcgi);
+}
+
+/**
+ * @brief free the request, the connection returns into the pool
+ * after the end of the request
+ */
+static void _fastcgi_release(fastcgi_request_t *freq)
+{
+	fastcgi_client_t *client = freq->client;
+	fastcgi_request_t **it = &client->requests;
+	while (*it != NULL && *it != freq)
+		it = &(*it)->next;
+	if (*it != NULL)
+		*it = freq->next;
+	_fastcgi_detach(freq);
+	free(freq);
+}
+
+/**
+ * @brief send the STDOUT buffer of the request as a PARAMS record
+ *
+ * The buffer is free before the response.
+ */
+static int _fastcgi_flushparams(fastcgi_request_t *freq)
+{
+	fastcgi_t *fastcgi = freq->client->fastcgi;
+	int ret = ESUCCESS;
+	_fastcgi_lock(fastcgi);
+	if (freq->conn != NULL)
+		ret = _fastcgi_record(fastcgi, freq->conn, FCGI_PARAMS, freq->id, freq->out, freq->outlength);
+	else
+		ret = EREJECT;
+	_fastcgi_unlock(fastcgi);
+	freq->outlength = 0;
+	return ret;
+}
+
+static int _fastcgi_param(void *arg, const char *name, int namelength, const char *value)
+{
+	fastcgi_request_t *freq = (fastcgi_request_t *)arg;
+	if (value == NULL)
+		return ESUCCESS;
+	if (namelength < 0)
+		namelength = strlen(name);
+	int valuelength = strlen(value);
+	if (namelength + valuelength + 8 > (int)sizeof(freq->out))
+	{
+		warn("fastcgi: parameter %.*s dropped", namelength, name);
+		return ESUCCESS;
+	}
+	if (freq->outlength + namelength + valuelength + 8 > (int)sizeof(freq->out) &&
+		_fastcgi_flushparams(freq) != ESUCCESS)
+		return EREJECT;
+	unsigned char *it = (unsigned char *)freq->out + freq->outlength;
+	it += _fastcgi_pairlength(it, namelength);
+	it += _fastcgi_pairlength(it, valuelength);
+	memcpy(it, name, namelength);
+	it += namelength;
+	memcpy(it, value, valuelength);
+	it += valuelength;
+	freq->outlength = (char *)it - freq->out;
+	return ESUCCESS;
+}
+
+/**
+ * @brief send the environment of the CGI script
+ */
+static int _fastcgi_params(fastcgi_request_t *freq, http_message_t *request)
+{
+	fastcgi_t *fastcgi = freq->client->fastcgi;
+	const char *uri = httpmessage_REQUEST(request, "uri");
+	char path[PATH_MAX];
+	int ret = ESUCCESS;
+
+	freq->outlength = 0;
+	freq->outoffset = 0;
+	snprintf(path, sizeof(path), "%s%s", (uri[0] != '/')? "/" : "", uri);
+	ret |= _fastcgi_param(freq, "SCRIPT_NAME", -1, path);
+	if (fastcgi->config.script != NULL)
+		ret |= _fastcgi_param(freq, "SCRIPT_FILENAME", -1, fastcgi->config.script);
+	else if (fastcgi->config.docroot != NULL)
+	{
+		snprintf(path, sizeof(path), "%s%s%s", fastcgi->config.docroot, (uri[0] != '/')? "/" : "", uri);
+		ret |= _fastcgi_param(freq, "SCRIPT_FILENAME", -1, path);
+	}
+	ret |= _fastcgi_param(freq, "DOCUMENT_ROOT", -1, fastcgi->config.docroot);
+	ret |= utils_cgienv(request, _fastcgi_param, freq);
+	if (ret == ESUCCESS && freq->outlength > 0)
+		ret = _fastcgi_flushparams(freq);
+	if (ret == ESUCCESS)
+		ret = _fastcgi_flushparams(freq);
+	return (ret == ESUCCESS)? ESUCCESS : EREJECT;
+}
+
+/**
+ * @brief attach the request to a connection of its backend and send
+ * the beginning of the request
+ *
+ * A connection of the pool may be closed by the backend at the same
+ * time, the request is sent again on a new connection.
+ */
+static int _fastcgi_start(fastcgi_request_t *freq, http_message_t *request)
+{
+	fastcgi_t *fastcgi = freq->client->fastcgi;
+	int reuse;
+	for (reuse = 1; reuse >= 0; reuse--)
+	{
+		if (_fastcgi_attach(freq, reuse) != ESUCCESS)
+			return EREJECT;
+		unsigned char begin[8] = {0, FCGI_RESPONDER, (fastcgi->config.poolsize > 0)? FCGI_KEEP_CONN : 0};
+		_fastcgi_lock(fastcgi);
+		int ret = _fastcgi_record(fastcgi, freq->conn, FCGI_BEGIN_REQUEST, freq->id, (char *)begin, sizeof(begin));
+		_fastcgi_unlock(fastcgi);
+		if (ret == ESUCCESS)
+			ret = _fastcgi_params(freq, request);
+		if (ret == ESUCCESS)
+			return ESUCCESS;
+		_fastcgi_detach(freq);
+		if (!freq->reused)
+			break;
+	}
+	return EREJECT;
+}
+
+static fastcgi_request_t *_fastcgi_open(fastcgi_client_t *client, http_message_t *request)
+{
+	fastcgi_t *fastcgi = client->fastcgi;
+	fastcgi_request_t *freq = calloc(1, sizeof(*freq));
+	if (freq == NULL)
+		return NULL;
+	freq->client = client;
+	const char *type = httpmessage_header_id(request, HDR_CONTENT_TYPE);
+	freq->form = (type != NULL && !strncasecmp(type, str_form_urlencoded, strlen(str_form_urlencoded)));
+	freq->next = client->requests;
+	client->requests = freq;
+
+	int i;
+	for (i = 0; i < fastcgi->nbackends; i++)
+	{
+		_fastcgi_lock(fastcgi);
+		fastcgi_backend_t *backend = _fastcgi_balance(fastcgi, freq->tried);
+		_fastcgi_unlock(fastcgi);
+		if (backend == NULL)
+			break;
+		freq->tried |= 1U << (backend - fastcgi->backends);
+		freq->backend = backend;
+		if (_fastcgi_start(freq, request) == ESUCCESS)
+			return freq;
+	}
+	_fastcgi_release(freq);
+	return NULL;
+}
+
+static int _fastcgi_stdin(fastcgi_request_t *freq, const char *data, int length)
+{
+	fastcgi_t *fastcgi = freq->client->fastcgi;
+	int ret = ESUCCESS;
+	_fastcgi_lock(fastcgi);
+	do
+	{
+		int size = (length > FCGI_MAXCONTENT)? FCGI_MAXCONTENT : length;
+		if (freq->conn == NULL)
+			ret = EREJECT;
+		else
+			ret = _fastcgi_record(fastcgi, freq->conn, FCGI_STDIN, freq->id, data, size);
+		data += size;
+		length -= size;
+	} while (ret == ESUCCESS && length > 0);
+	_fastcgi_unlock(fastcgi);
+	return ret;
+}
+
+/**
+ * @brief send the next part of the request content into STDIN
+ *
+ * @return EINCOMPLETE while the content is received, ESUCCESS or EREJECT
+ */
+static int _fastcgi_body(fastcgi_request_t *freq, http_message_t *request)
+{
+	char *data = NULL;
+	unsigned long long rest = 0;
+	int size = httpmessage_content(request, &data, &rest);
+	if (freq->form && size > 0)
+	{
+		/**
+		 * the parser stores the form after the query
+		 */
+		const char *query = httpmessage_REQUEST(request, "query");
+		int skip = (query != NULL && query[0] != '\0')? strlen(query) + 1: 0;
+		data += skip;
+		size -= (size > skip)? skip : size;
+		rest = 0;
+	}
+	if (size > 0 && _fastcgi_stdin(freq, data, size) != ESUCCESS)
+		return EREJECT;
+	if (size == EINCOMPLETE || rest > 0)
+		return EINCOMPLETE;
+	/**
+	 * the empty record is the end of STDIN
+	 */
+	return _fastcgi_stdin(freq, NULL, 0);
+}
+
+/**
+ * @brief find the empty line at the end of the CGI headers
+ */
+static char *_fastcgi_headerend(fastcgi_request_t *freq, char **body)
+{
+	char *it = freq->out + freq->outoffset;
+	char *end = freq->out + freq->outlength;
+	while ((it = memchr(it, '\n', end - it)) != NULL)
+	{
+		it++;
+		if (it < end && *it == '\n')
+		{
+			*body = it + 1;
+			return it;
+		}
+		if (it + 1 < end && it[0] == '\r' && it[1] == '\n')
+		{
+			*body = it + 2;
+			return it;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief read the CGI headers of the STDOUT and set the response
+ *
+ * @return ECONTINUE if the response has a content, ESUCCESS without
+ * content or EREJECT on error
+ */
+static int _fastcgi_header(fastcgi_request_t *freq, http_message_t *request, http_message_t *response)
+{
+	char *end;
+	char *body = NULL;
+	while ((end = _fastcgi_headerend(freq, &body)) == NULL)
+	{
+		if (freq->ended || freq->outlength == sizeof(freq->out))
+		{
+			err("fastcgi: bad response from %s", freq->backend->name);
+			return EREJECT;
+		}
+		if (_fastcgi_wait(freq) != ESUCCESS)
+			return EREJECT;
+	}
+	*end = '\0';
+
+	int status = 0;
+	const char *type = NULL;
+	const char *location = NULL;
+	long long length = -1;
+	char *line = freq->out + freq->outoffset;
+	while (line != NULL && *line != '\0')
+	{
+		char *next = strchr(line, '\n');
+		if (next != NULL)
+		{
+			*next = '\0';
+			if (next > line && next[-1] == '\r')
+				next[-1] = '\0';
+			next++;
+		}
+		char *value = strchr(line, ':');
+		if (value != NULL)
+		{
+			*value++ = '\0';
+			while (*value == ' ' || *value == '\t')
+				value++;
+			if (!strcasecmp(line, "Status"))
+				status = atoi(value);
+			else if (!strcasecmp(line, "Content-Type"))
+				type = value;
+			else if (!strcasecmp(line, "Content-Length"))
+				length = strtoll(value, NULL, 10);
+			else if (!strcasecmp(line, "Connection") || !strcasecmp(line, "Keep-Alive") ||
+					!strcasecmp(line, "Transfer-Encoding"))
+				continue;
+			else
+			{
+				if (!strcasecmp(line, "Location"))
+					location = value;
+				httpmessage_addheader(response, line, value);
+			}
+		}
+		line = next;
+	}
+	_fastcgi_lock(freq->client->fastcgi);
+	freq->outoffset = body - freq->out;
+	_fastcgi_unlock(freq->client->fastcgi);
+	_fastcgi_signal(freq->client->fastcgi);
+	if (status == 0)
+		status = (location != NULL)? RESULT_302 : RESULT_200;
+	httpmessage_result(response, status);
+
+	/**
+	 * the length is known if the backend sent the whole response
+	 */
+	if (length < 0 && freq->ended)
+		length = freq->outlength - freq->outoffset;
+	const char *method = httpmessage_REQUEST(request, "method");
+	if (!strcmp(method, str_head) || status == 204 || status == 304)
+	{
+		if (length >= 0 && status != 204 && status != 304)
+			httpmessage_addcontent(response, (type != NULL)? type : "none", NULL,
+					(length <= INT_MAX)? (int)length : -1);
+		return ESUCCESS;
+	}
+	httpmessage_addcontent(response, (type != NULL)? type : "none", NULL,
+			(length >= 0 && length <= INT_MAX)? (int)length : -1);
+	if (length == 0)
+		return ESUCCESS;
+	/**
+	 * the content of an error must not be replaced by the status
+	 */
+	if (status >= 300)
+		httpmessage_appendcontent(response, "", 0);
+	return ECONTINUE;
+}
+
+/**
+ * @brief append the next part of the STDOUT to the response
+ *
+ * @return ECONTINUE, ESUCCESS at the end of the request or EREJECT
+ */
+static int _fastcgi_content(fastcgi_request_t *freq, http_message_t *response)
+{
+	fastcgi_t *fastcgi = freq->client->fastcgi;
+	/**
+	 * the data is read when the content has been sent
+	 */
+	int space = httpmessage_appendcontent(response, NULL, 0);
+	if (space <= 0)
+		return ECONTINUE;
+	if (freq->outoffset == freq->outlength && !freq->ended)
+	{
+		if (_fastcgi_wait(freq) != ESUCCESS)
+			return EREJECT;
+	}
+	/**
+	 * the thread of another request may dispatch into the buffer
+	 */
+	_fastcgi_lock(fastcgi);
+	int length = freq->outlength - freq->outoffset;
+	if (length > space)
+		length = space;
+	if (length > 0 && httpmessage_appendcontent(response, freq->out + freq->outoffset, length) == EREJECT)
+		length = EREJECT;
+	else if (length > 0)
+		freq->outoffset += length;
+	int ended = (freq->outoffset == freq->outlength && freq->ended);
+	_fastcgi_unlock(fastcgi);
+	if (length == EREJECT)
+		return EREJECT;
+	if (length > 0)
+		_fastcgi_signal(fastcgi);
+	if (ended)
+	{
+		if (freq->protocolstatus != FCGI_REQUEST_COMPLETE)
+			return EREJECT;
+		return ESUCCESS;
+	}
+	return ECONTINUE;
+}
+
+static int _fastcgi_connector(void *arg, http_message_t *request, http_message_t *response)
+{
+	fastcgi_client_t *client = (fastcgi_client_t *)arg;
+	fastcgi_t *fastcgi = client->fastcgi;
+	fastcgi_request_t *freq = httpmessage_private(response, NULL);
+	if (freq == NULL)
+	{
+		const char *uri = httpmessage_REQUEST(request, "uri");
+		if (uri == NULL || (fastcgi->config.prefix != NULL &&
+			strncmp(uri, fastcgi->config.prefix, fastcgi->prefixlength)))
+			return EREJECT;
+		freq = _fastcgi_open(client, request);
+		if (freq == NULL)
+		{
+			httpmessage_result(response, RESULT_502);
+			return ESUCCESS;
+		}
+		httpmessage_private(response, freq);
+	}
+
+	int ret = EREJECT;
+	switch (freq->state)
+	{
+	case FASTCGI_STDIN:
+		ret = _fastcgi_body(freq, request);
+		if (ret != ESUCCESS)
+			break;
+		freq->state = FASTCGI_HEADER;
+	/* fallthrough */
+	case FASTCGI_HEADER:
+		ret = _fastcgi_header(freq, request, response);
+		if (ret == ECONTINUE)
+			freq->state = FASTCGI_CONTENT;
+		else if (ret == ESUCCESS)
+			_fastcgi_release(freq);
+	break;
+	case FASTCGI_CONTENT:
+		ret = _fastcgi_content(freq, response);
+		if (ret == ESUCCESS)
+			_fastcgi_release(freq);
+		else if (ret == EREJECT)
+		{
+			/**
+			 * the header is already sent, the client must detect the error
+			 * with the end of the connection.
+			 */
+			_fastcgi_detach(freq);
+			freq->state = FASTCGI_ABORTED;
+			httpclient_shutdown(httpmessage_client(request));
+		}
+	break;
+	case FASTCGI_ABORTED:
+	break;
+	}
+	if (ret == EREJECT && freq->state != FASTCGI_CONTENT && freq->state != FASTCGI_ABORTED)
+	{
+		/**
+		 * the backend failed before the response
+		 */
+		if (freq->timeout)
+			httpmessage_result(response, RESULT_504);
+		else if (freq->ended && freq->protocolstatus == FCGI_OVERLOADED)
+			httpmessage_result(response, RESULT_503);
+		else
+			httpmessage_result(response, RESULT_502);
+		_fastcgi_release(freq);
+		ret = ESUCCESS;
+	}
+	else if (ret == EREJECT)
+		ret = ECONTINUE;
+	return ret;
+}
+
+static void *_fastcgi_getctx(void *arg, http_client_t *clt, struct sockaddr *addr, int addrsize)
+{
+	fastcgi_client_t *client = calloc(1, sizeof(*client));
+	if (client == NULL)
+		return NULL;
+	client->fastcgi = (fastcgi_t *)arg;
+	httpclient_addconnector(clt, _fastcgi_connector, client, CONNECTOR_DOCUMENT, "fastcgi");
+	return client;
+}
+
+static void _fastcgi_freectx(void *arg)
+{
+	fastcgi_client_t *client = (fastcgi_client_t *)arg;
+	/**
+	 * the requests still there are not complete
+	 */
+	while (client->requests != NULL)
+		_fastcgi_release(client->requests);
+	free(client);
+}
+
+static int _fastcgi_resolve(fastcgi_backend_t *backend, const char *name)
+{
+	if (!strncmp(name, "unix:", 5))
+	{
+		struct sockaddr_un *addr = (struct sockaddr_un *)&backend->addr;
+		if (strlen(name + 5) >= sizeof(addr->sun_path))
+			return EREJECT;
+		addr->sun_family = AF_UNIX;
+		strcpy(addr->sun_path, name + 5);
+		backend->addrlen = sizeof(*addr);
+		return ESUCCESS;
+	}
+	char host[NI_MAXHOST];
+	const char *port = strrchr(name, ':');
+	if (port == NULL || port - name >= (int)sizeof(host))
+		return EREJECT;
+	int length = port - name;
+	/**
+	 * IPv6 address as "[::1]:9000"
+	 */
+	if (name[0] == '[' && port[-1] == ']')
+	{
+		name++;
+		length -= 2;
+	}
+	memcpy(host, name, length);
+	host[length] = '\0';
+	struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+	struct addrinfo *result = NULL;
+	int ret = getaddrinfo(host, port + 1, &hints, &result);
+	if (ret != 0 || result == NULL)
+	{
+		err("fastcgi: %s %s", host, gai_strerror(ret));
+		return EREJECT;
+	}
+	memcpy(&backend->addr, result->ai_addr, result->ai_addrlen);
+	backend->addrlen = result->ai_addrlen;
+	freeaddrinfo(result);
+	return ESUCCESS;
+}
+
+fastcgi_t *fastcgi_create(http_server_t *server, const fastcgi_config_t *config)
+{
+	if (config == NULL || config->backends == NULL || config->backends[0] == NULL)
+		return NULL;
+	fastcgi_t *fastcgi = calloc(1, sizeof(*fastcgi));
+	if (fastcgi == NULL)
+		return NULL;
+	fastcgi->config = *config;
+	if (fastcgi->config.poolsize < 0)
+		fastcgi->config.poolsize = 0;
+	if (fastcgi->config.timeout <= 0)
+		fastcgi->config.timeout = _fastcgi_defaultconfig.timeout;
+	if (fastcgi->config.idletime <= 0)
+		fastcgi->config.idletime = _fastcgi_defaultconfig.idletime;
+	if (fastcgi->config.maxrequests <= 0)
+		fastcgi->config.maxrequests = _fastcgi_defaultconfig.maxrequests;
+	if (fastcgi->config.maxrequests > FASTCGI_MAXREQUESTS)
+		fastcgi->config.maxrequests = FASTCGI_MAXREQUESTS;
+#ifndef USE_PTHREAD
+	/**
+	 * the requests of a connection are read by their own threads, without
+	 * thread a request could wait the next one forever.
+	 */
+	fastcgi->config.maxrequests = 1;
+#endif
+	if (fastcgi->config.prefix != NULL)
+		fastcgi->prefixlength = strlen(fastcgi->config.prefix);
+
+	int nbackends = 0;
+	while (config->backends[nbackends] != NULL)
+		nbackends++;
+	if (nbackends > FASTCGI_MAXBACKENDS)
+	{
+		warn("fastcgi: only %d backends are used", FASTCGI_MAXBACKENDS);
+		nbackends = FASTCGI_MAXBACKENDS;
+	}
+	fastcgi->backends = calloc(nbackends, sizeof(*fastcgi->backends));
+	if (fastcgi->backends == NULL)
+	{
+		free(fastcgi);
+		return NULL;
+	}
+	int i;
+	for (i = 0; i < nbackends; i++)
+	{
+		fastcgi_backend_t *backend = &fastcgi->backends[fastcgi->nbackends];
+		if (_fastcgi_resolve(backend, config->backends[i]) != ESUCCESS)
+			continue;
+		backend->name = config->backends[i];
+		fastcgi->nbackends++;
+	}
+	if (fastcgi->nbackends == 0)
+	{
+		fastcgi_destroy(fastcgi);
+		return NULL;
+	}
+#ifdef USE_PTHREAD
+	pthread_mutex_init(&fastcgi->mutex, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&fastcgi->cond, &attr);
+	pthread_condattr_destroy(&attr);
+#endif
+	httpserver_addmod(server, _fastcgi_getctx, _fastcgi_freectx, fastcgi, "fastcgi");
+	return fastcgi;
+}
+
+void fastcgi_destroy(fastcgi_t *fastcgi)
+{
+	int i;
+	for (i = 0; i < fastcgi->nbackends; i++)
+	{
+		fastcgi_backend_t *backend = &fastcgi->backends[i];
+		while (backend->conns != NULL)
+		{
+			fastcgi_conn_t *conn = backend->conns;
+			backend->conns = conn->next;
+			_fastcgi_close(conn);
+		}
+	}
+#ifdef USE_PTHREAD
+	if (fastcgi->nbackends > 0)
+	{
+		pthread_cond_destroy(&fastcgi->cond);
+		pthread_mutex_destroy(&fastcgi->mutex);
+	}
+#endif
+	free(fastcgi->backends);
+	free(fastcgi);
+}
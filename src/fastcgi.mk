@@ -0,0 +1,13 @@
+lib-$(SHARED)+=ouifastcgi
+slib-$(STATIC)+=ouifastcgi
+ouifastcgi_SOURCES=fastcgi.c
+ouifastcgi_CFLAGS+=-I../include/ouistiti
+ouifastcgi_LIBS+=ouiutils
+ouifastcgi_PKGCONFIG:=ouistiti
+
+ifeq ($(VTHREAD_TYPE),pthread)
+ouifastcgi_CFLAGS-$(VTHREAD)+=-DUSE_PTHREAD
+ouifastcgi_LIBS-$(VTHREAD)+=pthread
+endif
+
+ouifastcgi_CFLAGS-$(DEBUG)+=-g -DDEBUG
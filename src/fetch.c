@@ -0,0 +1,1289 @@
+/*****************************************************************************
+ * fetch.c: asynchronous HTTP client
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "log.h"
+#include "httpserver.h"
+#include "fetch.h"
+
+#define fetch_dbg(...)
+
+/**
+ * the buffer receives the headers of the response,
+ * they must not be larger.
+ */
+#ifndef FETCH_BUFFERSIZE
+#define FETCH_BUFFERSIZE 8192
+#endif
+#define FETCH_MAXHEADERS 64
+#define FETCH_MAXREADS 16
+/**
+ * a request is sent again one time when a connection of the pool
+ * is closed by the origin before the response
+ */
+#define FETCH_RETRIES 1
+
+typedef enum
+{
+	FETCH_CONNECTING,
+	FETCH_IDLE,
+	FETCH_ACTIVE,
+} _fetch_connstate_e;
+
+typedef struct fetch_origin_s fetch_origin_t;
+typedef struct fetch_connection_s fetch_connection_t;
+
+struct fetch_request_s
+{
+	fetch_t *fetch;
+	fetch_origin_t *origin;
+	fetch_connection_t *connection; /* the connection which sent the request */
+	const fetch_ops_t *ops;
+	void *arg;
+	char *method;
+	char *path;
+	char *headers; /* the lines of the headers set by the application */
+	int headerslength;
+	char *content;
+	int contentlength;
+	int idempotent; /* the request may be sent again */
+	int nocontent; /* the response of HEAD has no content */
+	int host; /* the Host header is set by the application */
+	int upgrade; /* the 101 response is the final one */
+	int queued;
+	int retries;
+	int timeout;
+	long long deadline;
+	fetch_error_e error; /* the request is stopped before its end */
+	int done; /* the complete callback is already called */
+	int status;
+	char *response; /* the headers of the response */
+	const char *names[FETCH_MAXHEADERS];
+	const char *values[FETCH_MAXHEADERS];
+	int nheaders;
+	fetch_request_t *next;
+};
+
+struct fetch_connection_s
+{
+	fetch_origin_t *origin;
+	int sock;
+	_fetch_connstate_e state;
+	int reused; /* at least one response is complete */
+	int keepalive;
+	int paused; /* the application does not receive the content */
+	int resumed; /* the data already received must be parsed */
+	int detached; /* the socket belongs to the application */
+	fetch_request_t *requests; /* sent, the first one receives its response */
+	int nrequests;
+	long long since; /* beginning of the idle time */
+	char *out; /* requests not yet sent */
+	int outlength;
+	int outoffset;
+	int outsize;
+	int header; /* the header of the response is expected */
+	int chunked;
+	int unknown; /* the content ends with the connection */
+	unsigned long long length; /* the rest of the content */
+	http_chunk_t chunk;
+	int chunkend;
+	int inoffset;
+	int inlength;
+	char in[FETCH_BUFFERSIZE];
+	fetch_connection_t *next;
+};
+
+struct fetch_origin_s
+{
+	char *authority; /* "host[:port]" for the Host header */
+	char *host;
+	char *port;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	fetch_connection_t *connections;
+	int nconnections;
+	fetch_request_t *queue;
+	fetch_origin_t *next;
+};
+
+struct fetch_s
+{
+	fetch_config_t config;
+	fetch_origin_t *origins;
+	int pending;
+	struct pollfd *fds;
+	fetch_connection_t **pollconnections;
+	int nfds;
+};
+
+static const fetch_config_t _fetch_defaultconfig =
+{
+	.maxconnections = FETCH_MAXCONNECTIONS,
+	.pipeline = FETCH_PIPELINE,
+	.timeout = FETCH_TIMEOUT,
+	.idletime = FETCH_IDLETIME,
+};
+
+static const char *_fetch_idempotent[] =
+{
+	"GET",
+	"HEAD",
+	"PUT",
+	"DELETE",
+	"OPTIONS",
+	"TRACE",
+	NULL,
+};
+
+static long long _fetch_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static void _fetch_free(fetch_request_t *request)
+{
+	free(request->method);
+	free(request->path);
+	free(request->headers);
+	free(request->content);
+	free(request->response);
+	free(request);
+}
+
+/**
+ * @brief call the complete callback
+ *
+ * The request stays allocated while its response is expected
+ * on a connection.
+ */
+static void _fetch_complete(fetch_request_t *request, fetch_error_e error, int release)
+{
+	if (!request->done)
+	{
+		request->done = 1;
+		request->fetch->pending--;
+		if (request->ops != NULL && request->ops->complete != NULL)
+			request->ops->complete(request->arg, request, error);
+	}
+	if (release)
+		_fetch_free(request);
+}
+
+static void _fetch_queue(fetch_origin_t *origin, fetch_request_t *request)
+{
+	fetch_request_t **it = &origin->queue;
+	while (*it != NULL)
+		it = &(*it)->next;
+	request->next = NULL;
+	*it = request;
+}
+
+static fetch_origin_t *_fetch_origin(fetch_t *fetch, const char *authority, int length)
+{
+	fetch_origin_t *origin;
+	for (origin = fetch->origins; origin != NULL; origin = origin->next)
+	{
+		if (!strncasecmp(origin->authority, authority, length) && origin->authority[length] == '\0')
+			return origin;
+	}
+	origin = calloc(1, sizeof(*origin));
+	if (origin == NULL)
+		return NULL;
+	origin->authority = strndup(authority, length);
+	/**
+	 * IPv6 address as "[::1]:8080"
+	 */
+	const char *host = authority;
+	const char *end = authority + length;
+	const char *port = NULL;
+	if (host[0] == '[')
+	{
+		host++;
+		end = memchr(host, ']', length - 1);
+		if (end != NULL && end + 1 < authority + length && end[1] == ':')
+			port = end + 2;
+	}
+	else
+	{
+		port = memchr(host, ':', length);
+		if (port != NULL)
+			end = port++;
+	}
+	if (end == NULL || end == host || origin->authority == NULL)
+	{
+		free(origin->authority);
+		free(origin);
+		return NULL;
+	}
+	origin->host = strndup(host, end - host);
+	if (port != NULL && port < authority + length)
+		origin->port = strndup(port, authority + length - port);
+	else
+		origin->port = strdup("80");
+	origin->next = fetch->origins;
+	fetch->origins = origin;
+	return origin;
+}
+
+fetch_t *fetch_create(const fetch_config_t *config)
+{
+	fetch_t *fetch = calloc(1, sizeof(*fetch));
+	if (fetch == NULL)
+		return NULL;
+	if (config != NULL)
+		fetch->config = *config;
+	if (fetch->config.maxconnections <= 0)
+		fetch->config.maxconnections = _fetch_defaultconfig.maxconnections;
+	if (fetch->config.pipeline <= 0)
+		fetch->config.pipeline = _fetch_defaultconfig.pipeline;
+	if (fetch->config.timeout <= 0)
+		fetch->config.timeout = _fetch_defaultconfig.timeout;
+	if (fetch->config.idletime <= 0)
+		fetch->config.idletime = _fetch_defaultconfig.idletime;
+	return fetch;
+}
+
+fetch_request_t *fetch_request(fetch_t *fetch, const char *method, const char *url, const fetch_ops_t *ops, void *arg)
+{
+	if (method == NULL || url == NULL || strncasecmp(url, "http://", 7))
+	{
+		err("fetch: unsupported URL %s", url);
+		return NULL;
+	}
+	const char *authority = url + 7;
+	int length = strcspn(authority, "/?#");
+	fetch_origin_t *origin = _fetch_origin(fetch, authority, length);
+	if (origin == NULL)
+	{
+		err("fetch: bad URL %s", url);
+		return NULL;
+	}
+	fetch_request_t *request = calloc(1, sizeof(*request));
+	if (request == NULL)
+		return NULL;
+	request->fetch = fetch;
+	request->origin = origin;
+	request->ops = ops;
+	request->arg = arg;
+	request->timeout = fetch->config.timeout;
+	request->method = strdup(method);
+	const char *path = authority + length;
+	length = strcspn(path, "#");
+	if (path[0] != '/')
+	{
+		request->path = malloc(length + 2);
+		if (request->path != NULL)
+		{
+			request->path[0] = '/';
+			memcpy(request->path + 1, path, length);
+			request->path[length + 1] = '\0';
+		}
+	}
+	else
+		request->path = strndup(path, length);
+	if (request->method == NULL || request->path == NULL)
+	{
+		_fetch_free(request);
+		return NULL;
+	}
+	int i;
+	for (i = 0; _fetch_idempotent[i] != NULL; i++)
+	{
+		if (!strcmp(method, _fetch_idempotent[i]))
+			request->idempotent = 1;
+	}
+	request->nocontent = !strcmp(method, "HEAD");
+	return request;
+}
+
+int fetch_addheader(fetch_request_t *request, const char *key, const char *value)
+{
+	if (request->queued || strpbrk(key, ":\r\n") != NULL || strpbrk(value, "\r\n") != NULL)
+		return EREJECT;
+	int length = strlen(key) + 2 + strlen(value) + 2;
+	char *headers = realloc(request->headers, request->headerslength + length + 1);
+	if (headers == NULL)
+		return EREJECT;
+	request->headers = headers;
+	request->headerslength += snprintf(headers + request->headerslength, length + 1, "%s: %s\r\n", key, value);
+	if (!strcasecmp(key, "Host"))
+		request->host = 1;
+	else if (!strcasecmp(key, "Upgrade"))
+		request->upgrade = 1;
+	return ESUCCESS;
+}
+
+int fetch_setcontent(fetch_request_t *request, const char *type, const char *content, int length)
+{
+	if (request->queued || content == NULL)
+		return EREJECT;
+	if (length == -1)
+		length = strlen(content);
+	if (type != NULL && fetch_addheader(request, "Content-Type", type) != ESUCCESS)
+		return EREJECT;
+	free(request->content);
+	request->content = malloc(length + 1);
+	if (request->content == NULL)
+		return EREJECT;
+	memcpy(request->content, content, length);
+	request->contentlength = length;
+	return ESUCCESS;
+}
+
+void fetch_deadline(fetch_request_t *request, int timeout)
+{
+	request->timeout = timeout;
+	if (request->queued)
+		request->deadline = _fetch_now() + timeout;
+}
+
+int fetch_send(fetch_request_t *request)
+{
+	if (request->queued)
+		return EREJECT;
+	request->queued = 1;
+	request->deadline = _fetch_now() + request->timeout;
+	request->fetch->pending++;
+	_fetch_queue(request->origin, request);
+	return ESUCCESS;
+}
+
+void fetch_cancel(fetch_request_t *request)
+{
+	if (request->done)
+		return;
+	if (!request->queued)
+	{
+		request->fetch->pending++;
+		_fetch_complete(request, FETCH_ECANCEL, 1);
+		return;
+	}
+	/**
+	 * the request may be into a callback of the connection,
+	 * it is stopped by the next fetch_run
+	 */
+	request->error = FETCH_ECANCEL;
+}
+
+int fetch_status(fetch_request_t *request)
+{
+	return request->status;
+}
+
+const char *fetch_header(fetch_request_t *request, const char *key)
+{
+	int i;
+	for (i = 0; i < request->nheaders; i++)
+	{
+		if (!strcasecmp(request->names[i], key))
+			return request->values[i];
+	}
+	return NULL;
+}
+
+const char *fetch_headers(fetch_request_t *request, int *iterator, const char **key)
+{
+	if (*iterator < 0 || *iterator >= request->nheaders)
+		return NULL;
+	*key = request->names[*iterator];
+	return request->values[(*iterator)++];
+}
+
+int fetch_socket(fetch_request_t *request, short *events)
+{
+	fetch_connection_t *connection = request->connection;
+	if (request->done || connection == NULL)
+		return -1;
+	*events = 0;
+	if (!connection->paused)
+		*events |= POLLIN;
+	if (connection->state == FETCH_CONNECTING || connection->outlength > 0)
+		*events |= POLLOUT;
+	return connection->sock;
+}
+
+void fetch_resume(fetch_request_t *request)
+{
+	fetch_connection_t *connection = request->connection;
+	if (request->done || connection == NULL || !connection->paused)
+		return;
+	connection->paused = 0;
+	connection->resumed = 1;
+}
+
+int fetch_detach(fetch_request_t *request, const char **data, int *length)
+{
+	fetch_connection_t *connection = request->connection;
+	if (request->done || connection == NULL || request->status != 101 || connection->detached)
+		return -1;
+	*data = connection->in + connection->inoffset;
+	*length = connection->inlength - connection->inoffset;
+	connection->inoffset = connection->inlength;
+	connection->detached = 1;
+	return connection->sock;
+}
+
+/**
+ * @brief open a new connection without waiting its establishment
+ */
+static fetch_connection_t *_fetch_connect(fetch_t *fetch, fetch_origin_t *origin)
+{
+	if (origin->addrlen == 0)
+	{
+		struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+		struct addrinfo *result = NULL;
+		int ret = getaddrinfo(origin->host, origin->port, &hints, &result);
+		if (ret != 0 || result == NULL)
+		{
+			err("fetch: %s %s", origin->host, gai_strerror(ret));
+			return NULL;
+		}
+		memcpy(&origin->addr, result->ai_addr, result->ai_addrlen);
+		origin->addrlen = result->ai_addrlen;
+		freeaddrinfo(result);
+	}
+	int sock = socket(origin->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		return NULL;
+	if (connect(sock, (struct sockaddr *)&origin->addr, origin->addrlen) < 0 && errno != EINPROGRESS)
+	{
+		err("fetch: connection to %s %s", origin->authority, strerror(errno));
+		close(sock);
+		return NULL;
+	}
+	int nodelay = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	fetch_connection_t *connection = calloc(1, sizeof(*connection));
+	if (connection == NULL)
+	{
+		close(sock);
+		return NULL;
+	}
+	connection->origin = origin;
+	connection->sock = sock;
+	connection->state = FETCH_CONNECTING;
+	connection->header = 1;
+	connection->next = origin->connections;
+	origin->connections = connection;
+	origin->nconnections++;
+	fetch_dbg("fetch: new connection to %s", origin->authority);
+	return connection;
+}
+
+static int _fetch_write(fetch_connection_t *connection, const char *data, int length)
+{
+	if (connection->outlength + length > connection->outsize)
+	{
+		int size = connection->outlength + length + FETCH_BUFFERSIZE;
+		char *out = realloc(connection->out, size);
+		if (out == NULL)
+			return EREJECT;
+		connection->out = out;
+		connection->outsize = size;
+	}
+	memcpy(connection->out + connection->outlength, data, length);
+	connection->outlength += length;
+	return ESUCCESS;
+}
+
+/**
+ * @brief give the request to the connection and prepare its sending
+ */
+static int _fetch_attach(fetch_connection_t *connection, fetch_request_t *request)
+{
+	fetch_request_t **it = &connection->requests;
+	while (*it != NULL)
+		it = &(*it)->next;
+	request->next = NULL;
+	*it = request;
+	request->connection = connection;
+	connection->nrequests++;
+	if (connection->state == FETCH_IDLE)
+		connection->state = FETCH_ACTIVE;
+
+	char line[64];
+	int ret = _fetch_write(connection, request->method, strlen(request->method));
+	ret |= _fetch_write(connection, " ", 1);
+	ret |= _fetch_write(connection, request->path, strlen(request->path));
+	ret |= _fetch_write(connection, " HTTP/1.1\r\n", 11);
+	if (!request->host)
+	{
+		ret |= _fetch_write(connection, "Host: ", 6);
+		ret |= _fetch_write(connection, connection->origin->authority, strlen(connection->origin->authority));
+		ret |= _fetch_write(connection, "\r\n", 2);
+	}
+	if (request->headers != NULL)
+		ret |= _fetch_write(connection, request->headers, request->headerslength);
+	if (request->content != NULL || !request->idempotent)
+	{
+		int length = snprintf(line, sizeof(line), "Content-Length: %d\r\n", request->contentlength);
+		ret |= _fetch_write(connection, line, length);
+	}
+	ret |= _fetch_write(connection, "\r\n", 2);
+	if (request->content != NULL)
+		ret |= _fetch_write(connection, request->content, request->contentlength);
+	return (ret == ESUCCESS)? ESUCCESS : EREJECT;
+}
+
+/**
+ * @brief close the connection and give back its requests
+ *
+ * The requests with an error are complete, the other ones are queued
+ * again to their origin if they may be sent again.
+ *
+ * @param error the error of the first request
+ * @param retry the first request did not receive a part of its response
+ */
+static void _fetch_close(fetch_t *fetch, fetch_connection_t *connection, fetch_error_e error, int retry)
+{
+	fetch_origin_t *origin = connection->origin;
+	fetch_connection_t **it = &origin->connections;
+	while (*it != NULL && *it != connection)
+		it = &(*it)->next;
+	if (*it != NULL)
+		*it = connection->next;
+	origin->nconnections--;
+	if (!connection->detached)
+		close(connection->sock);
+
+	fetch_request_t *done = NULL;
+	fetch_request_t *request = connection->requests;
+	int first = 1;
+	while (request != NULL)
+	{
+		fetch_request_t *next = request->next;
+		if (request->error == FETCH_OK && !request->done && request->status == 0 &&
+			(!first || error == FETCH_OK ||
+			(retry && request->idempotent && request->retries < FETCH_RETRIES)))
+		{
+			/**
+			 * the pipelined requests did not receive their response
+			 */
+			if (first)
+				request->retries++;
+			request->connection = NULL;
+			_fetch_queue(origin, request);
+		}
+		else
+		{
+			if (request->error == FETCH_OK)
+				request->error = (error != FETCH_OK)? error : FETCH_EPROTOCOL;
+			request->next = done;
+			done = request;
+		}
+		first = 0;
+		request = next;
+	}
+	free(connection->out);
+	free(connection);
+	/**
+	 * the callbacks are called at the end, they may queue new requests
+	 */
+	while (done != NULL)
+	{
+		request = done;
+		done = done->next;
+		_fetch_complete(request, request->error, 1);
+	}
+}
+
+static int _fetch_pipelinable(fetch_connection_t *connection)
+{
+	fetch_request_t *request;
+	for (request = connection->requests; request != NULL; request = request->next)
+	{
+		if (!request->idempotent)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief give the queued requests to the connections of their origin
+ *
+ * An idle connection is used first, then a new connection and at last
+ * an active one if the pipelining is allowed.
+ */
+static void _fetch_dispatch(fetch_t *fetch, fetch_origin_t *origin)
+{
+	while (origin->queue != NULL)
+	{
+		fetch_request_t *request = origin->queue;
+		fetch_connection_t *connection;
+		for (connection = origin->connections; connection != NULL; connection = connection->next)
+		{
+			if (connection->state == FETCH_IDLE)
+				break;
+		}
+		if (connection == NULL && origin->nconnections < fetch->config.maxconnections)
+		{
+			connection = _fetch_connect(fetch, origin);
+			if (connection == NULL)
+			{
+				origin->queue = request->next;
+				_fetch_complete(request, FETCH_ECONNECT, 1);
+				continue;
+			}
+		}
+		if (connection == NULL && request->idempotent && fetch->config.pipeline > 1)
+		{
+			/**
+			 * the connection must be persistent before the pipelining
+			 */
+			for (connection = origin->connections; connection != NULL; connection = connection->next)
+			{
+				if (connection->state == FETCH_ACTIVE && connection->reused &&
+					connection->keepalive && !connection->unknown &&
+					connection->nrequests < fetch->config.pipeline &&
+					_fetch_pipelinable(connection))
+					break;
+			}
+		}
+		if (connection == NULL)
+			break;
+		origin->queue = request->next;
+		if (_fetch_attach(connection, request) != ESUCCESS)
+		{
+			request->error = FETCH_ECANCEL;
+			_fetch_close(fetch, connection, FETCH_ECANCEL, 0);
+		}
+	}
+}
+
+/**
+ * @brief stop the requests after their deadline or their cancellation
+ * and close the idle connections
+ */
+static void _fetch_expire(fetch_t *fetch, long long now)
+{
+	fetch_origin_t *origin;
+	for (origin = fetch->origins; origin != NULL; origin = origin->next)
+	{
+		fetch_request_t **it = &origin->queue;
+		while (*it != NULL)
+		{
+			fetch_request_t *request = *it;
+			if (request->error == FETCH_OK && request->deadline <= now)
+				request->error = FETCH_ETIMEOUT;
+			if (request->error != FETCH_OK)
+			{
+				*it = request->next;
+				_fetch_complete(request, request->error, 1);
+				/**
+				 * the callback may change the queue
+				 */
+				it = &origin->queue;
+			}
+			else
+				it = &request->next;
+		}
+		fetch_connection_t *connection = origin->connections;
+		while (connection != NULL)
+		{
+			fetch_connection_t *next = connection->next;
+			fetch_request_t *request;
+			if (connection->state == FETCH_IDLE &&
+				now - connection->since >= (long long)fetch->config.idletime * 1000)
+			{
+				_fetch_close(fetch, connection, FETCH_OK, 0);
+				connection = next;
+				continue;
+			}
+			for (request = connection->requests; request != NULL; request = request->next)
+			{
+				if (request->error == FETCH_OK && !request->done && request->deadline <= now)
+					request->error = FETCH_ETIMEOUT;
+				if (request->error != FETCH_OK && request != connection->requests)
+				{
+					/**
+					 * the response of a pipelined request is read
+					 * before the next ones, the request stays there.
+					 */
+					_fetch_complete(request, request->error, 0);
+				}
+			}
+			request = connection->requests;
+			if (request != NULL && request->error != FETCH_OK)
+			{
+				err("fetch: %s %s%s", request->method, connection->origin->authority, request->path);
+				_fetch_close(fetch, connection, request->error, 0);
+				/**
+				 * the callbacks may change the list of connections
+				 */
+				next = origin->connections;
+			}
+			connection = next;
+		}
+	}
+}
+
+/**
+ * @brief read the status line and the headers of the response
+ *
+ * @return ESUCCESS, EINCOMPLETE without the whole header or EREJECT
+ */
+static int _fetch_header(fetch_connection_t *connection, fetch_request_t *request)
+{
+	char *header = connection->in + connection->inoffset;
+	char *end = memmem(header, connection->inlength - connection->inoffset, "\r\n\r\n", 4);
+	if (end == NULL)
+		return (connection->inoffset == 0 && connection->inlength == sizeof(connection->in))? EREJECT : EINCOMPLETE;
+	int minor = 0;
+	int status = 0;
+	if (sscanf(header, "HTTP/1.%d %d", &minor, &status) != 2 || status < 100)
+		return EREJECT;
+	connection->inoffset = end + 4 - connection->in;
+	/**
+	 * the interim responses are ignored, except the change of protocol
+	 * asked by the request
+	 */
+	if (status < 200 && (status != 101 || !request->upgrade))
+		return ECONTINUE;
+
+	free(request->response);
+	request->response = strndup(header, end - header);
+	if (request->response == NULL)
+		return EREJECT;
+	request->status = status;
+	request->nheaders = 0;
+	const char *connectionheader = NULL;
+	int haslength = 0;
+	connection->chunked = 0;
+	connection->length = 0;
+	char *line = strstr(request->response, "\r\n");
+	while (line != NULL)
+	{
+		line += 2;
+		char *next = strstr(line, "\r\n");
+		if (next != NULL)
+			*next = '\0';
+		char *value = strchr(line, ':');
+		if (value != NULL)
+		{
+			*value++ = '\0';
+			while (*value == ' ' || *value == '\t')
+				value++;
+			if (request->nheaders < FETCH_MAXHEADERS)
+			{
+				request->names[request->nheaders] = line;
+				request->values[request->nheaders] = value;
+				request->nheaders++;
+			}
+			else
+				warn("fetch: header %s dropped", line);
+			if (!strcasecmp(line, "Connection"))
+				connectionheader = value;
+			else if (!strcasecmp(line, "Content-Length"))
+			{
+				connection->length = strtoull(value, NULL, 10);
+				haslength = 1;
+			}
+			else if (!strcasecmp(line, "Transfer-Encoding"))
+				connection->chunked = (strcasestr(value, "chunked") != NULL);
+		}
+		line = next;
+	}
+	if (connectionheader != NULL)
+		connection->keepalive = (minor > 0)? (httpmessage_quality(connectionheader, "close") < 0):
+							(httpmessage_quality(connectionheader, "keep-alive") >= 0);
+	else
+		connection->keepalive = (minor > 0);
+
+	connection->unknown = 0;
+	if (status == 101)
+	{
+		/**
+		 * the connection belongs to the new protocol,
+		 * the application takes it with fetch_detach
+		 */
+		connection->chunked = 0;
+		connection->unknown = 1;
+		connection->keepalive = 0;
+	}
+	else if (request->nocontent || status == 204 || status == 304)
+	{
+		connection->chunked = 0;
+		connection->length = 0;
+	}
+	else if (connection->chunked)
+	{
+		memset(&connection->chunk, 0, sizeof(connection->chunk));
+		connection->chunkend = 0;
+	}
+	else if (!haslength)
+	{
+		connection->unknown = 1;
+		connection->keepalive = 0;
+	}
+	return ESUCCESS;
+}
+
+/**
+ * @brief remove the chunk framing of the content
+ *
+ * @return the length of the next data, 0 without data or EREJECT
+ */
+static int _fetch_dechunk(fetch_connection_t *connection, const char **data)
+{
+	const char *it = connection->in + connection->inoffset;
+	const char *end = connection->in + connection->inlength;
+	int length = 0;
+	http_chunk_part_e part;
+	/**
+	 * the trailers are not given to the application
+	 */
+	do
+		part = httpmessage_dechunk(&connection->chunk, &it, end, data, &length);
+	while (part == HTTPCHUNK_TRAILER || part == HTTPCHUNK_LINE);
+	connection->inoffset = it - connection->in;
+	if (part == HTTPCHUNK_ERROR)
+		return EREJECT;
+	if (part == HTTPCHUNK_END)
+		connection->chunkend = 1;
+	return (part == HTTPCHUNK_DATA)? length : 0;
+}
+
+/**
+ * @brief the response of the first request is complete
+ */
+static void _fetch_finish(fetch_t *fetch, fetch_connection_t *connection)
+{
+	fetch_request_t *request = connection->requests;
+	connection->requests = request->next;
+	connection->nrequests--;
+	connection->header = 1;
+	connection->reused = 1;
+	if (connection->requests == NULL && connection->keepalive)
+	{
+		connection->state = FETCH_IDLE;
+		connection->since = _fetch_now();
+	}
+	_fetch_complete(request, FETCH_OK, 1);
+}
+
+/**
+ * @brief give the received data to the requests of the connection
+ *
+ * @return ESUCCESS, ECONTINUE to close the connection after
+ * a complete response or an error for the first request
+ */
+static int _fetch_parse(fetch_t *fetch, fetch_connection_t *connection, fetch_error_e *error)
+{
+	while (connection->inoffset < connection->inlength || (connection->requests != NULL && !connection->header &&
+			!connection->chunked && !connection->unknown && connection->length == 0))
+	{
+		fetch_request_t *request = connection->requests;
+		if (request == NULL)
+		{
+			err("fetch: %s sends data without request", connection->origin->authority);
+			*error = FETCH_EPROTOCOL;
+			return EREJECT;
+		}
+		if (connection->header)
+		{
+			int ret = _fetch_header(connection, request);
+			if (ret == EINCOMPLETE)
+				break;
+			if (ret == ECONTINUE)
+				continue;
+			if (ret == EREJECT)
+			{
+				err("fetch: bad response from %s", connection->origin->authority);
+				*error = FETCH_EPROTOCOL;
+				return EREJECT;
+			}
+			connection->header = 0;
+			if (!request->done && request->error == FETCH_OK &&
+				request->ops != NULL && request->ops->response != NULL &&
+				request->ops->response(request->arg, request, request->status) == EREJECT)
+			{
+				*error = FETCH_ECANCEL;
+				return EREJECT;
+			}
+			if (connection->detached)
+			{
+				/**
+				 * the connection is closed without its socket
+				 */
+				_fetch_finish(fetch, connection);
+				return ECONTINUE;
+			}
+			continue;
+		}
+		const char *data = connection->in + connection->inoffset;
+		int length = 0;
+		int used = ESUCCESS;
+		if (connection->chunked)
+		{
+			length = _fetch_dechunk(connection, &data);
+			if (length < 0)
+			{
+				err("fetch: bad chunk from %s", connection->origin->authority);
+				*error = FETCH_EPROTOCOL;
+				return EREJECT;
+			}
+		}
+		else
+		{
+			length = connection->inlength - connection->inoffset;
+			if (!connection->unknown && (unsigned long long)length > connection->length)
+				length = connection->length;
+			connection->inoffset += length;
+			connection->length -= length;
+		}
+		if (length > 0 && !request->done && request->error == FETCH_OK &&
+			request->ops != NULL && request->ops->content != NULL)
+			used = request->ops->content(request->arg, request, data, length);
+		if (used == EREJECT)
+		{
+			*error = FETCH_ECANCEL;
+			return EREJECT;
+		}
+		if ((connection->chunked && connection->chunkend) ||
+			(!connection->chunked && !connection->unknown && connection->length == 0))
+		{
+			_fetch_finish(fetch, connection);
+			if (!connection->keepalive)
+				return ECONTINUE;
+		}
+		else if (used == ESPACE)
+		{
+			/**
+			 * the rest of the data waits fetch_resume
+			 */
+			connection->paused = 1;
+			break;
+		}
+	}
+	if (connection->inoffset > 0)
+	{
+		memmove(connection->in, connection->in + connection->inoffset, connection->inlength - connection->inoffset);
+		connection->inlength -= connection->inoffset;
+		connection->inoffset = 0;
+	}
+	return ESUCCESS;
+}
+
+/**
+ * @brief give the data of the connection to its requests
+ *
+ * @return ESUCCESS or EREJECT if the connection is closed
+ */
+static int _fetch_input(fetch_t *fetch, fetch_connection_t *connection)
+{
+	fetch_error_e error = FETCH_OK;
+	int parse = _fetch_parse(fetch, connection, &error);
+	if (parse == EREJECT)
+	{
+		_fetch_close(fetch, connection, error, 0);
+		return EREJECT;
+	}
+	if (parse == ECONTINUE)
+	{
+		_fetch_close(fetch, connection, FETCH_OK, 0);
+		return EREJECT;
+	}
+	return ESUCCESS;
+}
+
+/**
+ * @brief receive the data of the connection
+ *
+ * @return ESUCCESS or ECONTINUE and EREJECT if the connection is closed
+ */
+static int _fetch_receive(fetch_t *fetch, fetch_connection_t *connection)
+{
+	ssize_t ret;
+	int i;
+	/**
+	 * a large content is read with several calls,
+	 * the other connections wait the next event
+	 */
+	for (i = 0; i < FETCH_MAXREADS; i++)
+	{
+		ret = recv(connection->sock, connection->in + connection->inlength, sizeof(connection->in) - connection->inlength, 0);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+			return ESUCCESS;
+		if (ret <= 0)
+			break;
+		connection->inlength += ret;
+		if (_fetch_input(fetch, connection) != ESUCCESS)
+			return EREJECT;
+		if (connection->paused)
+			return ESUCCESS;
+	}
+	if (ret > 0)
+		return ESUCCESS;
+	/**
+	 * the end of the connection
+	 */
+	fetch_request_t *request = connection->requests;
+	if (request != NULL && !connection->header && connection->unknown && ret == 0)
+	{
+		_fetch_finish(fetch, connection);
+		_fetch_close(fetch, connection, FETCH_OK, 0);
+	}
+	else if (request != NULL)
+	{
+		/**
+		 * a connection of the pool may be closed by the origin
+		 * before to receive the request
+		 */
+		int retry = connection->reused && connection->header && connection->inlength == 0;
+		if (!retry)
+			err("fetch: %s closed during the response", connection->origin->authority);
+		_fetch_close(fetch, connection, FETCH_EPROTOCOL, retry);
+	}
+	else
+		_fetch_close(fetch, connection, FETCH_OK, 0);
+	return EREJECT;
+}
+
+/**
+ * @brief send the requests waiting into the connection
+ *
+ * @return ESUCCESS or EREJECT if the connection is closed
+ */
+static int _fetch_send(fetch_t *fetch, fetch_connection_t *connection)
+{
+	while (connection->outoffset < connection->outlength)
+	{
+		ssize_t ret = send(connection->sock, connection->out + connection->outoffset,
+					connection->outlength - connection->outoffset, MSG_NOSIGNAL);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return ESUCCESS;
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0)
+		{
+			int retry = connection->reused && connection->header && connection->inlength == 0;
+			_fetch_close(fetch, connection, FETCH_EPROTOCOL, retry);
+			return EREJECT;
+		}
+		connection->outoffset += ret;
+	}
+	connection->outoffset = 0;
+	connection->outlength = 0;
+	return ESUCCESS;
+}
+
+/**
+ * @brief prepare the list of the sockets to poll
+ *
+ * @return the number of sockets
+ */
+static int _fetch_prepare(fetch_t *fetch)
+{
+	int count = 0;
+	fetch_origin_t *origin;
+	fetch_connection_t *connection;
+	for (origin = fetch->origins; origin != NULL; origin = origin->next)
+		count += origin->nconnections;
+	if (count > fetch->nfds)
+	{
+		struct pollfd *fds = realloc(fetch->fds, count * sizeof(*fds));
+		if (fds != NULL)
+			fetch->fds = fds;
+		fetch_connection_t **connections = realloc(fetch->pollconnections, count * sizeof(*connections));
+		if (connections != NULL)
+			fetch->pollconnections = connections;
+		if (fds == NULL || connections == NULL)
+			return -1;
+		fetch->nfds = count;
+	}
+	count = 0;
+	for (origin = fetch->origins; origin != NULL; origin = origin->next)
+	{
+		for (connection = origin->connections; connection != NULL; connection = connection->next)
+		{
+			fetch->fds[count].fd = connection->sock;
+			fetch->fds[count].events = (connection->paused)? 0 : POLLIN;
+			fetch->fds[count].revents = 0;
+			if (connection->state == FETCH_CONNECTING || connection->outlength > 0)
+				fetch->fds[count].events |= POLLOUT;
+			fetch->pollconnections[count] = connection;
+			count++;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief returns the delay before the next deadline
+ */
+static int _fetch_delay(fetch_t *fetch, int timeout, long long now)
+{
+	fetch_origin_t *origin;
+	fetch_request_t *request;
+	for (origin = fetch->origins; origin != NULL; origin = origin->next)
+	{
+		for (request = origin->queue; request != NULL; request = request->next)
+		{
+			if (request->deadline - now < timeout)
+				timeout = (request->deadline > now)? request->deadline - now : 0;
+		}
+		fetch_connection_t *connection;
+		for (connection = origin->connections; connection != NULL; connection = connection->next)
+		{
+			for (request = connection->requests; request != NULL; request = request->next)
+			{
+				if (!request->done && request->deadline - now < timeout)
+					timeout = (request->deadline > now)? request->deadline - now : 0;
+			}
+		}
+	}
+	return timeout;
+}
+
+static void _fetch_event(fetch_t *fetch, fetch_connection_t *connection, short revents)
+{
+	if (connection->state == FETCH_CONNECTING)
+	{
+		if (!(revents & (POLLOUT | POLLERR | POLLHUP)))
+			return;
+		int error = 0;
+		socklen_t length = sizeof(error);
+		if (getsockopt(connection->sock, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0)
+		{
+			err("fetch: connection to %s %s", connection->origin->authority, strerror(error));
+			_fetch_close(fetch, connection, FETCH_ECONNECT, 0);
+			return;
+		}
+		connection->state = (connection->requests != NULL)? FETCH_ACTIVE : FETCH_IDLE;
+		connection->since = _fetch_now();
+		revents |= POLLOUT;
+	}
+	if ((revents & POLLOUT) && connection->outlength > 0 &&
+		_fetch_send(fetch, connection) != ESUCCESS)
+		return;
+	if ((revents & (POLLIN | POLLERR | POLLHUP)) && !connection->paused)
+		_fetch_receive(fetch, connection);
+}
+
+/**
+ * @brief parse the data kept by the connections after fetch_resume
+ */
+static void _fetch_resumed(fetch_t *fetch)
+{
+	fetch_origin_t *origin;
+	for (origin = fetch->origins; origin != NULL; origin = origin->next)
+	{
+		fetch_connection_t *connection = origin->connections;
+		while (connection != NULL)
+		{
+			fetch_connection_t *next = connection->next;
+			if (connection->resumed)
+			{
+				connection->resumed = 0;
+				/**
+				 * the callbacks may change the list of connections
+				 */
+				if (_fetch_input(fetch, connection) != ESUCCESS)
+					next = origin->connections;
+			}
+			connection = next;
+		}
+	}
+}
+
+int fetch_run(fetch_t *fetch, int timeout)
+{
+	long long now = _fetch_now();
+	_fetch_expire(fetch, now);
+	_fetch_resumed(fetch);
+	fetch_origin_t *origin;
+	for (origin = fetch->origins; origin != NULL; origin = origin->next)
+		_fetch_dispatch(fetch, origin);
+
+	int nfds = _fetch_prepare(fetch);
+	if (nfds > 0)
+	{
+		if (timeout < 0 || fetch->pending == 0)
+			timeout = 0;
+		timeout = _fetch_delay(fetch, timeout, now);
+		int ret = poll(fetch->fds, nfds, timeout);
+		int i;
+		for (i = 0; i < nfds && ret > 0; i++)
+		{
+			if (fetch->fds[i].revents == 0)
+				continue;
+			_fetch_event(fetch, fetch->pollconnections[i], fetch->fds[i].revents);
+		}
+	}
+	_fetch_expire(fetch, _fetch_now());
+	for (origin = fetch->origins; origin != NULL; origin = origin->next)
+		_fetch_dispatch(fetch, origin);
+	return fetch->pending;
+}
+
+void fetch_destroy(fetch_t *fetch)
+{
+	fetch_origin_t *origin = fetch->origins;
+	while (origin != NULL)
+	{
+		fetch_origin_t *next = origin->next;
+		while (origin->queue != NULL)
+		{
+			fetch_request_t *request = origin->queue;
+			origin->queue = request->next;
+			_fetch_complete(request, FETCH_ECANCEL, 1);
+		}
+		while (origin->connections != NULL)
+		{
+			fetch_request_t *request;
+			for (request = origin->connections->requests; request != NULL; request = request->next)
+				request->error = FETCH_ECANCEL;
+			_fetch_close(fetch, origin->connections, FETCH_ECANCEL, 0);
+		}
+		free(origin->authority);
+		free(origin->host);
+		free(origin->port);
+		free(origin);
+		origin = next;
+	}
+	free(fetch->fds);
+	free(fetch->pollconnections);
+	free(fetch);
+}
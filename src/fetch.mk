@@ -0,0 +1,7 @@
+lib-$(SHARED)+=ouifetch
+slib-$(STATIC)+=ouifetch
+ouifetch_SOURCES=fetch.c
+ouifetch_CFLAGS+=-I../include/ouistiti
+ouifetch_PKGCONFIG:=ouistiti
+
+ouifetch_CFLAGS-$(DEBUG)+=-g -DDEBUG
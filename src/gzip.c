@@ -0,0 +1,213 @@
+/*****************************************************************************
+ * gzip.c: gzip and deflate content encoders
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+#include "log.h"
+#include "httpserver.h"
+#include "gzip.h"
+
+#define gzip_dbg(...)
+
+#define GZIP_CHUNKSIZE 16384
+/**
+ * windowBits of zlib for the gzip and the zlib formats
+ */
+#define GZIP_WINDOWBITS (15 + 16)
+#define DEFLATE_WINDOWBITS 15
+
+struct gzip_s
+{
+	gzip_config_t config;
+	http_server_t *server;
+};
+
+typedef struct gzip_stream_s gzip_stream_t;
+struct gzip_stream_s
+{
+	z_stream z;
+	http_encoder_write_t write;
+	void *writearg;
+	unsigned char out[GZIP_CHUNKSIZE];
+};
+
+static const char *_gzip_defaulttypes[] =
+{
+	"text/",
+	"application/json",
+	"application/javascript",
+	"application/xml",
+	"image/svg+xml",
+	NULL
+};
+
+static const gzip_config_t _gzip_defaultconfig =
+{
+	.level = GZIP_LEVEL,
+	.minlength = GZIP_MINLENGTH,
+	.types = _gzip_defaulttypes,
+};
+
+static int _gzip_compressible(gzip_t *ctx, const char *contenttype)
+{
+	if (contenttype == NULL)
+		return 0;
+	const char **type;
+	for (type = ctx->config.types; *type != NULL; type++)
+	{
+		if (!strncasecmp(contenttype, *type, strlen(*type)))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief the level decreases with the load of the server
+ */
+static int _gzip_level(gzip_t *ctx)
+{
+	int load = httpserver_load(ctx->server);
+	if (load > 100)
+		load = 100;
+	int level = ctx->config.level - ((ctx->config.level - 1) * load) / 100;
+	gzip_dbg("gzip: level %d for load %d%%", level, load);
+	return level;
+}
+
+static void *_gzip_createstream(gzip_t *ctx, int windowbits, const char *contenttype,
+			unsigned long long length, http_encoder_write_t write, void *writearg)
+{
+	if (!_gzip_compressible(ctx, contenttype))
+		return NULL;
+	if (length != (unsigned long long)-1 && length < ctx->config.minlength)
+		return NULL;
+	gzip_stream_t *stream = calloc(1, sizeof(*stream));
+	if (stream == NULL)
+		return NULL;
+	if (deflateInit2(&stream->z, _gzip_level(ctx), Z_DEFLATED, windowbits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		err("gzip: initialization error");
+		free(stream);
+		return NULL;
+	}
+	stream->write = write;
+	stream->writearg = writearg;
+	return stream;
+}
+
+static void *_gzip_create(void *arg, const char *contenttype, unsigned long long length,
+			http_encoder_write_t write, void *writearg)
+{
+	return _gzip_createstream(arg, GZIP_WINDOWBITS, contenttype, length, write, writearg);
+}
+
+static void *_deflate_create(void *arg, const char *contenttype, unsigned long long length,
+			http_encoder_write_t write, void *writearg)
+{
+	return _gzip_createstream(arg, DEFLATE_WINDOWBITS, contenttype, length, write, writearg);
+}
+
+static int _gzip_encode(void *arg, const char *data, int length, int flush)
+{
+	gzip_stream_t *stream = (gzip_stream_t *)arg;
+	int zflush = Z_NO_FLUSH;
+	if (flush == ENCODER_FLUSH)
+		zflush = Z_SYNC_FLUSH;
+	else if (flush == ENCODER_END)
+		zflush = Z_FINISH;
+	stream->z.next_in = (unsigned char *)data;
+	stream->z.avail_in = length;
+	int ret;
+	do
+	{
+		stream->z.next_out = stream->out;
+		stream->z.avail_out = sizeof(stream->out);
+		ret = deflate(&stream->z, zflush);
+		if (ret == Z_STREAM_ERROR)
+		{
+			err("gzip: compression error");
+			return EREJECT;
+		}
+		int size = sizeof(stream->out) - stream->z.avail_out;
+		if (size > 0 && stream->write(stream->writearg, (const char *)stream->out, size) != ESUCCESS)
+			return EREJECT;
+	} while (stream->z.avail_out == 0 || (zflush == Z_FINISH && ret != Z_STREAM_END));
+	return ESUCCESS;
+}
+
+static void _gzip_destroy(void *arg)
+{
+	gzip_stream_t *stream = (gzip_stream_t *)arg;
+	deflateEnd(&stream->z);
+	free(stream);
+}
+
+static const http_encoder_t _gzip_encoder =
+{
+	.name = "gzip",
+	.create = _gzip_create,
+	.encode = _gzip_encode,
+	.destroy = _gzip_destroy,
+};
+
+static const http_encoder_t _deflate_encoder =
+{
+	.name = "deflate",
+	.create = _deflate_create,
+	.encode = _gzip_encode,
+	.destroy = _gzip_destroy,
+};
+
+gzip_t *gzip_create(http_server_t *server, const gzip_config_t *config)
+{
+	if (config == NULL)
+		config = &_gzip_defaultconfig;
+	gzip_t *ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL)
+		return NULL;
+	ctx->config = *config;
+	if (ctx->config.types == NULL)
+		ctx->config.types = _gzip_defaulttypes;
+	if (ctx->config.level < 1 || ctx->config.level > 9)
+		ctx->config.level = GZIP_LEVEL;
+	ctx->server = server;
+	/**
+	 * gzip is preferred, some clients of deflate expect the raw format
+	 */
+	httpserver_addencoder(server, &_gzip_encoder, ctx);
+	httpserver_addencoder(server, &_deflate_encoder, ctx);
+	return ctx;
+}
+
+void gzip_destroy(gzip_t *ctx)
+{
+	free(ctx);
+}
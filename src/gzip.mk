@@ -0,0 +1,8 @@
+lib-$(SHARED)+=ouigzip
+slib-$(STATIC)+=ouigzip
+ouigzip_SOURCES=gzip.c
+ouigzip_CFLAGS+=-I../include/ouistiti
+ouigzip_LIBS+=z
+ouigzip_PKGCONFIG:=ouistiti
+
+ouigzip_CFLAGS-$(DEBUG)+=-g -DDEBUG
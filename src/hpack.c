@@ -0,0 +1,976 @@
+/*****************************************************************************
+ * hpack.c: HPACK header compression (RFC 7541)
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef USE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "log.h"
+#include "httpserver.h"
+#include "hpack.h"
+
+#define hpack_dbg(...)
+
+#define HPACK_ENTRYOVERHEAD 32
+#define HPACK_STATICENTRIES 61
+#define HPACK_EOS 256
+
+/**
+ * indexes of the static table used by the encoder
+ */
+#define HPACK_STATUS 8
+#define HPACK_AUTHORIZATION 23
+#define HPACK_CONTENTLENGTH 28
+#define HPACK_CONTENTTYPE 31
+#define HPACK_COOKIE 32
+#define HPACK_DATE 33
+#define HPACK_SERVER 54
+#define HPACK_SETCOOKIE 55
+
+typedef struct _hpack_code_s _hpack_code_t;
+struct _hpack_code_s
+{
+	uint32_t code;
+	uint8_t bits;
+};
+
+/**
+ * Huffman code of each symbol (RFC 7541 Appendix B)
+ */
+static const _hpack_code_t _hpack_huffman[257] =
+{
+	{0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+	{0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+	{0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+	{0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+	{0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+	{0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+	{0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+	{0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+	{0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+	{0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+	{0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+	{0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+	{0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+	{0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+	{0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+	{0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+	{0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+	{0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+	{0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+	{0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+	{0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+	{0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+	{0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+	{0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+	{0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+	{0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+	{0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+	{0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+	{0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+	{0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+	{0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+	{0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+	{0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+	{0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+	{0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+	{0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+	{0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+	{0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+	{0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+	{0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+	{0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+	{0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+	{0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+	{0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+	{0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+	{0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+	{0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+	{0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+	{0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+	{0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+	{0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+	{0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+	{0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+	{0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+	{0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+	{0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+	{0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+	{0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+	{0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+	{0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+	{0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+	{0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+	{0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+	{0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+	{0x3fffffff, 30},};
+
+typedef struct _hpack_static_s _hpack_static_t;
+struct _hpack_static_s
+{
+	const char *name;
+	const char *value;
+};
+
+/**
+ * static table (RFC 7541 Appendix A), the index 1 is the first entry
+ */
+static const _hpack_static_t _hpack_static[HPACK_STATICENTRIES] =
+{
+	{":authority", ""},
+	{":method", "GET"},
+	{":method", "POST"},
+	{":path", "/"},
+	{":path", "/index.html"},
+	{":scheme", "http"},
+	{":scheme", "https"},
+	{":status", "200"},
+	{":status", "204"},
+	{":status", "206"},
+	{":status", "304"},
+	{":status", "400"},
+	{":status", "404"},
+	{":status", "500"},
+	{"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"},
+	{"accept-language", ""},
+	{"accept-ranges", ""},
+	{"accept", ""},
+	{"access-control-allow-origin", ""},
+	{"age", ""},
+	{"allow", ""},
+	{"authorization", ""},
+	{"cache-control", ""},
+	{"content-disposition", ""},
+	{"content-encoding", ""},
+	{"content-language", ""},
+	{"content-length", ""},
+	{"content-location", ""},
+	{"content-range", ""},
+	{"content-type", ""},
+	{"cookie", ""},
+	{"date", ""},
+	{"etag", ""},
+	{"expect", ""},
+	{"expires", ""},
+	{"from", ""},
+	{"host", ""},
+	{"if-match", ""},
+	{"if-modified-since", ""},
+	{"if-none-match", ""},
+	{"if-range", ""},
+	{"if-unmodified-since", ""},
+	{"last-modified", ""},
+	{"link", ""},
+	{"location", ""},
+	{"max-forwards", ""},
+	{"proxy-authenticate", ""},
+	{"proxy-authorization", ""},
+	{"range", ""},
+	{"referer", ""},
+	{"refresh", ""},
+	{"retry-after", ""},
+	{"server", ""},
+	{"set-cookie", ""},
+	{"strict-transport-security", ""},
+	{"transfer-encoding", ""},
+	{"user-agent", ""},
+	{"vary", ""},
+	{"via", ""},
+	{"www-authenticate", ""},
+};
+
+typedef struct hpack_entry_s hpack_entry_t;
+struct hpack_entry_s
+{
+	int offset; /* position of the name into the ring, the value follows */
+	int namelen;
+	int valuelen;
+};
+
+struct hpack_s
+{
+	char *ring; /* strings of the dynamic table, the oldest first */
+	int ringsize;
+	int ringstart;
+	int ringlength;
+	hpack_entry_t *entries; /* ring of the entries of the dynamic table */
+	int nbentries;
+	int first; /* the oldest entry */
+	int count;
+	int size; /* sum of the sizes of the entries */
+	int maxsize; /* current size limit of the table */
+	int settingsize; /* limit given by hpack_create */
+	int update; /* the encoder sends the size update with the next block */
+	int updatemin;
+	char *string[2]; /* decoding buffers of the name and the value */
+};
+
+typedef enum
+{
+	HPACK_LITERAL,
+	HPACK_INDEXING,
+	HPACK_NEVERINDEXED,
+} _hpack_policy_e;
+
+/**
+ * the encoder adds to the dynamic table the fields that the server
+ * repeats in each response, and never indexes the credentials.
+ */
+static const uint8_t _hpack_policy[HPACK_STATICENTRIES + 1] =
+{
+	[HPACK_CONTENTTYPE] = HPACK_INDEXING,
+	[HPACK_DATE] = HPACK_INDEXING,
+	[HPACK_SERVER] = HPACK_INDEXING,
+	[HPACK_AUTHORIZATION] = HPACK_NEVERINDEXED,
+	[HPACK_COOKIE] = HPACK_NEVERINDEXED,
+	[HPACK_SETCOOKIE] = HPACK_NEVERINDEXED,
+};
+
+/**
+ * static index of the known headers, 0 for the headers forbidden
+ * with HTTP/2 or without entry.
+ */
+static const uint8_t _hpack_headers[HDR_MAX] =
+{
+	[HDR_CONTENT_LENGTH] = HPACK_CONTENTLENGTH,
+	[HDR_CONTENT_TYPE] = HPACK_CONTENTTYPE,
+	[HDR_COOKIE] = HPACK_COOKIE,
+	[HDR_HOST] = 38,
+	[HDR_ACCEPT_ENCODING] = 16,
+	[HDR_IF_NONE_MATCH] = 41,
+	[HDR_RANGE] = 50,
+	[HDR_IF_RANGE] = 42,
+	[HDR_IF_MODIFIED_SINCE] = 40,
+	[HDR_EXPECT] = 35,
+};
+
+/**
+ * The Huffman decoder reads 4 bits per step.
+ * A state is an internal node of the Huffman tree, the root is the
+ * state 0. For each state and each nibble, the transition gives the
+ * next state and the decoded symbol if a leaf is reached. The codes
+ * are at least 5 bits long, a nibble decodes one symbol at most.
+ */
+#define HPACK_HUFFMAN_EMIT 0x01
+#define HPACK_HUFFMAN_FAIL 0x02
+/** the bits since the last symbol are a valid padding */
+#define HPACK_HUFFMAN_ACCEPT 0x04
+
+typedef struct _hpack_transition_s _hpack_transition_t;
+struct _hpack_transition_s
+{
+	uint8_t state;
+	uint8_t symbol;
+	uint8_t flags;
+};
+
+static _hpack_transition_t _hpack_decoder[256][16];
+
+/**
+ * perfect hash table is not possible for names of the static table
+ * without a large table, an open addressing table is built.
+ */
+#define HPACK_NAMESLOTS 128
+static uint8_t _hpack_names[HPACK_NAMESLOTS];
+
+#ifdef USE_PTHREAD
+static pthread_once_t _hpack_once = PTHREAD_ONCE_INIT;
+#else
+static int _hpack_initialized = 0;
+#endif
+
+#define HPACK_LEAF 0x8000
+static void _hpack_huffmaninit(void)
+{
+	uint16_t tree[256][2] = {{0}};
+	uint8_t depth[256] = {0};
+	uint8_t allones[256] = {1};
+	int nbnodes = 1;
+	int symbol;
+	for (symbol = 0; symbol < 257; symbol++)
+	{
+		int node = 0;
+		int bit;
+		for (bit = _hpack_huffman[symbol].bits - 1; bit > 0; bit--)
+		{
+			int value = (_hpack_huffman[symbol].code >> bit) & 0x01;
+			if (tree[node][value] == 0)
+			{
+				tree[node][value] = nbnodes;
+				depth[nbnodes] = depth[node] + 1;
+				allones[nbnodes] = allones[node] && value;
+				nbnodes++;
+			}
+			node = tree[node][value];
+		}
+		tree[node][_hpack_huffman[symbol].code & 0x01] = HPACK_LEAF | symbol;
+	}
+
+	int state;
+	for (state = 0; state < nbnodes; state++)
+	{
+		int nibble;
+		for (nibble = 0; nibble < 16; nibble++)
+		{
+			_hpack_transition_t *transition = &_hpack_decoder[state][nibble];
+			int node = state;
+			int bit;
+			for (bit = 3; bit >= 0; bit--)
+			{
+				int child = tree[node][(nibble >> bit) & 0x01];
+				if (child & HPACK_LEAF)
+				{
+					if ((child & ~HPACK_LEAF) == HPACK_EOS)
+					{
+						transition->flags = HPACK_HUFFMAN_FAIL;
+						break;
+					}
+					transition->symbol = child & ~HPACK_LEAF;
+					transition->flags |= HPACK_HUFFMAN_EMIT;
+					node = 0;
+				}
+				else
+					node = child;
+			}
+			if (transition->flags & HPACK_HUFFMAN_FAIL)
+				continue;
+			transition->state = node;
+			if (node == 0 || (allones[node] && depth[node] < 8))
+				transition->flags |= HPACK_HUFFMAN_ACCEPT;
+		}
+	}
+}
+
+static unsigned int _hpack_hash(const char *name, int namelen)
+{
+	unsigned int hash = 2166136261U;
+	int i;
+	for (i = 0; i < namelen; i++)
+	{
+		char c = name[i];
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		hash ^= (unsigned char)c;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static void _hpack_buildtables(void)
+{
+	_hpack_huffmaninit();
+	int i;
+	for (i = 1; i <= HPACK_STATICENTRIES; i++)
+	{
+		const char *name = _hpack_static[i - 1].name;
+		if (i > 1 && !strcmp(name, _hpack_static[i - 2].name))
+			continue;
+		unsigned int slot = _hpack_hash(name, strlen(name)) % HPACK_NAMESLOTS;
+		while (_hpack_names[slot] != 0)
+			slot = (slot + 1) % HPACK_NAMESLOTS;
+		_hpack_names[slot] = i;
+	}
+}
+
+/**
+ * the tables are built once, the threads may create their contexts
+ * together.
+ */
+void hpack_init(void)
+{
+#ifdef USE_PTHREAD
+	pthread_once(&_hpack_once, _hpack_buildtables);
+#else
+	if (_hpack_initialized)
+		return;
+	_hpack_buildtables();
+	_hpack_initialized = 1;
+#endif
+}
+
+/**
+ * @return the first index of the static table with this name or 0
+ */
+static int _hpack_staticname(const char *name, int namelen)
+{
+	unsigned int slot = _hpack_hash(name, namelen) % HPACK_NAMESLOTS;
+	while (_hpack_names[slot] != 0)
+	{
+		const char *entry = _hpack_static[_hpack_names[slot] - 1].name;
+		if (strlen(entry) == namelen && !strncasecmp(entry, name, namelen))
+			return _hpack_names[slot];
+		slot = (slot + 1) % HPACK_NAMESLOTS;
+	}
+	return 0;
+}
+
+/**
+ * @return the index of the static table with this name and this value or 0
+ */
+static int _hpack_staticvalue(int index, const char *value, int valuelen)
+{
+	const char *name = _hpack_static[index - 1].name;
+	for (; index <= HPACK_STATICENTRIES && !strcmp(_hpack_static[index - 1].name, name); index++)
+	{
+		const char *entry = _hpack_static[index - 1].value;
+		if (strlen(entry) == valuelen && !memcmp(entry, value, valuelen))
+			return index;
+	}
+	return 0;
+}
+
+int hpack_huffmandecode(const uint8_t *in, int length, char *out, int size)
+{
+	hpack_init();
+	int state = 0;
+	int flags = HPACK_HUFFMAN_ACCEPT;
+	int outlength = 0;
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		const _hpack_transition_t *transition = &_hpack_decoder[state][in[i] >> 4];
+		if (transition->flags & HPACK_HUFFMAN_FAIL)
+			return EREJECT;
+		if (transition->flags & HPACK_HUFFMAN_EMIT)
+		{
+			if (outlength >= size)
+				return EREJECT;
+			out[outlength++] = transition->symbol;
+		}
+		transition = &_hpack_decoder[transition->state][in[i] & 0x0F];
+		if (transition->flags & HPACK_HUFFMAN_FAIL)
+			return EREJECT;
+		if (transition->flags & HPACK_HUFFMAN_EMIT)
+		{
+			if (outlength >= size)
+				return EREJECT;
+			out[outlength++] = transition->symbol;
+		}
+		state = transition->state;
+		flags = transition->flags;
+	}
+	/**
+	 * the padding is the beginning of EOS, less than one byte of 1
+	 */
+	if (!(flags & HPACK_HUFFMAN_ACCEPT))
+		return EREJECT;
+	return outlength;
+}
+
+static int _hpack_huffmanlength(const char *in, int length)
+{
+	int bits = 0;
+	int i;
+	for (i = 0; i < length; i++)
+		bits += _hpack_huffman[(uint8_t)in[i]].bits;
+	return (bits + 7) / 8;
+}
+
+int hpack_huffmanencode(const char *in, int length, uint8_t *out, int size)
+{
+	uint64_t bits = 0;
+	int nbbits = 0;
+	int outlength = 0;
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		const _hpack_code_t *code = &_hpack_huffman[(uint8_t)in[i]];
+		bits = (bits << code->bits) | code->code;
+		nbbits += code->bits;
+		while (nbbits >= 8)
+		{
+			if (outlength >= size)
+				return EREJECT;
+			nbbits -= 8;
+			out[outlength++] = bits >> nbbits;
+		}
+	}
+	if (nbbits > 0)
+	{
+		if (outlength >= size)
+			return EREJECT;
+		out[outlength++] = (bits << (8 - nbbits)) | (0xFF >> nbbits);
+	}
+	return outlength;
+}
+
+/*****************************************************************************
+ * dynamic table
+ ****************************************************************************/
+static const char *_hpack_ringread(hpack_t *hpack, int offset, int length, char *scratch)
+{
+	offset %= hpack->ringsize;
+	if (offset + length <= hpack->ringsize)
+		return hpack->ring + offset;
+	/**
+	 * the string wraps around the end of the ring
+	 */
+	int first = hpack->ringsize - offset;
+	memcpy(scratch, hpack->ring + offset, first);
+	memcpy(scratch + first, hpack->ring, length - first);
+	return scratch;
+}
+
+static void _hpack_ringwrite(hpack_t *hpack, const char *data, int length)
+{
+	int offset = (hpack->ringstart + hpack->ringlength) % hpack->ringsize;
+	int first = hpack->ringsize - offset;
+	if (first > length)
+		first = length;
+	memcpy(hpack->ring + offset, data, first);
+	memcpy(hpack->ring, data + first, length - first);
+	hpack->ringlength += length;
+}
+
+/**
+ * @param index 0 for the newest entry
+ */
+static hpack_entry_t *_hpack_dynamic(hpack_t *hpack, int index)
+{
+	return &hpack->entries[(hpack->first + hpack->count - 1 - index) % hpack->nbentries];
+}
+
+static void _hpack_evict(hpack_t *hpack, int needed)
+{
+	while (hpack->count > 0 && hpack->size + needed > hpack->maxsize)
+	{
+		hpack_entry_t *entry = &hpack->entries[hpack->first];
+		int length = entry->namelen + entry->valuelen;
+		hpack->ringstart = (hpack->ringstart + length) % hpack->ringsize;
+		hpack->ringlength -= length;
+		hpack->size -= HPACK_ENTRYOVERHEAD + length;
+		hpack->first = (hpack->first + 1) % hpack->nbentries;
+		hpack->count--;
+	}
+}
+
+static void _hpack_insert(hpack_t *hpack, const char *name, int namelen, const char *value, int valuelen)
+{
+	int entrysize = HPACK_ENTRYOVERHEAD + namelen + valuelen;
+	if (entrysize > hpack->maxsize)
+	{
+		/**
+		 * a too large entry empties the table
+		 */
+		_hpack_evict(hpack, hpack->maxsize + 1);
+		return;
+	}
+	/**
+	 * the name may be one of the entries to evict
+	 */
+	if (name >= hpack->ring && name < hpack->ring + hpack->ringsize)
+	{
+		memcpy(hpack->string[0], name, namelen);
+		name = hpack->string[0];
+	}
+	_hpack_evict(hpack, entrysize);
+	hpack_entry_t *entry = &hpack->entries[(hpack->first + hpack->count) % hpack->nbentries];
+	entry->offset = (hpack->ringstart + hpack->ringlength) % hpack->ringsize;
+	entry->namelen = namelen;
+	entry->valuelen = valuelen;
+	_hpack_ringwrite(hpack, name, namelen);
+	_hpack_ringwrite(hpack, value, valuelen);
+	hpack->count++;
+	hpack->size += entrysize;
+}
+
+static int _hpack_entry(hpack_t *hpack, uint32_t index,
+						const char **name, int *namelen, const char **value, int *valuelen)
+{
+	if (index == 0)
+		return EREJECT;
+	if (index <= HPACK_STATICENTRIES)
+	{
+		*name = _hpack_static[index - 1].name;
+		*namelen = strlen(*name);
+		if (value != NULL)
+		{
+			*value = _hpack_static[index - 1].value;
+			*valuelen = strlen(*value);
+		}
+		return ESUCCESS;
+	}
+	index -= HPACK_STATICENTRIES + 1;
+	if (index >= hpack->count)
+		return EREJECT;
+	const hpack_entry_t *entry = _hpack_dynamic(hpack, index);
+	*namelen = entry->namelen;
+	*name = _hpack_ringread(hpack, entry->offset, entry->namelen, hpack->string[0]);
+	*valuelen = entry->valuelen;
+	if (value != NULL)
+		*value = _hpack_ringread(hpack, entry->offset + entry->namelen, entry->valuelen, hpack->string[1]);
+	return ESUCCESS;
+}
+
+hpack_t *hpack_create(int tablesize)
+{
+	hpack_init();
+	if (tablesize < 0)
+		tablesize = 0;
+	if (tablesize > HPACK_MAXSTRING)
+		tablesize = HPACK_MAXSTRING;
+	hpack_t *hpack = calloc(1, sizeof(*hpack));
+	if (hpack == NULL)
+		return NULL;
+	hpack->maxsize = tablesize;
+	hpack->settingsize = tablesize;
+	hpack->ringsize = (tablesize > 0)? tablesize: 1;
+	hpack->nbentries = tablesize / HPACK_ENTRYOVERHEAD + 1;
+	hpack->ring = calloc(1, hpack->ringsize);
+	hpack->entries = calloc(hpack->nbentries, sizeof(*hpack->entries));
+	hpack->string[0] = calloc(2, HPACK_MAXSTRING);
+	if (hpack->ring == NULL || hpack->entries == NULL || hpack->string[0] == NULL)
+	{
+		hpack_destroy(hpack);
+		return NULL;
+	}
+	hpack->string[1] = hpack->string[0] + HPACK_MAXSTRING;
+	return hpack;
+}
+
+void hpack_destroy(hpack_t *hpack)
+{
+	if (hpack->ring)
+		free(hpack->ring);
+	if (hpack->entries)
+		free(hpack->entries);
+	if (hpack->string[0])
+		free(hpack->string[0]);
+	free(hpack);
+}
+
+int hpack_tablesize(hpack_t *hpack, int tablesize)
+{
+	if (tablesize > hpack->settingsize)
+		tablesize = hpack->settingsize;
+	if (tablesize < 0)
+		tablesize = 0;
+	if (tablesize != hpack->maxsize)
+	{
+		/**
+		 * the smallest size since the last block must be sent too
+		 */
+		if (!hpack->update || tablesize < hpack->updatemin)
+			hpack->updatemin = tablesize;
+		hpack->update = 1;
+		hpack->maxsize = tablesize;
+		_hpack_evict(hpack, 0);
+	}
+	return tablesize;
+}
+
+/*****************************************************************************
+ * decoder
+ ****************************************************************************/
+static int _hpack_integer(const uint8_t **it, const uint8_t *end, int prefix, uint32_t *value)
+{
+	uint32_t mask = (1U << prefix) - 1;
+	if (*it >= end)
+		return EREJECT;
+	*value = **it & mask;
+	(*it)++;
+	if (*value < mask)
+		return ESUCCESS;
+	int shift = 0;
+	uint8_t byte;
+	do
+	{
+		if (*it >= end || shift > 21)
+			return EREJECT;
+		byte = **it;
+		(*it)++;
+		*value += (uint32_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+	return ESUCCESS;
+}
+
+static int _hpack_string(hpack_t *hpack, const uint8_t **it, const uint8_t *end, int id,
+						const char **string, int *length)
+{
+	if (*it >= end)
+		return EREJECT;
+	int huffman = **it & 0x80;
+	uint32_t value;
+	if (_hpack_integer(it, end, 7, &value) != ESUCCESS || value > (end - *it))
+		return EREJECT;
+	if (huffman)
+	{
+		int ret = hpack_huffmandecode(*it, value, hpack->string[id], HPACK_MAXSTRING);
+		if (ret < 0)
+			return EREJECT;
+		*string = hpack->string[id];
+		*length = ret;
+	}
+	else
+	{
+		*string = (const char *)*it;
+		*length = value;
+	}
+	*it += value;
+	return ESUCCESS;
+}
+
+int hpack_decode(hpack_t *hpack, const uint8_t *block, int length, hpack_field_t cb, void *arg)
+{
+	const uint8_t *it = block;
+	const uint8_t *end = block + length;
+	while (it < end)
+	{
+		const char *name = NULL;
+		const char *value = NULL;
+		int namelen = 0;
+		int valuelen = 0;
+		uint32_t index;
+		int indexing = 0;
+		if (*it & 0x80)
+		{
+			if (_hpack_integer(&it, end, 7, &index) != ESUCCESS ||
+				_hpack_entry(hpack, index, &name, &namelen, &value, &valuelen) != ESUCCESS)
+				return EREJECT;
+		}
+		else if ((*it & 0xE0) == 0x20)
+		{
+			/**
+			 * dynamic table size update
+			 */
+			if (_hpack_integer(&it, end, 5, &index) != ESUCCESS ||
+				index > hpack->settingsize)
+				return EREJECT;
+			hpack->maxsize = index;
+			_hpack_evict(hpack, 0);
+			continue;
+		}
+		else
+		{
+			/**
+			 * literal with incremental indexing (01), without indexing (0000)
+			 * or never indexed (0001)
+			 */
+			int prefix = 4;
+			if (*it & 0x40)
+			{
+				indexing = 1;
+				prefix = 6;
+			}
+			if (_hpack_integer(&it, end, prefix, &index) != ESUCCESS)
+				return EREJECT;
+			if (index > 0)
+			{
+				if (_hpack_entry(hpack, index, &name, &namelen, NULL, &valuelen) != ESUCCESS)
+					return EREJECT;
+			}
+			else if (_hpack_string(hpack, &it, end, 0, &name, &namelen) != ESUCCESS)
+				return EREJECT;
+			if (_hpack_string(hpack, &it, end, 1, &value, &valuelen) != ESUCCESS)
+				return EREJECT;
+		}
+		hpack_dbg("hpack: %.*s: %.*s", namelen, name, valuelen, value);
+		if (cb(arg, name, namelen, value, valuelen) != ESUCCESS)
+			return EREJECT;
+		if (indexing)
+			_hpack_insert(hpack, name, namelen, value, valuelen);
+	}
+	return ESUCCESS;
+}
+
+/*****************************************************************************
+ * encoder
+ ****************************************************************************/
+static int _hpack_putinteger(uint8_t *out, int size, int prefix, uint8_t flags, uint32_t value)
+{
+	uint32_t mask = (1U << prefix) - 1;
+	int length = 0;
+	if (size < 1)
+		return EREJECT;
+	if (value < mask)
+	{
+		out[length++] = flags | value;
+		return length;
+	}
+	out[length++] = flags | mask;
+	value -= mask;
+	while (value >= 0x80)
+	{
+		if (length >= size)
+			return EREJECT;
+		out[length++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	if (length >= size)
+		return EREJECT;
+	out[length++] = value;
+	return length;
+}
+
+/**
+ * the string is coded with Huffman when it is shorter
+ */
+static int _hpack_putstring(uint8_t *out, int size, const char *string, int length)
+{
+	int huffman = _hpack_huffmanlength(string, length);
+	int ret;
+	if (huffman < length)
+	{
+		ret = _hpack_putinteger(out, size, 7, 0x80, huffman);
+		if (ret < 0 || ret + huffman > size)
+			return EREJECT;
+		hpack_huffmanencode(string, length, out + ret, size - ret);
+		return ret + huffman;
+	}
+	ret = _hpack_putinteger(out, size, 7, 0x00, length);
+	if (ret < 0 || ret + length > size)
+		return EREJECT;
+	memcpy(out + ret, string, length);
+	return ret + length;
+}
+
+static int _hpack_encodeupdate(hpack_t *hpack, uint8_t *out, int size)
+{
+	if (!hpack->update)
+		return 0;
+	int length = 0;
+	if (hpack->updatemin < hpack->maxsize)
+		length = _hpack_putinteger(out, size, 5, 0x20, hpack->updatemin);
+	if (length < 0)
+		return EREJECT;
+	int ret = _hpack_putinteger(out + length, size - length, 5, 0x20, hpack->maxsize);
+	if (ret < 0)
+		return EREJECT;
+	hpack->update = 0;
+	return length + ret;
+}
+
+/**
+ * @return the index of the dynamic table with the field or 0
+ */
+static int _hpack_search(hpack_t *hpack, const char *name, int namelen, const char *value, int valuelen)
+{
+	int i;
+	for (i = 0; i < hpack->count; i++)
+	{
+		const hpack_entry_t *entry = _hpack_dynamic(hpack, i);
+		if (entry->namelen != namelen || entry->valuelen != valuelen)
+			continue;
+		const char *entryname;
+		const char *entryvalue;
+		_hpack_entry(hpack, HPACK_STATICENTRIES + 1 + i, &entryname, &namelen, &entryvalue, &valuelen);
+		if (!memcmp(entryvalue, value, valuelen) && !strncasecmp(entryname, name, namelen))
+			return HPACK_STATICENTRIES + 1 + i;
+	}
+	return 0;
+}
+
+/**
+ * @param nameindex	the index of the name into the static table or 0
+ */
+static int _hpack_encodefield(hpack_t *hpack, uint8_t *out, int size, int nameindex,
+							const char *name, int namelen, const char *value, int valuelen)
+{
+	int length = _hpack_encodeupdate(hpack, out, size);
+	if (length < 0)
+		return EREJECT;
+	int policy = _hpack_policy[nameindex];
+	int index = 0;
+	if (nameindex > 0)
+		index = _hpack_staticvalue(nameindex, value, valuelen);
+	if (index == 0 && policy == HPACK_INDEXING)
+		index = _hpack_search(hpack, name, namelen, value, valuelen);
+	int ret;
+	if (index > 0)
+	{
+		ret = _hpack_putinteger(out + length, size - length, 7, 0x80, index);
+		return (ret < 0)? EREJECT: length + ret;
+	}
+
+	if (policy == HPACK_INDEXING)
+		ret = _hpack_putinteger(out + length, size - length, 6, 0x40, nameindex);
+	else if (policy == HPACK_NEVERINDEXED)
+		ret = _hpack_putinteger(out + length, size - length, 4, 0x10, nameindex);
+	else
+		ret = _hpack_putinteger(out + length, size - length, 4, 0x00, nameindex);
+	if (ret < 0)
+		return EREJECT;
+	length += ret;
+	if (nameindex == 0)
+	{
+		/**
+		 * the names are lower case with HTTP/2
+		 */
+		if (namelen > HPACK_MAXSTRING)
+			return EREJECT;
+		char *lower = hpack->string[0];
+		int i;
+		for (i = 0; i < namelen; i++)
+		{
+			char c = name[i];
+			if (c >= 'A' && c <= 'Z')
+				c += 'a' - 'A';
+			lower[i] = c;
+		}
+		ret = _hpack_putstring(out + length, size - length, lower, namelen);
+		if (ret < 0)
+			return EREJECT;
+		length += ret;
+	}
+	ret = _hpack_putstring(out + length, size - length, value, valuelen);
+	if (ret < 0)
+		return EREJECT;
+	if (policy == HPACK_INDEXING)
+		_hpack_insert(hpack, _hpack_static[nameindex - 1].name, namelen, value, valuelen);
+	return length + ret;
+}
+
+int hpack_encode(hpack_t *hpack, uint8_t *out, int size, const char *name, int namelen, const char *value, int valuelen)
+{
+	int nameindex = _hpack_staticname(name, namelen);
+	return _hpack_encodefield(hpack, out, size, nameindex, name, namelen, value, valuelen);
+}
+
+int hpack_encodeheader(hpack_t *hpack, uint8_t *out, int size, http_header_e id, const char *value, int valuelen)
+{
+	if (id < 0 || id >= HDR_MAX || _hpack_headers[id] == 0)
+		return EREJECT;
+	int nameindex = _hpack_headers[id];
+	const char *name = _hpack_static[nameindex - 1].name;
+	return _hpack_encodefield(hpack, out, size, nameindex, name, strlen(name), value, valuelen);
+}
+
+int hpack_encodestatus(hpack_t *hpack, uint8_t *out, int size, int status)
+{
+	char value[4];
+	value[0] = '0' + (status / 100) % 10;
+	value[1] = '0' + (status / 10) % 10;
+	value[2] = '0' + status % 10;
+	value[3] = '\0';
+	return _hpack_encodefield(hpack, out, size, HPACK_STATUS, ":status", 7, value, 3);
+}
@@ -0,0 +1,17 @@
+lib-$(SHARED)+=ouihpack
+slib-$(STATIC)+=ouihpack
+ouihpack_SOURCES=hpack.c
+ouihpack_CFLAGS+=-I../include/ouistiti
+ouihpack_PKGCONFIG:=ouistiti
+
+ifeq ($(VTHREAD_TYPE),pthread)
+ouihpack_CFLAGS-$(VTHREAD)+=-DUSE_PTHREAD
+ouihpack_LIBS-$(VTHREAD)+=pthread
+endif
+
+ouihpack_CFLAGS-$(DEBUG)+=-g -DDEBUG
+
+bin-$(BENCH)+=hpackbench
+hpackbench_SOURCES=hpackbench.c
+hpackbench_CFLAGS+=-I../include/ouistiti
+hpackbench_LIBS+=ouihpack
@@ -0,0 +1,151 @@
+/*****************************************************************************
+ * hpackbench.c: microbenchmarks of the HPACK library
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "httpserver.h"
+#include "hpack.h"
+
+#define BENCH_LOOPS 200000
+
+static const char *request[][2] =
+{
+	{":method", "GET"},
+	{":scheme", "https"},
+	{":path", "/static/style.css?version=3.1"},
+	{":authority", "www.example.com"},
+	{"user-agent", "Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0"},
+	{"accept", "text/css,*/*;q=0.1"},
+	{"accept-language", "en-US,en;q=0.5"},
+	{"accept-encoding", "gzip, deflate, br"},
+	{"referer", "https://www.example.com/index.html"},
+	{"cookie", "session=4f8a2c6b1d9e3f70"},
+};
+
+static const char *response[][2] =
+{
+	{"Server", "ouistiti/3.1"},
+	{"Date", "Sun, 18 Oct 2026 10:00:00 GMT"},
+	{"Content-Type", "text/css"},
+	{"Content-Length", "4096"},
+	{"Cache-Control", "max-age=3600"},
+};
+
+static double _bench_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void _bench_result(const char *name, double start, int loops, long bytes)
+{
+	double elapsed = _bench_now() - start;
+	printf("%-24s %8.1f ns/op %8.1f MB/s\n", name,
+		elapsed * 1e9 / loops, bytes / elapsed / 1e6);
+}
+
+static int _bench_field(void *arg, const char *name, int namelen, const char *value, int valuelen)
+{
+	long *count = arg;
+	*count += namelen + valuelen;
+	return ESUCCESS;
+}
+
+static int _bench_request(uint8_t *block, int size)
+{
+	hpack_t *encoder = hpack_create(HPACK_TABLESIZE);
+	int length = 0;
+	unsigned int i;
+	for (i = 0; i < sizeof(request) / sizeof(request[0]); i++)
+	{
+		int ret = hpack_encode(encoder, block + length, size - length,
+				request[i][0], strlen(request[i][0]), request[i][1], strlen(request[i][1]));
+		if (ret < 0)
+			break;
+		length += ret;
+	}
+	hpack_destroy(encoder);
+	return length;
+}
+
+int main(int argc, char **argv)
+{
+	int loops = BENCH_LOOPS;
+	if (argc > 1)
+		loops = atoi(argv[1]);
+
+	uint8_t block[1024];
+	int length = _bench_request(block, sizeof(block));
+	long count = 0;
+	int i;
+
+	hpack_t *decoder = hpack_create(HPACK_TABLESIZE);
+	double start = _bench_now();
+	for (i = 0; i < loops; i++)
+		hpack_decode(decoder, block, length, _bench_field, &count);
+	hpack_destroy(decoder);
+	_bench_result("decode request", start, loops, (long)length * loops);
+
+	const char *string = request[4][1];
+	int stringlen = strlen(string);
+	uint8_t coded[256];
+	char decoded[256];
+	int codedlen = hpack_huffmanencode(string, stringlen, coded, sizeof(coded));
+	start = _bench_now();
+	for (i = 0; i < loops; i++)
+		hpack_huffmanencode(string, stringlen, coded, sizeof(coded));
+	_bench_result("huffman encode", start, loops, (long)stringlen * loops);
+	start = _bench_now();
+	for (i = 0; i < loops; i++)
+		hpack_huffmandecode(coded, codedlen, decoded, sizeof(decoded));
+	_bench_result("huffman decode", start, loops, (long)stringlen * loops);
+
+	/**
+	 * the responses of one connection share the dynamic table
+	 */
+	hpack_t *encoder = hpack_create(HPACK_TABLESIZE);
+	long bytes = 0;
+	start = _bench_now();
+	for (i = 0; i < loops; i++)
+	{
+		length = hpack_encodestatus(encoder, block, sizeof(block), 200);
+		unsigned int j;
+		for (j = 0; j < sizeof(response) / sizeof(response[0]); j++)
+			length += hpack_encode(encoder, block + length, sizeof(block) - length,
+				response[j][0], strlen(response[j][0]), response[j][1], strlen(response[j][1]));
+		bytes += length;
+	}
+	_bench_result("encode response", start, loops, bytes);
+	printf("response block %d bytes\n", length);
+	hpack_destroy(encoder);
+	return (count > 0)? 0: -1;
+}
@@ -36,17 +36,25 @@ struct buffer_s
 	int size;
 	int length;
 	int maxchunks;
+	int mapped; /* the data is a private mapping released with munmap */
+	int mapsize; /* the size of the mapping, the buffer may use only a part of it */
+	unsigned int release; /* the id of the last sending without copy of the mapping */
+	buffer_t *next;
 };
 
 buffer_t * _buffer_create(int maxchunks);
+buffer_t * _buffer_map(int length);
+int _buffer_remap(buffer_t *buffer, int length);
 int _buffer_chunksize(int new);
+int _buffer_reserve(buffer_t *buffer, int length);
+int _buffer_space(buffer_t *buffer);
 char *_buffer_append(buffer_t *buffer, const char *data, int length);
 char *_buffer_pop(buffer_t *buffer, int length);
 void _buffer_shrink(buffer_t *buffer, int reset);
 void _buffer_reset(buffer_t *buffer);
 int _buffer_rewindto(buffer_t *buffer, char needle);
-int _buffer_dbentry(buffer_t *storage, dbentry_t **db, char *key, const char * value);
-int _buffer_filldb(buffer_t *storage, dbentry_t **db, char separator, char fieldsep);
+int _buffer_dbentry(buffer_t *storage, dbtable_t *db, char *key, const char * value);
+int _buffer_filldb(buffer_t *storage, dbtable_t *db, char separator, char fieldsep);
 int _buffer_empty(buffer_t *buffer);
 int _buffer_full(buffer_t *buffer);
 char _buffer_last(buffer_t *buffer);
@@ -36,16 +36,48 @@
 #define CLIENT_ERROR 0x2000
 #define CLIENT_RESPONSEREADY 0x4000
 #define CLIENT_KEEPALIVE 0x8000
+#define CLIENT_ZEROCOPY 0x10000
+#define CLIENT_PIPELINE 0x20000
+#define CLIENT_WAITSOURCE 0x40000
 #define CLIENT_MACHINEMASK 0x000F
 #define CLIENT_NEW 0x0000
 #define CLIENT_READING 0x0001
 #define CLIENT_WAITING 0x0002
 #define CLIENT_SENDING 0x0003
+#define CLIENT_RELAY 0x0004
 #define CLIENT_EXIT 0x0009
 #define CLIENT_DEAD 0x000A
 
 #define WAIT_TIMER 2 //seconds
 
+/**
+ * number of requests parsed in one pass of the reception buffer
+ */
+#ifndef HTTPCLIENT_PIPELINE
+#define HTTPCLIENT_PIPELINE 8
+#endif
+
+/**
+ * number of mappings released by the kernel kept for the next responses
+ */
+#ifndef HTTPCLIENT_MAPPINGS
+#define HTTPCLIENT_MAPPINGS 2
+#endif
+
+/**
+ * maximum length of a file sent with one call to the ops
+ */
+#ifndef HTTPCLIENT_FILECHUNK
+#define HTTPCLIENT_FILECHUNK (1024 * 1024)
+#endif
+
+/**
+ * length of the file read into the memory when the ops cannot send it
+ */
+#ifndef HTTPCLIENT_FILEREAD
+#define HTTPCLIENT_FILEREAD (16 * 1024)
+#endif
+
 struct http_client_modctx_s
 {
 	void *ctx;
@@ -55,6 +87,23 @@ struct http_client_modctx_s
 };
 typedef struct http_client_modctx_s http_client_modctx_t;
 
+/**
+ * the connection relayed with another socket after an upgrade or a
+ * CONNECT, each direction uses its own pipe.
+ */
+#define RELAY_FROMCLIENT 0
+#define RELAY_TOCLIENT 1
+typedef struct http_client_relay_s http_client_relay_t;
+struct http_client_relay_s
+{
+	int sock;
+	int pipes[2][2];
+	int capacity; /* size of the pipes */
+	int pending[2]; /* data into the pipes */
+	int closed[2]; /* the source of the direction sent its end */
+	int shut[2]; /* the end is sent to the destination */
+};
+
 struct http_client_s
 {
 	int sock;
@@ -78,6 +127,18 @@ struct http_client_s
 	http_client_modctx_t *modctx; /* list of pointers returned by getctx of each mod */
 
 	buffer_t *sockdata;
+	unsigned int zerocopy_sent; /* number of sendzerocopy calls */
+	unsigned int zerocopy_done; /* number of sendzerocopy released by the kernel */
+	buffer_t *zerocopy_pending; /* mappings in sending, waiting the release of the kernel */
+	buffer_t *zerocopy_free; /* mappings released, ready for the next reservation */
+	struct iovec pipeline[HTTPCLIENT_PIPELINE * 2]; /* parts of the responses to send together */
+	int pipeline_count;
+	http_message_t *pipeline_done; /* requests with a response waiting into pipeline */
+	char *sendrest; /* the end of the buffers refused by the socket */
+	int sendrest_length;
+	int sendrest_size;
+	http_client_relay_t *relay;
+	http_message_t *streaming; /* the request of the stream sending its response */
 
 	http_server_session_t *session;
 	struct sockaddr_storage addr;
@@ -88,6 +149,8 @@ typedef struct http_client_s http_client_t;
 
 int httpclient_socket(http_client_t *client);
 int _httpclient_run(http_client_t *client);
+buffer_t *_httpclient_mapbuffer(http_client_t *client, int length);
+int _httpclient_relayevents(http_client_t *client, short events[2]);
 #ifdef HTTPCLIENT_FEATURES
 void httpclient_appendops(const httpclient_ops_t *ops);
 const httpclient_ops_t *httpclient_ops();
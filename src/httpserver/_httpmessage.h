@@ -41,6 +41,23 @@
 
 #define HTTPMESSAGE_KEEPALIVE 0x01
 #define HTTPMESSAGE_LOCKED 0x02
+#define HTTPMESSAGE_CHUNKED 0x04
+#define HTTPMESSAGE_LARGEHEAD 0x08
+#define HTTPMESSAGE_DECHUNK 0x10
+#define HTTPMESSAGE_EXPECTCONTINUE 0x20
+#define HTTPMESSAGE_CONTINUED 0x40
+#define HTTPMESSAGE_STREAM 0x80 /* the request comes from a stream of a multiplexed connection */
+
+#ifndef HTTPMESSAGE_MAXRANGES
+#define HTTPMESSAGE_MAXRANGES 16
+#endif
+/**
+ * maximum size of the query with the urlencoded content
+ */
+#ifndef HTTPMESSAGE_FORMMAX
+#define HTTPMESSAGE_FORMMAX (64 * 1024)
+#endif
+#define HTTPMESSAGE_ARENABLOCK 512
 
 extern const char str_true[];
 extern const char str_get[];
@@ -54,6 +71,35 @@ extern const char str_contentlength[];
 
 typedef struct buffer_s buffer_t;
 
+typedef struct http_message_range_s http_message_range_t;
+struct http_message_range_s
+{
+	unsigned long long offset; /* into the file or the content */
+	unsigned long long length;
+	char header[72]; /* the end of the part's header or the closing boundary */
+	int headerlength;
+};
+
+/**
+ * the arena keeps the memory of the message until its destruction,
+ * the blocks are never moved.
+ */
+typedef struct http_message_arena_s http_message_arena_t;
+struct http_message_arena_s
+{
+	http_message_arena_t *next;
+	int size;
+	int length;
+	char data[];
+};
+
+typedef struct http_message_parameter_s http_message_parameter_t;
+struct http_message_parameter_s
+{
+	unsigned int offset; /* the encoded value into query_storage */
+	int length; /* -1 for a parameter without value */
+};
+
 typedef struct http_connector_list_s http_connector_list_t;
 struct http_connector_list_s
 {
@@ -99,6 +145,7 @@ struct http_message_s
 		GENERATE_END = 0x00F0,
 		GENERATE_MASK = 0x00F0,
 		PARSE_CONTINUE = 0x0100,
+		PARSE_HEADERVALUE = 0x0200, /* the colon of the current header line is parsed */
 	}
 	state;
 	buffer_t *content;
@@ -106,18 +153,41 @@ struct http_message_s
 	buffer_t *header;
 	unsigned long long content_length;
 	unsigned int content_packet;
+	int file; /* file descriptor of the content, see httpmessage_addfile */
+	unsigned long long file_offset; /* (unsigned long long)-1 for a pipe */
+	unsigned long long file_length;
+	buffer_t *file_storage; /* the part of the file read when the ops cannot send it */
+	int source; /* descriptor waited by the connector, see httpmessage_source */
+	short source_events;
+	http_message_range_t *ranges; /* parts of multipart/byteranges, see _httpmessage_range */
+	int nranges;
+	int range; /* the next part to send, the last one is the closing boundary */
+	buffer_t *ranges_storage; /* the beginning of the parts' header */
+	const http_encoder_t *encoder; /* see _httpmessage_encoding */
+	void *encoderctx;
+	http_chunk_t chunk; /* the decoder of the chunked content */
+	buffer_t *trailers_storage;
+	dbtable_t *trailers;
 	const char *content_type;
 	buffer_t *uri;
 	http_message_version_e version;
 	buffer_t *headers_storage;
-	dbentry_t *headers;
+	dbtable_t headers;
+	const char *knownheaders[HDR_MAX];
 	char *query;
-	buffer_t *query_storage;
-	dbentry_t *queries;
+	buffer_t *query_storage; /* the query and the urlencoded content, never changed */
+	dbtable_t queries; /* the decoded keys, the values are decoded on the first access */
+	http_message_parameter_t *parameters; /* the encoded values of the queries entries */
+	int nbparameters; /* the size of parameters */
+	unsigned int query_token; /* the beginning of the parameter not yet complete */
+	unsigned int query_equal; /* the position after '=' into this parameter or 0 */
+	unsigned int query_scanned; /* the length of query_storage already tokenized */
+	http_message_arena_t *arena;
 	const char *cookie;
 	buffer_t *cookie_storage;
-	dbentry_t *cookies;
+	dbtable_t cookies;
 	void *private;
+	void *stream; /* see httpclient_openstream */
 	http_message_t *next;
 	char decodeval;
 };
@@ -150,17 +220,24 @@ typedef enum
 } _http_message_method_e;
 
 
+void _httpmessage_init(void);
 http_message_t * _httpmessage_create(http_client_t *client, http_message_t *parent);
 void _httpmessage_destroy(http_message_t *message);
 int _httpmessage_buildresponse(http_message_t *message, int version, buffer_t *header);
 buffer_t *_httpmessage_buildheader(http_message_t *message);
+int _httpmessage_buildhead(http_message_t *message, buffer_t *header);
+int _httpmessage_buildfields(http_message_t *message);
 int _httpmessage_parserequest(http_message_t *message, buffer_t *data);
+int _httpmessage_requestline(http_message_t *message, const char *method, const char *uri);
 int _httpmessage_fillheaderdb(http_message_t *message);
 char *_httpmessage_status(http_message_t *message);
 int _httpmessage_changestate(http_message_t *message, int new);
 int _httpmessage_state(http_message_t *message, int check);
 int _httpmessage_contentempty(http_message_t *message, int unset);
 int _httpmessage_runconnector(http_message_t *request, http_message_t *response);
+int _httpmessage_range(http_message_t *request, http_message_t *response);
+int _httpmessage_encoding(http_message_t *request, http_message_t *response,
+					http_encoder_write_t write, void *writearg);
 
 #ifdef _HTTPMESSAGE_
 const _http_message_result_t *_http_message_result[] =
@@ -257,6 +334,9 @@ const _http_message_result_t *_http_message_result[] =
 #if defined(RESULT_415)
 	&(_http_message_result_t){.result = RESULT_415, .status = " 415 Unsupported Media Type"},
 #endif
+#if defined(RESULT_431)
+	&(_http_message_result_t){.result = RESULT_431, .status = " 431 Request Header Fields Too Large"},
+#endif
 #if defined(RESULT_416)
 	&(_http_message_result_t){.result = RESULT_416, .status = " 416 Range Not Satisfiable"},
 #endif
@@ -59,6 +59,14 @@ struct httpserver_ops_s
 
 typedef struct http_server_mod_s http_server_mod_t;
 
+typedef struct http_encoder_list_s http_encoder_list_t;
+struct http_encoder_list_s
+{
+	const http_encoder_t *encoder;
+	void *arg;
+	http_encoder_list_t *next;
+};
+
 struct http_server_s
 {
 	int sock;
@@ -69,17 +77,20 @@ struct http_server_s
 	http_connector_list_t *callbacks;
 	http_server_config_t *config;
 	http_server_mod_t *mod;
+	http_encoder_list_t *encoders;
 	const httpserver_ops_t *ops;
 	const httpclient_ops_t *protocol_ops;
 	void *protocol;
 	http_message_method_t *methods;
 	buffer_t *methods_storage;
+	buffer_t *headers_storage;
 #ifdef USE_POLL
 	struct pollfd *poll_set;
 #else
 	fd_set fds[3];
 #endif
 	int numfds;
+	int nbclients;
 	http_server_t *next;
 };
 
@@ -89,5 +100,7 @@ struct http_server_session_s
 	buffer_t *storage;
 };
 
+const char *_httpserver_headers(http_server_t *server, int *length);
+
 #endif
 
@@ -0,0 +1,61 @@
+/*****************************************************************************
+ * _scan.h: delimiters scanning private data
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+
+#ifndef ___SCAN_H__
+#define ___SCAN_H__
+
+#define SCAN_MAXNEEDLES 8
+
+typedef struct scan_s scan_t;
+struct scan_s
+{
+	char needles[SCAN_MAXNEEDLES];
+	int nbneedles;
+	/** bitmap of the needles for the scalar version */
+	unsigned char map[256 / 8];
+};
+
+void _scan_init(scan_t *scan, const char *needles, int nbneedles);
+/**
+ * @brief select the version of _scan_find for the CPU
+ *
+ * It must be called before the start of the threads, see _httpmessage_init.
+ */
+void _scan_select(void);
+/**
+ * @brief search the first needle of the set
+ *
+ * @param scan the set of needles
+ * @param start the first character to check
+ * @param end the end of the data
+ *
+ * @return the pointer on the needle or end if not found
+ */
+char *_scan_find(const scan_t *scan, const char *start, const char *end);
+
+#endif
@@ -39,6 +39,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/mman.h>
 
 #ifdef USE_STDARG
 #include <stdarg.h>
@@ -51,6 +52,7 @@
 #include "_httpserver.h"
 #include "_httpmessage.h"
 #include "_buffer.h"
+#include "_scan.h"
 #include "dbentry.h"
 
 #ifndef HTTPMESSAGE_CHUNKSIZE
@@ -89,6 +91,58 @@ buffer_t * _buffer_create(int maxchunks)
 	return buffer;
 }
 
+/**
+ * @brief create a buffer of length bytes into its own mapping
+ *
+ * The buffer is filled by the connector and does not grow. Its pages
+ * may be sent without copy, then the mapping must stay unchanged
+ * until the kernel notifies the end of the sending.
+ */
+buffer_t * _buffer_map(int length)
+{
+	buffer_t *buffer = vcalloc(1, sizeof(*buffer));
+	if (buffer == NULL)
+		return NULL;
+#ifdef MAP_ANONYMOUS
+	buffer->data = mmap(NULL, length + 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buffer->data == MAP_FAILED)
+		buffer->data = NULL;
+	else
+		buffer->mapped = 1;
+#else
+	buffer->data = vcalloc(1, length + 1);
+#endif
+	if (buffer->data == NULL)
+	{
+		vfree(buffer);
+		return NULL;
+	}
+	buffer->mapsize = length + 1;
+	buffer->size = length + 1;
+	buffer->length = length;
+	/**
+	 * the offset after the end refuses any append
+	 */
+	buffer->offset = buffer->data + buffer->size;
+	return buffer;
+}
+
+/**
+ * @brief use again a mapping released by the kernel for length bytes
+ *
+ * @return ESUCCESS or EREJECT if the mapping is too small
+ */
+int _buffer_remap(buffer_t *buffer, int length)
+{
+	if (!buffer->mapped || length + 1 > buffer->mapsize)
+		return EREJECT;
+	buffer->size = length + 1;
+	buffer->length = length;
+	buffer->offset = buffer->data + buffer->size;
+	buffer->next = NULL;
+	return ESUCCESS;
+}
+
 int _buffer_chunksize(int new)
 {
 	if (new > 0)
@@ -96,6 +150,47 @@ int _buffer_chunksize(int new)
 	return ChunkSize;
 }
 
+/**
+ * @brief grow the buffer to receive length bytes after the data
+ *
+ * @return ESUCCESS or EREJECT if the buffer cannot grow enough
+ */
+int _buffer_reserve(buffer_t *buffer, int length)
+{
+	int missing = buffer->length + length + 1 - buffer->size;
+	if (missing <= 0)
+		return ESUCCESS;
+	int nbchunks = (missing + ChunkSize - 1) / ChunkSize;
+	int chunksize = ChunkSize * nbchunks;
+	if (nbchunks > buffer->maxchunks || (buffer->size + chunksize) > BUFFERMAX)
+		return EREJECT;
+	char *newptr = vrealloc(buffer->data, buffer->size + chunksize);
+	if (newptr == NULL)
+		return EREJECT;
+	buffer->offset = newptr + (buffer->offset - buffer->data);
+	buffer->data = newptr;
+	buffer->size += chunksize;
+	buffer->maxchunks -= nbchunks;
+	return ESUCCESS;
+}
+
+/**
+ * @brief compute the length that _buffer_append accepts without loss
+ *
+ * The chunks still available are counted only if the buffer may grow
+ * with all of them.
+ *
+ * @return the number of bytes
+ */
+int _buffer_space(buffer_t *buffer)
+{
+	int size = buffer->size;
+	if (size + buffer->maxchunks * ChunkSize <= BUFFERMAX)
+		size += buffer->maxchunks * ChunkSize;
+	int space = size - (int)(buffer->offset - buffer->data) - 1;
+	return (space > 0)? space: 0;
+}
+
 char *_buffer_append(buffer_t *buffer, const char *data, int length)
 {
 	if (length == -1)
@@ -103,7 +198,10 @@ char *_buffer_append(buffer_t *buffer, const char *data, int length)
 	if (length == 0)
 		return buffer->offset;
 
-	if (buffer->data + buffer->size < buffer->offset + length)
+	/**
+	 * the data is followed by its null character
+	 */
+	if (buffer->data + buffer->size <= buffer->offset + length)
 	{
 		int nbchunks = (length / ChunkSize) + 1;
 		if (buffer->maxchunks - nbchunks < 0)
@@ -137,7 +235,8 @@ char *_buffer_append(buffer_t *buffer, const char *data, int length)
 			buffer->data = newptr;
 		}
 
-		length = (length > chunksize)? (chunksize - 1): length;
+		if (buffer->offset + length > buffer->data + buffer->size - 1)
+			length = buffer->data + buffer->size - 1 - buffer->offset;
 	}
 	char *offset = memcpy(buffer->offset, data, length);
 	buffer->length += length;
@@ -163,7 +262,7 @@ void _buffer_shrink(buffer_t *buffer, int reset)
 		buffer->offset++;
 		buffer->length--;
 	}
-	memcpy(buffer->data, buffer->offset, buffer->length);
+	memmove(buffer->data, buffer->offset, buffer->length);
 	buffer->data[buffer->length] = '\0';
 	if (!reset)
 		buffer->offset = buffer->data + buffer->length;
@@ -193,7 +292,7 @@ int _buffer_rewindto(buffer_t *buffer, char needle)
 	return ret;
 }
 
-int _buffer_dbentry(buffer_t *storage, dbentry_t **db, char *key, const char * value)
+int _buffer_dbentry(buffer_t *storage, dbtable_t *db, char *key, const char * value)
 {
 	if (key[0] != 0)
 	{
@@ -201,30 +300,33 @@ int _buffer_dbentry(buffer_t *storage, dbentry_t **db, char *key, const char * v
 		{
 			value = str_true;
 		}
-		dbentry_t *entry;
-		entry = vcalloc(1, sizeof(dbentry_t));
-		if (entry == NULL)
-			return -1;
 		while (*key == ' ')
 			key++;
-		entry->key = key;
-		entry->value = value;
-		entry->next = *db;
-		*db = entry;
+		if (dbtable_add(db, key, value) < 0)
+		{
+			warn("buffer db full: %s", key);
+			return -1;
+		}
 		buffer_dbg("fill \t%s\t%s", key, value);
 	}
 	return 0;
 }
 
-int _buffer_filldb(buffer_t *storage, dbentry_t **db, char separator, char fieldsep)
+int _buffer_filldb(buffer_t *storage, dbtable_t *db, char separator, char fieldsep)
 {
 	int i;
 	char *key = storage->data;
 	const char *value = NULL;
 	int count = 0;
+	char *end = storage->data + storage->length;
+	char *it = storage->data;
+	scan_t delimiters;
+	const char needles[] = {'\n', '\0', separator, fieldsep};
+	_scan_init(&delimiters, needles, sizeof(needles));
 
-	for (i = 0; i < storage->length; i++)
+	while ((it = _scan_find(&delimiters, it, end)) < end)
 	{
+		i = it - storage->data;
 		if (storage->data[i] == '\n')
 			storage->data[i] = '\0';
 		if (storage->data[i] == separator && value == NULL)
@@ -245,6 +347,7 @@ int _buffer_filldb(buffer_t *storage, dbentry_t **db, char separator, char field
 			key = storage->data + i + 1;
 			value = NULL;
 		}
+		it++;
 	}
 	if (_buffer_dbentry(storage, db, key, value) < 0)
 		return -1;
@@ -273,70 +376,180 @@ char _buffer_last(buffer_t *buffer)
 
 void _buffer_destroy(buffer_t *buffer)
 {
+#ifdef MAP_ANONYMOUS
+	if (buffer->mapped)
+		munmap(buffer->data, buffer->mapsize);
+	else
+#endif
 	if (buffer->data != NULL)
 		vfree(buffer->data);
 	vfree(buffer);
 }
 
-const char *dbentry_search(dbentry_t *entry, const char *key)
+/**
+ * FNV-1a hash of the key in lower case
+ */
+unsigned int dbtable_hash(const char *key)
 {
-	const char *value = NULL;
-	while (entry != NULL)
+	unsigned int hash = 2166136261U;
+	while (*key != '\0')
 	{
-		if (!strcasecmp(entry->key, key))
-		{
-			value = entry->value;
+		char c = *key++;
+		if (c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+		hash ^= (unsigned char)c;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static int _dbtable_slot(const dbtable_t *table, const char *key, unsigned int hash)
+{
+	int mask = table->capacity * 2 - 1;
+	int i = hash & mask;
+	while (table->slots[i] != 0)
+	{
+		const dbtable_entry_t *entry = &table->entries[table->slots[i] - 1];
+		if (entry->hash == hash && !strcasecmp(entry->key, key))
 			break;
-		}
-		entry = entry->next;
+		i = (i + 1) & mask;
 	}
-	if (entry == NULL)
+	return i;
+}
+
+/**
+ * the slot keeps the last value of the key,
+ * the entry links the previous values.
+ */
+static void _dbtable_link(dbtable_t *table, int index)
+{
+	dbtable_entry_t *entry = &table->entries[index];
+	int i = _dbtable_slot(table, entry->key, entry->hash);
+	entry->next = table->slots[i];
+	table->slots[i] = index + 1;
+}
+
+/**
+ * @brief double the storage of the table
+ *
+ * The entries keep their index, the slots are computed again.
+ *
+ * @return 0 or -1 if the table reached DBTABLE_LIMIT
+ */
+static int _dbtable_grow(dbtable_t *table)
+{
+	int capacity = table->capacity * 2;
+	if (capacity > DBTABLE_LIMIT)
+		return -1;
+	dbtable_entry_t *entries = vcalloc(1, capacity * sizeof(*entries) + capacity * 2 * sizeof(*table->slots));
+	if (entries == NULL)
+		return -1;
+	memcpy(entries, table->entries, table->count * sizeof(*entries));
+	if (table->entries != table->inlineentries)
+		vfree(table->entries);
+	table->entries = entries;
+	table->slots = (unsigned short *)(entries + capacity);
+	table->capacity = capacity;
+	int j;
+	for (j = 0; j < table->count; j++)
+		_dbtable_link(table, j);
+	return 0;
+}
+
+int dbtable_add(dbtable_t *table, const char *key, const char *value)
+{
+	if (table->capacity == 0)
+	{
+		table->entries = table->inlineentries;
+		table->slots = table->inlineslots;
+		table->capacity = DBTABLE_MAXENTRIES;
+	}
+	if (table->count >= table->capacity && _dbtable_grow(table) < 0)
+		return -1;
+	dbtable_entry_t *entry = &table->entries[table->count];
+	entry->key = key;
+	entry->value = value;
+	entry->hash = dbtable_hash(key);
+	_dbtable_link(table, table->count);
+	table->count++;
+	return table->count - 1;
+}
+
+const dbtable_entry_t *dbtable_lookup(const dbtable_t *table, const char *key)
+{
+	if (table->count == 0)
+		return NULL;
+	int i = _dbtable_slot(table, key, dbtable_hash(key));
+	if (table->slots[i] == 0)
 	{
 		buffer_dbg("dbentry %s not found", key);
+		return NULL;
 	}
-	return value;
+	return &table->entries[table->slots[i] - 1];
+}
+
+const dbtable_entry_t *dbtable_nextvalue(const dbtable_t *table, const dbtable_entry_t *entry)
+{
+	if (entry == NULL || entry->next == 0)
+		return NULL;
+	return &table->entries[entry->next - 1];
+}
+
+const char *dbtable_search(const dbtable_t *table, const char *key)
+{
+	const dbtable_entry_t *entry = dbtable_lookup(table, key);
+	if (entry == NULL)
+		return NULL;
+	return entry->value;
 }
 
-void dbentry_revert(dbentry_t *constentry, char separator, char fieldsep)
+void dbtable_revert(dbtable_t *table, char separator, char fieldsep)
 {
-	dbentry_revert_t *entry = (dbentry_revert_t *)constentry;
-	while (entry != NULL)
+	int j;
+	for (j = 0; j < table->count; j++)
 	{
+		char *key = (char *)table->entries[j].key;
+		char *value = (char *)table->entries[j].value;
 		int i = 0;
-		while ((entry->key[i]) != '\0') i++;
-		(entry->key)[i] = separator;
+		while ((key[i]) != '\0') i++;
+		key[i] = separator;
 
-		if (entry->key < entry->value)
+		if (key < value)
 		{
 			int i = 0;
-			while ((entry->value[i]) != '\0') i++;
-			if ((fieldsep == '\r' || fieldsep == '\n') && entry->value[i + 1] == '\0')
+			while ((value[i]) != '\0') i++;
+			if ((fieldsep == '\r' || fieldsep == '\n') && value[i + 1] == '\0')
 			{
-				(entry->value)[i] = '\r';
-				(entry->value)[i + 1] = '\n';
+				value[i] = '\r';
+				value[i + 1] = '\n';
 			}
 			else
-				(entry->value)[i] = fieldsep;
+				value[i] = fieldsep;
 		}
 		else
 		{
-			if ((fieldsep == '\r' || fieldsep == '\n') && entry->key[i + 1] == '\0')
+			if ((fieldsep == '\r' || fieldsep == '\n') && key[i + 1] == '\0')
 			{
-				(entry->key)[i] = '\r';
-				(entry->key)[i + 1] = '\n';
+				key[i] = '\r';
+				key[i + 1] = '\n';
 			}
 		}
-
-		entry = entry->next;
 	}
 }
 
-void dbentry_destroy(dbentry_t *entry)
+void dbtable_reset(dbtable_t *table)
 {
-	while (entry)
-	{
-		dbentry_t *next = entry->next;
-		free(entry);
-		entry = next;
-	}
+	if (table->slots != NULL)
+		memset(table->slots, 0, table->capacity * 2 * sizeof(*table->slots));
+	table->count = 0;
+}
+
+void dbtable_destroy(dbtable_t *table)
+{
+	if (table->entries != NULL && table->entries != table->inlineentries)
+		vfree(table->entries);
+	table->entries = NULL;
+	table->slots = NULL;
+	table->capacity = 0;
+	table->count = 0;
 }
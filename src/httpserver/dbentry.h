@@ -48,8 +48,57 @@ struct dbentry_revert_s
 
 typedef struct dbentry_revert_s dbentry_revert_t;
 
-const char *dbentry_search(dbentry_t *entry, const char *key);
-void dbentry_destroy(dbentry_t *entry);
-void dbentry_revert(dbentry_t *constentry, char separator, char fieldsep);
+#ifndef DBTABLE_MAXENTRIES
+#define DBTABLE_MAXENTRIES 32
+#endif
+/**
+ * after DBTABLE_MAXENTRIES entries the table moves to an allocated
+ * storage, which doubles up to DBTABLE_LIMIT entries.
+ */
+#ifndef DBTABLE_LIMIT
+#define DBTABLE_LIMIT 1024
+#endif
+/**
+ * the number of slots must be a power of 2 and larger than the number of entries.
+ */
+#define DBTABLE_NBSLOTS (DBTABLE_MAXENTRIES * 2)
+
+typedef struct dbtable_entry_s dbtable_entry_t;
+struct dbtable_entry_s
+{
+	const char *key;
+	const char *value;
+	unsigned int hash;
+	/** index + 1 of the previous entry with the same key, 0 for none */
+	unsigned short next;
+};
+
+/**
+ * The table stores the entries in the order of insertion
+ * and indexes them by the hash of the key (case insensitive).
+ * The strings are not copied, they stay inside the storage buffer.
+ * A table filled with zeros is empty.
+ */
+typedef struct dbtable_s dbtable_t;
+struct dbtable_s
+{
+	/** the inline entries or the allocated storage */
+	dbtable_entry_t *entries;
+	/** index + 1 of the last entry with this hash, 0 for an empty slot */
+	unsigned short *slots;
+	unsigned short count;
+	unsigned short capacity;
+	dbtable_entry_t inlineentries[DBTABLE_MAXENTRIES];
+	unsigned short inlineslots[DBTABLE_NBSLOTS];
+};
+
+unsigned int dbtable_hash(const char *key);
+int dbtable_add(dbtable_t *table, const char *key, const char *value);
+const dbtable_entry_t *dbtable_lookup(const dbtable_t *table, const char *key);
+const dbtable_entry_t *dbtable_nextvalue(const dbtable_t *table, const dbtable_entry_t *entry);
+const char *dbtable_search(const dbtable_t *table, const char *key);
+void dbtable_revert(dbtable_t *table, char separator, char fieldsep);
+void dbtable_reset(dbtable_t *table);
+void dbtable_destroy(dbtable_t *table);
 
 #endif
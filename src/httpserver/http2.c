@@ -0,0 +1,1739 @@
+/*****************************************************************************
+ * http2.c: HTTP/2 protocol layer (RFC 9113)
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "valloc.h"
+#include "log.h"
+#include "httpserver.h"
+#include "http2.h"
+#include "hpack.h"
+
+#define http2_dbg(...)
+
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define HTTP2_PREFACELENGTH (sizeof(HTTP2_PREFACE) - 1)
+#define HTTP2_FRAMEHEADER 9
+#define HTTP2_DEFAULTWINDOW 65535
+#define HTTP2_MAXWINDOW 0x7FFFFFFF
+/**
+ * the response of a stream waits above this size of data not yet
+ * framed, and all the streams wait above this size of frames not yet
+ * sent on the socket.
+ */
+#define HTTP2_OUTPUTMAX 65536
+/**
+ * maximum size of a header block and of a HTTP/1 head to check for the upgrade
+ */
+#define HTTP2_MAXHEADERS 16384
+#define HTTP2_RECVSIZE 16384
+
+#define HTTP2_DEFAULTURGENCY 3
+
+typedef enum
+{
+	FRAME_DATA = 0x0,
+	FRAME_HEADERS = 0x1,
+	FRAME_PRIORITY = 0x2,
+	FRAME_RST_STREAM = 0x3,
+	FRAME_SETTINGS = 0x4,
+	FRAME_PUSH_PROMISE = 0x5,
+	FRAME_PING = 0x6,
+	FRAME_GOAWAY = 0x7,
+	FRAME_WINDOW_UPDATE = 0x8,
+	FRAME_CONTINUATION = 0x9,
+} http2_frame_e;
+
+#define FLAG_END_STREAM 0x01
+#define FLAG_ACK 0x01
+#define FLAG_END_HEADERS 0x04
+#define FLAG_PADDED 0x08
+#define FLAG_PRIORITY 0x20
+
+typedef enum
+{
+	H2_NO_ERROR = 0x0,
+	H2_PROTOCOL_ERROR = 0x1,
+	H2_INTERNAL_ERROR = 0x2,
+	H2_FLOW_CONTROL_ERROR = 0x3,
+	H2_STREAM_CLOSED = 0x5,
+	H2_FRAME_SIZE_ERROR = 0x6,
+	H2_REFUSED_STREAM = 0x7,
+	H2_CANCEL = 0x8,
+	H2_COMPRESSION_ERROR = 0x9,
+	H2_ENHANCE_YOUR_CALM = 0xb,
+} http2_error_e;
+
+typedef enum
+{
+	SETTINGS_HEADER_TABLE_SIZE = 0x1,
+	SETTINGS_ENABLE_PUSH = 0x2,
+	SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+	SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+	SETTINGS_MAX_FRAME_SIZE = 0x5,
+	SETTINGS_MAX_HEADER_LIST_SIZE = 0x6,
+} http2_settings_e;
+
+struct http2_s
+{
+	http_server_t *server;
+	const httpclient_ops_t *lowerops;
+	void *lowerconfig;
+	http2_config_t config;
+};
+
+typedef struct http2_queue_s http2_queue_t;
+struct http2_queue_s
+{
+	char *data;
+	int offset;
+	int length;
+	int size;
+};
+
+#define STREAM_RESPONDING 0x0001 /* the request of the stream runs into the client */
+#define STREAM_REMOTECLOSED 0x0002
+#define STREAM_LOCALCLOSED 0x0004
+#define STREAM_RESET 0x0008
+#define STREAM_HEAD 0x0010
+#define STREAM_OUTEND 0x0020 /* the last DATA frame ends the stream */
+#define STREAM_BLOCKED 0x0040 /* the response waits the room into the output */
+
+typedef struct http2_stream_s http2_stream_t;
+struct http2_stream_s
+{
+	uint32_t id;
+	int flags;
+	int urgency;
+	int sendwindow;
+	int recvwindow;
+	int credit; /* DATA received and not yet acknowledged by WINDOW_UPDATE */
+	long long contentlength; /* Content-Length of the request or -1 */
+	long long received; /* length of the DATA of the request */
+	http2_queue_t input; /* content of the request waiting the connector */
+	http2_queue_t output; /* content of the response waiting the DATA frames */
+	http2_stream_t *next;
+};
+
+typedef enum
+{
+	H2_DETECT,
+	H2_PASSTHROUGH,
+	H2_PREFACE,
+	H2_SETTINGS,
+	H2_FRAMES,
+	H2_CLOSED,
+} http2_state_e;
+
+typedef struct http2_ctx_s http2_ctx_t;
+struct http2_ctx_s
+{
+	http_client_t *client;
+	const httpclient_ops_t *lowerops;
+	void *lowerctx;
+	const http2_config_t *config;
+	http2_state_e state;
+	http2_queue_t in;
+	http2_queue_t out;
+	hpack_t *decoder;
+	hpack_t *encoder;
+	http2_queue_t block; /* header block waiting CONTINUATION */
+	uint32_t blockstream;
+	int blockflags;
+	http2_stream_t *streams;
+	int nbstreams;
+	uint32_t lastid;
+	int sendwindow;
+	int recvwindow;
+	int credit; /* DATA received on the connection and not yet acknowledged */
+	int initialwindow; /* SETTINGS_INITIAL_WINDOW_SIZE of the client */
+	int maxframe; /* SETTINGS_MAX_FRAME_SIZE of the client */
+};
+
+/**
+ * the request of a stream is built from the header block
+ */
+typedef struct http2_request_s http2_request_t;
+struct http2_request_s
+{
+	http2_stream_t *stream;
+	int trailer;
+	int malformed;
+	long long contentlength;
+	int host;
+	http2_queue_t method;
+	http2_queue_t path;
+	http2_queue_t authority;
+	http2_queue_t fields; /* "<name>\0<value>\0" */
+	http2_queue_t cookie;
+};
+
+static const http2_config_t _http2_defaultconfig =
+{
+	.maxstreams = HTTP2_MAXSTREAMS,
+	.window = HTTP2_WINDOW,
+	.maxframe = HTTP2_MAXFRAME,
+};
+
+static int _http2_queue_reserve(http2_queue_t *queue, int length)
+{
+	if (queue->offset + queue->length + length <= queue->size)
+		return ESUCCESS;
+	if (queue->offset > 0)
+	{
+		memmove(queue->data, queue->data + queue->offset, queue->length);
+		queue->offset = 0;
+	}
+	if (queue->length + length > queue->size)
+	{
+		int size = (queue->length + length) * 2;
+		if (size < 256)
+			size = 256;
+		char *data = vrealloc(queue->data, size);
+		if (data == NULL)
+			return EREJECT;
+		queue->data = data;
+		queue->size = size;
+	}
+	return ESUCCESS;
+}
+
+static int _http2_queue_append(http2_queue_t *queue, const void *data, int length)
+{
+	if (_http2_queue_reserve(queue, length) != ESUCCESS)
+		return EREJECT;
+	memcpy(queue->data + queue->offset + queue->length, data, length);
+	queue->length += length;
+	return ESUCCESS;
+}
+
+static int _http2_queue_string(http2_queue_t *queue, const char *string)
+{
+	return _http2_queue_append(queue, string, strlen(string));
+}
+
+static void _http2_queue_consume(http2_queue_t *queue, int length)
+{
+	queue->offset += length;
+	queue->length -= length;
+	if (queue->length == 0)
+		queue->offset = 0;
+}
+
+static void _http2_queue_free(http2_queue_t *queue)
+{
+	if (queue->data)
+		vfree(queue->data);
+	queue->data = NULL;
+	queue->offset = 0;
+	queue->length = 0;
+	queue->size = 0;
+}
+
+static const char *_http2_queue_data(const http2_queue_t *queue)
+{
+	return queue->data + queue->offset;
+}
+
+static uint32_t _http2_uint32(const uint8_t *data)
+{
+	return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static int _http2_frame(http2_ctx_t *ctx, int type, int flags, uint32_t id, const void *payload, int length)
+{
+	uint8_t header[HTTP2_FRAMEHEADER];
+	header[0] = length >> 16;
+	header[1] = length >> 8;
+	header[2] = length;
+	header[3] = type;
+	header[4] = flags;
+	header[5] = (id >> 24) & 0x7F;
+	header[6] = id >> 16;
+	header[7] = id >> 8;
+	header[8] = id;
+	if (_http2_queue_append(&ctx->out, header, sizeof(header)) != ESUCCESS ||
+		(length > 0 && _http2_queue_append(&ctx->out, payload, length) != ESUCCESS))
+		return EREJECT;
+	return ESUCCESS;
+}
+
+static void _http2_windowupdate(http2_ctx_t *ctx, uint32_t id, uint32_t increment)
+{
+	uint8_t payload[4] = {(increment >> 24) & 0x7F, increment >> 16, increment >> 8, increment};
+	_http2_frame(ctx, FRAME_WINDOW_UPDATE, 0, id, payload, sizeof(payload));
+}
+
+static void _http2_rststream(http2_ctx_t *ctx, uint32_t id, http2_error_e error)
+{
+	uint8_t payload[4] = {0, 0, 0, error};
+	_http2_frame(ctx, FRAME_RST_STREAM, 0, id, payload, sizeof(payload));
+}
+
+static int _http2_goaway(http2_ctx_t *ctx, http2_error_e error)
+{
+	if (ctx->state == H2_CLOSED)
+		return EREJECT;
+	uint32_t id = ctx->lastid;
+	uint8_t payload[8] = {(id >> 24) & 0x7F, id >> 16, id >> 8, id, 0, 0, 0, error};
+	_http2_frame(ctx, FRAME_GOAWAY, 0, 0, payload, sizeof(payload));
+	if (error != H2_NO_ERROR)
+		warn("http2: connection error %d", error);
+	ctx->state = H2_CLOSED;
+	return EREJECT;
+}
+
+static void _http2_settings(http2_ctx_t *ctx)
+{
+	const struct
+	{
+		uint16_t id;
+		uint32_t value;
+	} settings[] =
+	{
+		{SETTINGS_MAX_CONCURRENT_STREAMS, ctx->config->maxstreams},
+		{SETTINGS_INITIAL_WINDOW_SIZE, ctx->config->window},
+		{SETTINGS_MAX_FRAME_SIZE, ctx->config->maxframe},
+	};
+	uint8_t payload[sizeof(settings) / sizeof(settings[0]) * 6];
+	int i;
+	for (i = 0; i < sizeof(settings) / sizeof(settings[0]); i++)
+	{
+		uint8_t *setting = &payload[i * 6];
+		setting[0] = settings[i].id >> 8;
+		setting[1] = settings[i].id;
+		setting[2] = settings[i].value >> 24;
+		setting[3] = settings[i].value >> 16;
+		setting[4] = settings[i].value >> 8;
+		setting[5] = settings[i].value;
+	}
+	_http2_frame(ctx, FRAME_SETTINGS, 0, 0, payload, sizeof(payload));
+	/**
+	 * the window of the connection starts with the default size,
+	 * it grows to the window of one stream
+	 */
+	if (ctx->config->window > HTTP2_DEFAULTWINDOW)
+	{
+		_http2_windowupdate(ctx, 0, ctx->config->window - HTTP2_DEFAULTWINDOW);
+		ctx->recvwindow = ctx->config->window;
+	}
+}
+
+/**
+ * @brief send the frames while the socket accepts them
+ *
+ * The rest waits the socket into the loop of the client,
+ * see http2client_wait.
+ */
+static int _http2_flush(http2_ctx_t *ctx)
+{
+	while (ctx->out.length > 0)
+	{
+		int ret = ctx->lowerops->sendresp(ctx->lowerctx, _http2_queue_data(&ctx->out), ctx->out.length);
+		if (ret == EINCOMPLETE)
+			break;
+		if (ret <= 0)
+		{
+			ctx->state = H2_CLOSED;
+			return EREJECT;
+		}
+		_http2_queue_consume(&ctx->out, ret);
+	}
+	return ESUCCESS;
+}
+
+/*****************************************************************************
+ * streams
+ ****************************************************************************/
+static http2_stream_t *_http2_stream(http2_ctx_t *ctx, uint32_t id)
+{
+	http2_stream_t *stream = ctx->streams;
+	while (stream != NULL && stream->id != id)
+		stream = stream->next;
+	return stream;
+}
+
+static http2_stream_t *_http2_newstream(http2_ctx_t *ctx, uint32_t id)
+{
+	http2_stream_t *stream = vcalloc(1, sizeof(*stream));
+	if (stream == NULL)
+		return NULL;
+	stream->id = id;
+	stream->urgency = HTTP2_DEFAULTURGENCY;
+	stream->sendwindow = ctx->initialwindow;
+	/**
+	 * the client uses the default window until it acknowledges the settings
+	 */
+	stream->recvwindow = (ctx->config->window > HTTP2_DEFAULTWINDOW)? ctx->config->window: HTTP2_DEFAULTWINDOW;
+	stream->contentlength = -1;
+	stream->next = ctx->streams;
+	ctx->streams = stream;
+	ctx->nbstreams++;
+	if (id > ctx->lastid)
+		ctx->lastid = id;
+	return stream;
+}
+
+static void _http2_freestream(http2_ctx_t *ctx, http2_stream_t *stream)
+{
+	http2_stream_t **it = &ctx->streams;
+	while (*it != NULL && *it != stream)
+		it = &(*it)->next;
+	if (*it != NULL)
+		*it = stream->next;
+	ctx->nbstreams--;
+	_http2_queue_free(&stream->input);
+	_http2_queue_free(&stream->output);
+	vfree(stream);
+}
+
+/**
+ * the stream is freed when the client and the peer are done with it
+ */
+static void _http2_release(http2_ctx_t *ctx, http2_stream_t *stream)
+{
+	if (stream->flags & STREAM_RESPONDING)
+		return;
+	if ((stream->flags & STREAM_RESET) ||
+		((stream->flags & STREAM_LOCALCLOSED) && (stream->flags & STREAM_REMOTECLOSED)))
+	{
+		http2_dbg("http2: stream %u closed", stream->id);
+		_http2_freestream(ctx, stream);
+	}
+}
+
+/**
+ * the request of a reset stream is dropped by the client on its next
+ * step, see http2client_sendstream
+ */
+static void _http2_reset(http2_ctx_t *ctx, http2_stream_t *stream)
+{
+	stream->flags |= STREAM_RESET;
+	_http2_queue_free(&stream->input);
+	_http2_queue_free(&stream->output);
+	_http2_release(ctx, stream);
+}
+
+/**
+ * @brief the request of the peer is complete
+ *
+ * The content must have the length of its Content-Length (RFC 9113 8.1.1)
+ */
+static void _http2_remoteclose(http2_ctx_t *ctx, http2_stream_t *stream)
+{
+	if (stream->contentlength >= 0 && stream->received != stream->contentlength)
+	{
+		_http2_rststream(ctx, stream->id, H2_PROTOCOL_ERROR);
+		_http2_reset(ctx, stream);
+		return;
+	}
+	stream->flags |= STREAM_REMOTECLOSED;
+	_http2_release(ctx, stream);
+}
+
+/**
+ * @brief the response is complete
+ *
+ * The rest of the request is useless, the peer stops to send it
+ * after a RST_STREAM without error (RFC 9113 8.1).
+ */
+static void _http2_localclose(http2_ctx_t *ctx, http2_stream_t *stream)
+{
+	stream->flags |= STREAM_LOCALCLOSED;
+	if (!(stream->flags & STREAM_REMOTECLOSED))
+	{
+		_http2_rststream(ctx, stream->id, H2_NO_ERROR);
+		_http2_reset(ctx, stream);
+		return;
+	}
+	_http2_release(ctx, stream);
+}
+
+/*****************************************************************************
+ * response from the connectors
+ ****************************************************************************/
+/**
+ * @brief build the DATA frames of the streams
+ *
+ * The stream with the lowest urgency (RFC 9218) sends first, then the
+ * oldest one.
+ */
+static void _http2_schedule(http2_ctx_t *ctx)
+{
+	while (ctx->out.length < HTTP2_OUTPUTMAX)
+	{
+		http2_stream_t *next = NULL;
+		http2_stream_t *stream;
+		for (stream = ctx->streams; stream != NULL; stream = stream->next)
+		{
+			if (stream->flags & STREAM_RESET)
+				continue;
+			if (stream->output.length == 0 && !(stream->flags & STREAM_OUTEND))
+				continue;
+			if (stream->output.length > 0 && (stream->sendwindow <= 0 || ctx->sendwindow <= 0))
+				continue;
+			if (next == NULL || stream->urgency < next->urgency ||
+				(stream->urgency == next->urgency && stream->id < next->id))
+				next = stream;
+		}
+		if (next == NULL)
+			break;
+		int length = next->output.length;
+		if (length > ctx->maxframe)
+			length = ctx->maxframe;
+		if (length > next->sendwindow)
+			length = next->sendwindow;
+		if (length > ctx->sendwindow)
+			length = ctx->sendwindow;
+		int flags = 0;
+		if (length == next->output.length && (next->flags & STREAM_OUTEND))
+			flags |= FLAG_END_STREAM;
+		if (_http2_frame(ctx, FRAME_DATA, flags, next->id, _http2_queue_data(&next->output), length) != ESUCCESS)
+			break;
+		_http2_queue_consume(&next->output, length);
+		next->sendwindow -= length;
+		ctx->sendwindow -= length;
+		if (flags & FLAG_END_STREAM)
+		{
+			next->flags &= ~STREAM_OUTEND;
+			_http2_localclose(ctx, next);
+		}
+	}
+}
+
+/**
+ * @brief check the responses waiting the room into the output
+ *
+ * @return 1 if one of them may continue
+ */
+static int _http2_unblocked(http2_ctx_t *ctx)
+{
+	if (ctx->out.length >= HTTP2_OUTPUTMAX)
+		return 0;
+	http2_stream_t *stream;
+	for (stream = ctx->streams; stream != NULL; stream = stream->next)
+	{
+		if ((stream->flags & STREAM_BLOCKED) &&
+			((stream->flags & STREAM_RESET) || stream->output.length < HTTP2_OUTPUTMAX))
+			return 1;
+	}
+	return 0;
+}
+
+static int _http2_sendheaders(http2_ctx_t *ctx, http2_stream_t *stream, const uint8_t *block, int length, int flags)
+{
+	int type = FRAME_HEADERS;
+	do
+	{
+		int size = (length > ctx->maxframe)? ctx->maxframe: length;
+		int frameflags = (type == FRAME_HEADERS)? flags: 0;
+		if (size == length)
+			frameflags |= FLAG_END_HEADERS;
+		if (_http2_frame(ctx, type, frameflags, stream->id, block, size) != ESUCCESS)
+			return EREJECT;
+		block += size;
+		length -= size;
+		type = FRAME_CONTINUATION;
+	} while (length > 0);
+	return ESUCCESS;
+}
+
+static int _http2_iscase(const char *string, int length, const char *name)
+{
+	return (strlen(name) == length && !strncasecmp(string, name, length));
+}
+
+/**
+ * the fields of the connection are forbidden (RFC 9113 8.2.2)
+ */
+static int _http2_connectionfield(const char *name, int namelen)
+{
+	return (_http2_iscase(name, namelen, "connection") ||
+		_http2_iscase(name, namelen, "keep-alive") ||
+		_http2_iscase(name, namelen, "proxy-connection") ||
+		_http2_iscase(name, namelen, "transfer-encoding") ||
+		_http2_iscase(name, namelen, "upgrade"));
+}
+
+/**
+ * the known headers of the connection are not sent, the status is
+ * already the pseudo-header ":status"
+ */
+static int _http2_knownfield(http_header_e id)
+{
+	switch (id)
+	{
+	case HDR_CONNECTION:
+	case HDR_UPGRADE:
+	case HDR_TRANSFER_ENCODING:
+	case HDR_STATUS:
+		return EREJECT;
+	default:
+		break;
+	}
+	return ESUCCESS;
+}
+
+/**
+ * the value of a known header is stored into its slot
+ */
+static int _http2_isknown(http_message_t *response, const char *value)
+{
+	http_header_e id;
+	for (id = 0; id < HDR_MAX; id++)
+	{
+		if (httpmessage_header_id(response, id) == value)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief encode the status and the headers of the response into a HEADERS frame
+ *
+ * the known headers are encoded with the index of their name into the
+ * static table, the other ones with their name.
+ */
+static int _http2_responsehead(http2_ctx_t *ctx, http2_stream_t *stream, http_message_t *response)
+{
+	/**
+	 * the block of a reset stream is not sent, it must not change
+	 * the dynamic table of the encoder
+	 */
+	if (stream->flags & STREAM_RESET)
+		return ESUCCESS;
+	int status = httpmessage_result(response, -1);
+	uint8_t block[HTTP2_MAXHEADERS];
+	int length = hpack_encodestatus(ctx->encoder, block, sizeof(block), status);
+	const char *value;
+	http_header_e id;
+	for (id = 0; length >= 0 && id < HDR_MAX; id++)
+	{
+		value = httpmessage_header_id(response, id);
+		if (value == NULL || _http2_knownfield(id) != ESUCCESS)
+			continue;
+		int ret = hpack_encodeheader(ctx->encoder, block + length, sizeof(block) - length, id, value, strlen(value));
+		length = (ret < 0)? ret: length + ret;
+	}
+	const char *name = NULL;
+	int i = 0;
+	while (length >= 0 && (value = httpmessage_headers(response, &i, &name)) != NULL)
+	{
+		/**
+		 * the known headers are already into the block
+		 */
+		if (_http2_isknown(response, value))
+			continue;
+		int namelen = strlen(name);
+		if (_http2_connectionfield(name, namelen) || _http2_iscase(name, namelen, "status"))
+			continue;
+		int ret = hpack_encode(ctx->encoder, block + length, sizeof(block) - length, name, namelen, value, strlen(value));
+		length = (ret < 0)? ret: length + ret;
+	}
+	if (length < 0)
+	{
+		/**
+		 * the encoder changed its table with a block never sent
+		 */
+		err("http2: stream %u headers too large", stream->id);
+		return _http2_goaway(ctx, H2_INTERNAL_ERROR);
+	}
+
+	const char *contentlength = httpmessage_header_id(response, HDR_CONTENT_LENGTH);
+	int endstream = (stream->flags & STREAM_HEAD) || status == 204 || status == 304 ||
+		(contentlength != NULL && !strcmp(contentlength, "0"));
+	http2_dbg("http2: stream %u response %d", stream->id, status);
+	if (_http2_sendheaders(ctx, stream, block, length, endstream? FLAG_END_STREAM: 0) != ESUCCESS)
+		return EREJECT;
+	if (endstream)
+		_http2_localclose(ctx, stream);
+	return ESUCCESS;
+}
+
+static int _http2_senddata(http2_ctx_t *ctx, http2_stream_t *stream, const char *data, int length)
+{
+	if (stream->flags & (STREAM_RESET | STREAM_LOCALCLOSED))
+		return ESUCCESS;
+	return _http2_queue_append(&stream->output, data, length);
+}
+
+/*****************************************************************************
+ * requests from the client
+ ****************************************************************************/
+static int _http2_field(void *arg, const char *name, int namelen, const char *value, int valuelen)
+{
+	http2_request_t *request = (http2_request_t *)arg;
+	int i;
+	for (i = 0; i < valuelen; i++)
+	{
+		if (value[i] == '\r' || value[i] == '\n' || value[i] == '\0')
+			request->malformed = 1;
+	}
+	for (i = 0; i < namelen; i++)
+	{
+		if (name[i] == ':' && i > 0)
+			request->malformed = 1;
+		if ((name[i] >= 'A' && name[i] <= 'Z') || name[i] <= ' ')
+			request->malformed = 1;
+	}
+	if (request->malformed || namelen == 0)
+	{
+		request->malformed = 1;
+		return ESUCCESS;
+	}
+	if (name[0] == ':')
+	{
+		http2_queue_t *pseudo = NULL;
+		if (_http2_iscase(name, namelen, ":method"))
+			pseudo = &request->method;
+		else if (_http2_iscase(name, namelen, ":path"))
+			pseudo = &request->path;
+		else if (_http2_iscase(name, namelen, ":authority"))
+			pseudo = &request->authority;
+		else if (_http2_iscase(name, namelen, ":scheme"))
+			return ESUCCESS;
+		if (request->trailer || pseudo == NULL || pseudo->length > 0 || request->fields.length > 0)
+			request->malformed = 1;
+		else
+			_http2_queue_append(pseudo, value, valuelen);
+		return ESUCCESS;
+	}
+	if (_http2_connectionfield(name, namelen) || _http2_iscase(name, namelen, "te"))
+		return ESUCCESS;
+	if (_http2_iscase(name, namelen, "cookie"))
+	{
+		/**
+		 * the cookie may be split in several fields
+		 */
+		if (request->cookie.length > 0)
+			_http2_queue_append(&request->cookie, "; ", 2);
+		_http2_queue_append(&request->cookie, value, valuelen);
+		return ESUCCESS;
+	}
+	if (_http2_iscase(name, namelen, "content-length"))
+	{
+		long long length = 0;
+		for (i = 0; i < valuelen; i++)
+		{
+			if (value[i] < '0' || value[i] > '9')
+				break;
+			length = length * 10 + value[i] - '0';
+		}
+		if (valuelen == 0 || valuelen > 18 || i < valuelen ||
+			(request->contentlength >= 0 && request->contentlength != length))
+			request->malformed = 1;
+		request->contentlength = length;
+	}
+	else if (_http2_iscase(name, namelen, "host"))
+		request->host = 1;
+	else if (_http2_iscase(name, namelen, "priority") && request->stream != NULL)
+	{
+		const char *urgency = memmem(value, valuelen, "u=", 2);
+		if (urgency != NULL && urgency + 2 < value + valuelen &&
+			urgency[2] >= '0' && urgency[2] <= '7')
+			request->stream->urgency = urgency[2] - '0';
+	}
+	_http2_queue_append(&request->fields, name, namelen);
+	_http2_queue_append(&request->fields, "", 1);
+	_http2_queue_append(&request->fields, value, valuelen);
+	if (_http2_queue_append(&request->fields, "", 1) != ESUCCESS)
+		request->malformed = 1;
+	return ESUCCESS;
+}
+
+static void _http2_freerequest(http2_request_t *request)
+{
+	_http2_queue_free(&request->method);
+	_http2_queue_free(&request->path);
+	_http2_queue_free(&request->authority);
+	_http2_queue_free(&request->fields);
+	_http2_queue_free(&request->cookie);
+}
+
+/**
+ * @brief open the request of the stream into the client
+ */
+static int _http2_request(http2_ctx_t *ctx, http2_stream_t *stream, http2_request_t *request, int endstream)
+{
+	if (request->method.length == 0 || request->path.length == 0 ||
+		(endstream && request->contentlength > 0))
+		return EREJECT;
+	if (_http2_queue_append(&request->method, "", 1) != ESUCCESS ||
+		_http2_queue_append(&request->path, "", 1) != ESUCCESS)
+		return EREJECT;
+	const char *method = _http2_queue_data(&request->method);
+	http_message_t *message = httpclient_openstream(ctx->client, stream,
+							method, _http2_queue_data(&request->path), !endstream);
+	if (message == NULL)
+		return EREJECT;
+	stream->flags |= STREAM_RESPONDING;
+	stream->contentlength = request->contentlength;
+	if (!strcmp(method, "HEAD"))
+		stream->flags |= STREAM_HEAD;
+
+	/**
+	 * a header too large is refused by the client with the status 431
+	 */
+	if (!request->host && request->authority.length > 0)
+		httpclient_streamheader(message, "Host", 4,
+				_http2_queue_data(&request->authority), request->authority.length);
+	const char *field = _http2_queue_data(&request->fields);
+	const char *end = field + request->fields.length;
+	while (field < end)
+	{
+		int namelen = strlen(field);
+		const char *value = field + namelen + 1;
+		int valuelen = strlen(value);
+		httpclient_streamheader(message, field, namelen, value, valuelen);
+		field = value + valuelen + 1;
+	}
+	if (request->cookie.length > 0)
+		httpclient_streamheader(message, "Cookie", 6,
+				_http2_queue_data(&request->cookie), request->cookie.length);
+	return ESUCCESS;
+}
+
+static int _http2_headerblock(http2_ctx_t *ctx, uint32_t id, int flags, const uint8_t *block, int length)
+{
+	int endstream = flags & FLAG_END_STREAM;
+	http2_request_t request = {0};
+	request.contentlength = -1;
+	http2_stream_t *stream = _http2_stream(ctx, id);
+	if (stream == NULL && id > ctx->lastid)
+	{
+		stream = _http2_newstream(ctx, id);
+		if (stream == NULL)
+			return _http2_goaway(ctx, H2_INTERNAL_ERROR);
+	}
+	else if (stream == NULL || (stream->flags & STREAM_REMOTECLOSED))
+	{
+		/**
+		 * the decoding is required to keep the dynamic table
+		 */
+		stream = NULL;
+		request.malformed = 1;
+	}
+	else
+		request.trailer = 1;
+	request.stream = stream;
+	if (hpack_decode(ctx->decoder, block, length, _http2_field, &request) != ESUCCESS)
+	{
+		_http2_freerequest(&request);
+		return _http2_goaway(ctx, H2_COMPRESSION_ERROR);
+	}
+	if (stream == NULL)
+	{
+		_http2_freerequest(&request);
+		_http2_rststream(ctx, id, H2_STREAM_CLOSED);
+		return ESUCCESS;
+	}
+
+	int ret = ESUCCESS;
+	int error = H2_PROTOCOL_ERROR;
+	if (request.trailer && (stream->flags & STREAM_RESET))
+	{
+		_http2_freerequest(&request);
+		return ESUCCESS;
+	}
+	if (request.malformed || (request.trailer && !endstream))
+		ret = EREJECT;
+	else if (request.trailer)
+	{
+		/**
+		 * the trailers are dropped
+		 */
+	}
+	else if (ctx->nbstreams > ctx->config->maxstreams)
+	{
+		error = H2_REFUSED_STREAM;
+		ret = EREJECT;
+	}
+	else
+		ret = _http2_request(ctx, stream, &request, endstream);
+	_http2_freerequest(&request);
+
+	if (ret != ESUCCESS)
+	{
+		_http2_rststream(ctx, id, error);
+		_http2_reset(ctx, stream);
+		return ESUCCESS;
+	}
+	if (endstream)
+		_http2_remoteclose(ctx, stream);
+	http2_dbg("http2: stream %u request", id);
+	return ESUCCESS;
+}
+
+static int _http2_data(http2_ctx_t *ctx, uint32_t id, int flags, const uint8_t *payload, int length)
+{
+	/**
+	 * the window of the connection is released without waiting the
+	 * connectors, the window of the stream limits the memory.
+	 * The WINDOW_UPDATE is sent when half of the window is used.
+	 */
+	if (length > ctx->recvwindow)
+		return _http2_goaway(ctx, H2_FLOW_CONTROL_ERROR);
+	ctx->recvwindow -= length;
+	ctx->credit += length;
+	int window = (ctx->config->window > HTTP2_DEFAULTWINDOW)? ctx->config->window: HTTP2_DEFAULTWINDOW;
+	if (ctx->credit >= window / 2)
+	{
+		_http2_windowupdate(ctx, 0, ctx->credit);
+		ctx->recvwindow += ctx->credit;
+		ctx->credit = 0;
+	}
+	http2_stream_t *stream = _http2_stream(ctx, id);
+	if (stream == NULL || (stream->flags & STREAM_REMOTECLOSED))
+	{
+		if (id > ctx->lastid)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		if (stream == NULL || !(stream->flags & STREAM_RESET))
+			_http2_rststream(ctx, id, H2_STREAM_CLOSED);
+		return ESUCCESS;
+	}
+	if (length > stream->recvwindow)
+	{
+		_http2_rststream(ctx, id, H2_FLOW_CONTROL_ERROR);
+		_http2_reset(ctx, stream);
+		return ESUCCESS;
+	}
+	stream->recvwindow -= length;
+	stream->credit += length;
+	if (flags & FLAG_PADDED)
+	{
+		/**
+		 * the frame must contain the length of the padding
+		 */
+		if (length < 1)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		int padding = payload[0];
+		if (padding >= length)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		payload++;
+		length -= padding + 1;
+	}
+	if (stream->flags & STREAM_RESET)
+		return ESUCCESS;
+	stream->received += length;
+	if (stream->contentlength >= 0 && stream->received > stream->contentlength)
+	{
+		_http2_rststream(ctx, id, H2_PROTOCOL_ERROR);
+		_http2_reset(ctx, stream);
+		return ESUCCESS;
+	}
+	if (length > 0 && _http2_queue_append(&stream->input, payload, length) != ESUCCESS)
+		return _http2_goaway(ctx, H2_INTERNAL_ERROR);
+	if (flags & FLAG_END_STREAM)
+		_http2_remoteclose(ctx, stream);
+	return ESUCCESS;
+}
+
+static int _http2_applysettings(http2_ctx_t *ctx, const uint8_t *payload, int length)
+{
+	if (length % 6)
+		return H2_FRAME_SIZE_ERROR;
+	for (; length > 0; payload += 6, length -= 6)
+	{
+		int id = (payload[0] << 8) | payload[1];
+		uint32_t value = _http2_uint32(payload + 2);
+		switch (id)
+		{
+		case SETTINGS_HEADER_TABLE_SIZE:
+			hpack_tablesize(ctx->encoder, (value > HPACK_TABLESIZE)? HPACK_TABLESIZE: value);
+		break;
+		case SETTINGS_ENABLE_PUSH:
+			if (value > 1)
+				return H2_PROTOCOL_ERROR;
+		break;
+		case SETTINGS_INITIAL_WINDOW_SIZE:
+		{
+			if (value > HTTP2_MAXWINDOW)
+				return H2_FLOW_CONTROL_ERROR;
+			int delta = (int)value - ctx->initialwindow;
+			http2_stream_t *stream;
+			for (stream = ctx->streams; stream != NULL; stream = stream->next)
+			{
+				if ((long long)stream->sendwindow + delta > HTTP2_MAXWINDOW)
+					return H2_FLOW_CONTROL_ERROR;
+				stream->sendwindow += delta;
+			}
+			ctx->initialwindow = value;
+		}
+		break;
+		case SETTINGS_MAX_FRAME_SIZE:
+			if (value < 16384 || value > 16777215)
+				return H2_PROTOCOL_ERROR;
+			ctx->maxframe = value;
+		break;
+		default:
+			/**
+			 * the server never pushes.
+			 */
+		break;
+		}
+	}
+	return H2_NO_ERROR;
+}
+
+static int _http2_windowframe(http2_ctx_t *ctx, uint32_t id, const uint8_t *payload, int length)
+{
+	if (length != 4)
+		return _http2_goaway(ctx, H2_FRAME_SIZE_ERROR);
+	uint32_t increment = _http2_uint32(payload) & HTTP2_MAXWINDOW;
+	if (id == 0)
+	{
+		if (increment == 0 || (long long)ctx->sendwindow + increment > HTTP2_MAXWINDOW)
+			return _http2_goaway(ctx, (increment == 0)? H2_PROTOCOL_ERROR: H2_FLOW_CONTROL_ERROR);
+		ctx->sendwindow += increment;
+		return ESUCCESS;
+	}
+	http2_stream_t *stream = _http2_stream(ctx, id);
+	if (stream == NULL)
+	{
+		if (id > ctx->lastid)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		return ESUCCESS;
+	}
+	if (increment == 0 || (long long)stream->sendwindow + increment > HTTP2_MAXWINDOW)
+	{
+		_http2_rststream(ctx, id, (increment == 0)? H2_PROTOCOL_ERROR: H2_FLOW_CONTROL_ERROR);
+		_http2_reset(ctx, stream);
+		return (ctx->state == H2_CLOSED)? EREJECT: ESUCCESS;
+	}
+	stream->sendwindow += increment;
+	return ESUCCESS;
+}
+
+static int _http2_headersframe(http2_ctx_t *ctx, int type, int flags, uint32_t id, const uint8_t *payload, int length)
+{
+	if (type == FRAME_HEADERS)
+	{
+		if (id == 0 || (id & 0x01) == 0)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		int padding = 0;
+		if (flags & FLAG_PADDED)
+		{
+			if (length < 1)
+				return _http2_goaway(ctx, H2_FRAME_SIZE_ERROR);
+			padding = payload[0];
+			payload++;
+			length--;
+		}
+		if (flags & FLAG_PRIORITY)
+		{
+			if (length < 5)
+				return _http2_goaway(ctx, H2_FRAME_SIZE_ERROR);
+			if ((_http2_uint32(payload) & HTTP2_MAXWINDOW) == id)
+				return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+			payload += 5;
+			length -= 5;
+		}
+		if (padding > length)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		length -= padding;
+		ctx->blockstream = id;
+		ctx->blockflags = flags;
+	}
+	else if (ctx->blockstream == 0 || ctx->blockstream != id)
+		return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+
+	if (!(flags & FLAG_END_HEADERS) || ctx->block.length > 0)
+	{
+		if (ctx->block.length + length > HTTP2_MAXHEADERS)
+			return _http2_goaway(ctx, H2_ENHANCE_YOUR_CALM);
+		if (_http2_queue_append(&ctx->block, payload, length) != ESUCCESS)
+			return _http2_goaway(ctx, H2_INTERNAL_ERROR);
+		if (!(flags & FLAG_END_HEADERS))
+			return ESUCCESS;
+		payload = (const uint8_t *)_http2_queue_data(&ctx->block);
+		length = ctx->block.length;
+	}
+	ctx->blockstream = 0;
+	int ret = _http2_headerblock(ctx, id, ctx->blockflags, payload, length);
+	_http2_queue_free(&ctx->block);
+	return ret;
+}
+
+static int _http2_checkframe(http2_ctx_t *ctx, int type, int flags, uint32_t id, const uint8_t *payload, int length)
+{
+	if (ctx->blockstream != 0 && type != FRAME_CONTINUATION)
+		return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+	if (ctx->state == H2_SETTINGS)
+	{
+		/**
+		 * the preface of the client ends with a SETTINGS frame
+		 */
+		if (type != FRAME_SETTINGS || (flags & FLAG_ACK))
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		ctx->state = H2_FRAMES;
+	}
+	switch (type)
+	{
+	case FRAME_DATA:
+		if (id == 0)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		return _http2_data(ctx, id, flags, payload, length);
+	case FRAME_HEADERS:
+	case FRAME_CONTINUATION:
+		return _http2_headersframe(ctx, type, flags, id, payload, length);
+	case FRAME_PRIORITY:
+		if (id == 0)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		if (length != 5)
+			return _http2_goaway(ctx, H2_FRAME_SIZE_ERROR);
+	break;
+	case FRAME_RST_STREAM:
+	{
+		if (id == 0 || id > ctx->lastid)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		if (length != 4)
+			return _http2_goaway(ctx, H2_FRAME_SIZE_ERROR);
+		http2_stream_t *stream = _http2_stream(ctx, id);
+		if (stream != NULL)
+		{
+			http2_dbg("http2: stream %u reset %u", id, _http2_uint32(payload));
+			_http2_reset(ctx, stream);
+			if (ctx->state == H2_CLOSED)
+				return EREJECT;
+		}
+	}
+	break;
+	case FRAME_SETTINGS:
+	{
+		if (id != 0)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		if (flags & FLAG_ACK)
+		{
+			if (length != 0)
+				return _http2_goaway(ctx, H2_FRAME_SIZE_ERROR);
+			break;
+		}
+		int error = _http2_applysettings(ctx, payload, length);
+		if (error != H2_NO_ERROR)
+			return _http2_goaway(ctx, error);
+		_http2_frame(ctx, FRAME_SETTINGS, FLAG_ACK, 0, NULL, 0);
+	}
+	break;
+	case FRAME_PUSH_PROMISE:
+		return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+	case FRAME_PING:
+		if (id != 0)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		if (length != 8)
+			return _http2_goaway(ctx, H2_FRAME_SIZE_ERROR);
+		if (!(flags & FLAG_ACK))
+			_http2_frame(ctx, FRAME_PING, FLAG_ACK, 0, payload, length);
+	break;
+	case FRAME_GOAWAY:
+		if (id != 0)
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		warn("http2: goaway received");
+		return _http2_goaway(ctx, H2_NO_ERROR);
+	case FRAME_WINDOW_UPDATE:
+		return _http2_windowframe(ctx, id, payload, length);
+	default:
+		/**
+		 * the unknown frames are ignored
+		 */
+	break;
+	}
+	return ESUCCESS;
+}
+
+/*****************************************************************************
+ * connection
+ ****************************************************************************/
+static int _http2_base64url(const char *in, int length, uint8_t *out, int size)
+{
+	uint32_t value = 0;
+	int bits = 0;
+	int outlength = 0;
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		char c = in[i];
+		int digit;
+		if (c >= 'A' && c <= 'Z')
+			digit = c - 'A';
+		else if (c >= 'a' && c <= 'z')
+			digit = c - 'a' + 26;
+		else if (c >= '0' && c <= '9')
+			digit = c - '0' + 52;
+		else if (c == '-' || c == '+')
+			digit = 62;
+		else if (c == '_' || c == '/')
+			digit = 63;
+		else if (c == '=')
+			break;
+		else
+			return EREJECT;
+		value = (value << 6) | digit;
+		bits += 6;
+		if (bits >= 8)
+		{
+			bits -= 8;
+			if (outlength >= size)
+				return EREJECT;
+			out[outlength++] = value >> bits;
+		}
+	}
+	return outlength;
+}
+
+/**
+ * @brief split a field of the HTTP/1.1 head
+ *
+ * @return the length of the name or EREJECT
+ */
+static int _http2_headline(const char *line, const char *lineend, const char **value, int *valuelen)
+{
+	const char *colon = memchr(line, ':', lineend - line);
+	if (colon == NULL)
+		return EREJECT;
+	const char *it = colon + 1;
+	while (it < lineend && (*it == ' ' || *it == '\t'))
+		it++;
+	int length = lineend - it;
+	while (length > 0 && (it[length - 1] == '\r' || it[length - 1] == '\n' || it[length - 1] == ' '))
+		length--;
+	*value = it;
+	*valuelen = length;
+	return colon - line;
+}
+
+/**
+ * @brief upgrade the connection with the first HTTP/1.1 request
+ *
+ * The request is accepted with "Upgrade: h2c" and "HTTP2-Settings" and
+ * without content. It becomes the stream 1 without its upgrade fields.
+ */
+static int _http2_upgrade(http2_ctx_t *ctx, const char *head, int length)
+{
+	const char *end = head + length;
+	const char *first = memchr(head, '\n', length);
+	const char *settings = NULL;
+	int settingslen = 0;
+	int upgrade = 0;
+	if (first == NULL)
+		return EREJECT;
+	first++;
+	const char *line;
+	const char *lineend;
+	for (line = first; line < end; line = lineend)
+	{
+		lineend = memchr(line, '\n', end - line);
+		if (lineend == NULL)
+			break;
+		lineend++;
+		const char *value;
+		int valuelen;
+		int namelen = _http2_headline(line, lineend, &value, &valuelen);
+		if (namelen == EREJECT)
+			continue;
+		if (_http2_iscase(line, namelen, "Upgrade"))
+		{
+			if (valuelen >= 3 && memmem(value, valuelen, "h2c", 3) != NULL)
+				upgrade = 1;
+		}
+		else if (_http2_iscase(line, namelen, "HTTP2-Settings"))
+		{
+			settings = value;
+			settingslen = valuelen;
+		}
+		else if (_http2_iscase(line, namelen, "Transfer-Encoding") ||
+				(_http2_iscase(line, namelen, "Content-Length") && atoi(value) != 0))
+			return EREJECT;
+	}
+	uint8_t payload[HTTP2_MAXHEADERS / 4 * 3];
+	int payloadlen = EREJECT;
+	if (upgrade && settings != NULL)
+		payloadlen = _http2_base64url(settings, settingslen, payload, sizeof(payload));
+	if (payloadlen < 0 || _http2_applysettings(ctx, payload, payloadlen) != H2_NO_ERROR)
+		return EREJECT;
+
+	/**
+	 * "<method> <uri> HTTP/1.1"
+	 */
+	http2_queue_t requestline = {0};
+	const char *uri = memchr(head, ' ', first - head);
+	const char *version = (uri != NULL)? memchr(uri + 1, ' ', first - uri - 1): NULL;
+	if (version == NULL ||
+		_http2_queue_append(&requestline, head, uri - head) != ESUCCESS ||
+		_http2_queue_append(&requestline, "", 1) != ESUCCESS ||
+		_http2_queue_append(&requestline, uri + 1, version - uri - 1) != ESUCCESS ||
+		_http2_queue_append(&requestline, "", 1) != ESUCCESS)
+	{
+		_http2_queue_free(&requestline);
+		return EREJECT;
+	}
+	const char *method = _http2_queue_data(&requestline);
+	http2_stream_t *stream = _http2_newstream(ctx, 1);
+	http_message_t *message = NULL;
+	if (stream != NULL)
+		message = httpclient_openstream(ctx->client, stream, method, method + strlen(method) + 1, 0);
+	if (message == NULL)
+	{
+		if (stream != NULL)
+			_http2_freestream(ctx, stream);
+		_http2_queue_free(&requestline);
+		return EREJECT;
+	}
+	stream->flags |= STREAM_RESPONDING | STREAM_REMOTECLOSED;
+	if (!strcmp(method, "HEAD"))
+		stream->flags |= STREAM_HEAD;
+	_http2_queue_free(&requestline);
+
+	for (line = first; line < end; line = lineend)
+	{
+		lineend = memchr(line, '\n', end - line);
+		if (lineend == NULL)
+			break;
+		lineend++;
+		const char *value;
+		int valuelen;
+		int namelen = _http2_headline(line, lineend, &value, &valuelen);
+		if (namelen == EREJECT || _http2_iscase(line, namelen, "Upgrade") ||
+			_http2_iscase(line, namelen, "HTTP2-Settings") ||
+			_http2_connectionfield(line, namelen))
+			continue;
+		httpclient_streamheader(message, line, namelen, value, valuelen);
+	}
+
+	_http2_queue_string(&ctx->out, "HTTP/1.1 101 Switching Protocols\r\n"
+									"Connection: Upgrade\r\n"
+									"Upgrade: h2c\r\n\r\n");
+	_http2_settings(ctx);
+	warn("http2: connection upgraded");
+	return ESUCCESS;
+}
+
+static int _http2_detect(http2_ctx_t *ctx)
+{
+	const char *data = _http2_queue_data(&ctx->in);
+	int length = (ctx->in.length < HTTP2_PREFACELENGTH)? ctx->in.length: HTTP2_PREFACELENGTH;
+	if (!memcmp(data, HTTP2_PREFACE, length))
+	{
+		if (length == HTTP2_PREFACELENGTH)
+		{
+			ctx->state = H2_PREFACE;
+			_http2_settings(ctx);
+			warn("http2: connection with prior knowledge");
+		}
+		return ESUCCESS;
+	}
+	const char *end = memmem(data, ctx->in.length, "\r\n\r\n", 4);
+	if (end == NULL)
+	{
+		if (ctx->in.length > HTTP2_MAXHEADERS)
+			ctx->state = H2_PASSTHROUGH;
+		return ESUCCESS;
+	}
+	length = end + 4 - data;
+	if (_http2_upgrade(ctx, data, length) == ESUCCESS)
+	{
+		_http2_queue_consume(&ctx->in, length);
+		ctx->state = H2_PREFACE;
+	}
+	else
+		ctx->state = H2_PASSTHROUGH;
+	return ESUCCESS;
+}
+
+static int _http2_process(http2_ctx_t *ctx)
+{
+	if (ctx->state == H2_DETECT)
+		_http2_detect(ctx);
+	if (ctx->state == H2_PREFACE)
+	{
+		int length = (ctx->in.length < HTTP2_PREFACELENGTH)? ctx->in.length: HTTP2_PREFACELENGTH;
+		if (memcmp(_http2_queue_data(&ctx->in), HTTP2_PREFACE, length))
+			return _http2_goaway(ctx, H2_PROTOCOL_ERROR);
+		if (length < HTTP2_PREFACELENGTH)
+			return ESUCCESS;
+		_http2_queue_consume(&ctx->in, length);
+		ctx->state = H2_SETTINGS;
+	}
+	while ((ctx->state == H2_SETTINGS || ctx->state == H2_FRAMES) &&
+		ctx->in.length >= HTTP2_FRAMEHEADER)
+	{
+		const uint8_t *header = (const uint8_t *)_http2_queue_data(&ctx->in);
+		int length = (header[0] << 16) | (header[1] << 8) | header[2];
+		if (length > ctx->config->maxframe)
+			return _http2_goaway(ctx, H2_FRAME_SIZE_ERROR);
+		if (ctx->in.length < HTTP2_FRAMEHEADER + length)
+			break;
+		uint32_t id = _http2_uint32(header + 5) & HTTP2_MAXWINDOW;
+		if (_http2_checkframe(ctx, header[3], header[4], id, header + HTTP2_FRAMEHEADER, length) != ESUCCESS)
+			return EREJECT;
+		_http2_queue_consume(&ctx->in, HTTP2_FRAMEHEADER + length);
+	}
+	_http2_schedule(ctx);
+	return ESUCCESS;
+}
+
+/**
+ * @brief read and treat the data from the client
+ *
+ * @return ESUCCESS if data was read, EINCOMPLETE or EREJECT
+ */
+static int _http2_receive(http2_ctx_t *ctx)
+{
+	if (_http2_queue_reserve(&ctx->in, HTTP2_RECVSIZE) != ESUCCESS)
+		return EREJECT;
+	char *data = ctx->in.data + ctx->in.offset + ctx->in.length;
+	int ret = ctx->lowerops->recvreq(ctx->lowerctx, data, HTTP2_RECVSIZE);
+	if (ret == EINCOMPLETE)
+		return EINCOMPLETE;
+	if (ret <= 0)
+	{
+		ctx->state = H2_CLOSED;
+		return EREJECT;
+	}
+	ctx->in.length += ret;
+	ret = _http2_process(ctx);
+	if (_http2_flush(ctx) != ESUCCESS)
+		ret = EREJECT;
+	return ret;
+}
+
+/*****************************************************************************
+ * client operations
+ ****************************************************************************/
+static void *http2client_create(void *config, http_client_t *clt)
+{
+	http2_t *http2 = (http2_t *)config;
+	http2_ctx_t *ctx = vcalloc(1, sizeof(*ctx));
+	if (ctx == NULL)
+		return NULL;
+	ctx->lowerops = http2->lowerops;
+	ctx->lowerctx = ctx->lowerops->create(http2->lowerconfig, clt);
+	if (ctx->lowerctx == NULL)
+	{
+		vfree(ctx);
+		return NULL;
+	}
+	ctx->decoder = hpack_create(HPACK_TABLESIZE);
+	ctx->encoder = hpack_create(HPACK_TABLESIZE);
+	if (ctx->decoder == NULL || ctx->encoder == NULL)
+	{
+		if (ctx->decoder)
+			hpack_destroy(ctx->decoder);
+		if (ctx->encoder)
+			hpack_destroy(ctx->encoder);
+		ctx->lowerops->destroy(ctx->lowerctx);
+		vfree(ctx);
+		return NULL;
+	}
+	ctx->client = clt;
+	ctx->config = &http2->config;
+	ctx->state = H2_DETECT;
+	ctx->sendwindow = HTTP2_DEFAULTWINDOW;
+	ctx->recvwindow = HTTP2_DEFAULTWINDOW;
+	ctx->initialwindow = HTTP2_DEFAULTWINDOW;
+	ctx->maxframe = HTTP2_MAXFRAME;
+	return ctx;
+}
+
+static int http2client_connect(void *arg, const char *addr, int port)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	/**
+	 * the connections to other servers stay with HTTP/1
+	 */
+	ctx->state = H2_PASSTHROUGH;
+	if (ctx->lowerops->connect == NULL)
+		return EREJECT;
+	return ctx->lowerops->connect(ctx->lowerctx, addr, port);
+}
+
+static int http2client_recv(void *arg, char *data, int length)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	int received = 0;
+	while (1)
+	{
+		if (ctx->state == H2_PASSTHROUGH)
+		{
+			if (ctx->in.length == 0)
+				return ctx->lowerops->recvreq(ctx->lowerctx, data, length);
+			int size = (ctx->in.length < length)? ctx->in.length: length;
+			memcpy(data, _http2_queue_data(&ctx->in), size);
+			_http2_queue_consume(&ctx->in, size);
+			return size;
+		}
+		if (ctx->state == H2_CLOSED)
+			return EREJECT;
+		/**
+		 * the requests of the frames are read with recvstream,
+		 * and only one reading on the socket, the next one may block
+		 */
+		if (received)
+			return EINCOMPLETE;
+		int ret = _http2_receive(ctx);
+		if (ret != ESUCCESS)
+			return ret;
+		received = 1;
+	}
+	return EINCOMPLETE;
+}
+
+static int http2client_recvstream(void *arg, void *handle, char *data, int length)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	http2_stream_t *stream = (http2_stream_t *)handle;
+	if (ctx->state == H2_CLOSED)
+		return EREJECT;
+	if (stream->input.length == 0)
+		return (stream->flags & STREAM_REMOTECLOSED)? 0: EINCOMPLETE;
+	int size = (stream->input.length < length)? stream->input.length: length;
+	memcpy(data, _http2_queue_data(&stream->input), size);
+	_http2_queue_consume(&stream->input, size);
+	if (stream->input.length == 0 && stream->credit > 0 &&
+		!(stream->flags & STREAM_REMOTECLOSED))
+	{
+		/**
+		 * the connector took the data, the peer may send more
+		 */
+		_http2_windowupdate(ctx, stream->id, stream->credit);
+		stream->recvwindow += stream->credit;
+		stream->credit = 0;
+	}
+	return size;
+}
+
+static int http2client_sendstream(void *arg, void *handle, http_message_t *response, http_stream_part_e part, const char *data, int length)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	http2_stream_t *stream = (http2_stream_t *)handle;
+	int ret = ESUCCESS;
+	switch (part)
+	{
+	case HTTPSTREAM_READY:
+		if ((stream->flags & STREAM_RESET) || ctx->state == H2_CLOSED)
+		{
+			/**
+			 * the client drops the request
+			 */
+			stream->flags &= ~STREAM_RESPONDING;
+			_http2_release(ctx, stream);
+			return EREJECT;
+		}
+		/**
+		 * the output is limited by the windows of the peer
+		 */
+		stream->flags &= ~STREAM_BLOCKED;
+		if (stream->output.length >= HTTP2_OUTPUTMAX || ctx->out.length >= HTTP2_OUTPUTMAX)
+		{
+			stream->flags |= STREAM_BLOCKED;
+			ret = EINCOMPLETE;
+		}
+	break;
+	case HTTPSTREAM_HEAD:
+		ret = _http2_responsehead(ctx, stream, response);
+	break;
+	case HTTPSTREAM_DATA:
+		ret = _http2_senddata(ctx, stream, data, length);
+	break;
+	case HTTPSTREAM_END:
+		stream->flags &= ~STREAM_RESPONDING;
+		if (stream->flags & (STREAM_LOCALCLOSED | STREAM_RESET))
+			_http2_release(ctx, stream);
+		else
+		{
+			/**
+			 * the stream is released after its last DATA frame
+			 */
+			stream->flags |= STREAM_OUTEND;
+			_http2_schedule(ctx);
+		}
+	break;
+	}
+	return ret;
+}
+
+static int http2client_send(void *arg, const char *data, int length)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	if (ctx->state == H2_PASSTHROUGH)
+		return ctx->lowerops->sendresp(ctx->lowerctx, data, length);
+	err("http2: response out of a stream");
+	return EREJECT;
+}
+
+static int http2client_sendv(void *arg, const struct iovec *iov, int iovcnt)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	if (ctx->state == H2_PASSTHROUGH && ctx->lowerops->sendv != NULL)
+		return ctx->lowerops->sendv(ctx->lowerctx, iov, iovcnt);
+	if (ctx->state == H2_PASSTHROUGH)
+		return ctx->lowerops->sendresp(ctx->lowerctx, iov[0].iov_base, iov[0].iov_len);
+	err("http2: response out of a stream");
+	return EREJECT;
+}
+
+static int http2client_wait(void *arg, int options)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	if (ctx->state == H2_PASSTHROUGH)
+	{
+		if (!(options & WAIT_SEND) && ctx->in.length > 0)
+			return ESUCCESS;
+		return ctx->lowerops->wait(ctx->lowerctx, options);
+	}
+	if (ctx->state == H2_CLOSED)
+		return EREJECT;
+	_http2_schedule(ctx);
+	if (_http2_flush(ctx) != ESUCCESS)
+		return EREJECT;
+	/**
+	 * the rest of the frames waits the socket
+	 */
+	if (ctx->out.length > 0)
+		options |= WAIT_SEND;
+	else if (_http2_unblocked(ctx))
+		return ESUCCESS;
+	return ctx->lowerops->wait(ctx->lowerctx, options);
+}
+
+static int http2client_status(void *arg)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	if (ctx->state == H2_PASSTHROUGH && ctx->in.length > 0)
+		return ESUCCESS;
+	if (ctx->state == H2_CLOSED)
+		return EREJECT;
+	if (ctx->state != H2_PASSTHROUGH)
+	{
+		_http2_schedule(ctx);
+		if (_http2_flush(ctx) != ESUCCESS)
+			return EREJECT;
+	}
+	return ctx->lowerops->status(ctx->lowerctx);
+}
+
+static void http2client_flush(void *arg)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	if (ctx->state != H2_PASSTHROUGH)
+	{
+		_http2_schedule(ctx);
+		_http2_flush(ctx);
+	}
+	if (ctx->lowerops->flush != NULL)
+		ctx->lowerops->flush(ctx->lowerctx);
+}
+
+static void http2client_disconnect(void *arg)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	if (ctx->state == H2_SETTINGS || ctx->state == H2_FRAMES)
+	{
+		/**
+		 * the rest of the data may be sent before the closing
+		 */
+		_http2_schedule(ctx);
+		_http2_goaway(ctx, H2_NO_ERROR);
+	}
+	while (ctx->state == H2_CLOSED && ctx->out.length > 0 &&
+		ctx->lowerops->wait(ctx->lowerctx, WAIT_SEND) == ESUCCESS &&
+		_http2_flush(ctx) == ESUCCESS);
+	ctx->lowerops->disconnect(ctx->lowerctx);
+}
+
+static void http2client_destroy(void *arg)
+{
+	http2_ctx_t *ctx = (http2_ctx_t *)arg;
+	while (ctx->streams != NULL)
+		_http2_freestream(ctx, ctx->streams);
+	_http2_queue_free(&ctx->in);
+	_http2_queue_free(&ctx->out);
+	_http2_queue_free(&ctx->block);
+	hpack_destroy(ctx->decoder);
+	hpack_destroy(ctx->encoder);
+	ctx->lowerops->destroy(ctx->lowerctx);
+	vfree(ctx);
+}
+
+static const httpclient_ops_t http2_ops =
+{
+	.scheme = "http",
+	.default_port = 80,
+	.type = HTTPCLIENT_TYPE_MULTIPLEX,
+	.create = http2client_create,
+	.connect = http2client_connect,
+	.recvreq = http2client_recv,
+	.sendresp = http2client_send,
+	.wait = http2client_wait,
+	.status = http2client_status,
+	.flush = http2client_flush,
+	.disconnect = http2client_disconnect,
+	.destroy = http2client_destroy,
+	.sendzerocopy = NULL,
+	.released = NULL,
+	.sendv = http2client_sendv,
+	.recvstream = http2client_recvstream,
+	.sendstream = http2client_sendstream,
+};
+
+http2_t *http2_create(http_server_t *server, const http2_config_t *config)
+{
+	http2_t *http2 = vcalloc(1, sizeof(*http2));
+	if (http2 == NULL)
+		return NULL;
+	if (config == NULL)
+		config = &_http2_defaultconfig;
+	http2->config = *config;
+	if (http2->config.maxframe < HTTP2_MAXFRAME || http2->config.maxframe > 16777215)
+		http2->config.maxframe = HTTP2_MAXFRAME;
+	if (http2->config.window <= 0)
+		http2->config.window = HTTP2_WINDOW;
+	if (http2->config.maxstreams <= 0)
+		http2->config.maxstreams = HTTP2_MAXSTREAMS;
+	/**
+	 * the clients of fork and of pthread share the tables
+	 */
+	hpack_init();
+	http2->server = server;
+	http2->lowerconfig = server;
+	http2->lowerops = httpserver_changeprotocol(server, &http2_ops, http2);
+	return http2;
+}
+
+void http2_destroy(http2_t *http2)
+{
+	httpserver_changeprotocol(http2->server, http2->lowerops, http2->lowerconfig);
+	vfree(http2);
+}
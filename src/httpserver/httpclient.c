@@ -52,9 +52,22 @@
 #else
 #include <sys/select.h>
 #endif
+/**
+ * the pipe of a response is waited with poll
+ */
+#include <poll.h>
 
 #include <netdb.h>
 
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+/**
+ * the relay moves the data between the sockets with splice
+ */
+#define HTTPCLIENT_RELAY
+#include <poll.h>
+#include <sys/socket.h>
+#endif
+
 #include "valloc.h"
 #include "vthread.h"
 #include "log.h"
@@ -69,6 +82,7 @@
 
 static int _httpclient_thread(http_client_t *client);
 static void _httpclient_destroy(http_client_t *client);
+static void _httpclient_relayfree(http_client_t *client);
 
 http_client_t *httpclient_create(http_server_t *server, const httpclient_ops_t *fops, void *protocol)
 {
@@ -94,7 +108,12 @@ http_client_t *httpclient_create(http_server_t *server, const httpclient_ops_t *
 	client->recv_arg = client->opsctx;
 	if (client->opsctx != NULL)
 	{
-		client->sockdata = _buffer_create(1);
+		client->sockdata = _buffer_create(MAXCHUNKS_SOCKDATA);
+		/**
+		 * the buffer must be large enough to receive several requests
+		 */
+		if (client->sockdata != NULL)
+			_buffer_reserve(client->sockdata, _buffer_chunksize(-1) * (MAXCHUNKS_SOCKDATA - 1));
 	}
 	if (client->sockdata == NULL)
 	{
@@ -132,6 +151,8 @@ static void _httpclient_destroy(http_client_t *client)
 	}
 	if (client->sockdata)
 		_buffer_destroy(client->sockdata);
+	if (client->sendrest)
+		vfree(client->sendrest);
 	http_message_t *request = client->request_queue;
 	while (request)
 	{
@@ -140,9 +161,98 @@ static void _httpclient_destroy(http_client_t *client)
 		request = next;
 	}
 	client->request_queue = NULL;
+	request = client->pipeline_done;
+	while (request)
+	{
+		http_message_t *next = request->next;
+		_httpmessage_destroy(request);
+		request = next;
+	}
+	client->pipeline_done = NULL;
+	/**
+	 * the socket is closed, the kernel keeps its own references
+	 * on the pages still in sending
+	 */
+	while (client->zerocopy_pending != NULL)
+	{
+		buffer_t *next = client->zerocopy_pending->next;
+		_buffer_destroy(client->zerocopy_pending);
+		client->zerocopy_pending = next;
+	}
+	while (client->zerocopy_free != NULL)
+	{
+		buffer_t *next = client->zerocopy_free->next;
+		_buffer_destroy(client->zerocopy_free);
+		client->zerocopy_free = next;
+	}
+	_httpclient_relayfree(client);
 	vfree(client);
 }
 
+/**
+ * @brief This function returns a mapping to reserve the content of a response.
+ *
+ * A mapping released by the kernel is used again if it is large enough,
+ * otherwise a new mapping is created.
+ *
+ * @param client the client connection of the response.
+ * @param length the length of the content.
+ *
+ * @return the buffer or NULL on error.
+ */
+buffer_t *_httpclient_mapbuffer(http_client_t *client, int length)
+{
+	buffer_t **previous = &client->zerocopy_free;
+	while (*previous != NULL)
+	{
+		buffer_t *buffer = *previous;
+		if (_buffer_remap(buffer, length) == ESUCCESS)
+		{
+			*previous = buffer->next;
+			buffer->next = NULL;
+			return buffer;
+		}
+		previous = &buffer->next;
+	}
+	return _buffer_map(length);
+}
+
+/**
+ * @brief This function collects the mappings released by the kernel.
+ *
+ * The mappings are sent in order and the kernel releases them in order.
+ * Some of them are kept for the next reservations, the others are
+ * unmapped.
+ *
+ * @param client the client connection.
+ */
+static void _httpclient_releasebuffers(http_client_t *client)
+{
+	if (client->zerocopy_done != client->zerocopy_sent && client->ops->released != NULL)
+		client->ops->released(client->opsctx);
+	int nbfree = 0;
+	buffer_t *buffer = client->zerocopy_free;
+	while (buffer != NULL)
+	{
+		nbfree++;
+		buffer = buffer->next;
+	}
+	while (client->zerocopy_pending != NULL &&
+		(int)(client->zerocopy_done - client->zerocopy_pending->release) >= 0)
+	{
+		buffer = client->zerocopy_pending;
+		client->zerocopy_pending = buffer->next;
+		if (nbfree < HTTPCLIENT_MAPPINGS)
+		{
+			buffer->next = client->zerocopy_free;
+			client->zerocopy_free = buffer;
+			nbfree++;
+		}
+		else
+			_buffer_destroy(buffer);
+	}
+}
+
 void httpclient_destroy(http_client_t *client)
 {
 	_httpclient_destroy(client);
@@ -456,6 +566,15 @@ static int _httpclient_checkconnector(http_client_t *client, http_message_t *req
 				iterator = iterator->next;
 				continue;
 			}
+			/**
+			 * the filters accepted the request before the 100 Continue
+			 */
+			if (priority < 0 && (request->mode & HTTPMESSAGE_CONTINUED) &&
+				iterator->priority < CONNECTOR_DOCFILTER)
+			{
+				iterator = iterator->next;
+				continue;
+			}
 			client_dbg("client %p connector \"%s\"", client, iterator->name);
 			ret = iterator->func(iterator->arg, request, response);
 			if (ret != EREJECT)
@@ -497,6 +616,24 @@ static void _httpclient_pushrequest(http_client_t *client, http_message_t *reque
 	}
 }
 
+/**
+ * @brief check if a complete request of the queue changes the protocol
+ *
+ * The data after this request belongs to the new protocol, it is not
+ * parsed.
+ */
+static int _httpclient_upgrading(http_client_t *client)
+{
+	const http_message_t *request = client->request_queue;
+	while (request != NULL && request != client->request)
+	{
+		if (request->mode & HTTPMESSAGE_LOCKED)
+			return 1;
+		request = request->next;
+	}
+	return 0;
+}
+
 static int _httpclient_error_connector(void *arg, http_message_t *request, http_message_t *response)
 {
 	if (request->response->result == RESULT_200)
@@ -514,6 +651,24 @@ static http_connector_list_t error_connector = {
 	.priority = CONNECTOR_ERROR,
 	.name = "server",
 };
+/**
+ * @brief This function starts the timer of the connection with its first request
+ */
+static void _httpclient_timeout(http_client_t *client)
+{
+	if (client->timeout == 0)
+	{
+		/**
+		 * WAIT_ACCEPT does the first initialization
+		 * otherwise the return is EREJECT
+		 */
+		int timer = WAIT_TIMER * 3;
+		if (client->server->config->keepalive)
+			timer = client->server->config->keepalive;
+		client->timeout = timer * 100;
+	}
+}
+
 /**
  * @brief This function receives data from the client connection and parse the request.
  *
@@ -533,17 +688,7 @@ static http_connector_list_t error_connector = {
  */
 static int _httpclient_message(http_client_t *client, http_message_t *request)
 {
-	if (client->timeout == 0)
-	{
-		/**
-		 * WAIT_ACCEPT does the first initialization
-		 * otherwise the return is EREJECT
-		 */
-		int timer = WAIT_TIMER * 3;
-		if (client->server->config->keepalive)
-			timer = client->server->config->keepalive;
-		client->timeout = timer * 100;
-	}
+	_httpclient_timeout(client);
 	int ret = _httpmessage_parserequest(request, client->sockdata);
 
 	if ((request->mode & HTTPMESSAGE_KEEPALIVE) &&
@@ -555,6 +700,83 @@ static int _httpclient_message(http_client_t *client, http_message_t *request)
 	return ret;
 }
 
+/**
+ * @brief This function changes the states after the call of the connector.
+ *
+ * @param client the client connection which receives the request.
+ * @param request the request to check.
+ * @param response the response of the request.
+ * @param ret the value returned by the connector.
+ *
+ * @return the same values as _httpclient_request
+ */
+static int _httpclient_dispatch(http_client_t *client, http_message_t *request, http_message_t *response, int ret)
+{
+	/**
+	 * the connector does not wait its descriptor anymore
+	 */
+	if (ret != ESOURCE && response->source >= 0)
+	{
+		response->source = -1;
+		client->state &= ~CLIENT_WAITSOURCE;
+	}
+	switch (ret)
+	{
+	case ESUCCESS:
+	{
+		client->state = CLIENT_WAITING | (client->state & ~CLIENT_MACHINEMASK);
+		if ((response->state & PARSE_MASK) < PARSE_POSTHEADER)
+			_httpmessage_changestate(response, PARSE_POSTHEADER);
+		if (!(response->state & GENERATE_MASK))
+			_httpmessage_changestate(response, GENERATE_INIT);
+		_httpmessage_changestate(response, PARSE_END);
+		response->state &= ~PARSE_CONTINUE;
+		if (request->mode & HTTPMESSAGE_LOCKED)
+		{
+			client->state |= CLIENT_LOCKED;
+		}
+	}
+	break;
+	case ECONTINUE:
+		if ((response->state & PARSE_MASK) < PARSE_POSTHEADER)
+			_httpmessage_changestate(response, PARSE_POSTHEADER);
+		if (!(response->state & GENERATE_MASK))
+			_httpmessage_changestate(response, GENERATE_INIT);
+		response->state |= PARSE_CONTINUE;
+		if ((request->mode & HTTPMESSAGE_LOCKED) ||
+			(request->response->mode & HTTPMESSAGE_LOCKED))
+		{
+			client->state |= CLIENT_LOCKED;
+		}
+	break;
+	case EINCOMPLETE:
+		response->state |= PARSE_CONTINUE;
+	break;
+	case ESOURCE:
+		/**
+		 * the connector waits its descriptor, see httpmessage_source
+		 */
+		response->state |= PARSE_CONTINUE;
+		if (response->source >= 0 && !(request->mode & HTTPMESSAGE_STREAM))
+			client->state |= CLIENT_WAITSOURCE;
+	break;
+	case EREJECT:
+	{
+		error_connector.arg = client;
+		request->connector = &error_connector;
+		_httpmessage_changestate(response, GENERATE_ERROR);
+		request->response->state &= ~PARSE_CONTINUE;
+		// The response is an error and it is ready to be sent
+		ret = ESUCCESS;
+	}
+	break;
+	default:
+		err("client: connector error");
+	break;
+	}
+	return ret;
+}
+
 /**
  * @brief This function run the connector with the request.
  *
@@ -613,61 +835,77 @@ static int _httpclient_request(http_client_t *client, http_message_t *request)
 		 * The content is the "tempo" buffer, it is useless to free it.
 		 **/
 		request->content = NULL;
-		switch (ret)
-		{
-		case ESUCCESS:
-		{
-			client->state = CLIENT_WAITING | (client->state & ~CLIENT_MACHINEMASK);
-			if ((response->state & PARSE_MASK) < PARSE_POSTHEADER)
-				_httpmessage_changestate(response, PARSE_POSTHEADER);
-			if (!(response->state & GENERATE_MASK))
-				_httpmessage_changestate(response, GENERATE_INIT);
-			_httpmessage_changestate(response, PARSE_END);
-			response->state &= ~PARSE_CONTINUE;
-			if (request->mode & HTTPMESSAGE_LOCKED)
-			{
-				client->state |= CLIENT_LOCKED;
-			}
-		}
-		break;
-		case ECONTINUE:
-			if ((response->state & PARSE_MASK) < PARSE_POSTHEADER)
-				_httpmessage_changestate(response, PARSE_POSTHEADER);
-			if (!(response->state & GENERATE_MASK))
-				_httpmessage_changestate(response, GENERATE_INIT);
-			response->state |= PARSE_CONTINUE;
-			if ((request->mode & HTTPMESSAGE_LOCKED) ||
-				(request->response->mode & HTTPMESSAGE_LOCKED))
-			{
-				client->state |= CLIENT_LOCKED;
-			}
-		break;
-		case EINCOMPLETE:
-			response->state |= PARSE_CONTINUE;
-		break;
-		case EREJECT:
-		{
-			error_connector.arg = client;
-			request->connector = &error_connector;
-			_httpmessage_changestate(response, GENERATE_ERROR);
-			request->response->state &= ~PARSE_CONTINUE;
-			// The response is an error and it is ready to be sent
-			ret = ESUCCESS;
-		}
-		break;
-		default:
-			err("client: connector error");
-		break;
-		}
+		ret = _httpclient_dispatch(client, request, response, ret);
 	}
 	return ret;
 }
 
+static int _httpclient_flushpipeline(http_client_t *client);
+
+/**
+ * @brief This function keeps the buffer to send it with the next responses
+ *
+ * The buffer must stay unchanged until the pipeline is flushed, the request
+ * of the response is kept into pipeline_done until this moment.
+ */
+static int _httpclient_defer(http_client_t *client, buffer_t *buffer)
+{
+	if (client->pipeline_count == sizeof(client->pipeline) / sizeof(client->pipeline[0]) &&
+		_httpclient_flushpipeline(client) != ESUCCESS)
+		return EREJECT;
+	struct iovec *iov = &client->pipeline[client->pipeline_count++];
+	iov->iov_base = buffer->data;
+	iov->iov_len = buffer->length;
+	buffer->offset = buffer->data + buffer->length;
+	buffer->length = 0;
+	return ESUCCESS;
+}
+
+/**
+ * @brief This function gives the content of a stream to its protocol
+ *
+ * The protocol keeps the data until its own framing is sent,
+ * see httpclient_openstream.
+ *
+ * @return ESUCCESS or EREJECT
+ */
+static int _httpclient_sendstream(http_client_t *client, const struct iovec *iov, int iovcnt)
+{
+	http_message_t *request = client->streaming;
+	int i;
+	for (i = 0; i < iovcnt; i++)
+	{
+		if (iov[i].iov_len > 0 &&
+			client->ops->sendstream(client->opsctx, request->stream, request->response,
+				HTTPSTREAM_DATA, iov[i].iov_base, iov[i].iov_len) != ESUCCESS)
+			return EREJECT;
+	}
+	return ESUCCESS;
+}
+
 static int _httpclient_sendpart(http_client_t *client, buffer_t *buffer)
 {
 	int ret = ECONTINUE;
-	if ((buffer != NULL) && (buffer->length > 0))
+	if ((buffer != NULL) && (buffer->length > 0) &&
+		(client->streaming != NULL))
+	{
+		struct iovec iov = {.iov_base = buffer->data, .iov_len = buffer->length};
+		ret = _httpclient_sendstream(client, &iov, 1);
+		buffer->offset = buffer->data;
+		buffer->length = 0;
+	}
+	else if ((buffer != NULL) && (buffer->length > 0) &&
+		(client->state & CLIENT_PIPELINE))
+	{
+		ret = _httpclient_defer(client, buffer);
+	}
+	else if ((buffer != NULL) && (buffer->length > 0))
 	{
+		/**
+		 * the previous responses must be sent first
+		 */
+		if (client->pipeline_count > 0 && _httpclient_flushpipeline(client) != ESUCCESS)
+			return EREJECT;
 		buffer->offset = buffer->data;
 		int size = 0;
 		while (buffer->length > 0)
@@ -680,6 +918,12 @@ static int _httpclient_sendpart(http_client_t *client, buffer_t *buffer)
 		}
 		if (size == EINCOMPLETE)
 		{
+			/**
+			 * the rest is moved to the beginning, the next data of the
+			 * connector is appended after it
+			 */
+			memmove(buffer->data, buffer->offset, buffer->length);
+			buffer->offset = buffer->data + buffer->length;
 			ret = EINCOMPLETE;
 		}
 		else if (size < 0)
@@ -691,7 +935,10 @@ static int _httpclient_sendpart(http_client_t *client, buffer_t *buffer)
 			ret = EREJECT;
 		}
 		else
+		{
+			buffer->offset = buffer->data;
 			ret = ESUCCESS;
+		}
 	}
 	else
 	{
@@ -701,281 +948,1353 @@ static int _httpclient_sendpart(http_client_t *client, buffer_t *buffer)
 }
 
 /**
- * @brief This function build and send the response of the request
+ * @brief This function answers to "Expect: 100-continue" before the content.
  *
- * This function contains 2 parts: the first one runs the connector while
- * this one returns ECONTINUE (or EINCOMPLETE but it should not be the case).
- * The second part send the data on the client connection.
+ * The filters and the authentication connectors check the request
+ * without its content. If one of them responds, the response is sent
+ * and the content is never read. Otherwise the client receives
+ * "100 Continue" and the content is parsed for the other connectors.
  *
- * @param client the client connection to response.
- * @param request the request of the response to send.
+ * @param client the client connection which receives the request.
+ * @param request the request waiting the 100 Continue.
  *
- * @return ESUCCESS : the response is fully send.
- * ECONTINUE : the response is sending, and the function should be call again ASAP.
- * EINCOMPLETE : the connection is not ready to send data, and the function should be call again when it is ready.
- * EREJECT : the connection is closing during the sending.
+ * @return the same values as _httpclient_request
  */
-static int _httpclient_response(http_client_t *client, http_message_t *request)
+static int _httpclient_expect(http_client_t *client, http_message_t *request)
 {
-	int ret = ESUCCESS;
+	request->response = _httpmessage_create(client, request);
 	http_message_t *response = request->response;
 
-	switch (response->state & GENERATE_MASK)
+	int ret = EREJECT;
+	if (request->content_type != NULL &&
+		!strncasecmp(request->content_type, str_form_urlencoded, strlen(str_form_urlencoded)))
 	{
-		case 0:
-		case GENERATE_ERROR:
-		{
-			if (response->version == HTTP09)
-			{
-				_httpmessage_changestate(response, GENERATE_CONTENT);
-				ret = ECONTINUE;
-			}
-			else
-			{
-				if (response->header == NULL)
-					response->header = _buffer_create(MAXCHUNKS_HEADER);
-				buffer_t *buffer = response->header;
-				_httpmessage_buildresponse(response,response->version, buffer);
-				_httpmessage_changestate(response, GENERATE_RESULT);
-				ret = EINCOMPLETE;
-			}
-			response->state &= ~PARSE_CONTINUE;
-			client->state |= CLIENT_LOCKED;
-		}
-		break;
-		case GENERATE_INIT:
+		/**
+		 * the parameters of a form are into the content,
+		 * the filters check them after the 100 Continue
+		 */
+		request->mode &= ~HTTPMESSAGE_EXPECTCONTINUE;
+	}
+	else
+	{
+		http_connector_list_t *iterator = client->callbacks;
+		while (iterator != NULL && iterator->priority < CONNECTOR_DOCFILTER)
 		{
-			ret = ECONTINUE;
-			if (response->version == HTTP09)
-				_httpmessage_changestate(response, GENERATE_CONTENT);
-			else
+			if (iterator->func)
 			{
-				if (response->header == NULL)
-					response->header = _buffer_create(MAXCHUNKS_HEADER);
-				buffer_t *buffer = response->header;
-				if ((response->state & PARSE_MASK) >= PARSE_POSTHEADER)
+				client_dbg("client %p expect connector \"%s\"", client, iterator->name);
+				ret = iterator->func(iterator->arg, request, response);
+				if (ret != EREJECT)
 				{
-					_httpmessage_changestate(response, GENERATE_RESULT);
-					_httpmessage_buildresponse(response,response->version, buffer);
-					ret = EINCOMPLETE;
+					request->connector = iterator;
+					break;
 				}
 			}
+			iterator = iterator->next;
 		}
-		break;
-		case GENERATE_RESULT:
+		if (ret == ESUCCESS)
 		{
-			int sent;
 			/**
-			 * here, it is the call to the sendresp callback from the
-			 * server configuration.
-			 * see http_server_config_t and httpserver_create
+			 * the final response is sent without the content,
+			 * the connection is closed after it.
 			 */
-			sent = _httpclient_sendpart(client, response->header);
-			if (sent == EREJECT)
-			{
-				ret = EREJECT;
-			}
-			else if (sent == ESUCCESS)
-			{
-				/**
-				 * for error the content must be set before the header
-				 * generation to set the ContentLength
-				 */
-				if ((response->result >= 299) &&
-					(response->content == NULL))
-				{
-					const char *value = _httpmessage_status(response);
-					httpmessage_addcontent(response, "text/plain", value, strlen(value));
-					httpmessage_appendcontent(response, "\r\n", 2);
-				}
-
-				_httpmessage_changestate(response, GENERATE_HEADER);
-				_buffer_destroy(response->header);
-				response->header = NULL;
-				int state = request->response->state;
-				_httpmessage_buildheader(response);
-				request->response->state = state;
-				ret = EINCOMPLETE;
-			}
+			httpclient_flag(client, 0, CLIENT_RESPONSEREADY);
+			return _httpclient_dispatch(client, request, response, ret);
 		}
-		break;
-		case GENERATE_HEADER:
-		{
-			int sent;
-			sent = _httpclient_sendpart(client, response->headers_storage);
-			if (sent == ESUCCESS)
-			{
-				_httpmessage_changestate(response, GENERATE_SEPARATOR);
-				ret = EINCOMPLETE;
+		request->mode |= HTTPMESSAGE_CONTINUED;
+	}
+
+	if (response->header == NULL)
+		response->header = _buffer_create(MAXCHUNKS_HEADER * 2);
+	buffer_t *buffer = response->header;
+	int result = response->result;
+	response->result = RESULT_100;
+	_httpmessage_buildresponse(response, response->version, buffer);
+	response->result = result;
+	buffer->offset = buffer->data + buffer->length;
+	_buffer_append(buffer, "\r\n", 2);
+	if (_httpclient_sendpart(client, buffer) == EREJECT)
+		return EREJECT;
+	_buffer_reset(buffer);
+	if (request->connector == NULL)
+		return EINCOMPLETE;
+	return _httpclient_dispatch(client, request, response, ret);
+}
+
+/**
+ * @brief This function keeps the end of the buffers refused by the socket
+ *
+ * The framing must not be cut, the rest is copied and sent before
+ * any other data by _httpclient_sendrest.
+ *
+ * @return ESUCCESS or EREJECT
+ */
+static int _httpclient_keeprest(http_client_t *client, const struct iovec *iov, int iovcnt)
+{
+	int length = client->sendrest_length;
+	int i;
+	for (i = 0; i < iovcnt; i++)
+		length += iov[i].iov_len;
+	if (length > client->sendrest_size)
+	{
+		char *rest = vrealloc(client->sendrest, length);
+		if (rest == NULL)
+			return EREJECT;
+		client->sendrest = rest;
+		client->sendrest_size = length;
+	}
+	for (i = 0; i < iovcnt; i++)
+	{
+		memcpy(client->sendrest + client->sendrest_length, iov[i].iov_base, iov[i].iov_len);
+		client->sendrest_length += iov[i].iov_len;
+	}
+	return ESUCCESS;
+}
+
+/**
+ * @brief This function sends the rest kept by _httpclient_keeprest
+ *
+ * @return ESUCCESS when the rest is sent, EINCOMPLETE or EREJECT
+ */
+static int _httpclient_sendrest(http_client_t *client)
+{
+	int offset = 0;
+	while (offset < client->sendrest_length)
+	{
+		int size = client->client_send(client->send_arg, client->sendrest + offset,
+						client->sendrest_length - offset);
+		if (size == EINCOMPLETE)
+			break;
+		if (size < 0)
+		{
+			err("client %p rest %d send error %s", client, client->sendrest_length - offset, strerror(errno));
+			return EREJECT;
+		}
+		offset += size;
+	}
+	client->sendrest_length -= offset;
+	memmove(client->sendrest, client->sendrest + offset, client->sendrest_length);
+	return (client->sendrest_length > 0)? EINCOMPLETE: ESUCCESS;
+}
+
+/**
+ * @brief This function sends several buffers completely.
+ *
+ * The buffers are sent with one call to the sendv callback of the ops,
+ * when the client does not use another sender (TLS). Otherwise
+ * each buffer is sent with client_send.
+ * When the socket is full, the rest is kept and the response waits
+ * the socket into the main loop (see _httpclient_response).
+ *
+ * @param client the client connection.
+ * @param iov the buffers to send, the vector is modified.
+ * @param iovcnt the number of buffers.
+ *
+ * @return ESUCCESS or EREJECT if the connection is broken
+ */
+static int _httpclient_sendv(http_client_t *client, struct iovec *iov, int iovcnt)
+{
+	if (client->streaming != NULL)
+		return _httpclient_sendstream(client, iov, iovcnt);
+	if (iov != client->pipeline && client->pipeline_count > 0 &&
+		_httpclient_flushpipeline(client) != ESUCCESS)
+		return EREJECT;
+	if (client->sendrest_length > 0)
+	{
+		int ret = _httpclient_sendrest(client);
+		if (ret == EREJECT)
+			return EREJECT;
+		if (ret == EINCOMPLETE)
+			return _httpclient_keeprest(client, iov, iovcnt);
+	}
+	while (iovcnt > 0)
+	{
+		int size;
+		if (client->ops->sendv != NULL && client->client_send == client->ops->sendresp)
+			size = client->ops->sendv(client->opsctx, iov, iovcnt);
+		else
+			size = client->client_send(client->send_arg, iov->iov_base, iov->iov_len);
+		if (size == EINCOMPLETE)
+			return _httpclient_keeprest(client, iov, iovcnt);
+		if (size < 0)
+		{
+			err("client %p sendv error %s", client, strerror(errno));
+			return EREJECT;
+		}
+		while (iovcnt > 0 && size >= iov->iov_len)
+		{
+			size -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0)
+		{
+			iov->iov_base = (char *)iov->iov_base + size;
+			iov->iov_len -= size;
+		}
+	}
+	return ESUCCESS;
+}
+
+/**
+ * @brief This function sends the responses kept into the pipeline
+ *
+ * All the parts are sent with only one call to sendv when it is possible,
+ * after that the requests of these responses are destroyed.
+ *
+ * @return ESUCCESS or EREJECT
+ */
+static int _httpclient_flushpipeline(http_client_t *client)
+{
+	int ret = ESUCCESS;
+	if (client->pipeline_count > 0)
+	{
+		ret = _httpclient_sendv(client, client->pipeline, client->pipeline_count);
+		client->pipeline_count = 0;
+		if (client->ops->flush != NULL)
+			client->ops->flush(client->opsctx);
+	}
+	while (client->pipeline_done != NULL)
+	{
+		http_message_t *next = client->pipeline_done->next;
+		_httpmessage_destroy(client->pipeline_done);
+		client->pipeline_done = next;
+	}
+	return ret;
+}
+
+/**
+ * @brief This function sends the buffer as one chunk of the content.
+ *
+ * The size and the end of the chunk are sent around the buffer
+ * without copy.
+ *
+ * @param client the client connection.
+ * @param buffer the part of the content to send.
+ *
+ * @return ESUCCESS or EREJECT
+ */
+static int _httpclient_sendchunk(http_client_t *client, buffer_t *buffer)
+{
+	char size[12];
+	struct iovec iov[3];
+	int length = snprintf(size, sizeof(size), "%x\r\n", buffer->length);
+	iov[0].iov_base = size;
+	iov[0].iov_len = length;
+	iov[1].iov_base = buffer->data;
+	iov[1].iov_len = buffer->length;
+	iov[2].iov_base = "\r\n";
+	iov[2].iov_len = 2;
+	int ret = _httpclient_sendv(client, iov, 3);
+	/**
+	 * the next part of the content is appended from the beginning
+	 */
+	if (ret == ESUCCESS)
+		_buffer_reset(buffer);
+	return ret;
+}
+
+/**
+ * @brief This function sends the data produced by the encoder of the response
+ *
+ * see _httpmessage_encoding and http_encoder_t
+ */
+static int _httpclient_encoded(void *arg, const char *data, int length)
+{
+	http_message_t *response = (http_message_t *)arg;
+	if (length == 0)
+		return ESUCCESS;
+	if (response->mode & HTTPMESSAGE_CHUNKED)
+	{
+		char size[12];
+		struct iovec iov[3];
+		iov[0].iov_base = size;
+		iov[0].iov_len = snprintf(size, sizeof(size), "%x\r\n", length);
+		iov[1].iov_base = (char *)data;
+		iov[1].iov_len = length;
+		iov[2].iov_base = "\r\n";
+		iov[2].iov_len = 2;
+		return _httpclient_sendv(response->client, iov, 3);
+	}
+	struct iovec iov = {.iov_base = (char *)data, .iov_len = length};
+	return _httpclient_sendv(response->client, &iov, 1);
+}
+
+/**
+ * @brief This function checks if the response may use chunked transfer
+ *
+ * HTTP/1.1 responses without Content-Length use the chunked
+ * transfer encoding to keep the connection alive. The responses without
+ * content and the upgraded connections keep the previous behaviour.
+ */
+static int _httpclient_chunkable(http_client_t *client, http_message_t *request, http_message_t *response)
+{
+	if (request->mode & HTTPMESSAGE_STREAM)
+		return 0;
+	int version = response->version;
+	if (client->server != NULL && version > (client->server->config->version & HTTPVERSION_MASK))
+		version = client->server->config->version & HTTPVERSION_MASK;
+	if (version < HTTP11 || version >= HTTP20)
+		return 0;
+	if (!_httpmessage_contentempty(response, 1))
+		return 0;
+	if (request->method && request->method->id == MESSAGE_TYPE_HEAD)
+		return 0;
+	if (response->result < 200 || response->result == 204 || response->result == 304)
+		return 0;
+	if ((request->mode & HTTPMESSAGE_LOCKED) || (response->mode & HTTPMESSAGE_LOCKED) ||
+		(client->state & CLIENT_LOCKED))
+		return 0;
+	return 1;
+}
+
+/**
+ * @brief This function sends the content of the response without copy.
+ *
+ * Only a buffer reserved by the connector (httpmessage_reservecontent)
+ * is sent without copy, the other contents are too small to gain from
+ * it. The buffer must stay unchanged until the kernel releases it:
+ * it waits on the client with the id of its last sending, and the
+ * response receives a new buffer for the next part of the content.
+ * TLS and other senders need their own buffers, the content is
+ * sent without copy only with the ops of the client.
+ *
+ * @param client the client connection to response.
+ * @param response the response with the content to send.
+ *
+ * @return the same values as _httpclient_sendpart
+ */
+static int _httpclient_sendcontent(http_client_t *client, http_message_t *response)
+{
+	buffer_t *buffer = response->content;
+	if (response->encoderctx != NULL)
+	{
+		/**
+		 * a streaming connector waits its data on the other side
+		 */
+		int flush = (response->state & PARSE_CONTINUE)? ENCODER_FLUSH: ENCODER_MORE;
+		int ret = response->encoder->encode(response->encoderctx, buffer->data, buffer->length, flush);
+		_buffer_reset(buffer);
+		return ret;
+	}
+	if (response->mode & HTTPMESSAGE_CHUNKED)
+	{
+		if (buffer->length == 0)
+			return ECONTINUE;
+		return _httpclient_sendchunk(client, buffer);
+	}
+	int zerocopy = 0;
+	if (client->server != NULL)
+		zerocopy = client->server->config->zerocopy;
+	if ((client->state & CLIENT_PIPELINE) || zerocopy <= 0 ||
+		!buffer->mapped || buffer->size - 1 < zerocopy ||
+		client->ops->sendzerocopy == NULL ||
+		client->client_send != client->ops->sendresp)
+		return _httpclient_sendpart(client, buffer);
+
+	if (client->pipeline_count > 0 && _httpclient_flushpipeline(client) != ESUCCESS)
+		return EREJECT;
+	/**
+	 * the buffer is filled to its end, the rest to send is at its end
+	 */
+	const char *data = buffer->data + buffer->size - 1 - buffer->length;
+	int size = 0;
+	while (buffer->length > 0)
+	{
+		size = client->ops->sendzerocopy(client->opsctx, data, buffer->length);
+		if (size < 0)
+			break;
+		buffer->length -= size;
+		data += size;
+	}
+	if (size == EINCOMPLETE)
+	{
+		/**
+		 * the rest is counted again with the next sending
+		 */
+		if (!_httpmessage_contentempty(response, 1))
+			response->content_length += buffer->length;
+		return EINCOMPLETE;
+	}
+	if (size < 0)
+	{
+		err("client %p rest %d send error %s", client, buffer->length, strerror(errno));
+		return EREJECT;
+	}
+	buffer_t *storage = _buffer_create(MAXCHUNKS_CONTENT);
+	if (storage == NULL)
+		return EREJECT;
+	buffer->release = client->zerocopy_sent;
+	buffer->next = NULL;
+	buffer_t **last = &client->zerocopy_pending;
+	while (*last != NULL)
+		last = &(*last)->next;
+	*last = buffer;
+	response->content_storage = storage;
+	response->content = storage;
+	return ESUCCESS;
+}
+
+/**
+ * @brief This function sends the next part of the file of the response
+ *
+ * The kernel copies the file to the socket with the ops of the client.
+ * TLS and other senders need the data, the file is read into the
+ * content buffer for them.
+ *
+ * @param client the client connection.
+ * @param response the response with the file to send.
+ *
+ * @return ESUCCESS when the file is completely sent, ECONTINUE, EREJECT,
+ * EINCOMPLETE when the socket is full or ESOURCE when the pipe is empty
+ */
+static int _httpclient_sendfile(http_client_t *client, http_message_t *response)
+{
+	int length = HTTPCLIENT_FILECHUNK;
+	if (response->file_length < length)
+		length = response->file_length;
+	int size = 0;
+	if (length > 0 && client->ops->sendfile != NULL && response->encoderctx == NULL &&
+		client->client_send == client->ops->sendresp)
+	{
+		/**
+		 * the previous responses must be sent first
+		 */
+		if (client->pipeline_count > 0 && _httpclient_flushpipeline(client) != ESUCCESS)
+			return EREJECT;
+		size = client->ops->sendfile(client->opsctx, response->file, response->file_offset, length);
+		if (size == EINCOMPLETE || size == ESOURCE)
+			return size;
+	}
+	else if (length > 0)
+	{
+		/**
+		 * the content buffer may belong to the connector, the file
+		 * is read into its own buffer
+		 */
+		if (response->file_storage == NULL)
+			response->file_storage = _buffer_map(HTTPCLIENT_FILEREAD);
+		buffer_t *buffer = response->file_storage;
+		if (buffer == NULL)
+			return EREJECT;
+		if (length > buffer->size - 1)
+			length = buffer->size - 1;
+		if (response->file_offset == (unsigned long long)-1)
+			size = read(response->file, buffer->data, length);
+		else
+			size = pread(response->file, buffer->data, length, response->file_offset);
+		if (size < 0 && errno == EAGAIN)
+			return ESOURCE;
+		if (size > 0 && response->encoderctx != NULL)
+		{
+			if (response->encoder->encode(response->encoderctx, buffer->data, size, ENCODER_MORE) != ESUCCESS)
+				return EREJECT;
+		}
+		else if (size > 0)
+		{
+			struct iovec iov = {.iov_base = buffer->data, .iov_len = size};
+			if (_httpclient_sendv(client, &iov, 1) != ESUCCESS)
+				return EREJECT;
+		}
+	}
+	if (length > 0 && size <= 0)
+	{
+		/**
+		 * the file is shorter than the Content-Length
+		 */
+		err("client %p file send error %s", client, strerror(errno));
+		return EREJECT;
+	}
+	if (response->file_offset != (unsigned long long)-1)
+		response->file_offset += size;
+	response->file_length -= size;
+	if (!_httpmessage_contentempty(response, 1))
+		response->content_length -= (response->content_length < size)? response->content_length: size;
+	if (response->file_length > 0)
+		return ECONTINUE;
+	/**
+	 * the next parts of multipart/byteranges use the same file
+	 */
+	if (response->ranges != NULL)
+		return ESUCCESS;
+	close(response->file);
+	response->file = -1;
+	return ESUCCESS;
+}
+
+/**
+ * @brief This function sends the next part of a multipart/byteranges response
+ *
+ * The content in memory is sent with one call to sendv, the headers of
+ * the parts are gathered with the slices of the content.
+ * The slices of a file are sent with _httpclient_sendfile after the
+ * header of their part.
+ *
+ * @param client the client connection.
+ * @param response the response prepared by _httpmessage_range.
+ *
+ * @return ESUCCESS when the closing boundary is sent, ECONTINUE, EINCOMPLETE or EREJECT
+ */
+static int _httpclient_sendranges(http_client_t *client, http_message_t *response)
+{
+	if (response->file >= 0 && response->file_length > 0)
+	{
+		int ret = _httpclient_sendfile(client, response);
+		if (ret != ESUCCESS)
+			return ret;
+	}
+	if (response->range > response->nranges)
+		return ESUCCESS;
+
+	buffer_t *prefix = response->ranges_storage;
+	struct iovec iov[HTTPMESSAGE_MAXRANGES * 3 + 1];
+	int iovcnt = 0;
+	unsigned long long length = 0;
+	do
+	{
+		http_message_range_t *range = &response->ranges[response->range++];
+		if (response->range <= response->nranges)
+		{
+			iov[iovcnt].iov_base = prefix->data;
+			iov[iovcnt++].iov_len = prefix->length;
+		}
+		iov[iovcnt].iov_base = range->header;
+		iov[iovcnt++].iov_len = range->headerlength;
+		if (range->length == 0)
+			continue;
+		if (response->file >= 0)
+		{
+			response->file_offset = range->offset;
+			response->file_length = range->length;
+			break;
+		}
+		iov[iovcnt].iov_base = response->content->data + range->offset;
+		iov[iovcnt++].iov_len = range->length;
+	} while (response->range <= response->nranges);
+	int i;
+	for (i = 0; i < iovcnt; i++)
+		length += iov[i].iov_len;
+	if (_httpclient_sendv(client, iov, iovcnt) != ESUCCESS)
+		return EREJECT;
+	if (!_httpmessage_contentempty(response, 1))
+		response->content_length -= (response->content_length < length)? response->content_length: length;
+	if (response->range <= response->nranges)
+		return ECONTINUE;
+	if (response->content != NULL)
+		_buffer_reset(response->content);
+	return (response->file_length > 0)? ECONTINUE: ESUCCESS;
+}
+
+/**
+ * @brief This function build and send the response of the request
+ *
+ * This function contains 2 parts: the first one runs the connector while
+ * this one returns ECONTINUE (or EINCOMPLETE but it should not be the case).
+ * The second part send the data on the client connection.
+ *
+ * @param client the client connection to response.
+ * @param request the request of the response to send.
+ *
+ * @return ESUCCESS : the response is fully send.
+ * ECONTINUE : the response is sending, and the function should be call again ASAP.
+ * EINCOMPLETE : the connection is not ready to send data, and the function should be call again when it is ready.
+ * ESPACE : the socket is full, the file is sent again when the socket is ready.
+ * ESOURCE : the pipe of the file is empty, it is sent again when the pipe is ready.
+ * EREJECT : the connection is closing during the sending.
+ */
+static int _httpclient_response(http_client_t *client, http_message_t *request)
+{
+	int ret = ESUCCESS;
+	http_message_t *response = request->response;
+
+	/**
+	 * the rest of the previous sending goes first
+	 */
+	if (client->sendrest_length > 0)
+	{
+		ret = _httpclient_sendrest(client);
+		if (ret != ESUCCESS)
+			return (ret == EREJECT)? EREJECT: ECONTINUE;
+	}
+	switch (response->state & GENERATE_MASK)
+	{
+		case 0:
+		case GENERATE_ERROR:
+		{
+			if (response->version == HTTP09)
+			{
+				_httpmessage_changestate(response, GENERATE_CONTENT);
+				ret = ECONTINUE;
+			}
+			else if (request->mode & HTTPMESSAGE_STREAM)
+			{
+				/**
+				 * the error closes only the stream
+				 */
+				_httpmessage_changestate(response, GENERATE_RESULT);
+				ret = EINCOMPLETE;
+			}
+			else
+			{
+				if (response->header == NULL)
+					response->header = _buffer_create(MAXCHUNKS_HEADER * 2);
+				buffer_t *buffer = response->header;
+				_httpmessage_buildresponse(response,response->version, buffer);
+				_httpmessage_changestate(response, GENERATE_RESULT);
+				ret = EINCOMPLETE;
+			}
+			response->state &= ~PARSE_CONTINUE;
+			if (!(request->mode & HTTPMESSAGE_STREAM))
+				client->state |= CLIENT_LOCKED;
+		}
+		break;
+		case GENERATE_INIT:
+		{
+			ret = ECONTINUE;
+			if (response->version == HTTP09)
+				_httpmessage_changestate(response, GENERATE_CONTENT);
+			else if (request->mode & HTTPMESSAGE_STREAM)
+			{
+				/**
+				 * the protocol of the stream encodes the status itself
+				 */
+				if ((response->state & PARSE_MASK) >= PARSE_POSTHEADER)
+				{
+					_httpmessage_changestate(response, GENERATE_RESULT);
+					ret = EINCOMPLETE;
+				}
+			}
+			else
+			{
+				if (response->header == NULL)
+					response->header = _buffer_create(MAXCHUNKS_HEADER * 2);
+				buffer_t *buffer = response->header;
+				if ((response->state & PARSE_MASK) >= PARSE_POSTHEADER)
+				{
+					_httpmessage_changestate(response, GENERATE_RESULT);
+					_httpmessage_buildresponse(response,response->version, buffer);
+					ret = EINCOMPLETE;
+				}
+			}
+		}
+		break;
+		case GENERATE_RESULT:
+		{
+			/**
+			 * the Range of the request may change the result
+			 */
+			if (response->result == RESULT_200 &&
+				_httpmessage_range(request, response) == ESUCCESS &&
+				response->header != NULL)
+			{
+				_buffer_reset(response->header);
+				_httpmessage_buildresponse(response, response->version, response->header);
+			}
+			/**
+			 * for error the content must be set before the header
+			 * generation to set the ContentLength
+			 */
+			if ((response->result >= 299) && (response->result != RESULT_304) &&
+				(response->content == NULL))
+			{
+				const char *value = _httpmessage_status(response);
+				httpmessage_addcontent(response, "text/plain", value, strlen(value));
+				httpmessage_appendcontent(response, "\r\n", 2);
+			}
+
+			if (response->result == RESULT_200 && response->ranges == NULL)
+				_httpmessage_encoding(request, response, _httpclient_encoded, response);
+			if (_httpclient_chunkable(client, request, response))
+				response->mode |= HTTPMESSAGE_CHUNKED;
+			int state = request->response->state;
+			_httpmessage_buildheader(response);
+			request->response->state = state;
+			if (request->mode & HTTPMESSAGE_STREAM)
+				_httpmessage_buildfields(response);
+			/**
+			 * the status line, the headers and the separator are sent
+			 * together from the header buffer.
+			 */
+			else
+				_httpmessage_buildhead(response, response->header);
+			_httpmessage_changestate(response, GENERATE_HEADER);
+			ret = ECONTINUE;
+		}
+		break;
+		case GENERATE_HEADER:
+		{
+			int sent = ESUCCESS;
+			/**
+			 * here, it is the call to the sendresp callback from the
+			 * server configuration.
+			 * see http_server_config_t and httpserver_create
+			 */
+			if (request->mode & HTTPMESSAGE_STREAM)
+				sent = client->ops->sendstream(client->opsctx, request->stream, response, HTTPSTREAM_HEAD, NULL, 0);
+			else if (response->header != NULL)
+			{
+				sent = _httpclient_sendpart(client, response->header);
+				if (sent == ESUCCESS && !(client->state & CLIENT_PIPELINE))
+				{
+					_buffer_destroy(response->header);
+					response->header = NULL;
+				}
+			}
+			/**
+			 * the headers stay in their storage when the head is too large
+			 */
+			if (sent == ESUCCESS && (response->mode & HTTPMESSAGE_LARGEHEAD))
+				sent = _httpclient_sendpart(client, response->headers_storage);
+			if (sent == ESUCCESS)
+			{
+				_httpmessage_changestate(response, GENERATE_SEPARATOR);
+				ret = EINCOMPLETE;
+			}
+			else if (sent == EREJECT)
+				ret = EREJECT;
+		}
+		break;
+		case GENERATE_SEPARATOR:
+		{
+			if (!(client->state & CLIENT_PIPELINE))
+				client->ops->flush(client->opsctx);
+			if (request->method && request->method->id == MESSAGE_TYPE_HEAD)
+			{
+				_httpmessage_changestate(response, GENERATE_END);
+				ret = ECONTINUE;
+			}
+			else if (response->ranges != NULL)
+			{
+				_httpmessage_changestate(response, GENERATE_CONTENT);
+				ret = ECONTINUE;
+			}
+			else if (response->content != NULL)
+			{
+				int sent;
+				/**
+				 * send the first part of the content.
+				 * The next loop may append data into the content, but
+				 * the first part has to be already sent
+				 */
+				if (!_httpmessage_contentempty(response, 1))
+					response->content_length -= response->content->length;
+				sent = _httpclient_sendcontent(client, response);
+				if (sent == EREJECT)
+				{
+					ret = EREJECT;
+				}
+				else
+				{
+					_httpmessage_changestate(response, GENERATE_CONTENT);
+					ret = ECONTINUE;
+					response->state |= PARSE_CONTINUE;
+				}
+			}
+			else if ((response->state & PARSE_CONTINUE) || response->file >= 0)
+			{
+				_httpmessage_changestate(response, GENERATE_CONTENT);
+				ret = ECONTINUE;
 			}
-			else if (sent == EREJECT)
+			else
+			{
+				_httpmessage_changestate(response, GENERATE_END);
+				ret = ECONTINUE;
+			}
+		}
+		break;
+		case GENERATE_CONTENT:
+		{
+			int sent = ESUCCESS;
+			/**
+			 * The connector may set a file after the content
+			 * (httpmessage_addfile), it is sent when the content is empty.
+			 * Without content and file, the connector has to be called
+			 */
+			if (response->ranges != NULL)
+			{
+				sent = _httpclient_sendranges(client, response);
+				ret = ECONTINUE;
+				if (sent == ESUCCESS)
+					_httpmessage_changestate(response, GENERATE_END);
+				else if (sent == EREJECT || sent == ESOURCE)
+					ret = sent;
+				else if (sent == EINCOMPLETE)
+					ret = ESPACE;
+			}
+			else if (response->content != NULL && response->content->length > 0)
+			{
+				if (!_httpmessage_contentempty(response, 1))
+				{
+
+					/**
+					 * if for any raison the content_length is not the real
+					 * size of the content the following condition must stop
+					 * the request
+					 */
+					response->content_length -=
+						(response->content_length < response->content->length)?
+						response->content_length : response->content->length;
+				}
+				sent = _httpclient_sendcontent(client, response);
+				ret = ECONTINUE;
+				if (_httpmessage_state(response, PARSE_END) && response->file < 0)
+					_httpmessage_changestate(response, GENERATE_END);
+				if (sent == EREJECT)
+					ret = EREJECT;
+#ifdef DEBUG
+				static long long sent = 0;
+				sent += response->content->length;
+				if (!_httpmessage_contentempty(response, 1) &&
+					_httpmessage_state(response, PARSE_END))
+				client_dbg("response send content %d %lld %lld", ret, response->content_length, sent);
+#endif
+			}
+			else if (response->file >= 0)
+			{
+				sent = _httpclient_sendfile(client, response);
+				ret = ECONTINUE;
+				if (sent == ESUCCESS && _httpmessage_state(response, PARSE_END))
+					_httpmessage_changestate(response, GENERATE_END);
+				else if (sent == EREJECT || sent == ESOURCE)
+					ret = sent;
+				else if (sent == EINCOMPLETE)
+					ret = ESPACE;
+			}
+			else
+			{
+				if (_httpmessage_state(response, PARSE_END) &&
+					!(response->state & PARSE_CONTINUE))
+				{
+					_httpmessage_changestate(response, GENERATE_END);
+				}
+				ret = ECONTINUE;
+			}
+		}
+		break;
+		case GENERATE_END:
+		{
+			if (response->encoderctx != NULL)
+			{
+				int sent = response->encoder->encode(response->encoderctx, NULL, 0, ENCODER_END);
+				response->encoder->destroy(response->encoderctx);
+				response->encoderctx = NULL;
+				if (sent != ESUCCESS)
+				{
+					ret = EREJECT;
+					break;
+				}
+			}
+			if (response->mode & HTTPMESSAGE_CHUNKED)
+			{
+				struct iovec iov = {.iov_base = "0\r\n\r\n", .iov_len = 5};
+				if (_httpclient_sendv(client, &iov, 1) != ESUCCESS)
+				{
+					ret = EREJECT;
+					break;
+				}
+				/**
+				 * all the content is sent, the connection may stay alive
+				 */
+				response->mode &= ~HTTPMESSAGE_CHUNKED;
+				response->content_length = 0;
+			}
+			if (response->content != NULL && response->content->length > 0)
+			{
+				_buffer_shrink(response->content, 1);
+			}
+			/**
+			 * the response is complete after its last byte
+			 */
+			if (client->sendrest_length > 0)
+			{
+				ret = ECONTINUE;
+				break;
+			}
+			if ((request->mode & HTTPMESSAGE_STREAM) &&
+				client->ops->sendstream(client->opsctx, request->stream, response, HTTPSTREAM_END, NULL, 0) != ESUCCESS)
+			{
 				ret = EREJECT;
+				break;
+			}
+			http_connector_list_t *callback = request->connector;
+			const char *name = "server";
+			if (callback)
+				name = callback->name;
+			warn("response to %p from connector \"%s\" result %d", client, name, request->response->result);
+			ret = ESUCCESS;
 		}
 		break;
-		case GENERATE_SEPARATOR:
+		default:
+			err("client: bad state %X", response->state & GENERATE_MASK);
+		break;
+	}
+	return ret;
+}
+
+/**
+ * @brief This function waits data on the client socket.
+ *
+ * @param client the client connection to trigg
+ * @param options the bitsmask with WAIT_ACCEPT and WAIT_SEND
+ *
+ * @return ESUCCESS : data are available.
+ * EINCOMPLETE : data is not available, wait again.
+ * EREJECT : connection must be close.
+ */
+static int _httpclient_wait(http_client_t *client, int options)
+{
+	int ret;
+	ret = client->ops->wait(client->opsctx, options);
+	return ret;
+}
+
+int httpclient_wait(http_client_t *client, int options)
+{
+	int ret;
+	ret = _httpclient_wait(client, options);
+	if (ret == ESUCCESS)
+		ret = client->sock;
+	return ret;
+}
+
+/**
+ * @brief This function waits data into the pipe of the response
+ * or the descriptor of its connector (see httpmessage_source)
+ *
+ * With threads, the client waits the pipe. Without threads, the server
+ * runs again the client while its response is not complete.
+ *
+ * @return ESUCCESS : data are available, EINCOMPLETE or EREJECT
+ */
+static int _httpclient_waitsource(http_client_t *client)
+{
+	http_message_t *request = client->request_queue;
+	http_message_t *response = (request != NULL)? request->response: NULL;
+	if (response == NULL || (response->source < 0 && response->file < 0))
+	{
+		client->state &= ~CLIENT_WAITSOURCE;
+		return ESUCCESS;
+	}
+	struct pollfd pfd = {.fd = response->file, .events = POLLIN};
+	/**
+	 * the descriptor of the connector goes before the pipe
+	 */
+	if (response->source >= 0)
+	{
+		pfd.fd = response->source;
+		pfd.events = response->source_events;
+	}
+#ifdef VTHREAD
+	int timeout = WAIT_TIMER * 1000;
+#else
+	int timeout = 0;
+#endif
+	int ret = poll(&pfd, 1, timeout);
+	if (ret < 0 && errno != EINTR)
+		return EREJECT;
+	if (ret <= 0)
+		return EINCOMPLETE;
+	/**
+	 * the end of the pipe is read by the sending
+	 */
+	response->source = -1;
+	client->state &= ~CLIENT_WAITSOURCE;
+	return ESUCCESS;
+}
+
+/**
+ * @brief This function prepares the error response of a bad request
+ */
+static void _httpclient_reject(http_client_t *client, http_message_t *request)
+{
+	/**
+	 * The request contains an syntax error and must be rejected
+	 */
+	if (request->response == NULL)
+		request->response = _httpmessage_create(client, request);
+
+	error_connector.arg = client;
+	request->connector = &error_connector;
+	_httpmessage_changestate(request->response, PARSE_CONTENT);
+	request->response->state |= PARSE_CONTINUE;
+	_httpmessage_changestate(request->response, GENERATE_ERROR);
+	/**
+	 * The format of the request is bad. It may be an attack.
+	 */
+	warn("bad request");
+	_httpmessage_changestate(request, PARSE_END);
+}
+
+int _httpclient_geterror(http_client_t *client)
+{
+	/**
+	 * the connection may close between two requests
+	 */
+	if (client->request == NULL)
+		return ESUCCESS;
+	_httpclient_reject(client, client->request);
+	client->request = NULL;
+	return ESUCCESS;
+}
+
+#ifdef HTTPCLIENT_RELAY
+static void _httpclient_relayfree(http_client_t *client)
+{
+	http_client_relay_t *relay = client->relay;
+	if (relay == NULL)
+		return;
+	int i;
+	for (i = 0; i < 4; i++)
+	{
+		if (relay->pipes[i / 2][i % 2] >= 0)
+			close(relay->pipes[i / 2][i % 2]);
+	}
+	if (relay->sock >= 0)
+		close(relay->sock);
+	free(relay);
+	client->relay = NULL;
+}
+
+/**
+ * @brief This function returns the events waited by the relay
+ *
+ * A direction reads its source while its pipe has space and writes
+ * its destination while its pipe has data.
+ *
+ * @param client the client connection.
+ * @param events the events of the client socket and of the relayed socket.
+ *
+ * @return the relayed socket or -1 if the client is not relaying
+ */
+int _httpclient_relayevents(http_client_t *client, short events[2])
+{
+	http_client_relay_t *relay = client->relay;
+	if (relay == NULL || (client->state & CLIENT_MACHINEMASK) != CLIENT_RELAY)
+		return -1;
+	events[0] = 0;
+	events[1] = 0;
+	if (!relay->closed[RELAY_FROMCLIENT] && relay->pending[RELAY_FROMCLIENT] < relay->capacity)
+		events[0] |= POLLIN;
+	if (relay->pending[RELAY_FROMCLIENT] > 0)
+		events[1] |= POLLOUT;
+	if (!relay->closed[RELAY_TOCLIENT] && relay->pending[RELAY_TOCLIENT] < relay->capacity)
+		events[1] |= POLLIN;
+	if (relay->pending[RELAY_TOCLIENT] > 0)
+		events[0] |= POLLOUT;
+	return relay->sock;
+}
+
+/**
+ * @brief This function starts the relay after the response
+ *
+ * The data of the client after the request is already into the
+ * reception buffer, it is the first data to send to the socket.
+ */
+static int _httpclient_relaystart(http_client_t *client)
+{
+	http_client_relay_t *relay = client->relay;
+	if (!_buffer_empty(client->sockdata))
+	{
+		int length = client->sockdata->length - (client->sockdata->offset - client->sockdata->data);
+		if (length > relay->capacity ||
+			write(relay->pipes[RELAY_FROMCLIENT][1], client->sockdata->offset, length) != length)
+			return EREJECT;
+		relay->pending[RELAY_FROMCLIENT] = length;
+	}
+	_buffer_reset(client->sockdata);
+	fcntl(client->sock, F_SETFL, fcntl(client->sock, F_GETFL) | O_NONBLOCK);
+	fcntl(relay->sock, F_SETFL, fcntl(relay->sock, F_GETFL) | O_NONBLOCK);
+	client->ops->flush(client->opsctx);
+	client_dbg("client %p relayed with %d", client, relay->sock);
+	return ESUCCESS;
+}
+
+/**
+ * @brief This function splices the data of one direction of the relay
+ *
+ * @return EREJECT on error
+ */
+static int _httpclient_relaymove(http_client_t *client, int direction, short revents)
+{
+	http_client_relay_t *relay = client->relay;
+	int *pipe = relay->pipes[direction];
+	int size;
+	if (!relay->closed[direction] && relay->pending[direction] < relay->capacity &&
+		(revents & (POLLIN | POLLHUP)))
+	{
+		int length = relay->capacity - relay->pending[direction];
+		if (direction == RELAY_FROMCLIENT)
+			size = client->ops->recvfile(client->opsctx, pipe[1], length);
+		else
+		{
+			size = splice(relay->sock, NULL, pipe[1], NULL, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (size < 0)
+				size = (errno == EAGAIN)? EINCOMPLETE : EREJECT;
+		}
+		if (size == EREJECT)
+			return EREJECT;
+		if (size == 0)
+			relay->closed[direction] = 1;
+		else if (size > 0)
+			relay->pending[direction] += size;
+	}
+	if (relay->pending[direction] > 0)
+	{
+		if (direction == RELAY_TOCLIENT)
+			size = client->ops->sendfile(client->opsctx, pipe[0], (unsigned long long)-1, relay->pending[direction]);
+		else
+		{
+			size = splice(pipe[0], NULL, relay->sock, NULL, relay->pending[direction], SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+			if (size < 0)
+				size = (errno == EAGAIN)? EINCOMPLETE : EREJECT;
+		}
+		if (size == EREJECT)
+			return EREJECT;
+		if (size > 0)
+			relay->pending[direction] -= size;
+	}
+	/**
+	 * the end of the source is sent after its last data
+	 */
+	if (relay->closed[direction] && relay->pending[direction] == 0 && !relay->shut[direction])
+	{
+		shutdown((direction == RELAY_FROMCLIENT)? relay->sock : client->sock, SHUT_WR);
+		relay->shut[direction] = 1;
+	}
+	return ESUCCESS;
+}
+
+/**
+ * @brief This function runs the relay of the client
+ *
+ * With threads, the relay waits the events of both sockets. Without
+ * threads, the server waits them with the other clients.
+ *
+ * @param client the client connection.
+ *
+ * @return ECONTINUE
+ */
+static int _httpclient_relay(http_client_t *client)
+{
+	http_client_relay_t *relay = client->relay;
+	struct pollfd pfd[2] = {{.fd = client->sock}, {.fd = relay->sock}};
+	short events[2];
+	_httpclient_relayevents(client, events);
+	pfd[0].events = events[0];
+	pfd[1].events = events[1];
+#ifdef VTHREAD
+	int timeout = WAIT_TIMER * 1000;
+#else
+	int timeout = 0;
+#endif
+	int ret = poll(pfd, 2, timeout);
+	if (ret < 0 && errno != EINTR)
+		ret = EREJECT;
+	else if ((pfd[0].revents | pfd[1].revents) & (POLLERR | POLLNVAL))
+		ret = EREJECT;
+	else if (_httpclient_relaymove(client, RELAY_FROMCLIENT, pfd[0].revents) != ESUCCESS ||
+		_httpclient_relaymove(client, RELAY_TOCLIENT, pfd[1].revents) != ESUCCESS)
+		ret = EREJECT;
+	if (ret == EREJECT || (relay->shut[RELAY_FROMCLIENT] && relay->shut[RELAY_TOCLIENT]))
+	{
+		warn("client %p relay end", client);
+		_httpclient_relayfree(client);
+		/**
+		 * the library closes the socket of the client
+		 */
+		client->state &= ~CLIENT_LOCKED;
+		client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
+	}
+	return ECONTINUE;
+}
+#else
+static void _httpclient_relayfree(http_client_t *client)
+{
+}
+
+int _httpclient_relayevents(http_client_t *client, short events[2])
+{
+	return -1;
+}
+
+static int _httpclient_relaystart(http_client_t *client)
+{
+	return EREJECT;
+}
+
+static int _httpclient_relay(http_client_t *client)
+{
+	client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
+	return ECONTINUE;
+}
+#endif
+
+/**
+ * @brief This function runs one step of the request of a stream
+ *
+ * The stream reads its own content, calls its connector and sends its
+ * response beside the other streams of the connection. The protocol
+ * stops the stream while it cannot send more data (HTTPSTREAM_READY).
+ *
+ * @param client the multiplexed connection.
+ * @param request the request opened by httpclient_openstream.
+ *
+ * @return ESUCCESS : the response is complete or the stream is closed.
+ * ECONTINUE : the stream did something and has to run again ASAP.
+ * EINCOMPLETE : the stream waits data from the connection.
+ * EREJECT : the connection is broken.
+ */
+static int _httpclient_stream(http_client_t *client, http_message_t *request)
+{
+	int ret = client->ops->sendstream(client->opsctx, request->stream, request->response, HTTPSTREAM_READY, NULL, 0);
+	if (ret != ESUCCESS)
+		return (ret == EREJECT)? ESUCCESS: EINCOMPLETE;
+
+	int progress = EINCOMPLETE;
+	int state = request->state & PARSE_MASK;
+	if (state == PARSE_END && request->response == NULL && request->result != RESULT_200)
+	{
+		/**
+		 * the method, the URI or the headers are refused
+		 */
+		_httpclient_reject(client, request);
+		progress = ECONTINUE;
+	}
+	else if (state < PARSE_END)
+	{
+		buffer_t *data = client->sockdata;
+		_buffer_reset(data);
+		if (state == PARSE_HEADER)
 		{
-			int size;
-			size = client->client_send(client->send_arg, "\r\n", 2);
-			if (size < 0)
-			{
-				err("client %p SEPARATOR send error %s", client, strerror(errno));
-				ret = EREJECT;
-				break;
-			}
-			client->ops->flush(client->opsctx);
-			if (request->method && request->method->id == MESSAGE_TYPE_HEAD)
-			{
-				_httpmessage_changestate(response, GENERATE_END);
-				ret = ECONTINUE;
-			}
-			else if (response->content != NULL)
-			{
-				int sent;
-				/**
-				 * send the first part of the content.
-				 * The next loop may append data into the content, but
-				 * the first part has to be already sent
-				 */
-				if (!_httpmessage_contentempty(response, 1))
-					response->content_length -= response->content->length;
-				sent = _httpclient_sendpart(client, response->content);
-				if (sent == EREJECT)
-				{
-					ret = EREJECT;
-				}
-				else
-				{
-					_httpmessage_changestate(response, GENERATE_CONTENT);
-					ret = ECONTINUE;
-					response->state |= PARSE_CONTINUE;
-				}
-			}
-			else if (response->state & PARSE_CONTINUE)
-			{
-				_httpmessage_changestate(response, GENERATE_CONTENT);
-				ret = ECONTINUE;
-			}
-			else
-			{
-				_httpmessage_changestate(response, GENERATE_END);
-				ret = ECONTINUE;
-			}
+			/**
+			 * the protocol added all the headers
+			 */
+			_httpmessage_changestate(request, PARSE_POSTHEADER);
+			progress = ECONTINUE;
 		}
-		break;
-		case GENERATE_CONTENT:
+		else if (state == PARSE_CONTENT || state == PARSE_POSTCONTENT)
 		{
-			int sent = ESUCCESS;
 			/**
-			 * The module may send data by itself (mod_sendfile).
-			 * In this case the content doesn't existe but the connector
-			 * has to be called
+			 * the connector already read the previous packet
 			 */
-			if (response->content != NULL && response->content->length > 0)
+			request->content_packet = 0;
+			int size = client->ops->recvstream(client->opsctx, request->stream, data->data, data->size - 1);
+			if (size == EREJECT)
+				return EREJECT;
+			if (size == 0)
 			{
-				if (!_httpmessage_contentempty(response, 1))
-				{
-
-					/**
-					 * if for any raison the content_length is not the real
-					 * size of the content the following condition must stop
-					 * the request
-					 */
-					response->content_length -=
-						(response->content_length < response->content->length)?
-						response->content_length : response->content->length;
-				}
-				sent = _httpclient_sendpart(client, response->content);
-				ret = ECONTINUE;
-				if (_httpmessage_state(response, PARSE_END))
-					_httpmessage_changestate(response, GENERATE_END);
-				if (sent == EREJECT)
-					ret = EREJECT;
-#ifdef DEBUG
-				static long long sent = 0;
-				sent += response->content->length;
-				if (!_httpmessage_contentempty(response, 1) &&
-					_httpmessage_state(response, PARSE_END))
-				client_dbg("response send content %d %lld %lld", ret, response->content_length, sent);
-#endif
+				/**
+				 * the length of the content is the length of the stream
+				 */
+				request->content_length = 0;
+				progress = ECONTINUE;
 			}
-			else
+			else if (size > 0)
 			{
-				if (_httpmessage_state(response, PARSE_END) &&
-					!(response->state & PARSE_CONTINUE))
-				{
-					_httpmessage_changestate(response, GENERATE_END);
-				}
-				ret = ECONTINUE;
+				data->length = size;
+				data->data[size] = 0;
+				progress = ECONTINUE;
 			}
 		}
-		break;
-		case GENERATE_END:
+		if (progress == ECONTINUE)
 		{
-			if (response->content != NULL && response->content->length > 0)
+			data->offset = data->data;
+			do
 			{
-				_buffer_shrink(response->content, 1);
-			}
-			http_connector_list_t *callback = request->connector;
-			const char *name = "server";
-			if (callback)
-				name = callback->name;
-			warn("response to %p from connector \"%s\" result %d", client, name, request->response->result);
-			ret = ESUCCESS;
+				state = request->state;
+				ret = _httpmessage_parserequest(request, data);
+			} while (ret == EINCOMPLETE && request->state != state);
+			if (ret == EREJECT)
+				_httpclient_reject(client, request);
 		}
-		break;
-		default:
-			err("client: bad state %X", response->state & GENERATE_MASK);
-		break;
+		_buffer_reset(data);
 	}
-	return ret;
+
+	if ((request->state & PARSE_MASK) <= PARSE_PRECONTENT)
+		return progress;
+	ret = ESUCCESS;
+	if (request->response == NULL || (request->response->state & PARSE_MASK) < PARSE_END)
+	{
+		ret = _httpclient_request(client, request);
+		/**
+		 * the stream never gives the connection to a connector
+		 */
+		client->state &= ~CLIENT_LOCKED;
+		/**
+		 * the connection does not wait the descriptor of one stream,
+		 * the connector is called again with the other streams
+		 */
+		if (ret == ESOURCE)
+			progress = ECONTINUE;
+	}
+	if (ret == ESUCCESS)
+		request->response->state &= ~PARSE_CONTINUE;
+
+	http_message_t *response = request->response;
+	if (response != NULL && (response->state & GENERATE_MASK) > 0)
+	{
+		client->streaming = request;
+		do
+		{
+			ret = _httpclient_response(client, request);
+		} while (ret == EINCOMPLETE);
+		client->streaming = NULL;
+		if (ret == ESUCCESS || ret == EREJECT)
+			return ret;
+		progress = ECONTINUE;
+	}
+	return progress;
 }
 
 /**
- * @brief This function waits data on the client socket.
+ * @brief This function runs the streams of a multiplexed connection
  *
- * @param client the client connection to trigg
- * @param options the bitsmask with WAIT_ACCEPT and WAIT_SEND
+ * Each stream has its own request and its own response, the slow
+ * response of a stream does not block the other ones.
  *
- * @return ESUCCESS : data are available.
- * EINCOMPLETE : data is not available, wait again.
- * EREJECT : connection must be close.
+ * @param client the multiplexed connection.
+ *
+ * @return ECONTINUE
  */
-static int _httpclient_wait(http_client_t *client, int options)
-{
-	int ret;
-	ret = client->ops->wait(client->opsctx, options);
-	return ret;
-}
-
-int httpclient_wait(http_client_t *client, int options)
-{
-	int ret;
-	ret = _httpclient_wait(client, options);
-	if (ret == ESUCCESS)
-		ret = client->sock;
-	return ret;
-}
-
-int _httpclient_geterror(http_client_t *client)
+static int _httpclient_runstreams(http_client_t *client)
 {
+	int progress = EINCOMPLETE;
+	http_message_t **it = &client->request_queue;
+	while (*it != NULL)
+	{
+		http_message_t *request = *it;
+		int ret = _httpclient_stream(client, request);
+		if (ret == EREJECT)
+		{
+			err("client should exit");
+			client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
+			return ECONTINUE;
+		}
+		if (ret == ESUCCESS)
+		{
+			*it = request->next;
+			_httpmessage_destroy(request);
+			progress = ECONTINUE;
+			continue;
+		}
+		if (ret == ECONTINUE)
+			progress = ECONTINUE;
+		it = &request->next;
+	}
+	if (progress == ECONTINUE)
+		client->state = CLIENT_SENDING | (client->state & ~CLIENT_MACHINEMASK);
+#ifdef VTHREAD
+	else
+		client->state = CLIENT_WAITING | (client->state & ~CLIENT_MACHINEMASK);
+#else
 	/**
-	 * The request contains an syntax error and must be rejected
-	 */
-	if (client->request->response == NULL)
-		client->request->response = _httpmessage_create(client, client->request);
-
-	error_connector.arg = client;
-	client->request->connector = &error_connector;
-	_httpmessage_changestate(client->request->response, PARSE_CONTENT);
-	client->request->response->state |= PARSE_CONTINUE;
-	_httpmessage_changestate(client->request->response, GENERATE_ERROR);
-	/**
-	 * The format of the request is bad. It may be an attack.
+	 * the main loop of the server runs the client while the streams
+	 * are open, the socket may be empty
 	 */
-	warn("bad request");
-	_httpmessage_changestate(client->request, PARSE_END);
-	client->request = NULL;
-	return ESUCCESS;
+	else
+		client->state = CLIENT_READING | (client->state & ~CLIENT_MACHINEMASK);
+#endif
+	return ECONTINUE;
 }
 
 /**
@@ -1003,13 +2322,29 @@ static int _httpclient_thread(http_client_t *client)
 	int send_ret = ECONTINUE;
 	int wait_option = 0;
 
+	/**
+	 * the notifications of the kernel release the mappings sent without copy
+	 */
+	if (client->zerocopy_pending != NULL)
+		_httpclient_releasebuffers(client);
+
 	switch (client->state & CLIENT_MACHINEMASK)
 	{
 		case CLIENT_NEW:
 			wait_option = WAIT_ACCEPT;
 		case CLIENT_WAITING:
 		{
-			recv_ret = _httpclient_wait(client, wait_option);
+			/**
+			 * the connector of the previous request waits its descriptor,
+			 * the socket is only checked
+			 */
+			if (client->state & CLIENT_WAITSOURCE)
+			{
+				send_ret = _httpclient_waitsource(client);
+				recv_ret = client->ops->status(client->opsctx);
+			}
+			else
+				recv_ret = _httpclient_wait(client, wait_option);
 		}
 		break;
 		case CLIENT_READING:
@@ -1021,13 +2356,26 @@ static int _httpclient_thread(http_client_t *client)
 		break;
 		case CLIENT_SENDING:
 		{
-			send_ret = _httpclient_wait(client, WAIT_SEND);
+			if (client->state & CLIENT_WAITSOURCE)
+				send_ret = _httpclient_waitsource(client);
+			else
+				send_ret = _httpclient_wait(client, WAIT_SEND);
 			if (_buffer_empty(client->sockdata))
 				recv_ret = client->ops->status(client->opsctx);
 		}
 		break;
+		case CLIENT_RELAY:
+		return _httpclient_relay(client);
 		case CLIENT_EXIT:
 		{
+			/**
+			 * the relay did not start, the library keeps the socket
+			 */
+			if (client->relay != NULL)
+			{
+				_httpclient_relayfree(client);
+				client->state &= ~CLIENT_LOCKED;
+			}
 			/**
 			 * flush the output socket
 			 */
@@ -1120,8 +2468,11 @@ static int _httpclient_thread(http_client_t *client)
 		client->state = CLIENT_WAITING | (client->state & ~CLIENT_MACHINEMASK);
 	}
 
-	if (!_buffer_empty(client->sockdata))
+	int pipeline = 0;
+	while (!_buffer_empty(client->sockdata) && pipeline < HTTPCLIENT_PIPELINE &&
+		!_httpclient_upgrading(client))
 	{
+		int locked = 0;
 		/**
 		 * the message must be create in all cases
 		 * the sockdata may contain a new message
@@ -1135,6 +2486,7 @@ static int _httpclient_thread(http_client_t *client)
 		/**
 		 * Some data availables
 		 */
+		int state = client->request->state;
 		recv_ret = _httpclient_message(client, client->request);
 		switch (recv_ret)
 		{
@@ -1187,18 +2539,52 @@ static int _httpclient_thread(http_client_t *client)
 			 */
 			if (client->request->content_length != 0)
 				_buffer_shrink(client->sockdata, 1);
+			locked = client->request->mode & HTTPMESSAGE_LOCKED;
 			client->request = NULL;
 			client->state = CLIENT_SENDING | (client->state & ~CLIENT_MACHINEMASK);
 		}
 		}
+		/**
+		 * the content may follow the header into the buffer, the parser
+		 * stops before it and must be called again.
+		 */
+		if (recv_ret == EINCOMPLETE && client->request != NULL &&
+			client->request->state != state)
+			continue;
+		/**
+		 * the following requests of the buffer are parsed now,
+		 * their responses will be sent together.
+		 * After an upgrade the data is for the new protocol.
+		 */
+		if (recv_ret != ESUCCESS || locked || !(client->state & CLIENT_KEEPALIVE))
+			break;
+		pipeline++;
 	}
 
+	int run_ret = ECONTINUE;
 	http_message_t *request = client->request_queue;
-	if (request != NULL &&
-		((request->state & PARSE_MASK) > PARSE_PRECONTENT))
+	if (request != NULL && (request->mode & HTTPMESSAGE_STREAM))
+	{
+		run_ret = _httpclient_runstreams(client);
+		request = NULL;
+	}
+	while (request != NULL &&
+		(((request->state & PARSE_MASK) > PARSE_PRECONTENT) ||
+		((request->mode & (HTTPMESSAGE_EXPECTCONTINUE | HTTPMESSAGE_CONTINUED)) == HTTPMESSAGE_EXPECTCONTINUE)))
 	{
 		int ret = ESUCCESS;
-		if (!request->response)
+		run_ret = ECONTINUE;
+		if (!(request->mode & HTTPMESSAGE_CONTINUED) &&
+			(request->mode & HTTPMESSAGE_EXPECTCONTINUE))
+		{
+			/**
+			 * the header is complete, the client waits the
+			 * 100 Continue or the final response
+			 */
+			if (!request->response)
+				ret = _httpclient_expect(client, request);
+		}
+		else if (!request->response)
 		{
 			/**
 			 * connector first call
@@ -1240,10 +2626,30 @@ static int _httpclient_thread(http_client_t *client)
 		if ((response->state & GENERATE_MASK) > 0)
 		{
 			int ret = EINCOMPLETE;
+			/**
+			 * a complete response is kept when other requests are
+			 * waiting, it will be sent with their responses
+			 */
+			if ((request->next != NULL || client->pipeline_count > 0) &&
+				_httpmessage_state(response, PARSE_END) &&
+				!(request->mode & HTTPMESSAGE_LOCKED) &&
+				!(response->mode & HTTPMESSAGE_LOCKED) &&
+				!(client->state & CLIENT_LOCKED))
+				client->state |= CLIENT_PIPELINE;
 			do
 			{
 				ret = _httpclient_response(client, request);
-			} while (ret == EINCOMPLETE);
+				/**
+				 * the connector is not called again, the generation
+				 * continues until the end
+				 */
+				if (ret == ECONTINUE && (client->state & CLIENT_PIPELINE))
+					response->state &= ~PARSE_CONTINUE;
+			} while (ret == EINCOMPLETE ||
+					(ret == ECONTINUE && (client->state & CLIENT_PIPELINE) &&
+					client->sendrest_length == 0));
+			int pipelined = client->state & CLIENT_PIPELINE;
+			client->state &= ~CLIENT_PIPELINE;
 
 			if (ret == ESUCCESS)
 			{
@@ -1260,22 +2666,36 @@ static int _httpclient_thread(http_client_t *client)
 					client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
 					ret = EINCOMPLETE;
 				}
-				else if (client->state & CLIENT_ERROR)
+				else if ((client->state & CLIENT_ERROR) && request->next == NULL)
 				{
+					/**
+					 * the bad request is the last one of the pipeline
+					 */
 					client_dbg("client: error");
 					client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
 				}
-				else if (client->state & CLIENT_LOCKED)
+				else if (client->relay != NULL && _httpclient_relaystart(client) == ESUCCESS)
 				{
-					client_dbg("client: locked");
-					client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
+					client_dbg("client: relay");
+					client->state = CLIENT_RELAY | (client->state & ~CLIENT_MACHINEMASK);
 				}
-				else if (httpmessage_result(request->response, -1) > 399)
+				else if (httpmessage_result(request->response, -1) > 399 &&
+						!(client->ops->type & HTTPCLIENT_TYPE_MULTIPLEX))
 				{
+					/**
+					 * the protocol does not change after an error,
+					 * the library closes the socket
+					 */
 					client_dbg("client: exit on result");
+					client->state &= ~CLIENT_LOCKED;
 					client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
 					ret = EINCOMPLETE;
 				}
+				else if (client->state & CLIENT_LOCKED)
+				{
+					client_dbg("client: locked");
+					client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
+				}
 				else if (client->state & CLIENT_KEEPALIVE)
 				{
 					client_dbg("client: keep alive");
@@ -1294,8 +2714,20 @@ static int _httpclient_thread(http_client_t *client)
 				 */
 				warn("client: response complete");
 				client->request_queue = request->next;
-				_httpmessage_destroy(request);
-				return ret;
+				if (pipelined)
+				{
+					request->next = client->pipeline_done;
+					client->pipeline_done = request;
+				}
+				else
+					_httpmessage_destroy(request);
+				run_ret = ret;
+				if ((client->state & CLIENT_MACHINEMASK) == CLIENT_READING)
+				{
+					request = client->request_queue;
+					continue;
+				}
+				break;
 			}
 			else if (ret == EREJECT)
 			{
@@ -1303,10 +2735,20 @@ static int _httpclient_thread(http_client_t *client)
 				client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
 			}
 			else
+			{
+				if (ret == ESOURCE)
+					client->state |= CLIENT_WAITSOURCE;
 				client->state = CLIENT_SENDING | (client->state & ~CLIENT_MACHINEMASK);
+			}
 		}
+		break;
 	}
-	return ECONTINUE;
+	if (_httpclient_flushpipeline(client) == EREJECT)
+	{
+		err("client should exit");
+		client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
+	}
+	return run_ret;
 }
 
 void httpclient_shutdown(http_client_t *client)
@@ -1314,3 +2756,95 @@ void httpclient_shutdown(http_client_t *client)
 	client->ops->disconnect(client->opsctx);
 	client->state = CLIENT_EXIT | (client->state & ~CLIENT_MACHINEMASK);
 }
+
+int httpclient_relay(http_client_t *client, int sock, const char *data, int length)
+{
+#ifdef HTTPCLIENT_RELAY
+	/**
+	 * the pipes must receive and send the data of the socket
+	 * without change
+	 */
+	if (client->ops->sendfile == NULL || client->ops->recvfile == NULL ||
+		(client->ops->type & HTTPCLIENT_TYPE_MULTIPLEX) ||
+		client->client_send != client->ops->sendresp ||
+		client->client_recv != client->ops->recvreq ||
+		client->relay != NULL || sock < 0)
+	{
+		warn("client %p cannot be relayed", client);
+		return EREJECT;
+	}
+	http_client_relay_t *relay = calloc(1, sizeof(*relay));
+	if (relay == NULL)
+		return EREJECT;
+	memset(relay->pipes, -1, sizeof(relay->pipes));
+	relay->sock = -1;
+	client->relay = relay;
+	if (pipe2(relay->pipes[RELAY_FROMCLIENT], O_NONBLOCK | O_CLOEXEC) < 0 ||
+		pipe2(relay->pipes[RELAY_TOCLIENT], O_NONBLOCK | O_CLOEXEC) < 0)
+	{
+		err("client %p relay pipe error %s", client, strerror(errno));
+		_httpclient_relayfree(client);
+		return EREJECT;
+	}
+	relay->capacity = fcntl(relay->pipes[RELAY_TOCLIENT][1], F_GETPIPE_SZ);
+	if (relay->capacity <= 0)
+		relay->capacity = 4096;
+	if (length > 0)
+	{
+		if (length > relay->capacity ||
+			write(relay->pipes[RELAY_TOCLIENT][1], data, length) != length)
+		{
+			_httpclient_relayfree(client);
+			return EREJECT;
+		}
+		relay->pending[RELAY_TOCLIENT] = length;
+	}
+	relay->sock = sock;
+	/**
+	 * the response is sent without chunk and the connection is not
+	 * used for the next requests
+	 */
+	client->state |= CLIENT_LOCKED;
+	return ESUCCESS;
+#else
+	return EREJECT;
+#endif
+}
+
+http_message_t *httpclient_openstream(http_client_t *client, void *stream, const char *method, const char *uri, int content)
+{
+	if (client->ops->sendstream == NULL || client->ops->recvstream == NULL)
+		return NULL;
+	http_message_t *request = _httpmessage_create(client, NULL);
+	if (request == NULL)
+		return NULL;
+	_httpclient_timeout(client);
+	request->mode |= HTTPMESSAGE_STREAM;
+	request->stream = stream;
+	_httpmessage_requestline(request, method, uri);
+	request->version = HTTP20;
+	/**
+	 * without Content-Length the content ends with the stream
+	 */
+	request->content_length = (content)? (unsigned long long)-1: 0;
+	_httpclient_pushrequest(client, request);
+	return request;
+}
+
+int httpclient_streamheader(http_message_t *request, const char *key, int keylength, const char *value, int valuelength)
+{
+	buffer_t *storage = request->headers_storage;
+	if (storage == NULL)
+		return EREJECT;
+	if (_buffer_append(storage, key, keylength) == NULL ||
+		_buffer_append(storage, ": ", 2) == NULL ||
+		_buffer_append(storage, value, valuelength) == NULL ||
+		_buffer_append(storage, "\r\n", 2) == NULL)
+	{
+		err("request headers too large");
+		request->result = RESULT_431;
+		_httpmessage_changestate(request, PARSE_END);
+		return EREJECT;
+	}
+	return ESUCCESS;
+}
@@ -39,7 +39,9 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdint.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <signal.h>
 
@@ -64,6 +66,7 @@
 #define _HTTPMESSAGE_
 #include "_httpmessage.h"
 #include "_buffer.h"
+#include "_scan.h"
 #include "dbentry.h"
 
 #define buffer_dbg(...)
@@ -89,6 +92,65 @@ const char str_connection[] = "Connection";
 const char str_contenttype[] = "Content-Type";
 const char str_contentlength[] = "Content-Length";
 
+static const char *_httpheader_names[HDR_MAX] =
+{
+	[HDR_CONTENT_LENGTH] = str_contentlength,
+	[HDR_CONTENT_TYPE] = str_contenttype,
+	[HDR_CONNECTION] = str_connection,
+	[HDR_COOKIE] = str_cookie,
+	[HDR_HOST] = "Host",
+	[HDR_UPGRADE] = "Upgrade",
+	[HDR_TRANSFER_ENCODING] = "Transfer-Encoding",
+	[HDR_ACCEPT_ENCODING] = "Accept-Encoding",
+	[HDR_IF_NONE_MATCH] = "If-None-Match",
+	[HDR_RANGE] = "Range",
+	[HDR_STATUS] = "Status",
+	[HDR_IF_RANGE] = "If-Range",
+	[HDR_IF_MODIFIED_SINCE] = "If-Modified-Since",
+	[HDR_EXPECT] = "Expect",
+};
+
+/**
+ * perfect hash of the known headers:
+ * 5 bits of the hash of the key (see dbtable_hash) are different for
+ * each name of _httpheader_names. The position of these bits is
+ * searched by _httpmessage_init, the table follows the list.
+ */
+#define HTTPHEADER_HASHBITS 5
+#define HTTPHEADER_HASHMASK ((1U << HTTPHEADER_HASHBITS) - 1)
+static int _httpheader_hashshift = -1;
+static signed char _httpheader_ids[HTTPHEADER_HASHMASK + 1];
+
+static void _httpheader_initids(void)
+{
+	int shift;
+	for (shift = 0; shift <= 32 - HTTPHEADER_HASHBITS; shift++)
+	{
+		memset(_httpheader_ids, HDR_UNKNOWN, sizeof(_httpheader_ids));
+		int id;
+		for (id = 0; id < HDR_MAX; id++)
+		{
+			int slot = (dbtable_hash(_httpheader_names[id]) >> shift) & HTTPHEADER_HASHMASK;
+			if (_httpheader_ids[slot] != HDR_UNKNOWN)
+				break;
+			_httpheader_ids[slot] = id;
+		}
+		if (id == HDR_MAX)
+		{
+			_httpheader_hashshift = shift;
+			return;
+		}
+	}
+	warn("message: the known headers are searched one by one");
+}
+
+/**
+ * the sets of delimiters of the parser, see _httpmessage_init
+ */
+static scan_t _httpmessage_uridelimiters;
+static scan_t _httpmessage_linedelimiters;
+static scan_t _httpmessage_querydelimiters;
+
 const http_message_method_t default_methods[] = {
 	{ .key = str_get, .id = MESSAGE_TYPE_GET, .next = (http_message_method_t *)&default_methods[1]},
 	{ .key = str_post, .id = MESSAGE_TYPE_POST, .properties = MESSAGE_ALLOW_CONTENT, .next =(http_message_method_t *) &default_methods[2]},
@@ -106,6 +168,7 @@ int httpmessage_chunksize()
 #ifdef HTTPCLIENT_FEATURES
 http_message_t * httpmessage_create()
 {
+	_httpmessage_init();
 	http_message_t *client = _httpmessage_create(NULL, NULL);
 	return client;
 }
@@ -202,6 +265,8 @@ http_message_t * _httpmessage_create(http_client_t *client, http_message_t *pare
 		message->result = RESULT_200;
 		message->client = client;
 		message->content_length = (unsigned long long)-1;
+		message->file = -1;
+		message->source = -1;
 		if (parent)
 		{
 			parent->response = message;
@@ -223,6 +288,8 @@ void _httpmessage_reset(http_message_t *message)
 		_buffer_reset(message->content);
 	if (message->headers_storage)
 		_buffer_reset(message->headers_storage);
+	dbtable_reset(&message->headers);
+	memset(message->knownheaders, 0, sizeof(message->knownheaders));
 }
 
 void _httpmessage_destroy(http_message_t *message)
@@ -237,15 +304,38 @@ void _httpmessage_destroy(http_message_t *message)
 		_buffer_destroy(message->content_storage);
 	if (message->header)
 		_buffer_destroy(message->header);
-	dbentry_destroy(message->headers);
 	if (message->headers_storage)
 		_buffer_destroy(message->headers_storage);
 	if (message->query_storage)
 		_buffer_destroy(message->query_storage);
-	dbentry_destroy(message->queries);
+	while (message->arena)
+	{
+		http_message_arena_t *next = message->arena->next;
+		vfree(message->arena);
+		message->arena = next;
+	}
 	if (message->cookie_storage)
 		_buffer_destroy(message->cookie_storage);
-	dbentry_destroy(message->cookies);
+	if (message->trailers_storage)
+		_buffer_destroy(message->trailers_storage);
+	if (message->trailers)
+	{
+		dbtable_destroy(message->trailers);
+		vfree(message->trailers);
+	}
+	dbtable_destroy(&message->headers);
+	dbtable_destroy(&message->queries);
+	dbtable_destroy(&message->cookies);
+	if (message->file >= 0)
+		close(message->file);
+	if (message->file_storage)
+		_buffer_destroy(message->file_storage);
+	if (message->ranges_storage)
+		_buffer_destroy(message->ranges_storage);
+	if (message->ranges)
+		vfree(message->ranges);
+	if (message->encoderctx)
+		message->encoder->destroy(message->encoderctx);
 	vfree(message);
 }
 
@@ -312,10 +402,29 @@ static int _httpmessage_parseuri(http_message_t *message, buffer_t *data)
 {
 	int next = PARSE_URI;
 	char *uri = data->offset;
+	char *end = data->data + data->length;
 	int length = 0;
 	int build_uri = 0;
-	while (data->offset < (data->data + data->length) && next == PARSE_URI)
+	const scan_t *delimiters = &_httpmessage_uridelimiters;
+	/**
+	 * the authority form does not begin with /, and the data after
+	 * the request belongs to the tunnel
+	 */
+	if (message->method->properties & MESSAGE_AUTHORITY)
+	{
+		build_uri = 1;
+		message->mode |= HTTPMESSAGE_LOCKED;
+	}
+	while (data->offset < end && next == PARSE_URI)
 	{
+		/**
+		 * jump to the next delimiter, the other characters are copied
+		 */
+		char *delimiter = _scan_find(delimiters, data->offset, end);
+		length += delimiter - data->offset;
+		data->offset = delimiter;
+		if (data->offset == end)
+			break;
 		switch (*data->offset)
 		{
 #ifndef HTTPMESSAGE_NODOUBLEDOT
@@ -325,7 +434,14 @@ static int _httpmessage_parseuri(http_message_t *message, buffer_t *data)
 #endif
 			case '%':
 			{
-				next = PARSE_URIENCODED;
+				/**
+				 * the query is decoded parameter by parameter,
+				 * see _httpmessage_urldecode
+				 */
+				if (message->query != NULL)
+					length++;
+				else
+					next = PARSE_URIENCODED;
 			}
 			break;
 			case '/':
@@ -362,14 +478,6 @@ static int _httpmessage_parseuri(http_message_t *message, buffer_t *data)
 				next = PARSE_VERSION;
 			}
 			break;
-			case '*':
-				length++;
-				/**
-				 * '*' URI is accepted
-				 */
-				if (message->uri == NULL && length == 0)
-					build_uri = 1;
-			break;
 			case '\r':
 			case '\n':
 			{
@@ -383,10 +491,6 @@ static int _httpmessage_parseuri(http_message_t *message, buffer_t *data)
 					data->offset++;
 			}
 			break;
-			default:
-			{
-				length++;
-			}
 		}
 		data->offset++;
 	}
@@ -628,7 +732,9 @@ static int _httpmessage_parseheader(http_message_t *message, buffer_t *data)
 {
 	int next = PARSE_HEADER;
 	char *header = data->offset;
+	char *end = data->data + data->length;
 	int length = 0;
+	const scan_t *delimiters = &_httpmessage_linedelimiters;
 
 	if (message->headers_storage == NULL)
 	{
@@ -636,12 +742,39 @@ static int _httpmessage_parseheader(http_message_t *message, buffer_t *data)
 	}
 
 	/* store header line as "<key>:<value>\0" */
-	while (data->offset < (data->data + data->length) && next == PARSE_HEADER)
+	while (data->offset < end && next == PARSE_HEADER)
 	{
-		switch (*data->offset)
+		char *delimiter = _scan_find(delimiters, data->offset, end);
+		length += delimiter - data->offset;
+		data->offset = delimiter;
+		if (data->offset == end)
+			break;
+		if (*data->offset == ':')
 		{
-			case '\n':
+			if (!(message->state & PARSE_HEADERVALUE))
 			{
+				/**
+				 * RFC7230 3.2.4: a request with a space between the name
+				 * of the header and the colon is rejected
+				 */
+				char last = (length > 0)? header[length - 1]: 0;
+				if (length == 0 && (message->state & PARSE_CONTINUE))
+					last = _buffer_last(message->headers_storage);
+				if (last == 0 || last == ' ' || last == '\t')
+				{
+					err("request header malformed");
+					message->result = RESULT_400;
+					return PARSE_END;
+				}
+				message->state |= PARSE_HEADERVALUE;
+			}
+			/**
+			 * the colon is a part of the line
+			 */
+			length++;
+		}
+		else if (*data->offset == '\n')
+		{
 			/**
 			 * Empty Header line defines the end of the header and
 			 * the beginning fo the content.
@@ -653,24 +786,28 @@ static int _httpmessage_parseheader(http_message_t *message, buffer_t *data)
 			else
 			{
 				header[length] = '\0';
-				_buffer_append(message->headers_storage, header, length + 1);
+				if (_buffer_append(message->headers_storage, header, length + 1) == NULL)
+				{
+					err("request headers too large");
+					message->result = RESULT_431;
+					return PARSE_END;
+				}
 				header = data->offset + 1;
 				length = 0;
-				message->state &= ~PARSE_CONTINUE;
-			}
+				message->state &= ~(PARSE_CONTINUE | PARSE_HEADERVALUE);
 			}
-			break;
-			case '\r':
-			break;
-			default:
-				length++;
 		}
 		data->offset++;
 	}
 	/* not enougth data to complete the line */
 	if (next == PARSE_HEADER && length > 0)
 	{
-		_buffer_append(message->headers_storage, header, length);
+		if (_buffer_append(message->headers_storage, header, length) == NULL)
+		{
+			err("request headers too large");
+			message->result = RESULT_431;
+			return PARSE_END;
+		}
 		message->state |= PARSE_CONTINUE;
 	}
 	return next;
@@ -688,33 +825,371 @@ static int _httpmessage_parsepostheader(http_message_t *message, buffer_t *data)
 	if (_httpmessage_fillheaderdb(message) != ESUCCESS)
 	{
 		next = PARSE_END;
-		message->result = RESULT_400;
-		err("request bad header %s", message->headers_storage->data);
+		message->result = RESULT_431;
+		err("request too many headers");
 	}
 	else
 	{
 		_buffer_shrink(data, 1);
 		next = PARSE_PRECONTENT;
 		message->state &= ~PARSE_CONTINUE;
+		/**
+		 * the client waits the 100 Continue before to send the content,
+		 * the filters check the request first.
+		 */
+		const char *expect = message->knownheaders[HDR_EXPECT];
+		if (expect != NULL && message->version == HTTP11 &&
+			!strcasecmp(expect, "100-continue") &&
+			!_httpmessage_contentempty(message, 0) && data->length == 0)
+			message->mode |= HTTPMESSAGE_EXPECTCONTINUE;
+	}
+	return next;
+}
+
+static uint32_t _httpmessage_word(const char *data)
+{
+	uint32_t word;
+	memcpy(&word, data, sizeof(word));
+	return word;
+}
+
+static uint64_t _httpmessage_dword(const char *data)
+{
+	uint64_t dword;
+	memcpy(&dword, data, sizeof(dword));
+	return dword;
+}
+
+/**
+ * @brief recognize the default methods without string comparison
+ *
+ * @return PARSE_URI or PARSE_INIT if the method is not a default one
+ */
+static int _httpmessage_fastmethod(http_message_t *message, buffer_t *data)
+{
+	const char *key = NULL;
+	int length = 0;
+	if (data->data + data->length - data->offset < 5)
+		return PARSE_INIT;
+	uint32_t word = _httpmessage_word(data->offset);
+	if (word == _httpmessage_word("GET "))
+	{
+		key = str_get;
+		length = 3;
+	}
+	else if (word == _httpmessage_word(str_post) && data->offset[4] == ' ')
+	{
+		key = str_post;
+		length = 4;
+	}
+	else if (word == _httpmessage_word(str_head) && data->offset[4] == ' ')
+	{
+		key = str_head;
+		length = 4;
 	}
+	else
+		return PARSE_INIT;
+
+	/**
+	 * the server keeps the pointers of the default keys
+	 */
+	const http_message_method_t *method = httpclient_server(message->client)->methods;
+	while (method != NULL && method->key != key)
+		method = method->next;
+	if (method == NULL)
+		return PARSE_INIT;
+	message->method = method;
+	data->offset += length + 1;
+	message->content_length = 0;
+	return PARSE_URI;
+}
+
+/**
+ * @brief recognize HTTP/1.1 and HTTP/1.0 versions with one comparison
+ *
+ * @return PARSE_PREHEADER or PARSE_VERSION for the slow path
+ */
+static int _httpmessage_fastversion(http_message_t *message, buffer_t *data)
+{
+	if (data->data + data->length - data->offset < 10)
+		return PARSE_VERSION;
+	uint64_t dword = _httpmessage_dword(data->offset);
+	int version;
+	if (dword == _httpmessage_dword(httpversion[HTTP11]))
+		version = HTTP11;
+	else if (dword == _httpmessage_dword(httpversion[HTTP10]))
+		version = HTTP10;
+	else
+		return PARSE_VERSION;
+	char *end = data->offset + 8;
+	if (*end == '\r')
+		end++;
+	if (*end != '\n')
+		return PARSE_VERSION;
+	message->version = version;
+	data->offset = end + 1;
+	return PARSE_PREHEADER;
+}
+
+/**
+ * @brief parse the request line and the headers in one pass
+ *
+ * The fast path calls the steps of the parser one after the other while
+ * the data are available and the request uses only the common features.
+ * Otherwise it returns the current state, and the state machine
+ * continues from the current offset of the data.
+ *
+ * @return the next state for _httpmessage_parserequest
+ */
+static int _httpmessage_parsefast(http_message_t *message, buffer_t *data)
+{
+	int next = _httpmessage_fastmethod(message, data);
+	if (next != PARSE_URI)
+		return _httpmessage_parseinit(message, data);
+	next = _httpmessage_parseuri(message, data);
+	if (next == PARSE_VERSION)
+		next = _httpmessage_fastversion(message, data);
+	if (next == PARSE_PREHEADER)
+		next = _httpmessage_parsepreheader(message, data);
+	if (next == PARSE_HEADER)
+		next = _httpmessage_parseheader(message, data);
+	if (next == PARSE_POSTHEADER)
+		next = _httpmessage_parsepostheader(message, data);
 	return next;
 }
 
+static int _httpmessage_hexdigit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/**
+ * @brief allocate memory released with the message
+ *
+ * The blocks of the arena are never moved, the pointers stay valid
+ * until _httpmessage_destroy.
+ */
+static void *_httpmessage_arena(http_message_t *message, int size)
+{
+	size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+	http_message_arena_t *block = message->arena;
+	if (block == NULL || block->size - block->length < size)
+	{
+		int blocksize = (size > HTTPMESSAGE_ARENABLOCK)? size : HTTPMESSAGE_ARENABLOCK;
+		block = vcalloc(1, sizeof(*block) + blocksize);
+		if (block == NULL)
+			return NULL;
+		block->size = blocksize;
+		block->next = message->arena;
+		message->arena = block;
+	}
+	void *data = block->data + block->length;
+	block->length += size;
+	return data;
+}
+
+/**
+ * @brief decode a string of "application/x-www-form-urlencoded"
+ *
+ * '+' is a space, an invalid %XX sequence is kept as it.
+ *
+ * @return the decoded string inside the arena of the message
+ */
+static char *_httpmessage_urldecode(http_message_t *message, const char *encoded, int length)
+{
+	char *decoded = _httpmessage_arena(message, length + 1);
+	if (decoded == NULL)
+		return NULL;
+	int i;
+	int j = 0;
+	for (i = 0; i < length; i++)
+	{
+		int high;
+		int low;
+		if (encoded[i] == '+')
+			decoded[j++] = ' ';
+		else if (encoded[i] == '%' && i + 2 < length &&
+				(high = _httpmessage_hexdigit(encoded[i + 1])) >= 0 &&
+				(low = _httpmessage_hexdigit(encoded[i + 2])) >= 0)
+		{
+			decoded[j++] = (high << 4) + low;
+			i += 2;
+		}
+		else
+			decoded[j++] = encoded[i];
+	}
+	decoded[j] = '\0';
+	return decoded;
+}
+
+/**
+ * @brief append data to the query storage
+ *
+ * The storage is not limited by the chunks of the buffer but by
+ * HTTPMESSAGE_FORMMAX. The parameters keep offsets and not pointers,
+ * the storage may be moved.
+ */
+static int _httpmessage_appendquery(http_message_t *message, const char *data, int length)
+{
+	buffer_t *storage = message->query_storage;
+	if (storage->length + length + 1 > HTTPMESSAGE_FORMMAX)
+		return EREJECT;
+	if (storage->length + length + 1 > storage->size)
+	{
+		int size = (storage->size > 0)? storage->size : _buffer_chunksize(-1);
+		while (size < storage->length + length + 1)
+			size *= 2;
+		if (size > HTTPMESSAGE_FORMMAX)
+			size = HTTPMESSAGE_FORMMAX;
+		char *newdata = vrealloc(storage->data, size);
+		if (newdata == NULL)
+			return EREJECT;
+		storage->data = newdata;
+		storage->size = size;
+	}
+	memcpy(storage->data + storage->length, data, length);
+	storage->length += length;
+	storage->offset = storage->data + storage->length;
+	storage->data[storage->length] = '\0';
+	return ESUCCESS;
+}
+
+/**
+ * @brief index the parameter from query_token to end
+ *
+ * The key is decoded now for the lookup, the value stays encoded
+ * until the first access.
+ *
+ * @return ESUCCESS or EREJECT if the parameter cannot be stored
+ */
+static int _httpmessage_addparameter(http_message_t *message, unsigned int end)
+{
+	unsigned int start = message->query_token;
+	unsigned int equal = message->query_equal;
+	unsigned int keyend = (equal > 0)? equal - 1 : end;
+	if (keyend <= start)
+		return ESUCCESS;
+	char *key = _httpmessage_urldecode(message, message->query_storage->data + start, keyend - start);
+	if (key == NULL)
+		return EREJECT;
+	int index = dbtable_add(&message->queries, key, NULL);
+	if (index < 0)
+		return EREJECT;
+	/**
+	 * the parameters follow the capacity of the table
+	 */
+	if (message->nbparameters < message->queries.capacity)
+	{
+		http_message_parameter_t *parameters = _httpmessage_arena(message, sizeof(*parameters) * message->queries.capacity);
+		if (parameters == NULL)
+			return EREJECT;
+		if (message->parameters != NULL)
+			memcpy(parameters, message->parameters, sizeof(*parameters) * message->nbparameters);
+		message->parameters = parameters;
+		message->nbparameters = message->queries.capacity;
+	}
+	message->parameters[index].offset = equal;
+	message->parameters[index].length = (equal > 0)? (int)(end - equal) : -1;
+	return ESUCCESS;
+}
+
+/**
+ * @brief tokenize the new data of the query storage
+ *
+ * Each byte is scanned once, the state of the current parameter
+ * stays inside the message between the packets of the content.
+ *
+ * @param last the end of the storage is the end of the last parameter
+ *
+ * @return ESUCCESS or EREJECT if a parameter cannot be stored
+ */
+static int _httpmessage_tokenquery(http_message_t *message, int last)
+{
+	int ret = ESUCCESS;
+	const scan_t *delimiters = &_httpmessage_querydelimiters;
+	char *data = message->query_storage->data;
+	char *end = data + message->query_storage->length;
+	char *it = data + message->query_scanned;
+	while ((it = _scan_find(delimiters, it, end)) < end)
+	{
+		if (*it == '&')
+		{
+			if (_httpmessage_addparameter(message, it - data) != ESUCCESS)
+				ret = EREJECT;
+			message->query_token = it - data + 1;
+			message->query_equal = 0;
+		}
+		else if (message->query_equal == 0)
+			message->query_equal = it - data + 1;
+		it++;
+	}
+	message->query_scanned = end - data;
+	if (last)
+	{
+		while (end > data + message->query_token && (end[-1] == '\r' || end[-1] == '\n'))
+			end--;
+		if (message->query_equal > end - data)
+			message->query_equal = end - data;
+		if (_httpmessage_addparameter(message, end - data) != ESUCCESS)
+			ret = EREJECT;
+		message->query_token = message->query_scanned;
+		message->query_equal = 0;
+	}
+	return ret;
+}
+
+/**
+ * @brief return the decoded value of a parameter
+ */
+static const char *_httpmessage_parametervalue(http_message_t *message, const dbtable_entry_t *entry)
+{
+	int index = entry - message->queries.entries;
+	if (entry->value == NULL)
+	{
+		const http_message_parameter_t *parameter = &message->parameters[index];
+		if (parameter->length < 0)
+			message->queries.entries[index].value = str_true;
+		else
+			message->queries.entries[index].value = _httpmessage_urldecode(message,
+					message->query_storage->data + parameter->offset, parameter->length);
+	}
+	return entry->value;
+}
+
 static int _httpmessage_parseprecontent(http_message_t *message, buffer_t *data)
 {
 	int next = PARSE_PRECONTENT;
-	int length = 0;
-	if (message->query)
-		length = strlen(message->query);
 
 	message->content_packet = 0;
-	if ((message->method->properties & MESSAGE_ALLOW_CONTENT) &&
+	int urlencoded = (message->method->properties & MESSAGE_ALLOW_CONTENT) &&
 		message->content_type != NULL &&
-		!strncasecmp(message->content_type, str_form_urlencoded, sizeof(str_form_urlencoded) - 1))
+		!strncasecmp(message->content_type, str_form_urlencoded, strlen(str_form_urlencoded));
+
+	if (urlencoded && !(message->mode & HTTPMESSAGE_DECHUNK) &&
+		message->content_length >= HTTPMESSAGE_FORMMAX)
+	{
+		err("message: form too large");
+		message->result = RESULT_413;
+		return PARSE_END;
+	}
+	if ((message->mode & (HTTPMESSAGE_EXPECTCONTINUE | HTTPMESSAGE_CONTINUED)) == HTTPMESSAGE_EXPECTCONTINUE)
+	{
+		/**
+		 * the content is not sent before the 100 Continue
+		 * see _httpclient_expect
+		 */
+		message->state |= PARSE_CONTINUE;
+	}
+	else if (urlencoded)
 	{
 		next = PARSE_POSTCONTENT;
 		message->state &= ~PARSE_CONTINUE;
-		length += message->content_length;
 	}
 	else if (_httpmessage_contentempty(message, 0))
 	{
@@ -735,70 +1210,288 @@ static int _httpmessage_parseprecontent(http_message_t *message, buffer_t *data)
 		message->state &= ~PARSE_CONTINUE;
 	}
 
-	if ((message->query != NULL) &&
+	if ((message->query != NULL) && (message->query[0] != '\0') &&
 		(message->query_storage == NULL))
 	{
-		int nbchunks = (length / _buffer_chunksize(-1) ) + 1;
-		message->query_storage = _buffer_create(nbchunks);
-		_buffer_append(message->query_storage, message->query, -1);
+		message->query_storage = _buffer_create(1);
+		if (_httpmessage_appendquery(message, message->query, strlen(message->query)) != ESUCCESS)
+			err("message: query too large");
+		/**
+		 * message mix query data inside the URI and Content
+		 */
+		if (urlencoded)
+			_httpmessage_appendquery(message, "&", 1);
+		if (_httpmessage_tokenquery(message, !urlencoded) != ESUCCESS)
+		{
+			message->result = RESULT_414;
+			next = PARSE_END;
+		}
 	}
 	return next;
 }
 
-static int _httpmessage_parsecontent(http_message_t *message, buffer_t *data)
+enum
 {
-	int next = PARSE_CONTENT;
+	CHUNK_SIZESTART,
+	CHUNK_SIZE,
+	CHUNK_EXTENSION,
+	CHUNK_DATA,
+	CHUNK_DATAEND,
+	CHUNK_TRAILER,
+	CHUNK_END,
+};
 
-	if (_httpmessage_contentempty(message, 0))
-	{
-		next = PARSE_END;
-	}
-	else
-	{
-		/**
-		 * The content of the request is the buffer past to the socket.
-		 * Then it is always a partial content. And the content has
-		 * to be treat part by part.
-		 * Is possible to use the buffer with the function
-		 *  httpmessage_content
-		 */
-		int length = data->length;
-		message_dbg("message: content (%d): %.*s", length, length, data->offset);
+http_chunk_part_e httpmessage_dechunk(http_chunk_t *chunk, const char **data, const char *end, const char **part, int *length)
+{
+	http_chunk_part_e ret = HTTPCHUNK_MORE;
+	const char *it = *data;
+	*length = 0;
+	if (chunk->state == CHUNK_END)
+		return HTTPCHUNK_END;
 
-		/**
-		 * If the Content-Length header is not set,
-		 * the parser must continue while the socket is opened
-		 */
-		if (_httpmessage_contentempty(message, 1))
+	while (it < end && ret == HTTPCHUNK_MORE)
+	{
+		switch (chunk->state)
 		{
-			length -= (data->offset - data->data);
+		case CHUNK_SIZESTART:
+		case CHUNK_SIZE:
+		{
+			int digit = _httpmessage_hexdigit(*it);
+			if (digit >= 0)
+			{
+				if (chunk->length > (((unsigned long long)-1) >> 5))
+				{
+					err("message: chunk too large");
+					return HTTPCHUNK_ERROR;
+				}
+				chunk->length = (chunk->length << 4) + digit;
+				chunk->state = CHUNK_SIZE;
+			}
+			else if (chunk->state == CHUNK_SIZESTART)
+			{
+				err("message: bad chunk size");
+				return HTTPCHUNK_ERROR;
+			}
+			else if (*it == '\n')
+			{
+				chunk->state = (chunk->length > 0)? CHUNK_DATA: CHUNK_TRAILER;
+			}
+			else
+				chunk->state = CHUNK_EXTENSION;
+			it++;
 		}
-		/**
-		 * At the end of the parsing the content_length of request
-		 * is zero. But it is false, the true value is
-		 * Sum(content->length);
-		 */
-		else if (message->content_length <= length)
+		break;
+		case CHUNK_EXTENSION:
 		{
 			/**
-			 * the last chunk of the content may contain data from the next request.
-			 * The length of the buffer "content" may be larger than the content, but
-			 * httpmessage_content must return the length of the content and not more
+			 * the chunk extensions are ignored
 			 */
-			length = message->content_length;
-			next = PARSE_END;
+			const char *lf = memchr(it, '\n', end - it);
+			if (lf == NULL)
+			{
+				it = end;
+				break;
+			}
+			it = lf + 1;
+			chunk->state = (chunk->length > 0)? CHUNK_DATA: CHUNK_TRAILER;
 		}
-		else
+		break;
+		case CHUNK_DATA:
 		{
-			length -= (data->offset - data->data);
+			unsigned long long size = end - it;
+			if (chunk->length < size)
+				size = chunk->length;
+			*part = it;
+			*length = size;
+			it += size;
+			chunk->length -= size;
+			if (chunk->length == 0)
+				chunk->state = CHUNK_DATAEND;
+			ret = HTTPCHUNK_DATA;
 		}
-
-		if (message->content == NULL)
+		break;
+		case CHUNK_DATAEND:
 		{
-			message->content_storage = _buffer_create(1);
-			message->content = message->content_storage;
+			if (*it == '\n')
+				chunk->state = CHUNK_SIZESTART;
+			else if (*it != '\r')
+			{
+				err("message: bad chunk end");
+				return HTTPCHUNK_ERROR;
+			}
+			it++;
 		}
-		_buffer_reset(message->content);
+		break;
+		case CHUNK_TRAILER:
+		{
+			/**
+			 * length is now the length of the current line,
+			 * the carriage returns are dropped.
+			 */
+			if (*it == '\r')
+			{
+				it++;
+				break;
+			}
+			if (*it == '\n')
+			{
+				it++;
+				ret = (chunk->length == 0)? HTTPCHUNK_END: HTTPCHUNK_LINE;
+				if (ret == HTTPCHUNK_END)
+					chunk->state = CHUNK_END;
+				chunk->length = 0;
+				break;
+			}
+			const char *last = it;
+			while (last < end && *last != '\r' && *last != '\n')
+				last++;
+			*part = it;
+			*length = last - it;
+			chunk->length += *length;
+			it = last;
+			ret = HTTPCHUNK_TRAILER;
+		}
+		break;
+		}
+	}
+	*data = it;
+	return ret;
+}
+
+/**
+ * @brief decode the content of a chunked message
+ *
+ * The data of the chunks is appended to the content buffer, the framing
+ * is dropped. The decoder keeps its state inside the message and
+ * continues with the next packet of the socket, the data is never
+ * stored longer than the packet.
+ * The trailers are stored into trailers_storage as "<key>: <value>\0".
+ *
+ * @return PARSE_CONTENT while the last chunk is not received, PARSE_END
+ * after the end of the trailers or on error (message->result is set).
+ */
+static int _httpmessage_dechunk(http_message_t *message, buffer_t *data, buffer_t *content)
+{
+	int next = PARSE_CONTENT;
+	const char *it = data->offset;
+	const char *end = data->data + data->length;
+
+	while (next == PARSE_CONTENT)
+	{
+		const char *part = NULL;
+		int length = 0;
+		http_chunk_part_e type = httpmessage_dechunk(&message->chunk, &it, end, &part, &length);
+		if (type == HTTPCHUNK_MORE)
+			break;
+		switch (type)
+		{
+		case HTTPCHUNK_DATA:
+		{
+			/**
+			 * the buffer may be too small to receive all the data
+			 */
+			int previous = content->length;
+			if (_buffer_append(content, part, length) == NULL ||
+				content->length - previous != length)
+			{
+				err("message: chunk content too large");
+				next = PARSE_END;
+			}
+		}
+		break;
+		case HTTPCHUNK_TRAILER:
+		{
+			if (message->trailers_storage == NULL)
+				message->trailers_storage = _buffer_create(MAXCHUNKS_HEADER);
+			if (_buffer_append(message->trailers_storage, part, length) == NULL)
+			{
+				err("message: trailers too large");
+				next = PARSE_END;
+			}
+		}
+		break;
+		case HTTPCHUNK_LINE:
+			if (message->trailers_storage != NULL)
+				_buffer_append(message->trailers_storage, "\0", 1);
+		break;
+		case HTTPCHUNK_END:
+			message->content_length = 0;
+			next = PARSE_END;
+		break;
+		default:
+			next = PARSE_END;
+		break;
+		}
+	}
+	if (next == PARSE_END && !_httpmessage_contentempty(message, 0))
+		message->result = RESULT_400;
+	data->offset = (char *)it;
+	return next;
+}
+
+static int _httpmessage_parsecontent(http_message_t *message, buffer_t *data)
+{
+	int next = PARSE_CONTENT;
+
+	if (message->mode & HTTPMESSAGE_DECHUNK)
+	{
+		if (message->content_storage == NULL)
+			message->content_storage = _buffer_create(MAXCHUNKS_SOCKDATA);
+		message->content = message->content_storage;
+		_buffer_reset(message->content);
+		next = _httpmessage_dechunk(message, data, message->content);
+		message->content_packet = message->content->length;
+		message_dbg("message: chunked content (%d)", message->content_packet);
+	}
+	else if (_httpmessage_contentempty(message, 0))
+	{
+		next = PARSE_END;
+	}
+	else
+	{
+		/**
+		 * The content of the request is the buffer past to the socket.
+		 * Then it is always a partial content. And the content has
+		 * to be treat part by part.
+		 * Is possible to use the buffer with the function
+		 *  httpmessage_content
+		 */
+		int length = data->length;
+		message_dbg("message: content (%d): %.*s", length, length, data->offset);
+
+		/**
+		 * If the Content-Length header is not set,
+		 * the parser must continue while the socket is opened
+		 */
+		if (_httpmessage_contentempty(message, 1))
+		{
+			length -= (data->offset - data->data);
+		}
+		/**
+		 * At the end of the parsing the content_length of request
+		 * is zero. But it is false, the true value is
+		 * Sum(content->length);
+		 */
+		else if (message->content_length <= length)
+		{
+			/**
+			 * the last chunk of the content may contain data from the next request.
+			 * The length of the buffer "content" may be larger than the content, but
+			 * httpmessage_content must return the length of the content and not more
+			 */
+			length = message->content_length;
+			next = PARSE_END;
+		}
+		else
+		{
+			length -= (data->offset - data->data);
+		}
+
+		if (message->content_storage == NULL)
+			message->content_storage = _buffer_create(MAXCHUNKS_SOCKDATA);
+		if (message->content == NULL)
+			message->content = message->content_storage;
+		_buffer_reset(message->content);
 		if (message->content != data)
 			_buffer_append(message->content, data->offset, length);
 		message->content_packet = length;
@@ -809,41 +1502,63 @@ static int _httpmessage_parsecontent(http_message_t *message, buffer_t *data)
 	return next;
 }
 
+/**
+ * @brief store and tokenize the "application/x-www-form-urlencoded" content
+ *
+ * The content is appended to the query and tokenized packet by packet.
+ * At the end query_storage becomes the content of the message,
+ * the connectors read the raw form as before.
+ */
 static int _httpmessage_parsepostcontent(http_message_t *message, buffer_t *data)
 {
 	int next = PARSE_POSTCONTENT;
 	char *query = data->offset;
 	int length = data->length -(data->offset - data->data);
-	/**
-	 * message mix query data inside the URI and Content
-	 */
+	int ret = ESUCCESS;
 	if (message->query_storage == NULL)
+		message->query_storage = _buffer_create(1);
+	if (message->mode & HTTPMESSAGE_DECHUNK)
+	{
+		if (message->content_storage == NULL)
+			message->content_storage = _buffer_create(MAXCHUNKS_SOCKDATA);
+		_buffer_reset(message->content_storage);
+		next = _httpmessage_dechunk(message, data, message->content_storage);
+		if (next == PARSE_CONTENT)
+			next = PARSE_POSTCONTENT;
+		if (ret == ESUCCESS)
+			ret = _httpmessage_appendquery(message, message->content_storage->data, message->content_storage->length);
+	}
+	else
 	{
-		int nbchunks = (data->length / _buffer_chunksize(-1) ) + 1;
-		message->query_storage = _buffer_create(nbchunks);
+		if (length > message->content_length)
+			length = message->content_length;
+		if (ret == ESUCCESS)
+			ret = _httpmessage_appendquery(message, query, length);
+		data->offset += length;
+		message->content_length -= length;
+		if (message->content_length == 0)
+			next = PARSE_END;
 	}
-	if (message->query != NULL)
+	if (ret != ESUCCESS)
 	{
-		_buffer_append(message->query_storage, "&", 1);
-		message->query = NULL;
+		err("message: form too large");
+		message->result = RESULT_413;
+		next = PARSE_END;
+	}
+	if (_httpmessage_tokenquery(message, next == PARSE_END) != ESUCCESS)
+	{
+		err("message: too many parameters");
+		message->result = RESULT_413;
+		next = PARSE_END;
 	}
-	while (length > 0 && (query[length - 1] == '\n' || query[length - 1] == '\r'))
-		length--;
-	_buffer_append(message->query_storage, query, length);
-	if (message->content_length <= length)
+	if (next == PARSE_END)
 	{
-		data->offset += message->content_length;
 		message->content = message->query_storage;
 		message->content_packet = message->query_storage->length;
 		message->content_length = message->query_storage->length;
-		next = PARSE_END;
 	}
 	else
-	{
-		data->offset += length;
-		message->content_length -= length;
 		message->state |= PARSE_CONTINUE;
-	}
 	return next;
 }
 
@@ -879,7 +1594,7 @@ int _httpmessage_parserequest(http_message_t *message, buffer_t *data)
 		{
 			case PARSE_INIT:
 			{
-				next = _httpmessage_parseinit(message, data);
+				next = _httpmessage_parsefast(message, data);
 			}
 			break;
 			case PARSE_URI:
@@ -964,16 +1679,229 @@ int _httpmessage_parserequest(http_message_t *message, buffer_t *data)
 	return ret;
 }
 
+/**
+ * @brief set the method and the URI of a request without request line
+ *
+ * The protocol of a multiplexed connection decodes the request line by
+ * itself, the URI is checked by the same parser as the HTTP/1 requests.
+ * The headers are added after, the message waits into PARSE_HEADER.
+ *
+ * @param message the new request.
+ * @param method the method of the request.
+ * @param uri the target of the request.
+ *
+ * @return ESUCCESS or EREJECT, message->result is set
+ */
+int _httpmessage_requestline(http_message_t *message, const char *method, const char *uri)
+{
+	if (message->headers_storage == NULL)
+		message->headers_storage = _buffer_create(MAXCHUNKS_HEADER);
+	const http_message_method_t *it = httpclient_server(message->client)->methods;
+	while (it != NULL && strcmp(it->key, method))
+		it = it->next;
+	if (it == NULL)
+	{
+		err("parse reject method %s", method);
+		message->result = RESULT_405;
+		_httpmessage_changestate(message, PARSE_END);
+		return EREJECT;
+	}
+	message->method = it;
+	_httpmessage_changestate(message, PARSE_URI);
+
+	int ret = EREJECT;
+	buffer_t *data = _buffer_create(MAXCHUNKS_URI);
+	if (data != NULL && _buffer_append(data, uri, -1) != NULL &&
+		_buffer_append(data, "\n", 1) != NULL)
+	{
+		data->offset = data->data;
+		ret = _httpmessage_parserequest(message, data);
+	}
+	else
+	{
+#ifdef RESULT_414
+		message->result = RESULT_414;
+#else
+		message->result = RESULT_400;
+#endif
+		_httpmessage_changestate(message, PARSE_END);
+	}
+	if (data != NULL)
+		_buffer_destroy(data);
+	return (ret == EREJECT)? EREJECT: ESUCCESS;
+}
+
+/**
+ * the status lines are indexed by the class and the code of the result
+ * (ie 404 => 3 * 32 + 4), there isn't any code larger than 31 in a class.
+ */
+#define HTTPMESSAGE_RESULTCODES 32
+#define HTTPMESSAGE_NBRESULTS (5 * HTTPMESSAGE_RESULTCODES)
+typedef struct _httpmessage_statusline_s _httpmessage_statusline_t;
+struct _httpmessage_statusline_s
+{
+	const char *line;
+	int length;
+};
+static const _http_message_result_t *_httpmessage_results[HTTPMESSAGE_NBRESULTS] = {0};
+static _httpmessage_statusline_t _httpmessage_statuslines[HTTPVERSIONS][HTTPMESSAGE_NBRESULTS] = {0};
+
+static int _httpmessage_resultindex(int result)
+{
+	if (result < 100 || result >= 600 || (result % 100) >= HTTPMESSAGE_RESULTCODES)
+		return -1;
+	return ((result / 100) - 1) * HTTPMESSAGE_RESULTCODES + (result % 100);
+}
+
+/**
+ * @brief build the status lines for all the versions and results
+ *
+ * The lines are built by _httpmessage_init, the storage is never freed.
+ */
+static void _httpmessage_initstatus(void)
+{
+	int size = 0;
+	int i;
+	int version;
+	for (i = 0; _http_message_result[i] != NULL; i++)
+	{
+		for (version = HTTP09; version < HTTPVERSIONS; version++)
+			size += strlen(httpversion[version]) + strlen(_http_message_result[i]->status) + 3;
+	}
+	char *line = vcalloc(1, size);
+	if (line == NULL)
+		return;
+	for (i = 0; _http_message_result[i] != NULL; i++)
+	{
+		int index = _httpmessage_resultindex(_http_message_result[i]->result);
+		if (index < 0)
+			continue;
+		_httpmessage_results[index] = _http_message_result[i];
+		for (version = HTTP09; version < HTTPVERSIONS; version++)
+		{
+			int length = sprintf(line, "%s%s\r\n", httpversion[version], _http_message_result[i]->status);
+			_httpmessage_statuslines[version][index].line = line;
+			_httpmessage_statuslines[version][index].length = length;
+			line += length + 1;
+		}
+	}
+}
+
+/**
+ * @brief write the decimal value of an integer
+ *
+ * @param string the output with at least 21 characters
+ * @param value the integer to write
+ *
+ * @return the length of the string
+ */
+static int _httpmessage_ulltoa(char *string, unsigned long long value)
+{
+	char digits[20];
+	int length = 0;
+	do
+	{
+		digits[length++] = '0' + (value % 10);
+		value /= 10;
+	} while (value > 0);
+	int i;
+	for (i = 0; i < length; i++)
+		string[i] = digits[length - 1 - i];
+	string[length] = '\0';
+	return length;
+}
+
+/**
+ * the Date header is cached for the current second by each thread,
+ * without thread local storage it is built for each response.
+ */
+#ifndef VTHREAD
+# define HTTPMESSAGE_THREADLOCAL
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+# define HTTPMESSAGE_THREADLOCAL _Thread_local
+#elif defined(__GNUC__)
+# define HTTPMESSAGE_THREADLOCAL __thread
+#endif
+
+#define HTTPMESSAGE_DATESIZE sizeof("Date: Thu, 01 Jan 1970 00:00:00 GMT\r\n")
+
+/**
+ * @brief return the Date header of the current second
+ *
+ * @param buffer the storage of the header if there is no cache
+ * @param length the length of the header
+ */
+static const char *_httpmessage_date(char buffer[HTTPMESSAGE_DATESIZE], int *length)
+{
+#ifdef HTTPMESSAGE_THREADLOCAL
+	static HTTPMESSAGE_THREADLOCAL time_t last = 0;
+	static HTTPMESSAGE_THREADLOCAL char date[HTTPMESSAGE_DATESIZE];
+#else
+	time_t last = 0;
+	char *date = buffer;
+#endif
+	time_t now = time(NULL);
+	if (now != last)
+	{
+		struct tm tm;
+		gmtime_r(&now, &tm);
+		strftime(date, HTTPMESSAGE_DATESIZE, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+		last = now;
+	}
+	*length = HTTPMESSAGE_DATESIZE - 1;
+	return date;
+}
+
+static char *_httpmessage_headerline(buffer_t *storage, const char *key, int *length);
+
+/**
+ * @brief append the headers of the server to the headers of the response
+ *
+ * The headers are added only if the configuration of the server asks
+ * them, and if the connector (a CGI script...) did not set them.
+ */
+static void _httpmessage_addserverheaders(http_message_t *message, buffer_t *storage)
+{
+	http_server_t *server = httpclient_server(message->client);
+	if (server == NULL || server->config->headers == 0)
+		return;
+	const char *data;
+	int length;
+	if ((server->config->headers & HTTPSERVER_HEADER_SERVER) &&
+		_httpmessage_headerline(storage, "Server", &length) == NULL)
+	{
+		data = _httpserver_headers(server, &length);
+		if (length > 0)
+			_buffer_append(storage, data, length);
+	}
+	if ((server->config->headers & HTTPSERVER_HEADER_DATE) &&
+		_httpmessage_headerline(storage, "Date", &length) == NULL)
+	{
+		char date[HTTPMESSAGE_DATESIZE];
+		data = _httpmessage_date(date, &length);
+		_buffer_append(storage, data, length);
+	}
+}
+
 int _httpmessage_buildresponse(http_message_t *message, int version, buffer_t *header)
 {
 	http_message_version_e _version = message->version;
 	if (message->version > (version & HTTPVERSION_MASK))
 		_version = (version & HTTPVERSION_MASK);
-	_buffer_append(header, httpversion[_version], strlen(httpversion[_version]));
 
-	char *status = _httpmessage_status(message);
-	_buffer_append(header, status, strlen(status));
-	_buffer_append(header, "\r\n", 2);
+	int index = _httpmessage_resultindex(message->result);
+	if (index >= 0 && _httpmessage_statuslines[_version][index].line != NULL)
+	{
+		_buffer_append(header, _httpmessage_statuslines[_version][index].line,
+				_httpmessage_statuslines[_version][index].length);
+	}
+	else
+	{
+		_buffer_append(header, httpversion[_version], -1);
+		char *status = _httpmessage_status(message);
+		_buffer_append(header, status, -1);
+		_buffer_append(header, "\r\n", 2);
+	}
 
 	header->offset = header->data;
 	return ESUCCESS;
@@ -981,29 +1909,123 @@ int _httpmessage_buildresponse(http_message_t *message, int version, buffer_t *h
 
 buffer_t *_httpmessage_buildheader(http_message_t *message)
 {
-	if (message->headers != NULL)
+	if (message->headers.count > 0)
+	{
+		dbtable_revert(&message->headers, ':', '\n');
+		dbtable_reset(&message->headers);
+		memset(message->knownheaders, 0, sizeof(message->knownheaders));
+	}
+	if (message->headers_storage == NULL)
 	{
-		dbentry_revert(message->headers, ':', '\n');
-		dbentry_destroy(message->headers);
-		message->headers = NULL;
+		message->headers_storage = _buffer_create(MAXCHUNKS_HEADER);
 	}
-	if (!_httpmessage_contentempty(message, 1))
+	buffer_t *storage = message->headers_storage;
+	if (message->result == RESULT_204 || message->result == RESULT_304)
 	{
-		char content_length[32];
-		snprintf(content_length, 31, "%llu",  message->content_length);
-		httpmessage_addheader(message, str_contentlength, content_length);
-		if ((message->mode & HTTPMESSAGE_KEEPALIVE) > 0)
-		{
-			httpmessage_addheader(message, str_connection, "Keep-Alive");
-		}
+		/**
+		 * these responses never have content, the Content-Length
+		 * of a 304 would be the length of the document
+		 */
+		message->content_length = 0;
+	}
+	else if (!_httpmessage_contentempty(message, 1))
+	{
+		static const char contentlength[] = "Content-Length: ";
+		char value[24];
+		int length = _httpmessage_ulltoa(value, message->content_length);
+		_buffer_append(storage, contentlength, sizeof(contentlength) - 1);
+		_buffer_append(storage, value, length);
+		_buffer_append(storage, "\r\n", 2);
+	}
+	else if (message->mode & HTTPMESSAGE_CHUNKED)
+	{
+		static const char chunked[] = "Transfer-Encoding: chunked\r\n";
+		_buffer_append(storage, chunked, sizeof(chunked) - 1);
+	}
+	else if (message->mode & HTTPMESSAGE_LOCKED)
+	{
+		/**
+		 * the connection continues with another protocol
+		 */
+		message->mode &= ~HTTPMESSAGE_KEEPALIVE;
+	}
+	else if (message->version >= HTTP20)
+	{
+		/**
+		 * the stream ends the content without closing the connection
+		 */
+		message->mode &= ~HTTPMESSAGE_KEEPALIVE;
 	}
 	else
 	{
+		static const char close[] = "Connection: Close\r\n";
 		message->mode &= ~HTTPMESSAGE_KEEPALIVE;
-		httpmessage_addheader(message, str_connection, "Close");
+		_buffer_append(storage, close, sizeof(close) - 1);
+	}
+	if ((message->mode & HTTPMESSAGE_KEEPALIVE) > 0)
+	{
+		static const char keepalive[] = "Connection: Keep-Alive\r\n";
+		_buffer_append(storage, keepalive, sizeof(keepalive) - 1);
 	}
-	message->headers_storage->offset = message->headers_storage->data;
-	return message->headers_storage;
+	storage->offset = storage->data;
+	return storage;
+}
+
+int _httpmessage_buildhead(http_message_t *message, buffer_t *header)
+{
+	int ret = ESUCCESS;
+	int statuslength = header->length;
+	buffer_t *storage = message->headers_storage;
+
+	/**
+	 * the buffers are ready to be sent, the offsets are at the beginning
+	 */
+	header->offset = header->data + header->length;
+	storage->offset = storage->data + storage->length;
+	if (_buffer_append(header, storage->data, storage->length) == NULL)
+		ret = EREJECT;
+	else
+	{
+		_buffer_reset(storage);
+		storage = header;
+	}
+	if (ret != ESUCCESS)
+	{
+		/**
+		 * the head is too large for one buffer,
+		 * the headers are sent after the status line
+		 */
+		message->mode |= HTTPMESSAGE_LARGEHEAD;
+		header->length = statuslength;
+		header->offset = header->data + statuslength;
+		header->data[statuslength] = '\0';
+	}
+
+	_httpmessage_addserverheaders(message, storage);
+	_buffer_append(storage, "\r\n", 2);
+
+	storage->offset = storage->data;
+	header->offset = header->data;
+	return ret;
+}
+
+static int _httpmessage_filldb(http_message_t *message);
+
+/**
+ * @brief fill the table of the headers of a response without head
+ *
+ * The protocol of a multiplexed connection encodes the status and the
+ * headers by itself (see http_sendstream_t), the status line and
+ * the separator are not built.
+ */
+int _httpmessage_buildfields(http_message_t *message)
+{
+	buffer_t *storage = message->headers_storage;
+
+	storage->offset = storage->data + storage->length;
+	_httpmessage_addserverheaders(message, storage);
+	storage->offset = storage->data;
+	return _httpmessage_filldb(message);
 }
 
 void *httpmessage_private(http_message_t *message, void *data)
@@ -1028,6 +2050,8 @@ int httpmessage_content(http_message_t *message, char **data, unsigned long long
 	{
 		if (!_httpmessage_contentempty(message, 1))
 			*content_length = message->content_length;
+		else if ((message->mode & (HTTPMESSAGE_DECHUNK | HTTPMESSAGE_STREAM)) && state < PARSE_END)
+			*content_length = message->content_length;
 		else
 			*content_length = 0;
 	}
@@ -1043,6 +2067,8 @@ int httpmessage_content(http_message_t *message, char **data, unsigned long long
 		return size;
 	if (state < PARSE_CONTENT)
 		return EINCOMPLETE;
+	if (size == 0 && state == PARSE_CONTENT && (message->mode & (HTTPMESSAGE_DECHUNK | HTTPMESSAGE_STREAM)))
+		return EINCOMPLETE;
 	if (size == 0 && state >= PARSE_CONTENT)
 		return EREJECT;
 	return size;
@@ -1063,7 +2089,11 @@ int httpmessage_parsecgi(http_message_t *message, char *data, int *size)
 		_httpmessage_changestate(message, PARSE_END);
 		return EINCOMPLETE;
 	}
-	static buffer_t tempo;
+	/**
+	 * the buffer belongs to the call, the parsing of several
+	 * responses may run at the same time.
+	 */
+	buffer_t tempo = {0};
 	tempo.data = data;
 	tempo.offset = data;
 	tempo.length = *size;
@@ -1104,23 +2134,77 @@ http_message_result_e httpmessage_result(http_message_t *message, http_message_r
 
 char *_httpmessage_status(http_message_t *message)
 {
-	int i = 0;
-	while (_http_message_result[i] != NULL)
-	{
-		if (_http_message_result[i]->result == message->result)
-			return _http_message_result[i]->status;
-		i++;
-	}
+	int index = _httpmessage_resultindex(message->result);
+	if (index >= 0 && _httpmessage_results[index] != NULL)
+		return _httpmessage_results[index]->status;
 	static char status[] = " XXX ";
 	snprintf(status, 6, " %.3d", message->result);
 	return status;
 }
 
+static http_header_e _httpheader_id(const dbtable_entry_t *entry)
+{
+	if (_httpheader_hashshift < 0)
+	{
+		http_header_e id;
+		for (id = 0; id < HDR_MAX; id++)
+		{
+			if (!strcasecmp(entry->key, _httpheader_names[id]))
+				return id;
+		}
+		return HDR_UNKNOWN;
+	}
+	http_header_e id = _httpheader_ids[(entry->hash >> _httpheader_hashshift) & HTTPHEADER_HASHMASK];
+	if (id != HDR_UNKNOWN && strcasecmp(entry->key, _httpheader_names[id]))
+		id = HDR_UNKNOWN;
+	return id;
+}
+
+/**
+ * @brief prepare the static data of the parser
+ *
+ * The server calls it at its creation, an application without server
+ * calls it with its first httpmessage_create, before to start its threads.
+ */
+void _httpmessage_init(void)
+{
+	static int initialized = 0;
+	if (initialized)
+		return;
+	_httpheader_initids();
+	_httpmessage_initstatus();
+	_scan_select();
+#ifndef HTTPMESSAGE_NODOUBLEDOT
+	_scan_init(&_httpmessage_uridelimiters, "%/? \r\n.", 7);
+#else
+	_scan_init(&_httpmessage_uridelimiters, "%/? \r\n", 6);
+#endif
+	_scan_init(&_httpmessage_linedelimiters, ":\r\n", 3);
+	_scan_init(&_httpmessage_querydelimiters, "&=", 2);
+	initialized = 1;
+}
+
+static int _httpmessage_filldb(http_message_t *message)
+{
+	if (_buffer_filldb(message->headers_storage, &message->headers, ':', '\r') < 0)
+		return EREJECT;
+	int i;
+	for (i = 0; i < message->headers.count; i++)
+	{
+		const dbtable_entry_t *entry = &message->headers.entries[i];
+		http_header_e id = _httpheader_id(entry);
+		if (id != HDR_UNKNOWN)
+			message->knownheaders[id] = entry->value;
+	}
+	return ESUCCESS;
+}
+
 int _httpmessage_fillheaderdb(http_message_t *message)
 {
-	_buffer_filldb(message->headers_storage, &message->headers, ':', '\r');
+	if (_httpmessage_filldb(message) != ESUCCESS)
+		return EREJECT;
 	const char *value = NULL;
-	value = dbentry_search(message->headers, str_connection);
+	value = message->knownheaders[HDR_CONNECTION];
 	if (value != NULL && strcasestr(value, "Keep-Alive") != NULL)
 		message->mode |= HTTPMESSAGE_KEEPALIVE;
 	if (value != NULL && strcasestr(value, "Upgrade") != NULL)
@@ -1128,16 +2212,25 @@ int _httpmessage_fillheaderdb(http_message_t *message)
 		warn("Connection upgrading");
 		message->mode |= HTTPMESSAGE_LOCKED;
 	}
-	value = dbentry_search(message->headers, str_contentlength);
+	value = message->knownheaders[HDR_CONTENT_LENGTH];
 	if (value != NULL)
 		message->content_length = atoi(value);
-	value = dbentry_search(message->headers, str_contenttype);
+	value = message->knownheaders[HDR_TRANSFER_ENCODING];
+	if (value != NULL && strcasestr(value, "chunked") != NULL)
+	{
+		/**
+		 * the chunked encoding overrides the Content-Length
+		 */
+		message->mode |= HTTPMESSAGE_DECHUNK;
+		message->content_length = (unsigned long long)-1;
+	}
+	value = message->knownheaders[HDR_CONTENT_TYPE];
 	if (value != NULL)
 		message->content_type = value;
-	value = dbentry_search(message->headers, "Status");
+	value = message->knownheaders[HDR_STATUS];
 	if (value != NULL)
 		httpmessage_result(message, atoi(value));
-	value = dbentry_search(message->headers, str_cookie);
+	value = message->knownheaders[HDR_COOKIE];
 	if (value != NULL)
 		message->cookie = value;
 	return ESUCCESS;
@@ -1233,6 +2326,25 @@ int httpmessage_addcontent(http_message_t *message, const char *type, const char
 	return 0;
 }
 
+char *httpmessage_reservecontent(http_message_t *message, const char *type, int length)
+{
+	if (message->content != NULL || length <= 0)
+		return NULL;
+	buffer_t *buffer = NULL;
+	if (message->client != NULL)
+		buffer = _httpclient_mapbuffer(message->client, length);
+	else
+		buffer = _buffer_map(length);
+	if (buffer == NULL)
+		return NULL;
+	httpmessage_addcontent(message, type, NULL, length);
+	if (message->content_storage != NULL)
+		_buffer_destroy(message->content_storage);
+	message->content_storage = buffer;
+	message->content = buffer;
+	return buffer->data;
+}
+
 int httpmessage_appendcontent(http_message_t *message, const char *content, int length)
 {
 	if (message->content == NULL && content != NULL)
@@ -1251,15 +2363,473 @@ int httpmessage_appendcontent(http_message_t *message, const char *content, int
 			return EREJECT;
 		return message->content->size - message->content->length;
 	}
+	/**
+	 * without data, the function returns the space to fill the content
+	 * before its sending
+	 */
+	if (message->content != NULL)
+		return _buffer_space(message->content);
 	return httpclient_server(message->client)->config->chunksize;
 }
 
+int httpmessage_addfile(http_message_t *message, int fd, unsigned long long offset, unsigned long long length)
+{
+	if (fd < 0 || message->file >= 0)
+		return EREJECT;
+	struct stat filestat;
+	if (fstat(fd, &filestat) == 0 && S_ISFIFO(filestat.st_mode))
+		offset = (unsigned long long)-1;
+	message->file = fd;
+	message->file_offset = offset;
+	message->file_length = length;
+	/**
+	 * the file follows the content already set
+	 */
+	if (_httpmessage_contentempty(message, 1))
+		message->content_length = length;
+	else
+		message->content_length += length;
+	return ESUCCESS;
+}
+
+/**
+ * @brief search a header line set by the connector
+ *
+ * @param storage the headers of the response
+ * @param key the name of the header
+ * @param length the length of the line with its end
+ *
+ * @return the beginning of the line or NULL
+ */
+static char *_httpmessage_headerline(buffer_t *storage, const char *key, int *length)
+{
+	int keylength = strlen(key);
+	char *line = storage->data;
+	char *end = storage->data + storage->length;
+	while (line < end)
+	{
+		char *next = memchr(line, '\n', end - line);
+		next = (next == NULL)? end: next + 1;
+		if (!strncasecmp(line, key, keylength) && line[keylength] == ':')
+		{
+			*length = next - line;
+			return line;
+		}
+		line = next;
+	}
+	return NULL;
+}
+
+static const char *_httpmessage_headervalue(buffer_t *storage, const char *key, int *length)
+{
+	int linelength = 0;
+	const char *value = _httpmessage_headerline(storage, key, &linelength);
+	if (value == NULL)
+		return NULL;
+	const char *end = value + linelength;
+	value += strlen(key) + 1;
+	while (*value == ' ')
+		value++;
+	while (end > value && (end[-1] == '\r' || end[-1] == '\n'))
+		end--;
+	*length = end - value;
+	return value;
+}
+
+static void _httpmessage_removeheader(buffer_t *storage, const char *key)
+{
+	int length = 0;
+	char *line = _httpmessage_headerline(storage, key, &length);
+	if (line == NULL)
+		return;
+	memmove(line, line + length, storage->data + storage->length - (line + length));
+	storage->length -= length;
+	storage->offset = storage->data + storage->length;
+	storage->data[storage->length] = '\0';
+}
+
+/**
+ * @brief check the If-Range validator with the ETag or the Last-Modified date
+ *
+ * @return ESUCCESS if the ranges may be sent
+ */
+static int _httpmessage_ifrange(http_message_t *request, http_message_t *response)
+{
+	const char *value = httpmessage_header_id(request, HDR_IF_RANGE);
+	if (value == NULL || value[0] == '\0')
+		return ESUCCESS;
+	const char *validator = NULL;
+	int length = 0;
+	/**
+	 * only the strong comparison is allowed
+	 */
+	if (value[0] == '"')
+		validator = _httpmessage_headervalue(response->headers_storage, "ETag", &length);
+	else if (strncmp(value, "W/", 2))
+		validator = _httpmessage_headervalue(response->headers_storage, "Last-Modified", &length);
+	if (validator == NULL || strlen(value) != length || strncmp(value, validator, length))
+		return EREJECT;
+	return ESUCCESS;
+}
+
+static int _httpmessage_isdigit(const char *value)
+{
+	return (*value >= '0' && *value <= '9');
+}
+
+/**
+ * @brief parse the "bytes=" ranges of the request
+ *
+ * @param value the list of ranges after "bytes="
+ * @param size the length of the document
+ * @param ranges the satisfiable ranges
+ *
+ * @return the number of satisfiable ranges or EREJECT if the header must be ignored
+ */
+static int _httpmessage_parseranges(const char *value, unsigned long long size, http_message_range_t *ranges)
+{
+	int nranges = 0;
+	unsigned long long total = 0;
+	while (*value != '\0')
+	{
+		unsigned long long first;
+		unsigned long long last;
+		char *end;
+		while (*value == ' ' || *value == ',')
+			value++;
+		if (*value == '\0')
+			break;
+		if (*value == '-')
+		{
+			if (!_httpmessage_isdigit(value + 1))
+				return EREJECT;
+			last = strtoull(value + 1, &end, 10);
+			first = (last < size)? size - last: 0;
+			if (last == 0)
+				first = size;
+			last = size - 1;
+		}
+		else
+		{
+			if (!_httpmessage_isdigit(value))
+				return EREJECT;
+			first = strtoull(value, &end, 10);
+			if (*end != '-')
+				return EREJECT;
+			value = end + 1;
+			end = (char *)value;
+			last = size - 1;
+			if (_httpmessage_isdigit(value))
+			{
+				unsigned long long value_last = strtoull(value, &end, 10);
+				if (value_last < first)
+					return EREJECT;
+				if (value_last < last)
+					last = value_last;
+			}
+		}
+		value = end;
+		while (*value == ' ')
+			value++;
+		if (*value != ',' && *value != '\0')
+			return EREJECT;
+		if (first >= size)
+			continue;
+		if (nranges == HTTPMESSAGE_MAXRANGES)
+			return EREJECT;
+		ranges[nranges].offset = first;
+		ranges[nranges].length = last - first + 1;
+		total += ranges[nranges].length;
+		nranges++;
+	}
+	/**
+	 * overlapping ranges would send more than the document
+	 */
+	if (total > size)
+		return EREJECT;
+	return nranges;
+}
+
+static void _httpmessage_unsatisfiable(http_message_t *response, unsigned long long size)
+{
+	char value[32];
+	snprintf(value, sizeof(value), "bytes */%llu", size);
+	_httpmessage_removeheader(response->headers_storage, str_contenttype);
+	httpmessage_addheader(response, "Content-Range", value);
+	if (response->file >= 0)
+		close(response->file);
+	response->file = -1;
+	if (response->content_storage)
+		_buffer_destroy(response->content_storage);
+	response->content_storage = NULL;
+	/**
+	 * the error message is the content
+	 */
+	response->content = NULL;
+	response->content_length = (unsigned long long)-1;
+	response->result = RESULT_416;
+}
+
+static int _httpmessage_multipart(http_message_t *response, http_message_range_t *ranges, int nranges, unsigned long long size)
+{
+	static unsigned int counter = 0;
+	char boundary[17];
+	snprintf(boundary, sizeof(boundary), "%08lx%08x", (unsigned long)time(NULL), ++counter);
+
+	response->ranges = vcalloc(nranges + 1, sizeof(*response->ranges));
+	response->ranges_storage = _buffer_create(MAXCHUNKS_HEADER);
+	if (response->ranges == NULL || response->ranges_storage == NULL)
+		return EREJECT;
+	buffer_t *prefix = response->ranges_storage;
+	_buffer_append(prefix, "\r\n--", 4);
+	_buffer_append(prefix, boundary, -1);
+	_buffer_append(prefix, "\r\n", 2);
+	int length = 0;
+	const char *type = _httpmessage_headervalue(response->headers_storage, str_contenttype, &length);
+	if (type != NULL)
+	{
+		_buffer_append(prefix, str_contenttype, -1);
+		_buffer_append(prefix, ": ", 2);
+		_buffer_append(prefix, type, length);
+		_buffer_append(prefix, "\r\n", 2);
+	}
+	if (_buffer_append(prefix, "Content-Range: bytes ", -1) == NULL)
+		return EREJECT;
+
+	unsigned long long contentlength = 0;
+	int i;
+	for (i = 0; i < nranges; i++)
+	{
+		http_message_range_t *range = &response->ranges[i];
+		range->offset = ranges[i].offset;
+		range->length = ranges[i].length;
+		range->headerlength = snprintf(range->header, sizeof(range->header),
+			"%llu-%llu/%llu\r\n\r\n", range->offset, range->offset + range->length - 1, size);
+		if (response->file >= 0)
+			range->offset += response->file_offset;
+		contentlength += prefix->length + range->headerlength + range->length;
+	}
+	http_message_range_t *closing = &response->ranges[nranges];
+	closing->headerlength = snprintf(closing->header, sizeof(closing->header),
+		"\r\n--%s--\r\n", boundary);
+	contentlength += closing->headerlength;
+
+	char value[64];
+	snprintf(value, sizeof(value), "multipart/byteranges; boundary=%s", boundary);
+	_httpmessage_removeheader(response->headers_storage, str_contenttype);
+	httpmessage_addheader(response, str_contenttype, value);
+	response->nranges = nranges;
+	response->range = 0;
+	response->file_length = 0;
+	response->content_length = contentlength;
+	return ESUCCESS;
+}
+
+/**
+ * @brief cut the response of the connector with the Range of the request
+ *
+ * The content must be complete into memory or into a file, the streams
+ * are not cut. One range is sent as a slice of the content or the file,
+ * the others are sent as multipart/byteranges (see _httpclient_sendranges).
+ *
+ * @param request the request with the Range header
+ * @param response the response to cut before the header generation
+ *
+ * @return ESUCCESS if the result of the response changed
+ */
+int _httpmessage_range(http_message_t *request, http_message_t *response)
+{
+	unsigned long long size;
+	if (response->result != RESULT_200 || !_httpmessage_state(response, PARSE_END) ||
+		(response->state & PARSE_CONTINUE) || request->method == NULL ||
+		(request->method->id != MESSAGE_TYPE_GET && request->method->id != MESSAGE_TYPE_HEAD))
+		return EREJECT;
+	if (response->file >= 0 && response->file_offset != (unsigned long long)-1 &&
+		(response->content == NULL || response->content->length == 0))
+		size = response->file_length;
+	else if (response->file < 0 && response->content != NULL &&
+		response->content == response->content_storage &&
+		response->content_length == response->content->length)
+		size = response->content_length;
+	else
+		return EREJECT;
+	httpmessage_addheader(response, "Accept-Ranges", "bytes");
+
+	const char *value = httpmessage_header_id(request, HDR_RANGE);
+	if (value == NULL || strncmp(value, "bytes=", 6))
+		return EREJECT;
+	if (_httpmessage_ifrange(request, response) != ESUCCESS)
+		return EREJECT;
+	http_message_range_t ranges[HTTPMESSAGE_MAXRANGES];
+	int nranges = _httpmessage_parseranges(value + 6, size, ranges);
+	if (nranges < 0)
+		return EREJECT;
+	if (nranges == 0)
+	{
+		_httpmessage_unsatisfiable(response, size);
+		return ESUCCESS;
+	}
+	if (nranges > 1)
+	{
+		if (_httpmessage_multipart(response, ranges, nranges, size) != ESUCCESS)
+		{
+			if (response->ranges)
+				vfree(response->ranges);
+			response->ranges = NULL;
+			return EREJECT;
+		}
+		response->result = RESULT_206;
+		return ESUCCESS;
+	}
+
+	char contentrange[72];
+	snprintf(contentrange, sizeof(contentrange), "bytes %llu-%llu/%llu",
+		ranges[0].offset, ranges[0].offset + ranges[0].length - 1, size);
+	httpmessage_addheader(response, "Content-Range", contentrange);
+	if (response->file >= 0)
+	{
+		response->file_offset += ranges[0].offset;
+		response->file_length = ranges[0].length;
+	}
+	else
+	{
+		buffer_t *content = response->content;
+		memmove(content->data, content->data + ranges[0].offset, ranges[0].length);
+		content->length = ranges[0].length;
+		content->offset = content->data + content->length;
+		content->data[content->length] = '\0';
+	}
+	response->content_length = ranges[0].length;
+	response->result = RESULT_206;
+	return ESUCCESS;
+}
+
+int httpmessage_quality(const char *list, const char *token)
+{
+	int length = strlen(token);
+	while (*list != '\0')
+	{
+		while (*list == ' ' || *list == ',')
+			list++;
+		const char *end = list;
+		while (*end != '\0' && *end != ',' && *end != ';' && *end != ' ')
+			end++;
+		int found = ((end - list) == length && !strncasecmp(list, token, length));
+		int quality = 1000;
+		while (*end == ' ')
+			end++;
+		if (*end == ';')
+		{
+			const char *q = strstr(end, "q=");
+			const char *next = strchr(end, ',');
+			if (q != NULL && (next == NULL || q < next))
+			{
+				quality = (q[2] == '1')? 1000: 0;
+				if (q[3] == '.')
+				{
+					int i;
+					int unit = 100;
+					for (i = 4; i < 7 && _httpmessage_isdigit(q + i); i++, unit /= 10)
+						quality += (q[i] - '0') * unit;
+				}
+			}
+		}
+		if (found)
+			return quality;
+		while (*end != '\0' && *end != ',')
+			end++;
+		list = end;
+	}
+	return -1;
+}
+
+/**
+ * @brief select the encoder of the response's content
+ *
+ * The complete content is encoded with the best encoder of the server
+ * accepted by the request. The Content-Length is unknown after that,
+ * the content is sent chunked.
+ *
+ * @param request the request with Accept-Encoding
+ * @param response the response before the header generation
+ * @param write the callback to send the encoded data
+ * @param writearg the first argument of write
+ *
+ * @return ESUCCESS if the content is encoded
+ */
+int _httpmessage_encoding(http_message_t *request, http_message_t *response,
+					http_encoder_write_t write, void *writearg)
+{
+	http_server_t *server = httpclient_server(response->client);
+	if (server == NULL || server->encoders == NULL || response->result != RESULT_200 ||
+		response->version < HTTP10 || request->method == NULL ||
+		request->method->id == MESSAGE_TYPE_HEAD || response->headers_storage == NULL)
+		return EREJECT;
+	const char *accept = httpmessage_header_id(request, HDR_ACCEPT_ENCODING);
+	if (accept == NULL || accept[0] == '\0')
+		return EREJECT;
+	int length = 0;
+	if (_httpmessage_headerline(response->headers_storage, "Content-Encoding", &length) != NULL)
+		return EREJECT;
+
+	const http_encoder_list_t *best = NULL;
+	int bestquality = 0;
+	int any = httpmessage_quality(accept, "*");
+	const http_encoder_list_t *it;
+	for (it = server->encoders; it != NULL; it = it->next)
+	{
+		int quality = httpmessage_quality(accept, it->encoder->name);
+		if (quality < 0)
+			quality = any;
+		if (quality > bestquality)
+		{
+			best = it;
+			bestquality = quality;
+		}
+	}
+	if (best == NULL)
+		return EREJECT;
+
+	char contenttype[64] = {0};
+	const char *type = _httpmessage_headervalue(response->headers_storage, str_contenttype, &length);
+	if (type != NULL)
+		snprintf(contenttype, sizeof(contenttype), "%.*s", length, type);
+	response->encoderctx = best->encoder->create(best->arg, (type != NULL)? contenttype: NULL,
+			response->content_length, write, writearg);
+	if (response->encoderctx == NULL)
+		return EREJECT;
+	response->encoder = best->encoder;
+
+	/**
+	 * the ranges and the validators are for the identity of the content
+	 */
+	_httpmessage_removeheader(response->headers_storage, "Accept-Ranges");
+	const char *etag = _httpmessage_headervalue(response->headers_storage, "ETag", &length);
+	if (etag != NULL && etag[0] == '"')
+	{
+		char weak[72];
+		snprintf(weak, sizeof(weak), "W/%.*s", length, etag);
+		_httpmessage_removeheader(response->headers_storage, "ETag");
+		httpmessage_addheader(response, "ETag", weak);
+	}
+	httpmessage_addheader(response, "Content-Encoding", best->encoder->name);
+	httpmessage_addheader(response, "Vary", "Accept-Encoding");
+	response->content_length = (unsigned long long)-1;
+	return ESUCCESS;
+}
+
 int httpmessage_keepalive(http_message_t *message)
 {
 	message->mode |= HTTPMESSAGE_KEEPALIVE;
 	return httpclient_socket(message->client);
 }
 
+void httpmessage_source(http_message_t *message, int fd, short events)
+{
+	message->source = fd;
+	message->source_events = events;
+}
+
 int httpmessage_lock(http_message_t *message)
 {
 	message->mode |= HTTPMESSAGE_LOCKED;
@@ -1342,8 +2912,7 @@ const char *httpmessage_REQUEST(http_message_t *message, const char *key)
 	}
 	else if (!strcasecmp(key, "query"))
 	{
-		if (message->query_storage != NULL)
-			value = message->query_storage->data;
+		value = message->query;
 	}
 	else if (!strcasecmp(key, "scheme"))
 	{
@@ -1359,16 +2928,7 @@ const char *httpmessage_REQUEST(http_message_t *message, const char *key)
 	}
 	else if (!strcasecmp(key, "result"))
 	{
-		int i = 0;
-		while (_http_message_result[i] != NULL)
-		{
-			if (_http_message_result[i]->result == message->result)
-			{
-				value = _http_message_result[i]->status;
-				break;
-			}
-			i++;
-		}
+		value = _httpmessage_status(message);
 	}
 	else if (!strcasecmp(key, "content"))
 	{
@@ -1385,7 +2945,7 @@ const char *httpmessage_REQUEST(http_message_t *message, const char *key)
 		}
 		if (value == NULL)
 		{
-			value = dbentry_search(message->headers, key);
+			value = dbtable_search(&message->headers, key);
 		}
 	}
 	else if (!strncasecmp(key, "remote_addr", 11))
@@ -1412,34 +2972,84 @@ const char *httpmessage_REQUEST(http_message_t *message, const char *key)
 	}
 	else
 	{
-		value = dbentry_search(message->headers, key);
+		value = dbtable_search(&message->headers, key);
 	}
 	if (value == NULL)
 		value = httpserver_INFO(httpclient_server(message->client), key);
 	return value;
 }
 
-const char *httpmessage_parameter(http_message_t *message, const char *key)
+const char *httpmessage_header_id(http_message_t *message, http_header_e id)
+{
+	if (id <= HDR_UNKNOWN || id >= HDR_MAX)
+		return NULL;
+	return message->knownheaders[id];
+}
+
+const char *httpmessage_headers(http_message_t *message, int *iterator, const char **name)
 {
-	if (message->queries == NULL)
+	if (*iterator >= message->headers.count)
+		return NULL;
+	const dbtable_entry_t *entry = &message->headers.entries[*iterator];
+	*iterator += 1;
+	if (name != NULL)
+		*name = entry->key;
+	return entry->value;
+}
+
+const char *httpmessage_trailer(http_message_t *message, const char *key)
+{
+	if (message->trailers_storage == NULL)
+		return NULL;
+	if (message->trailers == NULL)
 	{
-		_buffer_filldb(message->query_storage, &message->queries, '=', '&');
+		message->trailers = vcalloc(1, sizeof(*message->trailers));
+		if (message->trailers == NULL)
+			return NULL;
+		_buffer_filldb(message->trailers_storage, message->trailers, ':', '\r');
 	}
-	return dbentry_search(message->queries, key);
+	return dbtable_search(message->trailers, key);
+}
+
+const char *httpmessage_parameter(http_message_t *message, const char *key)
+{
+	const dbtable_entry_t *entry = dbtable_lookup(&message->queries, key);
+	if (entry == NULL)
+		return NULL;
+	return _httpmessage_parametervalue(message, entry);
+}
+
+const char *httpmessage_parameters(http_message_t *message, const char *key, int *iterator, const char **name)
+{
+	unsigned int hash = (key != NULL)? dbtable_hash(key) : 0;
+	int i;
+	for (i = *iterator; i < message->queries.count; i++)
+	{
+		const dbtable_entry_t *entry = &message->queries.entries[i];
+		if (key != NULL && (entry->hash != hash || strcasecmp(entry->key, key)))
+			continue;
+		*iterator = i + 1;
+		if (name != NULL)
+			*name = entry->key;
+		return _httpmessage_parametervalue(message, entry);
+	}
+	*iterator = i;
+	return NULL;
 }
 
 const char *httpmessage_cookie(http_message_t *message, const char *key)
 {
-	if (message->cookies == NULL)
+	if (message->cookie_storage == NULL)
 	{
 		if (message->cookie == NULL)
 			return NULL;
 		int nbchunks = ((strlen(message->cookie) + 1) / _buffer_chunksize(-1)) + 1;
 		message->cookie_storage = _buffer_create(nbchunks);
 		_buffer_append(message->cookie_storage, message->cookie, -1);
-		_buffer_filldb(message->cookie_storage, &message->cookies, '=', ';');
+		if (_buffer_filldb(message->cookie_storage, &message->cookies, '=', ';') < 0)
+			err("message: too many cookies, the last ones are lost");
 	}
-	return dbentry_search(message->cookies, key);
+	return dbtable_search(&message->cookies, key);
 }
 
 http_server_session_t *_httpserver_createsession(http_server_t *server, http_client_t *client)
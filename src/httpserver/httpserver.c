@@ -84,6 +84,7 @@ struct http_server_mod_s
 static void _http_addconnector(http_connector_list_t **first,
 						http_connector_t func, void *funcarg,
 						int priority, const char *name);
+static void _httpserver_buildheaders(http_server_t *server);
 
 /********************************************************************/
 static http_server_config_t defaultconfig = {
@@ -156,7 +157,12 @@ static int _httpserver_prepare(http_server_t *server)
 	{
 		if (httpclient_socket(client) > 0)
 		{
-			int status = client->ops->status(client->opsctx);
+			/**
+			 * the relay waits the events of both sockets
+			 */
+			short events[2];
+			int relaysock = _httpclient_relayevents(client, events);
+			int status = (relaysock < 0)? client->ops->status(client->opsctx) : EINCOMPLETE;
 			if (status == ESUCCESS)
 			{
 				/**
@@ -192,6 +198,28 @@ static int _httpserver_prepare(http_server_t *server)
 			server->numfds++;
 
 			maxfd = (maxfd > httpclient_socket(client))? maxfd:httpclient_socket(client);
+			if (relaysock >= 0)
+			{
+#ifdef USE_POLL
+				server->poll_set[server->numfds - 1].events = events[0];
+				server->poll_set[server->numfds].fd = relaysock;
+				server->poll_set[server->numfds].events = events[1];
+				server->numfds++;
+#else
+				FD_CLR(httpclient_socket(client), &server->fds[0]);
+				FD_CLR(httpclient_socket(client), &server->fds[1]);
+				if (events[0] & POLLIN)
+					FD_SET(httpclient_socket(client), &server->fds[0]);
+				if (events[0] & POLLOUT)
+					FD_SET(httpclient_socket(client), &server->fds[1]);
+				if (events[1] & POLLIN)
+					FD_SET(relaysock, &server->fds[0]);
+				if (events[1] & POLLOUT)
+					FD_SET(relaysock, &server->fds[1]);
+				FD_SET(relaysock, &server->fds[2]);
+#endif
+				maxfd = (maxfd > relaysock)? maxfd : relaysock;
+			}
 			count++;
 			if (count >= server->config->maxclients)
 				break;
@@ -262,7 +290,11 @@ static int _httpserver_checkclients(http_server_t *server, fd_set *prfds, fd_set
 			else
 				FD_CLR(httpclient_socket(client), prfds);
 		}
+		short events[2];
+		int relaysock = _httpclient_relayevents(client, events);
 		if (FD_ISSET(httpclient_socket(client), prfds) ||
+			FD_ISSET(httpclient_socket(client), pwfds) ||
+			(relaysock >= 0 && (FD_ISSET(relaysock, prfds) || FD_ISSET(relaysock, pwfds) || FD_ISSET(relaysock, pefds))) ||
 			client->request_queue != NULL)
 		{
 			client->state |= CLIENT_RUNNING;
@@ -328,6 +360,7 @@ static int _httpserver_checkserver(http_server_t *server, fd_set *prfds, fd_set
 		return EREJECT;
 
 	count = _httpserver_checkclients(server, prfds, pwfds, pefds);
+	server->nbclients = count;
 #ifdef DEBUG
 	_debug_maxclients = (_debug_maxclients > count)? _debug_maxclients: count;
 	server_dbg("nb clients %d / %d / %d", count, _debug_maxclients, _debug_nbclients);
@@ -505,8 +538,17 @@ static int _httpserver_run(http_server_t *server)
 				}
 				if (server->poll_set[j].revents & POLLERR)
 				{
+					int error = 0;
+					socklen_t errorlen = sizeof(error);
 					FD_SET(server->poll_set[j].fd, &rfds);
-					FD_SET(server->poll_set[j].fd, &efds);
+					/**
+					 * the error queue receives the notifications of MSG_ZEROCOPY
+					 * without error on the socket.
+					 */
+					if (getsockopt(server->poll_set[j].fd, SOL_SOCKET, SO_ERROR, &error, &errorlen) < 0 ||
+						error != 0)
+						FD_SET(server->poll_set[j].fd, &efds);
+					server->poll_set[j].revents &= ~POLLERR;
 				}
 				if (server->poll_set[j].revents & POLLHUP)
 				{
@@ -632,6 +674,7 @@ http_server_t *httpserver_create(http_server_config_t *config)
 
 	if (config->chunksize > 0)
 		_buffer_chunksize(config->chunksize);
+	_httpmessage_init();
 
 	server = vcalloc(1, sizeof(*server));
 	if (server == NULL)
@@ -657,12 +700,14 @@ http_server_t *httpserver_create(http_server_config_t *config)
 #ifdef USE_POLL
 	server->poll_set =
 #ifndef VTHREAD
-		vcalloc(1 + server->config->maxclients, sizeof(*server->poll_set));
+		vcalloc(1 + 2 * server->config->maxclients, sizeof(*server->poll_set));
 #else
 		vcalloc(1, sizeof(*server->poll_set));
 #endif
 #endif
 
+	_httpserver_buildheaders(server);
+
 	if (server->ops->start(server))
 	{
 		free(server);
@@ -691,6 +736,7 @@ http_server_t *httpserver_dup(http_server_t *server)
 
 	vserver->protocol_ops = server->protocol_ops;
 	vserver->protocol = server->protocol;
+	_httpserver_buildheaders(vserver);
 
 	return vserver;
 }
@@ -701,7 +747,12 @@ void httpserver_addmethod(http_server_t *server, const char *key, short properti
 	http_message_method_t *method = server->methods;
 	while (method != NULL)
 	{
-		id = method->id;
+		/**
+		 * the methods are pushed in front of the list,
+		 * the new id follows the largest one
+		 */
+		if (method->id > id)
+			id = method->id;
 		if (!strcmp(method->key, key))
 		{
 			break;
@@ -748,6 +799,29 @@ void httpserver_addmod(http_server_t *server, http_getctx_t modf, http_freectx_t
 	server->mod = mod;
 }
 
+void httpserver_addencoder(http_server_t *server, const http_encoder_t *encoder, void *arg)
+{
+	http_encoder_list_t *entry = vcalloc(1, sizeof(*entry));
+	if (entry == NULL)
+		return;
+	entry->encoder = encoder;
+	entry->arg = arg;
+	/**
+	 * the order of the list is the order of preference
+	 */
+	http_encoder_list_t **last = &server->encoders;
+	while (*last != NULL)
+		last = &(*last)->next;
+	*last = entry;
+}
+
+int httpserver_load(http_server_t *server)
+{
+	if (server->config->maxclients <= 0)
+		return 0;
+	return (server->nbclients * 100) / server->config->maxclients;
+}
+
 void httpserver_addconnector(http_server_t *server,
 						http_connector_t func, void *funcarg,
 						int priority, const char *name)
@@ -766,9 +840,11 @@ void httpserver_connect(http_server_t *server)
 	 *  - for each file to send
 	 *  - for stdin stdout stderr
 	 *  - for websocket and other stream
+	 *  - for the 2 pipes of each relayed client
 	 */
-	rlim.rlim_cur = _maxclients * 2 + 5 + MAXWEBSOCKETS;
+	rlim.rlim_cur = _maxclients * (2 + 4) + 5 + MAXWEBSOCKETS;
 	setrlimit(RLIMIT_NOFILE, &rlim);
+	_httpserver_buildheaders(server);
 
 #ifndef VTHREAD
 	_httpserver_connect(server);
@@ -818,6 +894,13 @@ void httpserver_destroy(http_server_t *server)
 		vfree(mod);
 		mod = next;
 	}
+	http_encoder_list_t *encoder = server->encoders;
+	while (encoder)
+	{
+		http_encoder_list_t *next = encoder->next;
+		vfree(encoder);
+		encoder = next;
+	}
 	http_message_method_t *method = (http_message_method_t *)server->methods;
 	while (method)
 	{
@@ -831,10 +914,45 @@ void httpserver_destroy(http_server_t *server)
 	}
 	if (server->methods_storage != NULL)
 		_buffer_destroy(server->methods_storage);
+	if (server->headers_storage != NULL)
+		_buffer_destroy(server->headers_storage);
 	if (server->poll_set)
 		vfree(server->poll_set);
 	vfree(server);
 }
+/**
+ * @brief build the headers of all the responses of the server
+ *
+ * The block is built before the start of the clients, the software
+ * name may change until httpserver_connect.
+ */
+static void _httpserver_buildheaders(http_server_t *server)
+{
+	if (!(server->config->headers & HTTPSERVER_HEADER_SERVER))
+		return;
+	if (server->headers_storage == NULL)
+		server->headers_storage = _buffer_create(MAXCHUNKS_HEADER);
+	if (server->headers_storage == NULL)
+		return;
+	_buffer_reset(server->headers_storage);
+	_buffer_append(server->headers_storage, "Server: ", -1);
+	_buffer_append(server->headers_storage, httpserver_software, -1);
+	_buffer_append(server->headers_storage, "\r\n", 2);
+}
+
+/**
+ * @brief return the headers of all the responses of the server
+ */
+const char *_httpserver_headers(http_server_t *server, int *length)
+{
+	if (server->headers_storage == NULL)
+	{
+		*length = 0;
+		return NULL;
+	}
+	*length = server->headers_storage->length;
+	return server->headers_storage->data;
+}
 /***********************************************************************/
 
 #ifndef NI_MAXHOST
@@ -0,0 +1,137 @@
+/*****************************************************************************
+ * scan.c: delimiters scanning with SIMD instructions
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# if defined(__GNUC__) && !defined(HTTPMESSAGE_NOSIMD)
+#  include <immintrin.h>
+#  define SCAN_X86
+# endif
+#endif
+
+#include "_scan.h"
+
+void _scan_init(scan_t *scan, const char *needles, int nbneedles)
+{
+	int i;
+	memset(scan, 0, sizeof(*scan));
+	if (nbneedles > SCAN_MAXNEEDLES)
+		nbneedles = SCAN_MAXNEEDLES;
+	for (i = 0; i < nbneedles; i++)
+	{
+		unsigned char c = needles[i];
+		scan->needles[i] = needles[i];
+		scan->map[c >> 3] |= 1 << (c & 0x07);
+	}
+	scan->nbneedles = nbneedles;
+}
+
+static char *_scan_scalar(const scan_t *scan, const char *start, const char *end)
+{
+	while (start < end)
+	{
+		unsigned char c = *start;
+		if (scan->map[c >> 3] & (1 << (c & 0x07)))
+			break;
+		start++;
+	}
+	return (char *)start;
+}
+
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+static char *_scan_sse2(const scan_t *scan, const char *start, const char *end)
+{
+	__m128i needles[SCAN_MAXNEEDLES];
+	int i;
+	for (i = 0; i < scan->nbneedles; i++)
+		needles[i] = _mm_set1_epi8(scan->needles[i]);
+
+	while (start + sizeof(__m128i) <= end)
+	{
+		__m128i block = _mm_loadu_si128((const __m128i *)start);
+		__m128i match = _mm_cmpeq_epi8(block, needles[0]);
+		for (i = 1; i < scan->nbneedles; i++)
+			match = _mm_or_si128(match, _mm_cmpeq_epi8(block, needles[i]));
+		unsigned int mask = _mm_movemask_epi8(match);
+		if (mask)
+			return (char *)start + __builtin_ctz(mask);
+		start += sizeof(__m128i);
+	}
+	return _scan_scalar(scan, start, end);
+}
+
+__attribute__((target("avx2")))
+static char *_scan_avx2(const scan_t *scan, const char *start, const char *end)
+{
+	__m256i needles[SCAN_MAXNEEDLES];
+	int i;
+	for (i = 0; i < scan->nbneedles; i++)
+		needles[i] = _mm256_set1_epi8(scan->needles[i]);
+
+	while (start + sizeof(__m256i) <= end)
+	{
+		__m256i block = _mm256_loadu_si256((const __m256i *)start);
+		__m256i match = _mm256_cmpeq_epi8(block, needles[0]);
+		for (i = 1; i < scan->nbneedles; i++)
+			match = _mm256_or_si256(match, _mm256_cmpeq_epi8(block, needles[i]));
+		unsigned int mask = _mm256_movemask_epi8(match);
+		if (mask)
+			return (char *)start + __builtin_ctz(mask);
+		start += sizeof(__m256i);
+	}
+	return _scan_sse2(scan, start, end);
+}
+#endif
+
+typedef char *(*scan_find_t)(const scan_t *scan, const char *start, const char *end);
+static scan_find_t _scan_findfunc = _scan_scalar;
+
+/**
+ * the best version for the CPU is selected once before the threads start.
+ */
+void _scan_select(void)
+{
+	scan_find_t func = _scan_scalar;
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		func = _scan_avx2;
+	else if (__builtin_cpu_supports("sse2"))
+		func = _scan_sse2;
+#endif
+	_scan_findfunc = func;
+}
+
+char *_scan_find(const scan_t *scan, const char *start, const char *end)
+{
+	if (scan->nbneedles == 0)
+		return (char *)end;
+	return _scan_findfunc(scan, start, end);
+}
@@ -24,6 +24,9 @@
  * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  *****************************************************************************/
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -46,6 +49,10 @@
 # include <netdb.h>
 # include <fcntl.h>
 # include <signal.h>
+# ifdef __linux__
+#  include <linux/errqueue.h>
+#  include <sys/sendfile.h>
+# endif
 
 #else
 
@@ -99,6 +106,14 @@ struct addrinfo
 #define MSG_NOSIGNAL 0
 #endif
 
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define TCP_ZEROCOPY
+#endif
+
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+#define TCP_SENDFILE
+#endif
+
 static void *tcpclient_create(void *config, http_client_t *clt)
 {
 	http_server_t *server = (http_server_t *)config;
@@ -116,6 +131,15 @@ static void *tcpclient_create(void *config, http_client_t *clt)
 			dbg("tcp accept error %s", strerror(errno));
 			return NULL;
 		}
+#ifdef TCP_ZEROCOPY
+		if (server->config->zerocopy > 0)
+		{
+			if (setsockopt(clt->sock, SOL_SOCKET, SO_ZEROCOPY, (void *)&(int){ 1 }, sizeof(int)) < 0)
+				warn("setsockopt(SO_ZEROCOPY) failed");
+			else
+				clt->state |= CLIENT_ZEROCOPY;
+		}
+#endif
 	}
 
 	return clt;
@@ -211,6 +235,174 @@ static int tcpclient_send(void *ctl, const char *data, int length)
 	return ret;
 }
 
+/**
+ * The buffer must not be changed before tcpclient_released returns
+ * a value larger than the value of zerocopy_sent after this call.
+ * Without SO_ZEROCOPY the data is copied and released immediately.
+ */
+static int tcpclient_sendzerocopy(void *ctl, const char *data, int length)
+{
+	int ret;
+	http_client_t *client = (http_client_t *)ctl;
+	int flags = MSG_NOSIGNAL;
+
+#ifdef TCP_ZEROCOPY
+	if (client->state & CLIENT_ZEROCOPY)
+		flags |= MSG_ZEROCOPY;
+#endif
+	ret = send(client->sock, data, length, flags);
+	if (ret < 0)
+	{
+		/**
+		 * ENOBUFS: the socket optmem limit is reached, the kernel
+		 * is not able to pin more pages before some releases.
+		 */
+		if (errno == EAGAIN || errno == ENOBUFS)
+			ret = EINCOMPLETE;
+		else
+			ret = EREJECT;
+	}
+	else if (flags != MSG_NOSIGNAL)
+	{
+		/**
+		 * the kernel gives an id to each sending with MSG_ZEROCOPY
+		 */
+		client->zerocopy_sent++;
+		tcp_dbg("tcp send zerocopy %d", ret);
+	}
+	else
+	{
+		client->zerocopy_sent++;
+		client->zerocopy_done++;
+		tcp_dbg("tcp send %d", ret);
+	}
+	return ret;
+}
+
+static int tcpclient_sendv(void *ctl, const struct iovec *iov, int iovcnt)
+{
+	int ret;
+	http_client_t *client = (http_client_t *)ctl;
+	struct msghdr msg = {0};
+
+	msg.msg_iov = (struct iovec *)iov;
+	msg.msg_iovlen = iovcnt;
+	ret = sendmsg(client->sock, &msg, MSG_NOSIGNAL);
+	if (ret < 0)
+	{
+		if (errno == EAGAIN)
+			ret = EINCOMPLETE;
+		else
+			ret = EREJECT;
+	}
+	else
+	{
+		tcp_dbg("tcp sendv %d", ret);
+	}
+	return ret;
+}
+
+#ifdef TCP_SENDFILE
+/**
+ * The regular files are sent with sendfile, the pipes with splice.
+ * Both copy the data inside the kernel, from the page cache or from
+ * the pipe buffer to the socket.
+ */
+static int tcpclient_sendfile(void *ctl, int fd, unsigned long long offset, int length)
+{
+	ssize_t ret;
+	http_client_t *client = (http_client_t *)ctl;
+
+	if (offset == (unsigned long long)-1)
+		ret = splice(fd, NULL, client->sock, NULL, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	else
+	{
+		off_t position = offset;
+		ret = sendfile(client->sock, fd, &position, length);
+	}
+	if (ret < 0)
+	{
+		int available = 0;
+		/**
+		 * splice fails on the socket and on the pipe with the same error
+		 */
+		if (errno == EAGAIN && offset == (unsigned long long)-1 &&
+			ioctl(fd, FIONREAD, &available) == 0 && available == 0)
+			ret = ESOURCE;
+		else if (errno == EAGAIN)
+			ret = EINCOMPLETE;
+		else
+			ret = EREJECT;
+	}
+	else
+	{
+		tcp_dbg("tcp sendfile %d", (int)ret);
+	}
+	return ret;
+}
+
+static int tcpclient_recvfile(void *ctl, int fd, int length)
+{
+	http_client_t *client = (http_client_t *)ctl;
+	ssize_t ret = splice(client->sock, NULL, fd, NULL, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (ret < 0)
+	{
+		if (errno == EAGAIN)
+			ret = EINCOMPLETE;
+		else
+			ret = EREJECT;
+	}
+	else
+	{
+		tcp_dbg("tcp recvfile %d", (int)ret);
+	}
+	return ret;
+}
+#endif
+
+/**
+ * The kernel sends the notification of the sendings on the error queue
+ * of the socket. Each MSG_ZEROCOPY sending receives an id, and the
+ * notifications contain ranges of ids. TCP releases the buffers in order.
+ */
+static unsigned int tcpclient_released(void *ctl)
+{
+	http_client_t *client = (http_client_t *)ctl;
+#ifdef TCP_ZEROCOPY
+	if (client->state & CLIENT_ZEROCOPY)
+	{
+		char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+		struct msghdr msg = {0};
+
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		while (recvmsg(client->sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) >= 0)
+		{
+			struct cmsghdr *cm;
+			for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+			{
+				if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) &&
+					!(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+					continue;
+				struct sock_extended_err *serr = (struct sock_extended_err *)CMSG_DATA(cm);
+				if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+					continue;
+				if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				{
+					tcp_dbg("tcp zerocopy fallback to copy");
+				}
+				/**
+				 * ee_data is the last id of the range released
+				 */
+				client->zerocopy_done = serr->ee_data + 1;
+			}
+			msg.msg_controllen = sizeof(control);
+		}
+	}
+#endif
+	return client->zerocopy_done;
+}
+
 static int tcpclient_wait(void *ctl, int options)
 {
 	http_client_t *client = (http_client_t *)ctl;
@@ -268,6 +460,15 @@ static int tcpclient_wait(void *ctl, int options)
 	{
 		FD_SET(client->sock, &fds);
 	}
+	else if ((poll_set[0].revents & POLLERR) && client->zerocopy_done != client->zerocopy_sent)
+	{
+		/**
+		 * the error queue contains the zerocopy notifications
+		 */
+		tcpclient_released(client);
+		errno = EAGAIN;
+		return EINCOMPLETE;
+	}
 	else if (ret < 0)
 		err("client %p poll %x", client, poll_set[0].revents);
 #else
@@ -424,6 +625,13 @@ const httpclient_ops_t *tcpclient_ops = &(httpclient_ops_t)
 	.flush = tcpclient_flush,
 	.disconnect = tcpclient_disconnect,
 	.destroy = tcpclient_destroy,
+	.sendzerocopy = tcpclient_sendzerocopy,
+	.released = tcpclient_released,
+	.sendv = tcpclient_sendv,
+#ifdef TCP_SENDFILE
+	.sendfile = tcpclient_sendfile,
+	.recvfile = tcpclient_recvfile,
+#endif
 };
 
 #ifdef TCP_SIGHANDLER
@@ -0,0 +1,479 @@
+/*****************************************************************************
+ * multipart.c: streaming multipart/form-data parser
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "log.h"
+#include "httpserver.h"
+#include "multipart.h"
+
+#define multipart_dbg(...)
+
+static const char str_multipart[] = "multipart/form-data";
+
+typedef enum
+{
+	MULTIPART_PREAMBLE,
+	MULTIPART_BOUNDARY, /* after the delimiter, before the end of line */
+	MULTIPART_BOUNDARYLF,
+	MULTIPART_CLOSE,
+	MULTIPART_HEADER,
+	MULTIPART_BODY,
+	MULTIPART_EPILOGUE,
+} _multipart_state_e;
+
+struct multipart_s
+{
+	const multipart_ops_t *ops;
+	void *arg;
+	_multipart_state_e state;
+	/**
+	 * the delimiter is "\r\n--" followed by the boundary
+	 */
+	char delimiter[MULTIPART_BOUNDARYMAX + 4];
+	int delimiterlength;
+	/**
+	 * number of bytes of the delimiter matched at the end of the previous slice
+	 */
+	int pending;
+	unsigned char skip[256];
+	multipart_part_t part;
+	/**
+	 * the headers of the current part are stored as "<key>: <value>\0"
+	 */
+	char header[MULTIPART_HEADERMAX];
+	int headerlength;
+	int linestart;
+};
+
+static int _multipart_boundary(multipart_t *multipart, const char *contenttype)
+{
+	const char *boundary = strstr(contenttype, "boundary=");
+	if (boundary == NULL)
+		return EREJECT;
+	boundary += sizeof("boundary=") - 1;
+	int length = 0;
+	if (*boundary == '"')
+	{
+		boundary++;
+		while (boundary[length] != '"' && boundary[length] != '\0')
+			length++;
+	}
+	else
+	{
+		while (boundary[length] != ';' && boundary[length] != ' ' && boundary[length] != '\0')
+			length++;
+	}
+	if (length == 0 || length > MULTIPART_BOUNDARYMAX ||
+		memchr(boundary, '\r', length) || memchr(boundary, '\n', length))
+		return EREJECT;
+	memcpy(multipart->delimiter, "\r\n--", 4);
+	memcpy(multipart->delimiter + 4, boundary, length);
+	multipart->delimiterlength = length + 4;
+
+	/**
+	 * Boyer-Moore-Horspool shift table
+	 */
+	int last = multipart->delimiterlength - 1;
+	memset(multipart->skip, multipart->delimiterlength, sizeof(multipart->skip));
+	int i;
+	for (i = 0; i < last; i++)
+		multipart->skip[(unsigned char)multipart->delimiter[i]] = last - i;
+	return ESUCCESS;
+}
+
+multipart_t *multipart_create(http_message_t *request, const multipart_ops_t *ops, void *arg)
+{
+	const char *contenttype = httpmessage_header_id(request, HDR_CONTENT_TYPE);
+	if (contenttype == NULL ||
+		strncasecmp(contenttype, str_multipart, sizeof(str_multipart) - 1))
+		return NULL;
+
+	multipart_t *multipart = calloc(1, sizeof(*multipart));
+	if (multipart == NULL)
+		return NULL;
+	if (_multipart_boundary(multipart, contenttype) != ESUCCESS)
+	{
+		err("multipart: bad boundary");
+		free(multipart);
+		return NULL;
+	}
+	multipart->ops = ops;
+	multipart->arg = arg;
+	multipart->state = MULTIPART_PREAMBLE;
+	/**
+	 * the first delimiter is at the beginning of the content without end of line
+	 */
+	multipart->pending = 2;
+	multipart->part.index = -1;
+	return multipart;
+}
+
+/**
+ * @brief search the delimiter into the data
+ *
+ * @return the position of the delimiter or -1
+ */
+static int _multipart_search(const multipart_t *multipart, const char *data, int length)
+{
+	const unsigned char *text = (const unsigned char *)data;
+	int last = multipart->delimiterlength - 1;
+	int i = 0;
+	while (i + last < length)
+	{
+		unsigned char c = text[i + last];
+		if (c == (unsigned char)multipart->delimiter[last] &&
+			!memcmp(text + i, multipart->delimiter, last))
+			return i;
+		i += multipart->skip[c];
+	}
+	return -1;
+}
+
+/**
+ * @brief search the beginning of the delimiter at the end of the data
+ *
+ * The boundary cannot contain "\r", the delimiter begins only at a "\r".
+ *
+ * @return the position of the beginning or length
+ */
+static int _multipart_partial(const multipart_t *multipart, const char *data, int length)
+{
+	int start = length - multipart->delimiterlength + 1;
+	if (start < 0)
+		start = 0;
+	const char *it = data + start;
+	const char *end = data + length;
+	while ((it = memchr(it, '\r', end - it)) != NULL)
+	{
+		if (!memcmp(it, multipart->delimiter, end - it))
+			return it - data;
+		it++;
+	}
+	return length;
+}
+
+static int _multipart_data(multipart_t *multipart, const char *data, int length)
+{
+	if (length == 0 || multipart->state != MULTIPART_BODY)
+		return ESUCCESS;
+	if (multipart->ops && multipart->ops->data &&
+		multipart->ops->data(multipart->arg, &multipart->part, data, length) == EREJECT)
+		return EREJECT;
+	return ESUCCESS;
+}
+
+/**
+ * @brief the delimiter is found, the body of the part is complete
+ */
+static int _multipart_delimiter(multipart_t *multipart)
+{
+	int ret = ESUCCESS;
+	if (multipart->state == MULTIPART_BODY && multipart->ops && multipart->ops->end)
+		ret = multipart->ops->end(multipart->arg, &multipart->part);
+	multipart->state = MULTIPART_BOUNDARY;
+	multipart->pending = 0;
+	return (ret == EREJECT)? EREJECT: ESUCCESS;
+}
+
+/**
+ * @brief parse the body of a part until the delimiter
+ *
+ * @return the length of data used or EREJECT
+ */
+static int _multipart_parsebody(multipart_t *multipart, const char *data, int length)
+{
+	if (multipart->pending > 0)
+	{
+		int rest = multipart->delimiterlength - multipart->pending;
+		if (rest > length)
+			rest = length;
+		if (!memcmp(data, multipart->delimiter + multipart->pending, rest))
+		{
+			multipart->pending += rest;
+			if (multipart->pending < multipart->delimiterlength)
+				return length;
+			if (_multipart_delimiter(multipart) == EREJECT)
+				return EREJECT;
+			return rest;
+		}
+		/**
+		 * the end of the previous slice was a part of the body
+		 */
+		if (_multipart_data(multipart, multipart->delimiter, multipart->pending) == EREJECT)
+			return EREJECT;
+		multipart->pending = 0;
+	}
+	int position = _multipart_search(multipart, data, length);
+	if (position >= 0)
+	{
+		if (_multipart_data(multipart, data, position) == EREJECT ||
+			_multipart_delimiter(multipart) == EREJECT)
+			return EREJECT;
+		return position + multipart->delimiterlength;
+	}
+	position = _multipart_partial(multipart, data, length);
+	multipart->pending = length - position;
+	if (_multipart_data(multipart, data, position) == EREJECT)
+		return EREJECT;
+	return length;
+}
+
+static void _multipart_disposition(multipart_t *multipart, char *value)
+{
+	char *param = strchr(value, ';');
+	while (param != NULL)
+	{
+		*param++ = '\0';
+		while (*param == ' ' || *param == '\t')
+			param++;
+		const char **field = NULL;
+		if (!strncasecmp(param, "name=", 5))
+		{
+			field = &multipart->part.name;
+			param += 5;
+		}
+		else if (!strncasecmp(param, "filename=", 9))
+		{
+			field = &multipart->part.filename;
+			param += 9;
+		}
+		char *end;
+		if (*param == '"')
+		{
+			param++;
+			end = strchr(param, '"');
+		}
+		else
+			end = strchr(param, ';');
+		if (field != NULL)
+			*field = param;
+		if (end == NULL)
+			break;
+		if (*end == '"')
+		{
+			*end++ = '\0';
+			param = strchr(end, ';');
+		}
+		else
+			param = end;
+	}
+}
+
+/**
+ * @brief store the header line and read the fields of the part
+ */
+static int _multipart_headerline(multipart_t *multipart)
+{
+	char *line = multipart->header + multipart->linestart;
+	int length = multipart->headerlength - multipart->linestart;
+	if (length > 0 && line[length - 1] == '\r')
+		length--;
+	line[length] = '\0';
+	multipart->headerlength = multipart->linestart + length + 1;
+	multipart->linestart = multipart->headerlength;
+
+	char *value = strchr(line, ':');
+	if (value == NULL)
+		return EREJECT;
+	value++;
+	while (*value == ' ' || *value == '\t')
+		value++;
+	if (!strncasecmp(line, "Content-Disposition:", 20))
+	{
+		/**
+		 * the parameters are cut into the storage, the key stays searchable
+		 */
+		_multipart_disposition(multipart, value);
+	}
+	else if (!strncasecmp(line, "Content-Type:", 13))
+		multipart->part.contenttype = value;
+	return ESUCCESS;
+}
+
+/**
+ * @brief parse the headers of the part until the empty line
+ *
+ * @return the length of data used or EREJECT
+ */
+static int _multipart_parseheader(multipart_t *multipart, const char *data, int length)
+{
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		if (data[i] != '\n')
+		{
+			if (multipart->headerlength == sizeof(multipart->header) - 1)
+			{
+				err("multipart: header too large");
+				return EREJECT;
+			}
+			multipart->header[multipart->headerlength++] = data[i];
+			continue;
+		}
+		int linelength = multipart->headerlength - multipart->linestart;
+		if (linelength == 0 ||
+			(linelength == 1 && multipart->header[multipart->linestart] == '\r'))
+		{
+			multipart->headerlength = multipart->linestart;
+			multipart->state = MULTIPART_BODY;
+			multipart_dbg("multipart: part %s %s", multipart->part.name, multipart->part.filename);
+			if (multipart->ops && multipart->ops->begin &&
+				multipart->ops->begin(multipart->arg, &multipart->part) == EREJECT)
+				return EREJECT;
+			return i + 1;
+		}
+		if (_multipart_headerline(multipart) == EREJECT)
+			return EREJECT;
+	}
+	return length;
+}
+
+/**
+ * @brief parse the end of the delimiter line
+ *
+ * @return the length of data used or EREJECT
+ */
+static int _multipart_parseboundary(multipart_t *multipart, const char *data, int length)
+{
+	int i;
+	for (i = 0; i < length && multipart->state != MULTIPART_HEADER &&
+			multipart->state != MULTIPART_EPILOGUE; i++)
+	{
+		char c = data[i];
+		switch (multipart->state)
+		{
+		case MULTIPART_BOUNDARY:
+			if (c == '-')
+				multipart->state = MULTIPART_CLOSE;
+			else if (c == '\r')
+				multipart->state = MULTIPART_BOUNDARYLF;
+			else if (c != ' ' && c != '\t')
+				return EREJECT;
+		break;
+		case MULTIPART_BOUNDARYLF:
+			if (c != '\n')
+				return EREJECT;
+			multipart->part.name = NULL;
+			multipart->part.filename = NULL;
+			multipart->part.contenttype = NULL;
+			multipart->part.index++;
+			multipart->headerlength = 0;
+			multipart->linestart = 0;
+			multipart->state = MULTIPART_HEADER;
+		break;
+		case MULTIPART_CLOSE:
+			if (c != '-')
+				return EREJECT;
+			multipart->state = MULTIPART_EPILOGUE;
+		break;
+		default:
+		break;
+		}
+	}
+	return i;
+}
+
+int multipart_parse(multipart_t *multipart, const char *data, int length)
+{
+	int offset = 0;
+	while (offset < length && multipart->state != MULTIPART_EPILOGUE)
+	{
+		int size = 0;
+		switch (multipart->state)
+		{
+		case MULTIPART_PREAMBLE:
+		case MULTIPART_BODY:
+			size = _multipart_parsebody(multipart, data + offset, length - offset);
+		break;
+		case MULTIPART_BOUNDARY:
+		case MULTIPART_BOUNDARYLF:
+		case MULTIPART_CLOSE:
+			size = _multipart_parseboundary(multipart, data + offset, length - offset);
+		break;
+		case MULTIPART_HEADER:
+			size = _multipart_parseheader(multipart, data + offset, length - offset);
+		break;
+		default:
+		break;
+		}
+		if (size == EREJECT)
+			return EREJECT;
+		offset += size;
+	}
+	if (multipart->state == MULTIPART_EPILOGUE)
+		return ESUCCESS;
+	return EINCOMPLETE;
+}
+
+int multipart_content(multipart_t *multipart, http_message_t *request)
+{
+	char *data = NULL;
+	unsigned long long rest = 0;
+	int size = httpmessage_content(request, &data, &rest);
+	if (size == EINCOMPLETE)
+		return EINCOMPLETE;
+	int ret = EINCOMPLETE;
+	if (size > 0)
+		ret = multipart_parse(multipart, data, size);
+	else if (multipart->state == MULTIPART_EPILOGUE)
+		ret = ESUCCESS;
+	if (ret == EINCOMPLETE && rest == 0)
+	{
+		err("multipart: content truncated");
+		ret = EREJECT;
+	}
+	return ret;
+}
+
+const char *multipart_header(multipart_t *multipart, const char *key)
+{
+	if (multipart->state != MULTIPART_BODY)
+		return NULL;
+	int length = strlen(key);
+	const char *line = multipart->header;
+	while (line < multipart->header + multipart->headerlength)
+	{
+		if (!strncasecmp(line, key, length) && line[length] == ':')
+		{
+			const char *value = line + length + 1;
+			while (*value == ' ' || *value == '\t')
+				value++;
+			return value;
+		}
+		line += strlen(line) + 1;
+	}
+	return NULL;
+}
+
+void multipart_destroy(multipart_t *multipart)
+{
+	free(multipart);
+}
@@ -0,0 +1,7 @@
+lib-$(SHARED)+=ouimultipart
+slib-$(STATIC)+=ouimultipart
+ouimultipart_SOURCES=multipart.c
+ouimultipart_CFLAGS+=-I../include/ouistiti
+ouimultipart_PKGCONFIG:=ouistiti
+
+ouimultipart_CFLAGS-$(DEBUG)+=-g -DDEBUG
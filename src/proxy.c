@@ -0,0 +1,1091 @@
+/*****************************************************************************
+ * proxy.c: reverse proxy connector
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "log.h"
+#include "httpserver.h"
+#include "fetch.h"
+#include "proxy.h"
+#include "_proxycache.h"
+
+#ifndef VTHREAD
+# error "the cache of the proxy waits the other clients inside the client, it needs VTHREAD"
+#endif
+
+#define proxy_dbg(...)
+
+/**
+ * the content of the upstream is not read while the client keeps
+ * this length to send.
+ */
+#ifndef PROXY_BUFFERSIZE
+#define PROXY_BUFFERSIZE 8192
+#endif
+/**
+ * the request content is sent to the upstream after its reception,
+ * it must not be larger.
+ */
+#ifndef PROXY_MAXCONTENT
+#define PROXY_MAXCONTENT (16 * 1024 * 1024)
+#endif
+#define PROXY_MAXHEADERS 64
+/**
+ * the upstreams already tried by a request are stored into a bit field
+ */
+#define PROXY_MAXUPSTREAMS 32
+
+typedef struct proxy_stats_s proxy_stats_t;
+struct proxy_stats_s
+{
+	int outstanding; /* requests in progress */
+	int failures; /* consecutive errors */
+	time_t ejected; /* end of the ejection */
+};
+
+typedef struct proxy_upstream_s proxy_upstream_t;
+struct proxy_upstream_s
+{
+	const char *name;
+	proxy_stats_t *stats; /* shared by the processes of the server */
+};
+
+struct proxy_s
+{
+	proxy_config_t config;
+	fetch_config_t fetch;
+	int prefixlength;
+	proxy_upstream_t *upstreams;
+	int nupstreams;
+	proxy_stats_t *stats;
+	int nstats;
+	unsigned int next; /* first upstream checked by the balancing */
+	proxy_cache_t *cache;
+};
+
+typedef enum
+{
+	PROXY_BODY,
+	PROXY_HEADER,
+	PROXY_CONTENT,
+	PROXY_END,
+	PROXY_FAILED,
+	PROXY_ABORTED,
+	PROXY_UPGRADE,
+	PROXY_TUNNEL,
+} _proxy_state_e;
+
+typedef struct proxy_client_s proxy_client_t;
+typedef struct proxy_request_s proxy_request_t;
+struct proxy_request_s
+{
+	proxy_client_t *client;
+	proxy_upstream_t *upstream;
+	unsigned int tried;
+	http_message_t *request;
+	http_message_t *response;
+	fetch_request_t *fetch; /* NULL after the complete callback */
+	fetch_error_e error;
+	_proxy_state_e state;
+	int form; /* the content is stored with the query */
+	int upgrade; /* the client asks to change the protocol */
+	int started; /* the header of the response is sent to the client */
+	int released; /* the complete callback frees the request */
+	int sock; /* the destination of a tunnel */
+	time_t deadline; /* end of the connection of a tunnel */
+	char *content; /* the request content for the upstream */
+	int contentlength;
+	int contentsize;
+	char *data; /* the response content not yet sent to the client */
+	int offset;
+	int datalength;
+	int datasize;
+	proxy_cachectx_t cache;
+	proxy_request_t *next;
+};
+
+/**
+ * the requests of one client share the connections of its fetch client
+ */
+struct proxy_client_s
+{
+	proxy_t *proxy;
+	fetch_t *fetch;
+	proxy_request_t *requests;
+};
+
+/**
+ * the headers of one connection, they are not forwarded
+ */
+static const char *_proxy_hopbyhop[] =
+{
+	"Connection",
+	"Keep-Alive",
+	"Proxy-Connection",
+	"Proxy-Authenticate",
+	"Proxy-Authorization",
+	"TE",
+	"Trailer",
+	"Transfer-Encoding",
+	"Upgrade",
+	"Expect",
+	"Content-Length",
+	NULL,
+};
+
+static const proxy_config_t _proxy_defaultconfig =
+{
+	.poolsize = PROXY_POOLSIZE,
+	.timeout = PROXY_TIMEOUT,
+	.idletime = PROXY_IDLETIME,
+	.maxfails = PROXY_MAXFAILS,
+	.ejecttime = PROXY_EJECTTIME,
+	.cacheentries = PROXY_CACHEENTRIES,
+	.cachemaxlength = PROXY_CACHEMAXLENGTH,
+};
+
+static int _proxy_forwarded(const char *name, const char *connection)
+{
+	int i;
+	for (i = 0; _proxy_hopbyhop[i] != NULL; i++)
+	{
+		if (!strcasecmp(name, _proxy_hopbyhop[i]))
+			return 0;
+	}
+	/**
+	 * the Connection header lists the other headers of the connection
+	 */
+	if (connection != NULL && httpmessage_quality(connection, name) >= 0)
+		return 0;
+	return 1;
+}
+
+/**
+ * @brief select the upstream with the least requests in progress
+ *
+ * The ejected upstreams are used only if all the others are ejected too.
+ * The search starts after the previous choice to share the load between
+ * upstreams with the same count.
+ */
+static proxy_upstream_t *_proxy_balance(proxy_t *proxy, unsigned int tried)
+{
+	time_t now = time(NULL);
+	proxy_upstream_t *best = NULL;
+	int bestload = 0;
+	unsigned int start = __atomic_fetch_add(&proxy->next, 1, __ATOMIC_RELAXED);
+	int pass;
+	for (pass = 0; pass < 2 && best == NULL; pass++)
+	{
+		int i;
+		for (i = 0; i < proxy->nupstreams; i++)
+		{
+			int index = (start + i) % proxy->nupstreams;
+			proxy_upstream_t *upstream = &proxy->upstreams[index];
+			if (tried & (1U << index))
+				continue;
+			if (pass == 0 && upstream->stats->ejected > now)
+				continue;
+			int load = __atomic_load_n(&upstream->stats->outstanding, __ATOMIC_RELAXED);
+			if (best == NULL || load < bestload)
+			{
+				best = upstream;
+				bestload = load;
+			}
+		}
+	}
+	return best;
+}
+
+static void _proxy_failed(proxy_t *proxy, proxy_upstream_t *upstream)
+{
+	if (__atomic_add_fetch(&upstream->stats->failures, 1, __ATOMIC_RELAXED) >= proxy->config.maxfails)
+	{
+		warn("proxy: %s ejected for %d seconds", upstream->name, proxy->config.ejecttime);
+		upstream->stats->ejected = time(NULL) + proxy->config.ejecttime;
+		__atomic_store_n(&upstream->stats->failures, 0, __ATOMIC_RELAXED);
+	}
+}
+
+/**
+ * @brief build the URL of the request for the upstream
+ *
+ * The path is encoded again, the query is kept as received.
+ */
+static char *_proxy_url(proxy_upstream_t *upstream, http_message_t *request)
+{
+	static const char hexa[] = "0123456789ABCDEF";
+	static const char allowed[] = "-._~!$&'()*+,;=:@/";
+	const char *uri = httpmessage_REQUEST(request, "uri");
+	const char *query = httpmessage_REQUEST(request, "query");
+	int querylength = (query != NULL)? strlen(query) : 0;
+	char *url = malloc(sizeof("http://") + strlen(upstream->name) + 1 + 3 * strlen(uri) + 1 + querylength);
+	if (url == NULL)
+		return NULL;
+	int length = sprintf(url, "http://%s", upstream->name);
+	if (uri[0] != '/')
+		url[length++] = '/';
+	for (; *uri != '\0'; uri++)
+	{
+		if ((*uri >= 'a' && *uri <= 'z') ||
+			(*uri >= 'A' && *uri <= 'Z') ||
+			(*uri >= '0' && *uri <= '9') ||
+			strchr(allowed, *uri) != NULL)
+			url[length++] = *uri;
+		else
+		{
+			url[length++] = '%';
+			url[length++] = hexa[(unsigned char)*uri >> 4];
+			url[length++] = hexa[*uri & 0x0F];
+		}
+	}
+	if (querylength > 0)
+	{
+		url[length++] = '?';
+		memcpy(url + length, query, querylength);
+		length += querylength;
+	}
+	url[length] = '\0';
+	return url;
+}
+
+/**
+ * @brief set the headers of the request for the upstream
+ */
+static int _proxy_headers(proxy_request_t *preq, fetch_request_t *freq)
+{
+	proxy_t *proxy = preq->client->proxy;
+	http_message_t *request = preq->request;
+	int ret = ESUCCESS;
+	const char *connection = httpmessage_header_id(request, HDR_CONNECTION);
+	const char *forwarded = NULL;
+	const char *name = NULL;
+	const char *value;
+	int it = 0;
+	while ((value = httpmessage_headers(request, &it, &name)) != NULL && ret == ESUCCESS)
+	{
+		if (!_proxy_forwarded(name, connection))
+			continue;
+		if (!strcasecmp(name, "X-Forwarded-For"))
+		{
+			forwarded = value;
+			continue;
+		}
+		ret = fetch_addheader(freq, name, value);
+	}
+	const char *remote = httpmessage_REQUEST(request, "remote_addr");
+	if (forwarded != NULL)
+	{
+		char *list = malloc(strlen(forwarded) + 2 + strlen(remote) + 1);
+		if (list == NULL)
+			return EREJECT;
+		sprintf(list, "%s, %s", forwarded, remote);
+		if (ret == ESUCCESS)
+			ret = fetch_addheader(freq, "X-Forwarded-For", list);
+		free(list);
+	}
+	else if (ret == ESUCCESS)
+		ret = fetch_addheader(freq, "X-Forwarded-For", remote);
+	if (ret == ESUCCESS)
+		ret = fetch_addheader(freq, "X-Forwarded-Proto", httpmessage_REQUEST(request, "scheme"));
+	if (ret == ESUCCESS && preq->upgrade)
+	{
+		ret = fetch_addheader(freq, "Upgrade", httpmessage_header_id(request, HDR_UPGRADE));
+		if (ret == ESUCCESS)
+			ret = fetch_addheader(freq, "Connection", "Upgrade");
+	}
+	else if (ret == ESUCCESS && proxy->config.poolsize <= 0)
+		ret = fetch_addheader(freq, "Connection", "close");
+	if (ret == ESUCCESS && preq->contentlength > 0)
+		ret = fetch_setcontent(freq, NULL, preq->content, preq->contentlength);
+	return ret;
+}
+
+static int _proxy_response(void *arg, fetch_request_t *freq, int status);
+static int _proxy_content(void *arg, fetch_request_t *freq, const char *data, int length);
+static void _proxy_complete(void *arg, fetch_request_t *freq, fetch_error_e error);
+
+static const fetch_ops_t _proxy_fetchops =
+{
+	.response = _proxy_response,
+	.content = _proxy_content,
+	.complete = _proxy_complete,
+};
+
+/**
+ * @brief send the request to the next upstream
+ *
+ * The request is queued into the fetch client of the connection, it is
+ * sent by the next fetch_run.
+ */
+static int _proxy_send(proxy_request_t *preq)
+{
+	proxy_client_t *client = preq->client;
+	proxy_t *proxy = client->proxy;
+	if (client->fetch == NULL)
+		client->fetch = fetch_create(&proxy->fetch);
+	if (client->fetch == NULL)
+		return EREJECT;
+	proxy_upstream_t *upstream = _proxy_balance(proxy, preq->tried);
+	if (upstream == NULL)
+		return EREJECT;
+	preq->tried |= 1U << (upstream - proxy->upstreams);
+	char *url = _proxy_url(upstream, preq->request);
+	if (url == NULL)
+		return EREJECT;
+	fetch_request_t *freq = fetch_request(client->fetch, httpmessage_REQUEST(preq->request, "method"),
+					url, &_proxy_fetchops, preq);
+	free(url);
+	if (freq == NULL)
+		return EREJECT;
+	__atomic_add_fetch(&upstream->stats->outstanding, 1, __ATOMIC_RELAXED);
+	preq->upstream = upstream;
+	preq->fetch = freq;
+	preq->state = PROXY_HEADER;
+	if (_proxy_headers(preq, freq) != ESUCCESS)
+	{
+		/**
+		 * the complete callback is called by the cancel
+		 */
+		fetch_cancel(freq);
+		return ESUCCESS;
+	}
+	fetch_send(freq);
+	return ESUCCESS;
+}
+
+/**
+ * @brief free the request
+ *
+ * The request is freed by the complete callback if the fetch client
+ * still uses it.
+ */
+static void _proxy_release(proxy_request_t *preq, int complete)
+{
+	proxy_client_t *client = preq->client;
+	proxy_request_t **it = &client->requests;
+	while (*it != NULL && *it != preq)
+		it = &(*it)->next;
+	if (*it != NULL)
+		*it = preq->next;
+	if (preq->upstream != NULL)
+		__atomic_sub_fetch(&preq->upstream->stats->outstanding, 1, __ATOMIC_RELAXED);
+	preq->upstream = NULL;
+	_proxycache_end(client->proxy->cache, &preq->cache, complete);
+	if (preq->sock >= 0)
+		close(preq->sock);
+	preq->sock = -1;
+	free(preq->content);
+	preq->content = NULL;
+	if (preq->fetch != NULL)
+	{
+		preq->released = 1;
+		fetch_cancel(preq->fetch);
+		return;
+	}
+	free(preq->data);
+	free(preq);
+}
+
+/**
+ * @brief set the response with the header of the upstream
+ */
+static int _proxy_response(void *arg, fetch_request_t *freq, int status)
+{
+	proxy_request_t *preq = (proxy_request_t *)arg;
+	proxy_t *proxy = preq->client->proxy;
+	http_message_t *request = preq->request;
+	http_message_t *response = preq->response;
+	const char *connection = fetch_header(freq, "Connection");
+	const char *type = NULL;
+	const char *names[PROXY_MAXHEADERS];
+	const char *values[PROXY_MAXHEADERS];
+	int nheaders = 0;
+	const char *name = NULL;
+	const char *value;
+	int it = 0;
+
+	httpmessage_result(response, status);
+	while ((value = fetch_headers(freq, &it, &name)) != NULL)
+	{
+		if (!strcasecmp(name, "Content-Type"))
+		{
+			type = value;
+			continue;
+		}
+		/**
+		 * the server sets its own Server and Date headers
+		 */
+		if (!strcasecmp(name, "Server") || !strcasecmp(name, "Date"))
+			continue;
+		if (!_proxy_forwarded(name, connection))
+			continue;
+		if (nheaders == PROXY_MAXHEADERS)
+		{
+			warn("proxy: header %s dropped", name);
+			continue;
+		}
+		httpmessage_addheader(response, name, value);
+		names[nheaders] = name;
+		values[nheaders] = value;
+		nheaders++;
+	}
+	if (status == 101)
+	{
+		/**
+		 * the connection is relayed after the response, the data
+		 * already received from the upstream are sent first
+		 */
+		const char *upgrade = fetch_header(freq, "Upgrade");
+		if (!preq->upgrade || upgrade == NULL)
+			return EREJECT;
+		httpmessage_addheader(response, "Upgrade", upgrade);
+		httpmessage_addheader(response, "Connection", "Upgrade");
+		const char *data = NULL;
+		int length = 0;
+		int sock = fetch_detach(freq, &data, &length);
+		if (sock < 0)
+			return EREJECT;
+		if (httpclient_relay(httpmessage_client(request), sock, data, length) != ESUCCESS)
+		{
+			close(sock);
+			return EREJECT;
+		}
+		httpmessage_lock(response);
+		preq->state = PROXY_UPGRADE;
+		return ESUCCESS;
+	}
+	_proxycache_store(proxy->cache, &preq->cache, status, type, names, values, nheaders, request);
+	__atomic_store_n(&preq->upstream->stats->failures, 0, __ATOMIC_RELAXED);
+
+	const char *length = fetch_header(freq, "Content-Length");
+	const char *encoding = fetch_header(freq, "Transfer-Encoding");
+	unsigned long long contentlength = (length != NULL)? strtoull(length, NULL, 10) : 0;
+	const char *method = httpmessage_REQUEST(request, "method");
+	if (!strcmp(method, str_head) || status == 204 || status == 304)
+	{
+		if (length != NULL && status != 204 && status != 304)
+			httpmessage_addcontent(response, (type != NULL)? type : "none", NULL,
+					(contentlength <= INT_MAX)? (int)contentlength : -1);
+	}
+	else
+	{
+		/**
+		 * the Content-Length is kept if it is possible
+		 */
+		int chunked = (encoding != NULL && strcasestr(encoding, "chunked") != NULL);
+		httpmessage_addcontent(response, (type != NULL)? type : "none", NULL,
+				(length != NULL && !chunked && contentlength <= INT_MAX)? (int)contentlength : -1);
+	}
+	preq->state = PROXY_CONTENT;
+	return ESUCCESS;
+}
+
+/**
+ * @brief keep the upstream content until the client sends it
+ *
+ * The connection to the upstream is not read while the client has too
+ * much to send.
+ */
+static int _proxy_content(void *arg, fetch_request_t *freq, const char *data, int length)
+{
+	proxy_request_t *preq = (proxy_request_t *)arg;
+	proxy_t *proxy = preq->client->proxy;
+	if (preq->offset > 0)
+	{
+		memmove(preq->data, preq->data + preq->offset, preq->datalength - preq->offset);
+		preq->datalength -= preq->offset;
+		preq->offset = 0;
+	}
+	if (preq->datalength + length > preq->datasize)
+	{
+		int size = preq->datalength + length;
+		if (size < PROXY_BUFFERSIZE)
+			size = PROXY_BUFFERSIZE;
+		char *buffer = realloc(preq->data, size);
+		if (buffer == NULL)
+			return EREJECT;
+		preq->data = buffer;
+		preq->datasize = size;
+	}
+	memcpy(preq->data + preq->datalength, data, length);
+	preq->datalength += length;
+	_proxycache_write(proxy->cache, &preq->cache, data, length);
+	/**
+	 * the timeout is the maximum delay between two parts of the content
+	 */
+	fetch_deadline(freq, proxy->config.timeout);
+	if (preq->datalength >= PROXY_BUFFERSIZE)
+		return ESPACE;
+	return ESUCCESS;
+}
+
+static void _proxy_complete(void *arg, fetch_request_t *freq, fetch_error_e error)
+{
+	proxy_request_t *preq = (proxy_request_t *)arg;
+	preq->fetch = NULL;
+	preq->error = error;
+	if (preq->released)
+	{
+		free(preq->data);
+		free(preq);
+		return;
+	}
+	if (preq->state == PROXY_HEADER)
+		preq->state = PROXY_FAILED;
+	else if (preq->state == PROXY_CONTENT)
+		preq->state = (error == FETCH_OK)? PROXY_END : PROXY_ABORTED;
+	if (error != FETCH_OK && preq->upstream != NULL)
+		err("proxy: %s error %d", preq->upstream->name, error);
+}
+
+static proxy_request_t *_proxy_open(proxy_client_t *client, http_message_t *request, http_message_t *response, proxy_cachectx_t *cache)
+{
+	proxy_t *proxy = client->proxy;
+	proxy_request_t *preq = calloc(1, sizeof(*preq));
+	if (preq == NULL)
+	{
+		_proxycache_end(proxy->cache, cache, 0);
+		return NULL;
+	}
+	preq->client = client;
+	preq->request = request;
+	preq->response = response;
+	preq->sock = -1;
+	preq->cache = *cache;
+	const char *type = httpmessage_header_id(request, HDR_CONTENT_TYPE);
+	preq->form = (type != NULL && !strncasecmp(type, str_form_urlencoded, strlen(str_form_urlencoded)));
+	const char *connection = httpmessage_header_id(request, HDR_CONNECTION);
+	preq->upgrade = (httpmessage_header_id(request, HDR_UPGRADE) != NULL &&
+					connection != NULL && httpmessage_quality(connection, "upgrade") >= 0);
+	preq->next = client->requests;
+	client->requests = preq;
+	return preq;
+}
+
+/**
+ * @brief keep the next part of the request content
+ *
+ * The chunks of the client are already decoded, the content is sent
+ * with its length after its reception.
+ *
+ * @return EINCOMPLETE while the content is received, ESUCCESS or EREJECT
+ */
+static int _proxy_body(proxy_request_t *preq, http_message_t *request)
+{
+	char *data = NULL;
+	unsigned long long rest = 0;
+	int size = httpmessage_content(request, &data, &rest);
+	if (preq->form && size > 0)
+	{
+		/**
+		 * the parser stores the form after the query
+		 */
+		const char *query = httpmessage_REQUEST(request, "query");
+		int skip = (query != NULL && query[0] != '\0')? strlen(query) + 1: 0;
+		data += skip;
+		size -= (size > skip)? skip : size;
+		rest = 0;
+	}
+	if (size > 0)
+	{
+		if (preq->contentlength + size > PROXY_MAXCONTENT)
+		{
+			err("proxy: request content too large");
+			return EREJECT;
+		}
+		if (preq->contentlength + size > preq->contentsize)
+		{
+			int contentsize = (preq->contentsize > 0)? preq->contentsize * 2 : PROXY_BUFFERSIZE;
+			while (contentsize < preq->contentlength + size)
+				contentsize *= 2;
+			char *content = realloc(preq->content, contentsize);
+			if (content == NULL)
+				return EREJECT;
+			preq->content = content;
+			preq->contentsize = contentsize;
+		}
+		memcpy(preq->content + preq->contentlength, data, size);
+		preq->contentlength += size;
+	}
+	if (size == EINCOMPLETE || rest > 0)
+		return EINCOMPLETE;
+	return ESUCCESS;
+}
+
+/**
+ * @brief append the content of the upstream to the response
+ *
+ * @return the length appended or EREJECT
+ */
+static int _proxy_flush(proxy_request_t *preq)
+{
+	int length = preq->datalength - preq->offset;
+	/**
+	 * the data is appended after the header, the Content-Length of
+	 * the header is not changed
+	 */
+	if (length == 0 || !preq->started)
+		return 0;
+	/**
+	 * the data is appended when the previous one has been sent
+	 */
+	int space = httpmessage_appendcontent(preq->response, NULL, 0);
+	if (space <= 0)
+		return 0;
+	if (length > space)
+		length = space;
+	if (httpmessage_appendcontent(preq->response, preq->data + preq->offset, length) == EREJECT)
+		return EREJECT;
+	preq->offset += length;
+	if (preq->offset == preq->datalength)
+	{
+		preq->offset = 0;
+		preq->datalength = 0;
+	}
+	if (preq->fetch != NULL && preq->datalength < PROXY_BUFFERSIZE)
+	{
+		fetch_deadline(preq->fetch, preq->client->proxy->config.timeout);
+		fetch_resume(preq->fetch);
+	}
+	return length;
+}
+
+/**
+ * @brief wait the upstream outside of the connector
+ *
+ * The client calls the connector again when the socket of the
+ * upstream is ready, or after its own timer to check the deadline.
+ */
+static int _proxy_wait(proxy_request_t *preq)
+{
+	short events = 0;
+	int sock = -1;
+	if (preq->fetch != NULL)
+		sock = fetch_socket(preq->fetch, &events);
+	if (sock < 0 || events == 0)
+		return EINCOMPLETE;
+	httpmessage_source(preq->response, sock, events);
+	return ESOURCE;
+}
+
+static int _proxy_resolve(struct sockaddr_storage *addr, socklen_t *addrlen, const char *name);
+
+/**
+ * @brief check the authority of a CONNECT request with the tunnels
+ */
+static int _proxy_tunnelallowed(proxy_t *proxy, const char *authority)
+{
+	const char *port = strrchr(authority, ':');
+	if (port == NULL)
+		return 0;
+	int i;
+	for (i = 0; proxy->config.tunnels[i] != NULL; i++)
+	{
+		const char *tunnel = proxy->config.tunnels[i];
+		if (tunnel[0] == '*' && !strcmp(tunnel + 1, port))
+			return 1;
+		if (!strcasecmp(tunnel, authority))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief relay the tunnel when its connection is established
+ *
+ * The library relays the connection of the client to the destination
+ * after the response, the proxy does not read the data.
+ */
+static int _proxy_tunnelconnect(proxy_request_t *preq, http_message_t *request, http_message_t *response)
+{
+	struct pollfd pfd = {.fd = preq->sock, .events = POLLOUT};
+	int error = ETIMEDOUT;
+	if (poll(&pfd, 1, 0) > 0)
+	{
+		socklen_t length = sizeof(error);
+		getsockopt(preq->sock, SOL_SOCKET, SO_ERROR, &error, &length);
+	}
+	else if (time(NULL) < preq->deadline)
+	{
+		httpmessage_source(response, preq->sock, POLLOUT);
+		return ESOURCE;
+	}
+	if (error != 0)
+	{
+		err("proxy: tunnel to %s %s", httpmessage_REQUEST(request, "uri"), strerror(error));
+		httpmessage_result(response, (error == ETIMEDOUT)? RESULT_504 : RESULT_502);
+		_proxy_release(preq, 0);
+		return ESUCCESS;
+	}
+	if (httpclient_relay(httpmessage_client(request), preq->sock, NULL, 0) != ESUCCESS)
+	{
+		httpmessage_result(response, RESULT_502);
+		_proxy_release(preq, 0);
+		return ESUCCESS;
+	}
+	preq->sock = -1;
+	httpmessage_lock(response);
+	proxy_dbg("proxy: tunnel to %s", httpmessage_REQUEST(request, "uri"));
+	httpmessage_result(response, RESULT_200);
+	_proxy_release(preq, 1);
+	return ESUCCESS;
+}
+
+/**
+ * @brief open the tunnel of a CONNECT request
+ *
+ * The connection is not blocking, the client waits it outside of the
+ * connector.
+ */
+static int _proxy_tunnel(proxy_client_t *client, http_message_t *request, http_message_t *response)
+{
+	proxy_t *proxy = client->proxy;
+	const char *authority = httpmessage_REQUEST(request, "uri");
+	if (authority == NULL || !_proxy_tunnelallowed(proxy, authority))
+	{
+		warn("proxy: tunnel to %s refused", authority);
+		httpmessage_result(response, RESULT_403);
+		return ESUCCESS;
+	}
+	struct sockaddr_storage addr;
+	socklen_t addrlen = 0;
+	int sock = -1;
+	if (_proxy_resolve(&addr, &addrlen, authority) == ESUCCESS)
+		sock = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sock >= 0 && connect(sock, (struct sockaddr *)&addr, addrlen) < 0 && errno != EINPROGRESS)
+	{
+		err("proxy: tunnel to %s %s", authority, strerror(errno));
+		close(sock);
+		sock = -1;
+	}
+	if (sock < 0)
+	{
+		httpmessage_result(response, RESULT_502);
+		return ESUCCESS;
+	}
+	int nodelay = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	proxy_cachectx_t cache;
+	_proxycache_init(&cache);
+	proxy_request_t *preq = _proxy_open(client, request, response, &cache);
+	if (preq == NULL)
+	{
+		close(sock);
+		httpmessage_result(response, RESULT_502);
+		return ESUCCESS;
+	}
+	preq->sock = sock;
+	preq->deadline = time(NULL) + (proxy->config.timeout + 999) / 1000;
+	preq->state = PROXY_TUNNEL;
+	httpmessage_private(response, preq);
+	return _proxy_tunnelconnect(preq, request, response);
+}
+
+static int _proxy_connector(void *arg, http_message_t *request, http_message_t *response)
+{
+	proxy_client_t *client = (proxy_client_t *)arg;
+	proxy_t *proxy = client->proxy;
+	proxy_request_t *preq = httpmessage_private(response, NULL);
+	if (preq == NULL)
+	{
+		if (proxy->config.tunnels != NULL &&
+			!strcmp(httpmessage_REQUEST(request, "method"), "CONNECT"))
+			return _proxy_tunnel(client, request, response);
+		const char *uri = httpmessage_REQUEST(request, "uri");
+		if (uri == NULL || (proxy->config.prefix != NULL &&
+			strncmp(uri, proxy->config.prefix, proxy->prefixlength)))
+			return EREJECT;
+		proxy_cachectx_t cache;
+		_proxycache_init(&cache);
+		if (_proxycache_lookup(proxy->cache, &cache, request, response) == PROXYCACHE_HIT)
+			return ESUCCESS;
+		preq = _proxy_open(client, request, response, &cache);
+		if (preq == NULL)
+		{
+			httpmessage_result(response, RESULT_502);
+			return ESUCCESS;
+		}
+		httpmessage_private(response, preq);
+	}
+
+	if (preq->state == PROXY_TUNNEL)
+		return _proxy_tunnelconnect(preq, request, response);
+	if (preq->state == PROXY_BODY)
+	{
+		int ret = _proxy_body(preq, request);
+		if (ret == EINCOMPLETE)
+			return EINCOMPLETE;
+		if (ret != ESUCCESS)
+		{
+			httpmessage_result(response, RESULT_413);
+			_proxy_release(preq, 0);
+			return ESUCCESS;
+		}
+		if (_proxy_send(preq) != ESUCCESS)
+		{
+			httpmessage_result(response, RESULT_502);
+			_proxy_release(preq, 0);
+			return ESUCCESS;
+		}
+	}
+	if (_proxy_flush(preq) == EREJECT)
+		preq->state = PROXY_ABORTED;
+	if (preq->fetch != NULL)
+		fetch_run(client->fetch, 0);
+	if (preq->state == PROXY_FAILED)
+	{
+		/**
+		 * the request is sent to another upstream if the first one is
+		 * not reachable, the upstream may have received it otherwise.
+		 */
+		_proxy_failed(proxy, preq->upstream);
+		__atomic_sub_fetch(&preq->upstream->stats->outstanding, 1, __ATOMIC_RELAXED);
+		preq->upstream = NULL;
+		if (preq->error == FETCH_ECONNECT && _proxy_send(preq) == ESUCCESS)
+			return EINCOMPLETE;
+		httpmessage_result(response, (preq->error == FETCH_ETIMEOUT)? RESULT_504 : RESULT_502);
+		_proxy_release(preq, 0);
+		return ESUCCESS;
+	}
+
+	int ret = EINCOMPLETE;
+	switch (preq->state)
+	{
+	case PROXY_BODY:
+	case PROXY_FAILED:
+	case PROXY_TUNNEL:
+	break;
+	case PROXY_HEADER:
+		ret = _proxy_wait(preq);
+	break;
+	case PROXY_UPGRADE:
+		_proxy_release(preq, 1);
+		return ESUCCESS;
+	case PROXY_CONTENT:
+	case PROXY_END:
+		if (_proxy_flush(preq) == EREJECT)
+		{
+			preq->state = PROXY_ABORTED;
+			ret = ECONTINUE;
+		}
+		else if (preq->state == PROXY_END && preq->datalength == 0)
+		{
+			_proxy_release(preq, 1);
+			return ESUCCESS;
+		}
+		else if (!preq->started || preq->datalength > 0)
+		{
+			/**
+			 * the client sends the header or the content before the
+			 * next call
+			 */
+			preq->started = 1;
+			ret = ECONTINUE;
+		}
+		else
+			ret = _proxy_wait(preq);
+	break;
+	case PROXY_ABORTED:
+		ret = ECONTINUE;
+	break;
+	}
+	if (preq->state == PROXY_ABORTED && preq->upstream != NULL)
+	{
+		/**
+		 * the header is already sent, the client must detect the error
+		 * with the end of the connection.
+		 */
+		if (preq->fetch != NULL)
+			fetch_cancel(preq->fetch);
+		else if (preq->error != FETCH_OK && preq->error != FETCH_ECANCEL)
+			_proxy_failed(proxy, preq->upstream);
+		__atomic_sub_fetch(&preq->upstream->stats->outstanding, 1, __ATOMIC_RELAXED);
+		preq->upstream = NULL;
+		httpclient_shutdown(httpmessage_client(request));
+	}
+	return ret;
+}
+
+static void *_proxy_getctx(void *arg, http_client_t *clt, struct sockaddr *addr, int addrsize)
+{
+	proxy_client_t *client = calloc(1, sizeof(*client));
+	if (client == NULL)
+		return NULL;
+	client->proxy = (proxy_t *)arg;
+	httpclient_addconnector(clt, _proxy_connector, client, CONNECTOR_DOCUMENT, "proxy");
+	return client;
+}
+
+static void _proxy_freectx(void *arg)
+{
+	proxy_client_t *client = (proxy_client_t *)arg;
+	/**
+	 * the requests still there are not complete
+	 */
+	while (client->requests != NULL)
+		_proxy_release(client->requests, 0);
+	if (client->fetch != NULL)
+		fetch_destroy(client->fetch);
+	free(client);
+}
+
+static int _proxy_resolve(struct sockaddr_storage *addr, socklen_t *addrlen, const char *name)
+{
+	char host[NI_MAXHOST];
+	const char *port = strrchr(name, ':');
+	if (port == NULL || port - name >= (int)sizeof(host))
+		return EREJECT;
+	int length = port - name;
+	/**
+	 * IPv6 address as "[::1]:8080"
+	 */
+	if (name[0] == '[' && port[-1] == ']')
+	{
+		name++;
+		length -= 2;
+	}
+	memcpy(host, name, length);
+	host[length] = '\0';
+	struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM};
+	struct addrinfo *result = NULL;
+	int ret = getaddrinfo(host, port + 1, &hints, &result);
+	if (ret != 0 || result == NULL)
+	{
+		err("proxy: %s %s", host, gai_strerror(ret));
+		return EREJECT;
+	}
+	memcpy(addr, result->ai_addr, result->ai_addrlen);
+	*addrlen = result->ai_addrlen;
+	freeaddrinfo(result);
+	return ESUCCESS;
+}
+
+proxy_t *proxy_create(http_server_t *server, const proxy_config_t *config)
+{
+	if (config == NULL || config->upstreams == NULL || config->upstreams[0] == NULL)
+		return NULL;
+	proxy_t *proxy = calloc(1, sizeof(*proxy));
+	if (proxy == NULL)
+		return NULL;
+	proxy->config = *config;
+	if (proxy->config.timeout <= 0)
+		proxy->config.timeout = _proxy_defaultconfig.timeout;
+	if (proxy->config.idletime <= 0)
+		proxy->config.idletime = _proxy_defaultconfig.idletime;
+	if (proxy->config.maxfails <= 0)
+		proxy->config.maxfails = _proxy_defaultconfig.maxfails;
+	if (proxy->config.ejecttime <= 0)
+		proxy->config.ejecttime = _proxy_defaultconfig.ejecttime;
+	if (proxy->config.cacheentries <= 0)
+		proxy->config.cacheentries = _proxy_defaultconfig.cacheentries;
+	if (proxy->config.cachemaxlength <= 0)
+		proxy->config.cachemaxlength = _proxy_defaultconfig.cachemaxlength;
+	if (proxy->config.prefix != NULL)
+		proxy->prefixlength = strlen(proxy->config.prefix);
+	proxy->fetch.maxconnections = proxy->config.poolsize;
+	proxy->fetch.pipeline = 1;
+	proxy->fetch.timeout = proxy->config.timeout;
+	proxy->fetch.idletime = proxy->config.idletime;
+
+	int nupstreams = 0;
+	while (config->upstreams[nupstreams] != NULL)
+		nupstreams++;
+	if (nupstreams > PROXY_MAXUPSTREAMS)
+	{
+		warn("proxy: only %d upstreams are used", PROXY_MAXUPSTREAMS);
+		nupstreams = PROXY_MAXUPSTREAMS;
+	}
+	proxy->upstreams = calloc(nupstreams, sizeof(*proxy->upstreams));
+	/**
+	 * the counters are shared by the processes of the server
+	 */
+	proxy->stats = mmap(NULL, nupstreams * sizeof(*proxy->stats), PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	proxy->nstats = nupstreams;
+	if (proxy->upstreams == NULL || proxy->stats == MAP_FAILED)
+	{
+		if (proxy->stats != MAP_FAILED)
+			munmap(proxy->stats, nupstreams * sizeof(*proxy->stats));
+		free(proxy->upstreams);
+		free(proxy);
+		return NULL;
+	}
+	int i;
+	for (i = 0; i < nupstreams; i++)
+	{
+		proxy_upstream_t *upstream = &proxy->upstreams[proxy->nupstreams];
+		struct sockaddr_storage addr;
+		socklen_t addrlen;
+		if (_proxy_resolve(&addr, &addrlen, config->upstreams[i]) != ESUCCESS)
+			continue;
+		upstream->name = config->upstreams[i];
+		upstream->stats = &proxy->stats[proxy->nupstreams];
+		proxy->nupstreams++;
+	}
+	if (proxy->nupstreams == 0)
+	{
+		proxy_destroy(proxy);
+		return NULL;
+	}
+	if (proxy->config.cachedir != NULL)
+	{
+		proxy->cache = _proxycache_create(proxy->config.cachedir, proxy->config.cacheentries,
+						proxy->config.cachemaxlength, proxy->config.timeout);
+		if (proxy->cache == NULL)
+			warn("proxy: cache disabled");
+	}
+	if (proxy->config.tunnels != NULL)
+		httpserver_addmethod(server, "CONNECT", MESSAGE_AUTHORITY);
+	httpserver_addmod(server, _proxy_getctx, _proxy_freectx, proxy, "proxy");
+	return proxy;
+}
+
+void proxy_destroy(proxy_t *proxy)
+{
+	munmap(proxy->stats, proxy->nstats * sizeof(*proxy->stats));
+	if (proxy->cache != NULL)
+		_proxycache_destroy(proxy->cache);
+	free(proxy->upstreams);
+	free(proxy);
+}
@@ -0,0 +1,8 @@
+lib-$(SHARED)+=ouiproxy
+slib-$(STATIC)+=ouiproxy
+ouiproxy_SOURCES=proxy.c proxycache.c
+ouiproxy_CFLAGS+=-I../include/ouistiti
+ouiproxy_PKGCONFIG:=ouistiti
+ouiproxy_LIBS+=ouifetch
+
+ouiproxy_CFLAGS-$(DEBUG)+=-g -DDEBUG
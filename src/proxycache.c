@@ -0,0 +1,791 @@
+/*****************************************************************************
+ * proxycache.c: disk cache of the reverse proxy
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "httpserver.h"
+#include "_proxycache.h"
+
+#define proxycache_dbg(...)
+
+#define PROXYCACHE_MAGIC 0x6f756943
+#define PROXYCACHE_VERSION 2
+/**
+ * an URI is searched into the PROXYCACHE_PROBES entries after its hash
+ */
+#define PROXYCACHE_PROBES 8
+/**
+ * the status line and the headers of a file are read at once
+ */
+#define PROXYCACHE_HEADERMAX 8192
+/**
+ * the responses of the longer URIs are not stored
+ */
+#define PROXYCACHE_NAMEMAX 2048
+/**
+ * milliseconds between two lookups of a request waiting another one
+ */
+#define PROXYCACHE_POLL 10
+/**
+ * the lookup waits the end of the storage by another request
+ */
+#define PROXYCACHE_WAIT (PROXYCACHE_FILL + 1)
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct proxy_cacheentry_s proxy_cacheentry_t;
+struct proxy_cacheentry_s
+{
+	uint64_t key; /* hash of the URI, 0 for a free entry */
+	uint64_t vary; /* hash of the request headers listed into varynames */
+	uint64_t filler; /* the request which stores the response, 0 without */
+	int64_t filling; /* last activity of the filler */
+	int64_t stored;
+	int64_t expires;
+	int64_t stale;
+	int64_t used;
+	uint64_t length;
+	uint32_t headerlength;
+	uint32_t generation; /* the version of the file */
+	int32_t lock;
+	int32_t valid;
+	char varynames[PROXYCACHE_VARYMAX];
+};
+
+typedef struct proxy_cacheindex_s proxy_cacheindex_t;
+struct proxy_cacheindex_s
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nentries;
+	uint32_t entrysize;
+	proxy_cacheentry_t entries[];
+};
+
+struct proxy_cache_s
+{
+	char *directory;
+	proxy_cacheindex_t *index;
+	size_t size;
+	int nentries;
+	unsigned long long maxlength;
+	int timeout;
+	uint32_t counter;
+};
+
+static void _proxycache_lock(proxy_cacheentry_t *entry)
+{
+	while (__atomic_exchange_n(&entry->lock, 1, __ATOMIC_ACQUIRE))
+		sched_yield();
+}
+
+static void _proxycache_unlock(proxy_cacheentry_t *entry)
+{
+	__atomic_store_n(&entry->lock, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief add a string and its terminator to a FNV-1a hash
+ */
+static uint64_t _proxycache_hash(uint64_t hash, const char *data)
+{
+	do
+	{
+		hash ^= (unsigned char)*data;
+		hash *= FNV_PRIME;
+	} while (*data++ != '\0');
+	return hash;
+}
+
+/**
+ * @brief return a header of the request received from the client
+ */
+static const char *_proxycache_header(http_message_t *request, const char *key)
+{
+	const char *name = NULL;
+	const char *value;
+	int it = 0;
+	while ((value = httpmessage_headers(request, &it, &name)) != NULL)
+	{
+		if (!strcasecmp(name, key))
+			return value;
+	}
+	return NULL;
+}
+
+/**
+ * @brief search a directive of a Cache-Control or Pragma value
+ *
+ * @param value	the list of directives
+ * @param name	the directive to search
+ * @param number	set with the value of the directive if it exists
+ *
+ * @return 1 if the directive is present, 0 otherwise
+ */
+static int _proxycache_directive(const char *value, const char *name, long *number)
+{
+	int length = strlen(name);
+	while (value != NULL && *value != '\0')
+	{
+		while (*value == ' ' || *value == '\t' || *value == ',')
+			value++;
+		if (!strncasecmp(value, name, length) && strchr("=, \t", value[length]) != NULL)
+		{
+			if (number != NULL && value[length] == '=')
+				*number = strtol(value + length + 1 + (value[length + 1] == '"'), NULL, 10);
+			return 1;
+		}
+		value = strchr(value, ',');
+	}
+	return 0;
+}
+
+/**
+ * @brief set the name of the response into the cache
+ *
+ * The name is the host, the URI and the query of the request with
+ * their terminators. It is written into the file of the response,
+ * the hash of the index doesn't identify the response alone.
+ *
+ * @return the length of the name or -1 if it is too long
+ */
+static int _proxycache_name(http_message_t *request, char *name, int size)
+{
+	const char *host = httpmessage_header_id(request, HDR_HOST);
+	const char *query = httpmessage_REQUEST(request, "query");
+	const char *parts[] = {(host != NULL)? host : "", httpmessage_REQUEST(request, "uri"), (query != NULL)? query : ""};
+	int length = 0;
+	int i;
+	for (i = 0; i < 3; i++)
+	{
+		int partlength = strlen(parts[i]) + 1;
+		if (length + partlength > size)
+			return -1;
+		memcpy(name + length, parts[i], partlength);
+		length += partlength;
+	}
+	return length;
+}
+
+static uint64_t _proxycache_key(const char *name, int length)
+{
+	uint64_t key = FNV_OFFSET;
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		key ^= (unsigned char)name[i];
+		key *= FNV_PRIME;
+	}
+	return (key != 0)? key : 1;
+}
+
+/**
+ * @brief hash the values of the request headers listed by Vary
+ */
+static uint64_t _proxycache_vary(http_message_t *request, const char *names)
+{
+	uint64_t hash = FNV_OFFSET;
+	while (*names != '\0')
+	{
+		char name[64];
+		names += strspn(names, " \t,");
+		int length = strcspn(names, " \t,");
+		if (length > 0 && length < (int)sizeof(name))
+		{
+			memcpy(name, names, length);
+			name[length] = '\0';
+			const char *value = _proxycache_header(request, name);
+			hash = _proxycache_hash(hash, name);
+			hash = _proxycache_hash(hash, (value != NULL)? value : "");
+		}
+		names += length;
+	}
+	return hash;
+}
+
+static void _proxycache_path(proxy_cache_t *cache, char *path, size_t size, int slot, uint64_t token)
+{
+	if (token != 0)
+		snprintf(path, size, "%s/%08x.%016llx.tmp", cache->directory, slot, (unsigned long long)token);
+	else
+		snprintf(path, size, "%s/%08x", cache->directory, slot);
+}
+
+/**
+ * @brief check that the filler of an entry is still running
+ *
+ * The filler refreshes its activity while it receives the response,
+ * a process which stopped or crashed leaves the entry to the next
+ * request.
+ */
+static int _proxycache_filling(proxy_cache_t *cache, proxy_cacheentry_t *entry, time_t now)
+{
+	if (entry->filler == 0)
+		return 0;
+	if (now - entry->filling > cache->timeout / 1000 + 1)
+		return 0;
+	pid_t pid = entry->filler >> 32;
+	return (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+/**
+ * @brief set the response with the file of the entry
+ *
+ * The file may be replaced after the copy of the entry, its first
+ * line must match the copy. Another URI may have the same hash, the
+ * name of the file must match the name of the request.
+ */
+static int _proxycache_serve(proxy_cache_t *cache, int slot, const proxy_cacheentry_t *entry,
+			const char *name, int namelength, http_message_t *response, time_t now)
+{
+	char path[PATH_MAX];
+	_proxycache_path(cache, path, sizeof(path), slot, 0);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return EREJECT;
+	char first[40];
+	int length = snprintf(first, sizeof(first), "%016llx %08x %04x\n",
+				(unsigned long long)entry->key, entry->generation, namelength);
+	char header[PROXYCACHE_HEADERMAX + 1];
+	struct stat filestat;
+	if (entry->headerlength > PROXYCACHE_HEADERMAX ||
+		fstat(fd, &filestat) != 0 ||
+		(uint64_t)filestat.st_size != entry->headerlength + entry->length ||
+		pread(fd, header, entry->headerlength, 0) != (ssize_t)entry->headerlength ||
+		strncmp(header, first, length))
+	{
+		proxycache_dbg("proxy: cache file %s changed", path);
+		close(fd);
+		return EREJECT;
+	}
+	if (length + namelength + 1 > (int)entry->headerlength ||
+		memcmp(header + length, name, namelength) || header[length + namelength] != '\n')
+	{
+		proxycache_dbg("proxy: cache file %s of another URI", path);
+		close(fd);
+		return EREJECT;
+	}
+	header[entry->headerlength] = '\0';
+	char *line = header + length + namelength + 1;
+	httpmessage_result(response, strtol(line, &line, 10));
+	line = strchr(line, '\n');
+	while (line != NULL && line[1] != '\r' && line[1] != '\0')
+	{
+		line++;
+		char *next = strstr(line, "\r\n");
+		if (next == NULL)
+			break;
+		*next = '\0';
+		char *value = strchr(line, ':');
+		if (value != NULL)
+		{
+			*value++ = '\0';
+			while (*value == ' ')
+				value++;
+			httpmessage_addheader(response, line, value);
+		}
+		line = next + 1;
+	}
+	char age[24];
+	snprintf(age, sizeof(age), "%lld", (long long)(now - entry->stored));
+	httpmessage_addheader(response, "Age", age);
+	if (entry->length > 0)
+		httpmessage_addfile(response, fd, entry->headerlength, entry->length);
+	else
+	{
+		close(fd);
+		httpmessage_addcontent(response, "none", NULL, 0);
+	}
+	return ESUCCESS;
+}
+
+static void _proxycache_own(proxy_cache_t *cache, proxy_cachectx_t *ctx, proxy_cacheentry_t *entry, time_t now)
+{
+	ctx->slot = entry - cache->index->entries;
+	ctx->key = entry->key;
+	ctx->token = ((uint64_t)getpid() << 32) | __atomic_add_fetch(&cache->counter, 1, __ATOMIC_RELAXED);
+	ctx->generation = entry->generation + 1;
+	entry->filler = ctx->token;
+	entry->filling = now;
+}
+
+/**
+ * @brief search the URI into the index
+ *
+ * @return PROXYCACHE_HIT, PROXYCACHE_WAIT while another request stores
+ * the response, PROXYCACHE_FILL if the request stores the response
+ * or PROXYCACHE_MISS
+ */
+static int _proxycache_probe(proxy_cache_t *cache, proxy_cachectx_t *ctx, uint64_t key,
+			const char *name, int namelength, http_message_t *request, http_message_t *response, int reload, int fill)
+{
+	time_t now = time(NULL);
+	proxy_cacheentry_t *victim = NULL;
+	int64_t victimused = 0;
+	int victimfree = 0;
+	int i;
+	for (i = 0; i < PROXYCACHE_PROBES; i++)
+	{
+		int slot = (key + i) % cache->nentries;
+		proxy_cacheentry_t *entry = &cache->index->entries[slot];
+		_proxycache_lock(entry);
+		if (entry->key != key)
+		{
+			/**
+			 * a free entry is better than the least recently used one
+			 */
+			if (entry->key == 0 && !victimfree)
+			{
+				victim = entry;
+				victimfree = 1;
+			}
+			else if (entry->key != 0 && !victimfree && (victim == NULL || entry->used < victimused) &&
+					!_proxycache_filling(cache, entry, now))
+			{
+				victim = entry;
+				victimused = entry->used;
+			}
+			_proxycache_unlock(entry);
+			continue;
+		}
+		int match = entry->valid &&
+			(entry->varynames[0] == '\0' || entry->vary == _proxycache_vary(request, entry->varynames));
+		int filling = _proxycache_filling(cache, entry, now);
+		/**
+		 * the stale response is sent while another request gets the new one
+		 */
+		if (match && !reload && (now < entry->expires || (now < entry->stale && (filling || !fill))))
+		{
+			proxy_cacheentry_t copy = *entry;
+			entry->used = now;
+			_proxycache_unlock(entry);
+			if (_proxycache_serve(cache, slot, &copy, name, namelength, response, now) == ESUCCESS)
+				return PROXYCACHE_HIT;
+			return PROXYCACHE_MISS;
+		}
+		_proxycache_unlock(entry);
+		if (filling && fill && !reload)
+			return PROXYCACHE_WAIT;
+		if (filling || !fill)
+			return PROXYCACHE_MISS;
+		_proxycache_lock(entry);
+		int ret = PROXYCACHE_MISS;
+		if (entry->key == key && !_proxycache_filling(cache, entry, now))
+		{
+			_proxycache_own(cache, ctx, entry, now);
+			ret = PROXYCACHE_FILL;
+		}
+		_proxycache_unlock(entry);
+		return ret;
+	}
+	if (!fill || victim == NULL)
+		return PROXYCACHE_MISS;
+	/**
+	 * the entry may be taken by another process since the probe
+	 */
+	int ret = PROXYCACHE_MISS;
+	_proxycache_lock(victim);
+	if ((victimfree && victim->key == 0) ||
+		(!victimfree && victim->key != 0 && victim->used == victimused && !_proxycache_filling(cache, victim, now)))
+	{
+		victim->key = key;
+		victim->valid = 0;
+		victim->filler = 0;
+		_proxycache_own(cache, ctx, victim, now);
+		ret = PROXYCACHE_FILL;
+	}
+	_proxycache_unlock(victim);
+	return ret;
+}
+
+void _proxycache_init(proxy_cachectx_t *ctx)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->slot = -1;
+	ctx->fd = -1;
+}
+
+int _proxycache_lookup(proxy_cache_t *cache, proxy_cachectx_t *ctx, http_message_t *request, http_message_t *response)
+{
+	if (cache == NULL)
+		return PROXYCACHE_MISS;
+	const char *method = httpmessage_REQUEST(request, "method");
+	int head = !strcmp(method, str_head);
+	if (!head && strcmp(method, str_get))
+		return PROXYCACHE_MISS;
+	if (_proxycache_header(request, "Authorization") != NULL)
+		return PROXYCACHE_MISS;
+	const char *control = _proxycache_header(request, "Cache-Control");
+	if (_proxycache_directive(control, "no-store", NULL))
+		return PROXYCACHE_MISS;
+	long maxage = -1;
+	int reload = _proxycache_directive(control, "no-cache", NULL) ||
+			(_proxycache_directive(control, "max-age", &maxage) && maxage == 0) ||
+			_proxycache_directive(_proxycache_header(request, "Pragma"), "no-cache", NULL);
+	/**
+	 * the upstream may answer with a part of the content or without
+	 * content to these requests, they use the cache but don't fill it
+	 */
+	int fill = !head && httpmessage_header_id(request, HDR_RANGE) == NULL &&
+			httpmessage_header_id(request, HDR_IF_NONE_MATCH) == NULL &&
+			httpmessage_header_id(request, HDR_IF_MODIFIED_SINCE) == NULL;
+	char name[PROXYCACHE_NAMEMAX];
+	int namelength = _proxycache_name(request, name, sizeof(name));
+	if (namelength < 0)
+		return PROXYCACHE_MISS;
+	uint64_t key = _proxycache_key(name, namelength);
+	/**
+	 * the requests of the same URI wait the response of the first one
+	 */
+	int wait = 0;
+	int ret;
+	while ((ret = _proxycache_probe(cache, ctx, key, name, namelength, request, response, reload, fill)) == PROXYCACHE_WAIT)
+	{
+		if (wait >= cache->timeout)
+			return PROXYCACHE_MISS;
+		poll(NULL, 0, PROXYCACHE_POLL);
+		wait += PROXYCACHE_POLL;
+	}
+	return ret;
+}
+
+static int _proxycache_writeall(int fd, const char *data, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t ret = write(fd, data, length);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return EREJECT;
+		data += ret;
+		length -= ret;
+	}
+	return ESUCCESS;
+}
+
+static int _proxycache_cacheable(int status)
+{
+	static const int statuses[] = {200, 203, 300, 301, 404, 410, 0};
+	int i;
+	for (i = 0; statuses[i] != 0; i++)
+	{
+		if (statuses[i] == status)
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief compute the freshness of the upstream response
+ *
+ * Only the responses with an explicit expiration are stored.
+ *
+ * @return ESUCCESS if the response may be stored, EREJECT otherwise
+ */
+static int _proxycache_freshness(proxy_cachectx_t *ctx, const char **names, const char **values, int nheaders,
+			http_message_t *request)
+{
+	time_t now = time(NULL);
+	const char *control = NULL;
+	const char *expires = NULL;
+	const char *vary = NULL;
+	long age = 0;
+	int i;
+	for (i = 0; i < nheaders; i++)
+	{
+		if (!strcasecmp(names[i], "Cache-Control"))
+			control = values[i];
+		else if (!strcasecmp(names[i], "Expires"))
+			expires = values[i];
+		else if (!strcasecmp(names[i], "Age"))
+			age = strtol(values[i], NULL, 10);
+		else if (!strcasecmp(names[i], "Vary"))
+			vary = values[i];
+		else if (!strcasecmp(names[i], "Set-Cookie"))
+			return EREJECT;
+	}
+	if (_proxycache_directive(control, "no-store", NULL) || _proxycache_directive(control, "private", NULL))
+		return EREJECT;
+	long maxage = -1;
+	struct tm tm = {0};
+	if ((_proxycache_directive(control, "s-maxage", &maxage) && maxage >= 0) ||
+		(_proxycache_directive(control, "max-age", &maxage) && maxage >= 0))
+		ctx->expires = now + maxage - age;
+	else if (expires != NULL && strptime(expires, "%a, %d %b %Y %H:%M:%S GMT", &tm) != NULL)
+		ctx->expires = timegm(&tm);
+	else if (expires != NULL)
+		ctx->expires = now;
+	else
+		return EREJECT;
+	if (_proxycache_directive(control, "no-cache", NULL))
+		ctx->expires = now;
+	long revalidate = 0;
+	ctx->stale = ctx->expires;
+	if (_proxycache_directive(control, "stale-while-revalidate", &revalidate) && revalidate > 0)
+		ctx->stale += revalidate;
+	if (ctx->stale <= now)
+		return EREJECT;
+	ctx->varynames[0] = '\0';
+	if (vary != NULL)
+	{
+		if (strchr(vary, '*') != NULL || strlen(vary) >= sizeof(ctx->varynames))
+			return EREJECT;
+		strcpy(ctx->varynames, vary);
+	}
+	ctx->vary = _proxycache_vary(request, ctx->varynames);
+	return ESUCCESS;
+}
+
+void _proxycache_store(proxy_cache_t *cache, proxy_cachectx_t *ctx, int status, const char *type,
+			const char **names, const char **values, int nheaders, http_message_t *request)
+{
+	if (ctx->slot < 0)
+		return;
+	if (!_proxycache_cacheable(status) ||
+		_proxycache_freshness(ctx, names, values, nheaders, request) != ESUCCESS)
+	{
+		_proxycache_end(cache, ctx, 0);
+		return;
+	}
+	char name[PROXYCACHE_NAMEMAX];
+	int namelength = _proxycache_name(request, name, sizeof(name));
+	if (namelength < 0)
+	{
+		_proxycache_end(cache, ctx, 0);
+		return;
+	}
+	char header[PROXYCACHE_HEADERMAX];
+	int length = snprintf(header, sizeof(header), "%016llx %08x %04x\n",
+				(unsigned long long)ctx->key, ctx->generation, namelength);
+	memcpy(header + length, name, namelength);
+	length += namelength;
+	length += snprintf(header + length, sizeof(header) - length, "\n%d\n", status);
+	if (type != NULL)
+		length += snprintf(header + length, sizeof(header) - length, "Content-Type: %s\r\n", type);
+	int i;
+	for (i = 0; i < nheaders && length < (int)sizeof(header); i++)
+	{
+		if (!strcasecmp(names[i], "Age"))
+			continue;
+		length += snprintf(header + length, sizeof(header) - length, "%s: %s\r\n", names[i], values[i]);
+	}
+	if (length < (int)sizeof(header))
+		length += snprintf(header + length, sizeof(header) - length, "\r\n");
+	if (length >= (int)sizeof(header))
+	{
+		_proxycache_end(cache, ctx, 0);
+		return;
+	}
+	char path[PATH_MAX];
+	_proxycache_path(cache, path, sizeof(path), ctx->slot, ctx->token);
+	ctx->fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (ctx->fd < 0 || _proxycache_writeall(ctx->fd, header, length) != ESUCCESS)
+	{
+		err("proxy: cache file %s %s", path, strerror(errno));
+		_proxycache_end(cache, ctx, 0);
+		return;
+	}
+	ctx->headerlength = length;
+	ctx->length = 0;
+}
+
+void _proxycache_write(proxy_cache_t *cache, proxy_cachectx_t *ctx, const char *data, int length)
+{
+	if (ctx->fd < 0)
+		return;
+	if (ctx->length + length > cache->maxlength ||
+		_proxycache_writeall(ctx->fd, data, length) != ESUCCESS)
+	{
+		_proxycache_end(cache, ctx, 0);
+		return;
+	}
+	ctx->length += length;
+	proxy_cacheentry_t *entry = &cache->index->entries[ctx->slot];
+	__atomic_store_n(&entry->filling, time(NULL), __ATOMIC_RELAXED);
+}
+
+void _proxycache_end(proxy_cache_t *cache, proxy_cachectx_t *ctx, int complete)
+{
+	if (ctx->slot < 0)
+		return;
+	proxy_cacheentry_t *entry = &cache->index->entries[ctx->slot];
+	char temporary[PATH_MAX];
+	_proxycache_path(cache, temporary, sizeof(temporary), ctx->slot, ctx->token);
+	if (ctx->fd >= 0)
+		close(ctx->fd);
+	int published = 0;
+	_proxycache_lock(entry);
+	if (entry->filler == ctx->token && entry->key == ctx->key)
+	{
+		char path[PATH_MAX];
+		_proxycache_path(cache, path, sizeof(path), ctx->slot, 0);
+		/**
+		 * the new file replaces the previous one for the next lookups
+		 */
+		if (complete && ctx->fd >= 0 && rename(temporary, path) == 0)
+		{
+			time_t now = time(NULL);
+			entry->valid = 1;
+			entry->generation = ctx->generation;
+			entry->headerlength = ctx->headerlength;
+			entry->length = ctx->length;
+			entry->stored = now;
+			entry->used = now;
+			entry->expires = ctx->expires;
+			entry->stale = ctx->stale;
+			entry->vary = ctx->vary;
+			strcpy(entry->varynames, ctx->varynames);
+			published = 1;
+		}
+		entry->filler = 0;
+		if (!entry->valid)
+			entry->key = 0;
+	}
+	_proxycache_unlock(entry);
+	if (ctx->fd >= 0 && !published)
+		unlink(temporary);
+	proxycache_dbg("proxy: cache %08x %s", ctx->slot, published? "stored" : "released");
+	ctx->fd = -1;
+	ctx->slot = -1;
+}
+
+/**
+ * @brief remove the temporary files of the previous run
+ */
+static void _proxycache_clean(proxy_cache_t *cache)
+{
+	DIR *dir = opendir(cache->directory);
+	if (dir == NULL)
+		return;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL)
+	{
+		int length = strlen(ent->d_name);
+		if (length > 4 && !strcmp(ent->d_name + length - 4, ".tmp"))
+			unlinkat(dirfd(dir), ent->d_name, 0);
+	}
+	closedir(dir);
+}
+
+proxy_cache_t *_proxycache_create(const char *directory, int entries, unsigned long long maxlength, int timeout)
+{
+	if (mkdir(directory, 0700) < 0 && errno != EEXIST)
+	{
+		err("proxy: cache directory %s %s", directory, strerror(errno));
+		return NULL;
+	}
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/index", directory);
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0)
+	{
+		err("proxy: cache index %s %s", path, strerror(errno));
+		return NULL;
+	}
+	size_t size = sizeof(proxy_cacheindex_t) + entries * sizeof(proxy_cacheentry_t);
+	struct stat filestat;
+	int reset = (fstat(fd, &filestat) != 0 || (size_t)filestat.st_size != size);
+	if (reset && (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0))
+	{
+		err("proxy: cache index %s %s", path, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+	/**
+	 * the index is shared by the processes of the server and it is kept
+	 * with the files for the next run
+	 */
+	proxy_cacheindex_t *index = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (index == MAP_FAILED)
+		return NULL;
+	proxy_cache_t *cache = calloc(1, sizeof(*cache));
+	if (cache == NULL)
+	{
+		munmap(index, size);
+		return NULL;
+	}
+	cache->directory = strdup(directory);
+	cache->index = index;
+	cache->size = size;
+	cache->nentries = entries;
+	cache->maxlength = maxlength;
+	cache->timeout = timeout;
+	if (!reset && (index->magic != PROXYCACHE_MAGIC || index->version != PROXYCACHE_VERSION ||
+		index->nentries != (uint32_t)entries || index->entrysize != sizeof(proxy_cacheentry_t)))
+		reset = 1;
+	if (reset)
+	{
+		memset(index, 0, size);
+		index->magic = PROXYCACHE_MAGIC;
+		index->version = PROXYCACHE_VERSION;
+		index->nentries = entries;
+		index->entrysize = sizeof(proxy_cacheentry_t);
+	}
+	int i;
+	for (i = 0; i < entries; i++)
+	{
+		/**
+		 * the storages of the previous run are lost
+		 */
+		proxy_cacheentry_t *entry = &index->entries[i];
+		entry->lock = 0;
+		entry->filler = 0;
+		if (!entry->valid)
+			entry->key = 0;
+	}
+	_proxycache_clean(cache);
+	return cache;
+}
+
+void _proxycache_destroy(proxy_cache_t *cache)
+{
+	munmap(cache->index, cache->size);
+	free(cache->directory);
+	free(cache);
+}
@@ -0,0 +1,644 @@
+/*****************************************************************************
+ * staticfile.c: static documents connector
+ * this file is part of https://github.com/ouistiti-project/libhttpserver
+ *****************************************************************************
+ * Copyright (C) 2026
+ *
+ * Authors: Marc Chalain <marc.chalain@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject
+ * to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *****************************************************************************/
+
+#if defined(__GNUC__) && !defined(_GNU_SOURCE)
+# define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/stat.h>
+#ifdef __linux__
+# include <sys/inotify.h>
+#endif
+#ifdef USE_PTHREAD
+# include <pthread.h>
+#endif
+
+#include "log.h"
+#include "httpserver.h"
+#include "utils.h"
+#include "staticfile.h"
+
+#define staticfile_dbg(...)
+
+/**
+ * with the fork model each client runs in its own process, the caches
+ * would live only for one connection: the documents are opened for
+ * each request.
+ */
+#if defined(VTHREAD) && !defined(USE_PTHREAD) && !defined(WIN32)
+# define STATICFILE_NOCACHE
+#endif
+
+#ifdef __linux__
+# define STATICFILE_EVENTS (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | \
+			IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+/**
+ * the precompressed sidecars of the documents, the first one is preferred
+ */
+static const struct
+{
+	const char *name;
+	const char *extension;
+} _staticfile_encodings[] =
+{
+	{"br", ".br"},
+	{"gzip", ".gz"},
+};
+#define STATICFILE_NBENCODINGS (sizeof(_staticfile_encodings) / sizeof(_staticfile_encodings[0]))
+
+typedef struct staticfile_variant_s staticfile_variant_t;
+struct staticfile_variant_s
+{
+	int fd; /* -1 without sidecar */
+	unsigned long long size;
+	char etag[48];
+};
+
+typedef struct staticfile_entry_s staticfile_entry_t;
+struct staticfile_entry_s
+{
+	unsigned int hash;
+	int fd; /* -1 for a missing path */
+	unsigned long long size;
+	time_t mtime;
+	const char *mime;
+	char etag[48];
+	char lastmodified[32];
+	staticfile_variant_t variants[STATICFILE_NBENCODINGS];
+	int nvariants;
+	int wd; /* inotify watch of the directory */
+	const char *name; /* name of the file into its directory */
+	staticfile_entry_t *hnext;
+	staticfile_entry_t *prev;
+	staticfile_entry_t *next;
+	int urilength;
+	char *uri;
+	char path[];
+};
+
+typedef struct staticfile_list_s staticfile_list_t;
+struct staticfile_list_s
+{
+	staticfile_entry_t *first; /* the most recent */
+	staticfile_entry_t *last;
+	int count;
+	int max;
+};
+
+struct staticfile_s
+{
+	staticfile_config_t config;
+	char docroot[PATH_MAX];
+	int docrootlength;
+	staticfile_entry_t **table;
+	unsigned int tablemask;
+	staticfile_list_t documents;
+	staticfile_list_t missings;
+	int inotify;
+#ifdef USE_PTHREAD
+	pthread_mutex_t mutex;
+#endif
+};
+
+static const staticfile_config_t _staticfile_defaultconfig =
+{
+	.docroot = ".",
+	.index = STATICFILE_INDEX,
+	.cachesize = STATICFILE_CACHESIZE,
+	.negativesize = STATICFILE_NEGATIVESIZE,
+};
+
+static unsigned int _staticfile_hash(const char *uri, int length)
+{
+	unsigned int hash = 2166136261U;
+	int i;
+	for (i = 0; i < length; i++)
+	{
+		hash ^= (unsigned char)uri[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static void _staticfile_unlink(staticfile_list_t *list, staticfile_entry_t *entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		list->first = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		list->last = entry->prev;
+	entry->prev = NULL;
+	entry->next = NULL;
+	list->count--;
+}
+
+static void _staticfile_push(staticfile_list_t *list, staticfile_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = list->first;
+	if (list->first)
+		list->first->prev = entry;
+	else
+		list->last = entry;
+	list->first = entry;
+	list->count++;
+}
+
+static void _staticfile_close(staticfile_entry_t *entry)
+{
+	if (entry->fd >= 0)
+		close(entry->fd);
+	int i;
+	for (i = 0; i < STATICFILE_NBENCODINGS; i++)
+	{
+		if (entry->variants[i].fd >= 0)
+			close(entry->variants[i].fd);
+	}
+	free(entry);
+}
+
+static void _staticfile_free(staticfile_t *ctx, staticfile_entry_t *entry)
+{
+	staticfile_entry_t **it = &ctx->table[entry->hash & ctx->tablemask];
+	while (*it != NULL && *it != entry)
+		it = &(*it)->hnext;
+	if (*it != NULL)
+		*it = entry->hnext;
+	_staticfile_unlink((entry->fd < 0)? &ctx->missings: &ctx->documents, entry);
+	_staticfile_close(entry);
+}
+
+static void _staticfile_flush(staticfile_t *ctx, staticfile_list_t *list)
+{
+	while (list->first != NULL)
+		_staticfile_free(ctx, list->first);
+}
+
+#ifdef __linux__
+/**
+ * @brief check if the event is on the document or on one of its sidecars
+ */
+static int _staticfile_changed(const staticfile_entry_t *entry, const char *name)
+{
+	int length = strlen(entry->name);
+	if (strncmp(entry->name, name, length))
+		return 0;
+	if (name[length] == '\0')
+		return 1;
+	int i;
+	for (i = 0; i < STATICFILE_NBENCODINGS; i++)
+	{
+		if (!strcmp(name + length, _staticfile_encodings[i].extension))
+			return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief invalidate the entries changed on the file system
+ *
+ * The events are read without waiting, the descriptor is not blocking.
+ */
+static void _staticfile_events(staticfile_t *ctx)
+{
+	char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	int length;
+	while ((length = read(ctx->inotify, events, sizeof(events))) > 0)
+	{
+		const char *it = events;
+		while (it < events + length)
+		{
+			const struct inotify_event *event = (const struct inotify_event *)it;
+			it += sizeof(*event) + event->len;
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				_staticfile_flush(ctx, &ctx->documents);
+				_staticfile_flush(ctx, &ctx->missings);
+				continue;
+			}
+			/**
+			 * a new file may be one of the missing paths
+			 */
+			if (event->mask & (IN_CREATE | IN_MOVED_TO))
+				_staticfile_flush(ctx, &ctx->missings);
+			staticfile_entry_t *entry = ctx->documents.first;
+			while (entry != NULL)
+			{
+				staticfile_entry_t *next = entry->next;
+				if (entry->wd == event->wd &&
+					(event->len == 0 || _staticfile_changed(entry, event->name)))
+				{
+					staticfile_dbg("staticfile: %s changed", entry->path);
+					_staticfile_free(ctx, entry);
+				}
+				entry = next;
+			}
+		}
+	}
+}
+
+static int _staticfile_watch(staticfile_t *ctx, char *path, const char *name)
+{
+	int wd = -1;
+	char *dir = (char *)name - 1;
+	/**
+	 * the directory of a missing path may not exist,
+	 * the nearest parent is watched
+	 */
+	while (dir > path)
+	{
+		*dir = '\0';
+		wd = inotify_add_watch(ctx->inotify, path, STATICFILE_EVENTS);
+		*dir = '/';
+		if (wd >= 0)
+			break;
+		do dir--; while (dir > path && *dir != '/');
+	}
+	return wd;
+}
+#endif
+
+static staticfile_entry_t *_staticfile_search(staticfile_t *ctx, const char *uri, int length, unsigned int hash)
+{
+	staticfile_entry_t *entry = ctx->table[hash & ctx->tablemask];
+	while (entry != NULL)
+	{
+		if (entry->hash == hash && entry->urilength == length &&
+			!memcmp(entry->uri, uri, length))
+			return entry;
+		entry = entry->hnext;
+	}
+	return NULL;
+}
+
+/**
+ * @brief open the precompressed variants next to the document
+ *
+ * A sidecar older than the document is obsolete and ignored.
+ */
+static void _staticfile_opensidecars(staticfile_entry_t *entry)
+{
+	int i;
+	for (i = 0; i < STATICFILE_NBENCODINGS; i++)
+	{
+		staticfile_variant_t *variant = &entry->variants[i];
+		char path[PATH_MAX];
+		struct stat filestat;
+		if (snprintf(path, sizeof(path), "%s%s", entry->path, _staticfile_encodings[i].extension) >= sizeof(path) ||
+			stat(path, &filestat) != 0 || !S_ISREG(filestat.st_mode) ||
+			filestat.st_mtime < entry->mtime)
+			continue;
+		variant->fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (variant->fd < 0)
+			continue;
+		variant->size = filestat.st_size;
+		snprintf(variant->etag, sizeof(variant->etag), "\"%lx-%llx-%s\"",
+			(unsigned long)filestat.st_mtime, variant->size, _staticfile_encodings[i].name);
+		entry->nvariants++;
+		staticfile_dbg("staticfile: sidecar %s", path);
+	}
+}
+
+static int _staticfile_open(staticfile_t *ctx, staticfile_entry_t *entry)
+{
+	struct stat filestat;
+	if (stat(entry->path, &filestat) != 0)
+		return EREJECT;
+	if (S_ISDIR(filestat.st_mode))
+	{
+		/**
+		 * the document of a directory is its index
+		 */
+		int length = strlen(entry->path);
+		if (entry->path[length - 1] != '/')
+			entry->path[length++] = '/';
+		strcpy(entry->path + length, ctx->config.index);
+		entry->name = entry->path + length;
+		if (stat(entry->path, &filestat) != 0)
+			return EREJECT;
+	}
+	if (!S_ISREG(filestat.st_mode))
+		return EREJECT;
+	entry->fd = open(entry->path, O_RDONLY | O_CLOEXEC);
+	if (entry->fd < 0)
+		return EREJECT;
+	entry->size = filestat.st_size;
+	entry->mtime = filestat.st_mtime;
+	entry->mime = utils_getmime(entry->path);
+	snprintf(entry->etag, sizeof(entry->etag), "\"%lx-%llx\"",
+		(unsigned long)entry->mtime, entry->size);
+	struct tm tm;
+	strftime(entry->lastmodified, sizeof(entry->lastmodified),
+		"%a, %d %b %Y %H:%M:%S GMT", gmtime_r(&entry->mtime, &tm));
+	_staticfile_opensidecars(entry);
+	return ESUCCESS;
+}
+
+/**
+ * @brief create the entry of the URI
+ *
+ * @return the entry, with fd < 0 for a missing document, or NULL on error
+ */
+static staticfile_entry_t *_staticfile_load(staticfile_t *ctx, const char *uri, int length, unsigned int hash)
+{
+	int indexlength = strlen(ctx->config.index);
+	int pathlength = ctx->docrootlength + length + 1 + indexlength + 1;
+	if (pathlength > PATH_MAX)
+		return NULL;
+	staticfile_entry_t *entry = calloc(1, sizeof(*entry) + pathlength + length + 1);
+	if (entry == NULL)
+		return NULL;
+	entry->hash = hash;
+	entry->fd = -1;
+	entry->wd = -1;
+	int i;
+	for (i = 0; i < STATICFILE_NBENCODINGS; i++)
+		entry->variants[i].fd = -1;
+	memcpy(entry->path, ctx->docroot, ctx->docrootlength);
+	memcpy(entry->path + ctx->docrootlength, uri, length);
+	entry->uri = entry->path + pathlength;
+	memcpy(entry->uri, uri, length);
+	entry->urilength = length;
+	entry->name = strrchr(entry->path, '/') + 1;
+
+	_staticfile_open(ctx, entry);
+	staticfile_dbg("staticfile: load %s %d", entry->path, entry->fd);
+	if (ctx->inotify < 0)
+		return entry;
+#ifdef __linux__
+	/**
+	 * the entry is kept only if the changes are notified
+	 */
+	entry->wd = _staticfile_watch(ctx, entry->path, entry->name);
+	if (entry->wd < 0)
+		return entry;
+#endif
+	staticfile_list_t *list = (entry->fd < 0)? &ctx->missings: &ctx->documents;
+	if (list->max <= 0)
+		return entry;
+	if (list->count >= list->max)
+		_staticfile_free(ctx, list->last);
+	_staticfile_push(list, entry);
+	staticfile_entry_t **bucket = &ctx->table[hash & ctx->tablemask];
+	entry->hnext = *bucket;
+	*bucket = entry;
+	return entry;
+}
+
+static int _staticfile_cached(staticfile_t *ctx, staticfile_entry_t *entry)
+{
+	return (entry->prev != NULL || entry->next != NULL ||
+		ctx->documents.first == entry || ctx->missings.first == entry);
+}
+
+/**
+ * @brief check the ETag with the list of If-None-Match
+ */
+static int _staticfile_matchetag(const char *list, const char *etag)
+{
+	int length = strlen(etag);
+	while (*list != '\0')
+	{
+		while (*list == ' ' || *list == ',')
+			list++;
+		if (*list == '*')
+			return 1;
+		/**
+		 * the weak comparison is used for GET and HEAD
+		 */
+		if (!strncmp(list, "W/", 2))
+			list += 2;
+		if (!strncmp(list, etag, length) &&
+			(list[length] == '\0' || list[length] == ',' || list[length] == ' '))
+			return 1;
+		while (*list != '\0' && *list != ',')
+			list++;
+	}
+	return 0;
+}
+
+static int _staticfile_notmodified(http_message_t *request, staticfile_entry_t *entry, const char *etag)
+{
+	const char *value = httpmessage_header_id(request, HDR_IF_NONE_MATCH);
+	if (value != NULL && value[0] != '\0')
+		return _staticfile_matchetag(value, etag);
+	value = httpmessage_header_id(request, HDR_IF_MODIFIED_SINCE);
+	if (value == NULL || value[0] == '\0')
+		return 0;
+	if (!strcmp(value, entry->lastmodified))
+		return 1;
+	struct tm tm = {0};
+	if (strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm) == NULL)
+		return 0;
+	return (timegm(&tm) >= entry->mtime);
+}
+
+/**
+ * @brief select the best sidecar accepted by the request
+ *
+ * @return the index of the encoding or -1 for the document itself
+ */
+static int _staticfile_encoding(http_message_t *request, const staticfile_entry_t *entry)
+{
+	const char *accept = httpmessage_header_id(request, HDR_ACCEPT_ENCODING);
+	if (accept == NULL || entry->nvariants == 0)
+		return -1;
+	int best = -1;
+	int bestquality = 0;
+	int i;
+	for (i = 0; i < STATICFILE_NBENCODINGS; i++)
+	{
+		if (entry->variants[i].fd < 0)
+			continue;
+		int quality = httpmessage_quality(accept, _staticfile_encodings[i].name);
+		if (quality > bestquality)
+		{
+			best = i;
+			bestquality = quality;
+		}
+	}
+	return best;
+}
+
+static int _staticfile_connector(void *arg, http_message_t *request, http_message_t *response)
+{
+	staticfile_t *ctx = (staticfile_t *)arg;
+	const char *method = httpmessage_REQUEST(request, "method");
+	if (method == NULL || (strcmp(method, str_get) && strcmp(method, str_head)))
+		return EREJECT;
+	const char *uri = httpmessage_REQUEST(request, "uri");
+	if (uri == NULL || uri[0] != '/')
+		return EREJECT;
+	int length = strcspn(uri, "?#");
+	/**
+	 * the path must stay under the document root
+	 */
+	const char *dots = uri;
+	while ((dots = strstr(dots, "/..")) != NULL && dots < uri + length)
+	{
+		if (dots[3] == '/' || dots + 3 == uri + length)
+			return EREJECT;
+		dots += 3;
+	}
+
+	int ret = EREJECT;
+	unsigned int hash = _staticfile_hash(uri, length);
+#ifdef USE_PTHREAD
+	pthread_mutex_lock(&ctx->mutex);
+#endif
+#ifdef __linux__
+	if (ctx->inotify >= 0)
+		_staticfile_events(ctx);
+#endif
+	staticfile_entry_t *entry = _staticfile_search(ctx, uri, length, hash);
+	if (entry != NULL)
+	{
+		staticfile_list_t *list = (entry->fd < 0)? &ctx->missings: &ctx->documents;
+		_staticfile_unlink(list, entry);
+		_staticfile_push(list, entry);
+	}
+	else
+		entry = _staticfile_load(ctx, uri, length, hash);
+	if (entry != NULL && entry->fd >= 0)
+	{
+		int fd = entry->fd;
+		unsigned long long size = entry->size;
+		const char *etag = entry->etag;
+		int encoding = _staticfile_encoding(request, entry);
+		if (encoding >= 0)
+		{
+			fd = entry->variants[encoding].fd;
+			size = entry->variants[encoding].size;
+			etag = entry->variants[encoding].etag;
+		}
+		httpmessage_addheader(response, "ETag", etag);
+		httpmessage_addheader(response, "Last-Modified", entry->lastmodified);
+		if (entry->nvariants > 0)
+			httpmessage_addheader(response, "Vary", "Accept-Encoding");
+		if (_staticfile_notmodified(request, entry, etag))
+		{
+			/**
+			 * the answer does not need any access to the file
+			 */
+			httpmessage_result(response, RESULT_304);
+			ret = ESUCCESS;
+		}
+		else
+		{
+			/**
+			 * the response closes its descriptor, the cache keeps its own one
+			 */
+			fd = dup(fd);
+			if (fd >= 0)
+			{
+				httpmessage_addheader(response, "Content-Type", entry->mime);
+				if (encoding >= 0)
+					httpmessage_addheader(response, "Content-Encoding", _staticfile_encodings[encoding].name);
+				httpmessage_addfile(response, fd, 0, size);
+				ret = ESUCCESS;
+			}
+		}
+	}
+	if (entry != NULL && !_staticfile_cached(ctx, entry))
+		_staticfile_close(entry);
+#ifdef USE_PTHREAD
+	pthread_mutex_unlock(&ctx->mutex);
+#endif
+	return ret;
+}
+
+staticfile_t *staticfile_create(http_server_t *server, const staticfile_config_t *config)
+{
+	if (config == NULL)
+		config = &_staticfile_defaultconfig;
+	staticfile_t *ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL)
+		return NULL;
+	ctx->config = *config;
+	if (ctx->config.docroot == NULL)
+		ctx->config.docroot = _staticfile_defaultconfig.docroot;
+	if (ctx->config.index == NULL)
+		ctx->config.index = _staticfile_defaultconfig.index;
+	if (realpath(ctx->config.docroot, ctx->docroot) == NULL)
+	{
+		err("staticfile: %s %s", ctx->config.docroot, strerror(errno));
+		free(ctx);
+		return NULL;
+	}
+	ctx->docrootlength = strlen(ctx->docroot);
+	ctx->documents.max = ctx->config.cachesize;
+	ctx->missings.max = ctx->config.negativesize;
+	unsigned int tablesize = 16;
+	while (tablesize < (unsigned int)(ctx->documents.max + ctx->missings.max))
+		tablesize <<= 1;
+	ctx->table = calloc(tablesize, sizeof(*ctx->table));
+	if (ctx->table == NULL)
+	{
+		free(ctx);
+		return NULL;
+	}
+	ctx->tablemask = tablesize - 1;
+	ctx->inotify = -1;
+#if defined(__linux__) && !defined(STATICFILE_NOCACHE)
+	ctx->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (ctx->inotify < 0)
+		warn("staticfile: cache disabled %s", strerror(errno));
+#endif
+#ifdef USE_PTHREAD
+	pthread_mutex_init(&ctx->mutex, NULL);
+#endif
+	httpserver_addconnector(server, _staticfile_connector, ctx, CONNECTOR_DOCUMENT, "staticfile");
+	return ctx;
+}
+
+void staticfile_destroy(staticfile_t *ctx)
+{
+	_staticfile_flush(ctx, &ctx->documents);
+	_staticfile_flush(ctx, &ctx->missings);
+	if (ctx->inotify >= 0)
+		close(ctx->inotify);
+#ifdef USE_PTHREAD
+	pthread_mutex_destroy(&ctx->mutex);
+#endif
+	free(ctx->table);
+	free(ctx);
+}
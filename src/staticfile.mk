@@ -0,0 +1,13 @@
+lib-$(SHARED)+=ouistaticfile
+slib-$(STATIC)+=ouistaticfile
+ouistaticfile_SOURCES=staticfile.c
+ouistaticfile_CFLAGS+=-I../include/ouistiti
+ouistaticfile_LIBS+=ouiutils
+ouistaticfile_PKGCONFIG:=ouistiti
+
+ifeq ($(VTHREAD_TYPE),pthread)
+ouistaticfile_CFLAGS-$(VTHREAD)+=-DUSE_PTHREAD
+ouistaticfile_LIBS-$(VTHREAD)+=pthread
+endif
+
+ouistaticfile_CFLAGS-$(DEBUG)+=-g -DDEBUG
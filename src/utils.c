@@ -26,11 +26,13 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  *****************************************************************************/
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <unistd.h>
+#include <limits.h>
 
 #include "log.h"
 #include "httpserver.h"
@@ -401,6 +403,63 @@ int utils_parsestring(const char *string, int listlength, utils_parsestring_t li
 	return ret;
 }
 
+int utils_cgienv(http_message_t *request, utils_cgienv_t cb, void *arg)
+{
+	const char *uri = httpmessage_REQUEST(request, "uri");
+	const char *query = httpmessage_REQUEST(request, "query");
+	char value[PATH_MAX];
+	int ret = ESUCCESS;
+
+	snprintf(value, sizeof(value), "%s%s%s%s", (uri[0] != '/')? "/" : "", uri,
+			(query != NULL && query[0] != '\0')? "?" : "", (query != NULL)? query : "");
+	ret |= cb(arg, "REQUEST_URI", -1, value);
+	ret |= cb(arg, "QUERY_STRING", -1, (query != NULL)? query : "");
+	ret |= cb(arg, "GATEWAY_INTERFACE", -1, "CGI/1.1");
+	ret |= cb(arg, "REQUEST_METHOD", -1, httpmessage_REQUEST(request, "method"));
+	ret |= cb(arg, "SERVER_PROTOCOL", -1, httpmessage_REQUEST(request, "version"));
+	ret |= cb(arg, "SERVER_SOFTWARE", -1, httpmessage_SERVER(request, "software"));
+	const char *name = httpmessage_SERVER(request, "name");
+	const char *addr = httpmessage_SERVER(request, "addr");
+	ret |= cb(arg, "SERVER_ADDR", -1, addr);
+	ret |= cb(arg, "SERVER_NAME", -1, (name != NULL && name[0] != '\0')? name : addr);
+	ret |= cb(arg, "SERVER_PORT", -1, httpmessage_SERVER(request, "port"));
+	ret |= cb(arg, "REMOTE_ADDR", -1, httpmessage_REQUEST(request, "remote_addr"));
+	ret |= cb(arg, "REMOTE_PORT", -1, httpmessage_REQUEST(request, "remote_port"));
+	const char *scheme = httpmessage_REQUEST(request, "scheme");
+	ret |= cb(arg, "REQUEST_SCHEME", -1, scheme);
+	if (scheme != NULL && !strcmp(scheme, "https"))
+		ret |= cb(arg, "HTTPS", -1, "on");
+	ret |= cb(arg, "CONTENT_TYPE", -1, httpmessage_header_id(request, HDR_CONTENT_TYPE));
+	ret |= cb(arg, "CONTENT_LENGTH", -1, httpmessage_header_id(request, HDR_CONTENT_LENGTH));
+
+	const char *header;
+	int it = 0;
+	name = NULL;
+	while ((header = httpmessage_headers(request, &it, &name)) != NULL)
+	{
+		/**
+		 * the Proxy header must not become the HTTP_PROXY variable
+		 */
+		if (!strcasecmp(name, "Content-Type") || !strcasecmp(name, "Content-Length") ||
+			!strcasecmp(name, "Proxy"))
+			continue;
+		char variable[128] = "HTTP_";
+		int length = 5;
+		while (*name != '\0' && length < (int)sizeof(variable) - 1)
+		{
+			char c = *name++;
+			if (c >= 'a' && c <= 'z')
+				c -= 'a' - 'A';
+			else if (c == '-')
+				c = '_';
+			variable[length++] = c;
+		}
+		variable[length] = '\0';
+		ret |= cb(arg, variable, length, header);
+	}
+	return (ret == ESUCCESS)? ESUCCESS : EREJECT;
+}
+
 #ifndef COOKIE
 static const char str_Cookie[] = "Cookie";
 static const char str_SetCookie[] = "Set-Cookie";